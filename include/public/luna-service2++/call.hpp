@@ -122,6 +122,8 @@ private:
 
     void call(LSHandle *sh, const char *uri, const char *payload, bool oneReply, const char *appID = NULL);
 
+    void call(LSHandle *sh, const char *uri, const char *payload, size_t payload_len, bool oneReply);
+
     void callSignal(LSHandle *sh, const char *category, const char *methodName);
 
     bool isMainLoopThread() const;
@@ -26,6 +26,10 @@
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace LS {
 
@@ -211,6 +215,27 @@ public:
      */
     void sendSignal(const char *uri, const char *payload, bool typecheck = true) const;
 
+    /**
+     * Send signal by given URI with a payload of known length
+     * @param uri signal
+     * @param payload parameter, doesn't have to be NUL-terminated
+     * @param payload_len length of the payload
+     * @param typecheck if true then check existens of the signal point and log warning if it does not exist
+     */
+    void sendSignal(const char *uri, const char *payload, size_t payload_len, bool typecheck) const;
+
+    void sendSignal(const char *uri, const std::string &payload, bool typecheck = true) const
+    {
+        sendSignal(uri, payload.data(), payload.size(), typecheck);
+    }
+
+#if __cplusplus >= 201703L
+    void sendSignal(const char *uri, std::string_view payload, bool typecheck = true) const
+    {
+        sendSignal(uri, payload.data(), payload.size(), typecheck);
+    }
+#endif
+
     /**
      * Make a call
      * @param uri
@@ -235,6 +260,34 @@ public:
                       void *context,
                       const char *appID = NULL);
 
+    /**
+     * Make a call with a payload of known length
+     * @param uri
+     * @param payload
+     * @return call control object
+     */
+    Call callOneReply(const char *uri, const std::string &payload)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), true, nullptr, nullptr);
+    }
+
+    Call callOneReply(const char *uri, const std::string &payload, LSFilterFunc func, void *context)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), true, func, context);
+    }
+
+#if __cplusplus >= 201703L
+    Call callOneReply(const char *uri, std::string_view payload)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), true, nullptr, nullptr);
+    }
+
+    Call callOneReply(const char *uri, std::string_view payload, LSFilterFunc func, void *context)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), true, func, context);
+    }
+#endif
+
     /**
      * @brief Multi-call
      * Returned object will collect arrived messages in internal queue.
@@ -261,6 +314,62 @@ public:
                         void *context,
                         const char *appID = NULL);
 
+    /**
+     * Multi-call with a payload of known length
+     * @param uri
+     * @param payload
+     * @return call handler object
+     */
+    Call callMultiReply(const char *uri, const std::string &payload)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), false, nullptr, nullptr);
+    }
+
+    Call callMultiReply(const char *uri, const std::string &payload, LSFilterFunc func, void *context)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), false, func, context);
+    }
+
+#if __cplusplus >= 201703L
+    Call callMultiReply(const char *uri, std::string_view payload)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), false, nullptr, nullptr);
+    }
+
+    Call callMultiReply(const char *uri, std::string_view payload, LSFilterFunc func, void *context)
+    {
+        return callWithLen(uri, payload.data(), payload.size(), false, func, context);
+    }
+#endif
+
+    /**
+     * Make a call that doesn't expect a reply
+     * Whatever the service replies is dropped, so there is nothing to wait for or cancel.
+     * @param uri
+     * @param payload
+     */
+    void callNoReply(const char *uri, const char *payload) const;
+
+    /**
+     * Make a call that doesn't expect a reply, with a payload of known length
+     * @param uri
+     * @param payload doesn't have to be NUL-terminated
+     * @param payload_len length of the payload
+     */
+    void callNoReply(const char *uri, const char *payload, size_t payload_len) const;
+
+    void callNoReply(const char *uri, const std::string &payload) const
+    {
+        callNoReply(uri, payload.data(), payload.size());
+    }
+
+#if __cplusplus >= 201703L
+    void callNoReply(const char *uri, std::string_view payload) const
+    {
+        callNoReply(uri, payload.data(), payload.size());
+    }
+#endif
+
     /**
      * Call a signal
      * @param category
@@ -287,6 +396,9 @@ private:
 
     LSHandle *release();
 
+    Call callWithLen(const char *uri, const char *payload, size_t payload_len,
+                     bool oneReply, LSFilterFunc func, void *context);
+
     friend std::ostream &operator<<(std::ostream &os, const Handle &service_handle);
 };
 
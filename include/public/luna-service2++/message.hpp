@@ -21,6 +21,10 @@
 #include <luna-service2/lunaservice.h>
 #include <cassert>
 #include <iostream>
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace LS {
 
@@ -142,8 +146,34 @@ public:
 
     void respond(const char *reply_payload);
 
+    void respond(const char *reply_payload, size_t reply_payload_len);
+
+    void respond(const std::string &reply_payload)
+    {
+        respond(reply_payload.data(), reply_payload.size());
+    }
+
     void reply(Handle &service_handle, const char *reply_payload);
 
+    void reply(Handle &service_handle, const char *reply_payload, size_t reply_payload_len);
+
+    void reply(Handle &service_handle, const std::string &reply_payload)
+    {
+        reply(service_handle, reply_payload.data(), reply_payload.size());
+    }
+
+#if __cplusplus >= 201703L
+    void respond(std::string_view reply_payload)
+    {
+        respond(reply_payload.data(), reply_payload.size());
+    }
+
+    void reply(Handle &service_handle, std::string_view reply_payload)
+    {
+        reply(service_handle, reply_payload.data(), reply_payload.size());
+    }
+#endif
+
 private:
     LSMessage *_message;
 
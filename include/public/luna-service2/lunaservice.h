@@ -125,6 +125,19 @@ typedef unsigned long LSMessageToken;
  */
 #define LSMESSAGE_TOKEN_INVALID 0
 
+/**
+ * @brief Type of a message payload.
+ *
+ * Payloads are NUL-terminated JSON text unless they were sent with
+ * LSCallBinary() or LSMessageReplyBinary(). Services can tag their own
+ * binary formats with values from LS_PAYLOAD_TYPE_USER up.
+ */
+typedef unsigned int LSPayloadType;
+
+#define LS_PAYLOAD_TYPE_JSON    0       /**< NUL-terminated JSON text */
+#define LS_PAYLOAD_TYPE_BINARY  1       /**< opaque bytes */
+#define LS_PAYLOAD_TYPE_USER    0x100   /**< first service-defined binary type */
+
 /**
 * @brief Error object which contains information about first
 *        error since it was initialized via LSErrorInit.
@@ -212,6 +225,22 @@ typedef enum {
 	 */
 	LUNA_METHOD_FLAG_VALIDATE_IN = (1 << 1),
 
+	/**
+	 * Run the method on the worker threads of the handle instead of its
+	 * main loop, see LSSetWorkerThreads(). Calls from the same sender are
+	 * still handled one at a time, in the order they were received.
+	 *
+	 * @note the method must only use thread-safe calls like
+	 *       LSMessageReply() and LSCall()
+	 */
+	LUNA_METHOD_FLAG_CONCURRENT = (1 << 2),
+
+	/**
+	 * Together with LUNA_METHOD_FLAG_CONCURRENT, let calls from the same
+	 * sender run alongside each other and finish in any order.
+	 */
+	LUNA_METHOD_FLAG_UNORDERED = (1 << 3),
+
 	/**
 	 * Constant to reprsent method with no flags turned on
 	 */
@@ -223,6 +252,8 @@ typedef enum {
 	 */
 	LUNA_METHOD_FLAGS_ALL = LUNA_METHOD_FLAG_DEPRECATED
 	                      | LUNA_METHOD_FLAG_VALIDATE_IN
+	                      | LUNA_METHOD_FLAG_CONCURRENT
+	                      | LUNA_METHOD_FLAG_UNORDERED
 	                      ,
 } LSMethodFlags;
 
@@ -306,6 +337,35 @@ typedef void (*LSDisconnectHandler)(LSHandle *sh, void *user_data);
 bool LSSetDisconnectHandler(LSHandle *sh, LSDisconnectHandler disconnect_handler,
                     void *user_data, LSError *lserror);
 
+/**
+ * What to do when the messages queued for a peer cross the high watermark
+ * set with LSSetOutgoingWatermarks().
+ */
+typedef enum {
+    LSOutgoingPolicyNone,               /**< only call the watermark handler */
+    LSOutgoingPolicyBlock,              /**< block the sender until the queue drains to the low watermark */
+    LSOutgoingPolicyDropOldestUpdate,   /**< drop the oldest queued subscription updates */
+    LSOutgoingPolicyDisconnect,         /**< disconnect the peer */
+} LSOutgoingPolicy;
+
+typedef void (*LSOutgoingWatermarkHandler)(LSHandle *sh, const char *service_name,
+                    const char *unique_name, bool above_high_watermark,
+                    void *user_data);
+
+bool LSSetOutgoingWatermarks(LSHandle *sh,
+                    size_t high_bytes, size_t low_bytes,
+                    unsigned int high_messages, unsigned int low_messages,
+                    LSOutgoingPolicy policy, LSError *lserror);
+
+bool LSSetOutgoingWatermarkHandler(LSHandle *sh,
+                    LSOutgoingWatermarkHandler watermark_handler,
+                    void *user_data, LSError *lserror);
+
+bool LSSetIncomingBudget(LSHandle *sh, size_t max_bytes,
+                    unsigned int max_messages, LSError *lserror);
+
+bool LSSetWorkerThreads(LSHandle *sh, unsigned int max_threads, LSError *lserror);
+
 bool LSRegisterCategory(LSHandle *sh, const char *category,
                    LSMethod      *methods,
                    LSSignal      *langis,
@@ -371,6 +431,8 @@ const char * LSMessageGetCategory(LSMessage *message);
 const char * LSMessageGetMethod(LSMessage *message);
 
 const char * LSMessageGetPayload(LSMessage *message);
+LSPayloadType LSMessageGetPayloadType(LSMessage *message);
+const void * LSMessageGetPayloadBinary(LSMessage *message, size_t *len);
 
 bool LSMessageIsSubscription(LSMessage *lsmgs);
 
@@ -383,6 +445,12 @@ bool LSMessageRespond(LSMessage *message, const char *reply_payload,
 bool LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
                 LSError *lserror);
 
+bool LSMessageReplyLen(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                size_t replyPayloadLen, LSError *lserror);
+
+bool LSMessageReplyBinary(LSHandle *sh, LSMessage *lsmsg, LSPayloadType payload_type,
+                const void *payload, size_t payload_len, LSError *lserror);
+
 /* @} END OF LunaServiceMessage */
 
 /**
@@ -467,6 +535,27 @@ bool LSCallOneReply(LSHandle *sh, const char *uri, const char *payload,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, LSError *lserror);
 
+bool LSCallWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror);
+
+bool LSCallOneReplyWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror);
+
+bool LSCallBinary(LSHandle *sh, const char *uri, LSPayloadType payload_type,
+       const void *payload, size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror);
+
+bool LSCallNoReply(LSHandle *sh, const char *uri, const char *payload,
+       LSError *lserror);
+
+bool LSCallNoReplyWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len, LSError *lserror);
+
 bool LSCallFromApplication(LSHandle *sh, const char *uri, const char *payload,
        const char *applicationID,
        LSFilterFunc callback, void *ctx,
@@ -517,6 +606,9 @@ void LSSubscriptionRemove(LSSubscriptionIter *iter);
 bool LSSubscriptionReply(LSHandle *sh, const char *key,
                     const char *payload, LSError *lserror);
 
+bool LSSubscriptionReplyLen(LSHandle *sh, const char *key,
+                    const char *payload, size_t payload_len, LSError *lserror);
+
 bool LSSubscriptionRespond(LSPalmService *psh, const char *key,
                       const char *payload, LSError *lserror);
 
@@ -534,9 +626,16 @@ bool LSSubscriptionPost(LSHandle *sh, const char *category,
 bool LSSignalSend(LSHandle *sh, const char *uri, const char *payload,
              LSError *lserror);
 
+bool LSSignalSendLen(LSHandle *sh, const char *uri, const char *payload,
+             size_t payload_len, LSError *lserror);
+
 bool LSSignalSendNoTypecheck(LSHandle *sh,
             const char *uri, const char *payload, LSError *lserror);
 
+bool LSSignalSendNoTypecheckLen(LSHandle *sh,
+            const char *uri, const char *payload, size_t payload_len,
+            LSError *lserror);
+
 bool LSSignalCall(LSHandle *sh,
          const char *category, const char *methodName,
          LSFilterFunc filterFunc, void *ctx,
@@ -194,6 +194,34 @@ void Call::call(LSHandle *sh, const char *uri, const char *payload, bool oneRepl
     }
 }
 
+void Call::call(LSHandle *sh, const char *uri, const char *payload, size_t payload_len, bool oneReply)
+{
+    LS::Error error;
+    typedef bool (*CallFuncType)(LSHandle *,
+                                 const char *,
+                                 const char *,
+                                 size_t,
+                                 LSFilterFunc,
+                                 void *,
+                                 LSMessageToken *,
+                                 LSError *);
+    _sh = sh;
+    _single = oneReply;
+    CallFuncType callFunc = _single ? LSCallOneReplyWithLen : LSCallWithLen;
+
+    if (!callFunc(_sh,
+                  uri,
+                  payload,
+                  payload_len,
+                  &replyCallback,
+                  _context.get(),
+                  &_token,
+                  error.get()))
+    {
+        throw error;
+    }
+}
+
 void Call::callSignal(LSHandle *sh, const char *category, const char *methodName)
 {
     LS::Error error;
@@ -213,6 +213,26 @@ void Handle::sendSignal(const char *uri, const char *payload, bool typecheck) co
     }
 }
 
+void Handle::sendSignal(const char *uri, const char *payload, size_t payload_len, bool typecheck) const
+{
+    Error error;
+
+    if (typecheck)
+    {
+        if (!LSSignalSendLen(_handle, uri, payload, payload_len, error.get()))
+        {
+            throw error;
+        }
+    }
+    else
+    {
+        if (!LSSignalSendNoTypecheckLen(_handle, uri, payload, payload_len, error.get()))
+        {
+            throw error;
+        }
+    }
+}
+
 Call Handle::callOneReply(const char *uri,
                           const char *payload,
                           const char *appID)
@@ -255,6 +275,39 @@ Call Handle::callMultiReply(const char *uri,
     return call;
 }
 
+Call Handle::callWithLen(const char *uri,
+                         const char *payload,
+                         size_t payload_len,
+                         bool oneReply,
+                         LSFilterFunc func,
+                         void *context)
+{
+    Call call;
+    call.continueWith(func, context);
+    call.call(_handle, uri, payload, payload_len, oneReply);
+    return call;
+}
+
+void Handle::callNoReply(const char *uri, const char *payload) const
+{
+    Error error;
+
+    if (!LSCallNoReply(_handle, uri, payload, error.get()))
+    {
+        throw error;
+    }
+}
+
+void Handle::callNoReply(const char *uri, const char *payload, size_t payload_len) const
+{
+    Error error;
+
+    if (!LSCallNoReplyWithLen(_handle, uri, payload, payload_len, error.get()))
+    {
+        throw error;
+    }
+}
+
 Call Handle::callSignal(const char *category,
                         const char *methodName,
                         LSFilterFunc func,
@@ -78,4 +78,24 @@ void Message::respond(const char *reply_payload)
     }
 }
 
+void Message::reply(Handle &service_handle, const char *reply_payload, size_t reply_payload_len)
+{
+    Error error;
+
+    if (!LSMessageReplyLen(service_handle.get(), _message, reply_payload, reply_payload_len, error.get()))
+    {
+        throw error;
+    }
+}
+
+void Message::respond(const char *reply_payload, size_t reply_payload_len)
+{
+    Error error;
+
+    if (!LSMessageReplyLen(LSMessageGetConnection(_message), _message, reply_payload, reply_payload_len, error.get()))
+    {
+        throw error;
+    }
+}
+
 }
@@ -126,15 +126,11 @@ void PerformanceTest::make_server_call(const char* payload, bool with_reply)
     }
     else
     {
-        client.callOneReply("luna://com.palm.ls_performance/reply_on_call_empty/call", payload).get();
-
-        // TODO: measure call without callback. Do not ref outgoing message in
-        //       _LSTransportSerialSave if reply is not expected.
-        //std::unique_lock<std::mutex> lock(call_mut);
-        //call_received = false;
-        //client.callNoReply("luna://com.palm.ls_performance/simple_call/call", payload);
-        //while (!call_received)
-        //    call_cv.wait(lock);
+        std::unique_lock<std::mutex> lock(call_mut);
+        call_received = false;
+        client.callNoReply("luna://com.palm.ls_performance/simple_call/call", payload);
+        while (!call_received)
+            call_cv.wait(lock);
     }
 }
 
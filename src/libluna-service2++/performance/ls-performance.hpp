@@ -35,7 +35,6 @@ public:
     LS2Service(const std::string &name, bool public_service);
     ~LS2Service();
     void AddMethod(const std::string& name, const LS2Method& _method);
-    void callNoReply(const char *uri, const char *payload, const char * appID = NULL);
 };
 
 inline void LS2Service::loop_thread_func()
@@ -75,13 +74,6 @@ inline void LS2Service::AddMethod(const std::string& name, const LS2Method& _met
     setCategoryData(name.c_str(), method.get());
 }
 
-inline void LS2Service::callNoReply(const char *uri, const char *payload, const char * appID)
-{
-    LS::Error error;
-    if (!LSCallFromApplication( get(), uri, payload, appID, nullptr,nullptr, nullptr,error.get()))
-        throw error;
-}
-
 class Timer
 {
     std::chrono::high_resolution_clock::time_point start;
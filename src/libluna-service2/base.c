@@ -359,6 +359,101 @@ _LSCategoryUnregister(LSHandle *sh, void *user_data)
 }
 #endif
 
+typedef struct _LSConcurrentCall {
+    LSCategoryTable *category;
+    LSMessage *message;
+    bool handled;
+} _LSConcurrentCall;
+
+static void
+_LSConcurrentCallFree(_LSConcurrentCall *call)
+{
+    /* dropped when the handle was unregistered; the serial of the call has
+     * already been counted as processed, so the caller only learns about it
+     * from an error reply */
+    if (!call->handled)
+    {
+        _LSTransportReplyToHandlerResult(call->message->transport_msg, LSMessageHandlerResultNotHandled);
+    }
+
+    LSMessageUnref(call->message);
+    g_slice_free(_LSConcurrentCall, call);
+}
+
+/* runs on a worker thread */
+static void
+_LSConcurrentCallRun(_LSConcurrentCall *call)
+{
+    LSMessage *message = call->message;
+
+    call->handled = true;
+
+    LSMessageHandlerResult retVal = LSCategoryMethodCall(message->sh, call->category,
+                                                         message->transport_msg->client->service_name,
+                                                         message);
+
+    /* there's nobody else to send the error reply */
+    _LSTransportReplyToHandlerResult(message->transport_msg, retVal);
+}
+
+/**
+* @brief Hand a call to a LUNA_METHOD_FLAG_CONCURRENT method over to the
+* worker threads of the handle.
+*
+* @param  sh
+* @param  category
+* @param  message
+* @param  flags      flags of the method
+*
+* @retval true if the call was handed over
+* @retval false if it has to be handled on the main loop
+*/
+static bool
+_LSHandleConcurrentCall(LSHandle *sh, LSCategoryTable *category, LSMessage *message, LSMethodFlags flags)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    if (sh->worker_threads == 0)
+    {
+        return false;
+    }
+
+    if (!sh->workers)
+    {
+        sh->workers = _LSWorkersNew(sh->worker_threads, &lserror);
+        if (!sh->workers)
+        {
+            LOG_LSERROR(MSGID_LS_WORKERS_ERR, &lserror);
+            LSErrorFree(&lserror);
+            sh->worker_threads = 0;
+            return false;
+        }
+    }
+
+    _LSConcurrentCall *call = g_slice_new(_LSConcurrentCall);
+    call->category = category;
+    call->message = message;
+    call->handled = false;
+    LSMessageRef(message);
+
+    /* calls from the same peer are kept in order, unless the method opts out */
+    const void *key = (flags & LUNA_METHOD_FLAG_UNORDERED) ? NULL : message->transport_msg->client;
+
+    if (!_LSWorkersPush(sh->workers, key, (_LSWorkersFunc)_LSConcurrentCallRun, call,
+                        (GDestroyNotify)_LSConcurrentCallFree, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_WORKERS_ERR, &lserror);
+        LSErrorFree(&lserror);
+        /* the main loop handles it instead */
+        call->handled = true;
+        _LSConcurrentCallFree(call);
+        return false;
+    }
+
+    return true;
+}
+
 static LSMessageHandlerResult
 _LSHandleMethodCall(LSHandle *sh, _LSTransportMessage *transport_msg)
 {
@@ -382,7 +477,18 @@ _LSHandleMethodCall(LSHandle *sh, _LSTransportMessage *transport_msg)
     }
     else
     {
-        retVal = LSCategoryMethodCall(sh, category, transport_msg->client->service_name, message);
+        LSMethodEntry *method = g_hash_table_lookup(category->methods, LSMessageGetMethod(message));
+
+        if (method && (method->flags & LUNA_METHOD_FLAG_CONCURRENT) &&
+            _LSHandleConcurrentCall(sh, category, message, method->flags))
+        {
+            /* the worker sends the error reply if the call isn't handled */
+            retVal = LSMessageHandlerResultHandled;
+        }
+        else
+        {
+            retVal = LSCategoryMethodCall(sh, category, transport_msg->client->service_name, message);
+        }
     }
 
     LSMessageUnref(message);
@@ -401,6 +507,7 @@ _LSMessageHandler(_LSTransportMessage *message, void *context)
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
         /* NOTE: the "cancel method call" is handled by the
          * _privateMethods -- _LSPrivateCancel, which is registered for
@@ -599,6 +706,12 @@ static LSMethod _privateMethods[] = {
     { "mallinfo", _LSPrivateGetMallinfo},
     { "malloc_trim", _LSPrivateDoMallocTrim},
 #endif
+#ifdef MESSAGE_POOL_DEBUG
+    { "message_pool", _LSPrivateGetMessagePool},
+#endif
+#ifdef OUTGOING_QUEUE_DEBUG
+    { "outgoing_queues", _LSPrivateGetOutgoingQueues},
+#endif
 #ifdef INTROSPECTION_DEBUG
     { "introspection", _LSPrivateInrospection},
 #endif
@@ -627,6 +740,157 @@ LSSetDisconnectHandler(LSHandle *sh, LSDisconnectHandler disconnect_handler,
     return true;
 }
 
+static void
+_LSOutgoingWatermarkHandler(_LSTransportClient *client, bool above_high_watermark, void *context)
+{
+    LSHandle *sh = (LSHandle *)context;
+    LSOutgoingWatermarkHandler handler = sh->outgoing_watermark_handler;
+
+    if (handler)
+    {
+        handler(sh, _LSTransportClientGetServiceName(client), _LSTransportClientGetUniqueName(client),
+                above_high_watermark, sh->outgoing_watermark_handler_data);
+    }
+}
+
+/**
+* @brief Bound the messages queued for each peer that doesn't read them fast
+* enough.
+*
+* A peer's queue crosses the high watermark when either enabled limit is
+* reached and stays above it until both have drained to their low
+* watermarks. A zero high watermark disables that limit; both are disabled
+* by default. What happens above the high watermark is set by @p policy:
+* @ref LSOutgoingPolicyBlock makes senders on other threads than the main
+* loop wait a few seconds at most for the queue to drain,
+* @ref LSOutgoingPolicyDropOldestUpdate drops the oldest queued subscription
+* updates (never a first reply), and @ref LSOutgoingPolicyDisconnect drops
+* the connection to the peer.
+*
+* Should be called before the handle is attached to a main loop.
+*
+* @param  sh
+* @param  high_bytes       bytes queued to cross the high watermark
+* @param  low_bytes        bytes queued to drop back below it
+* @param  high_messages    messages queued to cross the high watermark
+* @param  low_messages     messages queued to drop back below it
+* @param  policy           what to do above the high watermark
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSetOutgoingWatermarks(LSHandle *sh, size_t high_bytes, size_t low_bytes,
+                        unsigned int high_messages, unsigned int low_messages,
+                        LSOutgoingPolicy policy, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    _LSErrorIfFailMsg(low_bytes <= high_bytes && low_messages <= high_messages, lserror,
+        MSGID_LS_PARAMETER_IS_NULL, -EINVAL, "Low watermark is above the high watermark");
+    _LSErrorIfFailMsg(policy >= LSOutgoingPolicyNone && policy <= LSOutgoingPolicyDisconnect, lserror,
+        MSGID_LS_PARAMETER_IS_NULL, -EINVAL, "Invalid outgoing queue policy: %d", (int)policy);
+
+    _LSTransportOutgoingLimits limits = {
+        .high_bytes = high_bytes,
+        .low_bytes = low_bytes,
+        .high_messages = high_messages,
+        .low_messages = low_messages,
+        .policy = policy,
+    };
+
+    _LSTransportSetOutgoingLimits(sh->transport, &limits);
+
+    return true;
+}
+
+/**
+* @brief Set a function to be called when the queue of messages to a peer
+* crosses the high watermark or drains to the low watermark.
+*
+* @param  sh
+* @param  watermark_handler
+* @param  user_data
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSetOutgoingWatermarkHandler(LSHandle *sh, LSOutgoingWatermarkHandler watermark_handler,
+                              void *user_data, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+    sh->outgoing_watermark_handler = watermark_handler;
+    sh->outgoing_watermark_handler_data = user_data;
+    return true;
+}
+
+/**
+* @brief Set how much is read from a single peer each time the main loop
+* wakes us up for it.
+*
+* Once either limit is reached, the messages read so far are dispatched and
+* the rest is left for the next main loop iteration, so a peer that floods
+* us can't delay the other peers and sources of the main loop. Zero
+* disables a limit. The defaults are 256 KB and 64 messages.
+*
+* @param  sh
+* @param  max_bytes        bytes read per wakeup
+* @param  max_messages     messages read per wakeup
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSetIncomingBudget(LSHandle *sh, size_t max_bytes, unsigned int max_messages, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    _LSTransportIncomingBudget budget = {
+        .bytes = max_bytes,
+        .messages = max_messages,
+    };
+
+    _LSTransportSetIncomingBudget(sh->transport, &budget);
+
+    return true;
+}
+
+/**
+* @brief Set how many threads run the methods registered with
+* LUNA_METHOD_FLAG_CONCURRENT.
+*
+* The threads are started when such a method is first called, and calls from
+* the same sender are handled one at a time unless the method also has
+* LUNA_METHOD_FLAG_UNORDERED. Zero runs these methods on the main loop like
+* any other. The default is the number of processors.
+*
+* @param  sh
+* @param  max_threads      maximum number of calls handled at once
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSetWorkerThreads(LSHandle *sh, unsigned int max_threads, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    sh->worker_threads = max_threads;
+
+    /* with 0 the pool just isn't used anymore */
+    if (sh->workers && max_threads > 0)
+    {
+        _LSWorkersSetMaxThreads(sh->workers, max_threads);
+    }
+
+    return true;
+}
+
 /*
     We need a common routine one level down from all the public LSRegister* functions
 */
@@ -650,6 +914,7 @@ _LSRegisterCommon(const char *name, LSHandle **ret_sh,
 
     sh->name        = g_strdup(name);
     sh->transport   = NULL;
+    sh->worker_threads = g_get_num_processors();
 
     LSHANDLE_SET_VALID(sh, call_ret_addr);
 
@@ -668,7 +933,9 @@ _LSRegisterCommon(const char *name, LSHandle **ret_sh,
         .disconnect_handler = _LSDisconnectHandler,
         .disconnect_context = sh,
         .message_failure_handler = _LSHandleMessageFailure,
-        .message_failure_context = sh
+        .message_failure_context = sh,
+        .outgoing_watermark_handler = _LSOutgoingWatermarkHandler,
+        .outgoing_watermark_context = sh
     };
 
     if (!_LSTransportInit(&sh->transport, name, &_LSTransportHandler, lserror))
@@ -879,6 +1146,14 @@ _LSUnregisterCommon(LSHandle *sh, bool flush_and_send_shutdown, void *call_ret_a
 {
     _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
 
+    /* the running calls still use the categories and the transport */
+    if (sh->workers)
+    {
+        _LSWorkersClose(sh->workers, sh->context);
+        _LSWorkersFree(sh->workers);
+        sh->workers = NULL;
+    }
+
     _LSGlobalLock();
 
     if (sh->tableHandlers)
@@ -30,6 +30,7 @@
 #include "signal.h"
 #include "subscription.h"
 #include "transport.h"
+#include "workers.h"
 
 /**
  * @addtogroup LunaServiceInternals
@@ -125,6 +126,12 @@ struct LSHandle {
     LSDisconnectHandler disconnect_handler;
     void           *disconnect_handler_data;
 
+    LSOutgoingWatermarkHandler outgoing_watermark_handler;
+    void           *outgoing_watermark_handler_data;
+
+    _LSWorkers     *workers;       /**< runs LUNA_METHOD_FLAG_CONCURRENT methods; created on first use */
+    unsigned int    worker_threads; /**< max threads in @ref workers; 0 runs those methods on the main loop */
+
     /* FIXME: remove when we don't have a custom mainloop for java */
     _FetchMessageQueue *fetch_message_queue;
                                   /**< queue for fetch style retreival */
@@ -49,10 +49,12 @@
  */
 
 static bool _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
-       const char *payload,
+       LSPayloadType payload_type, const char *payload, size_t payload_len,
        const char *applicationID,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, bool single, LSError *lserror);
+static bool _LSCallCheckUriAndPayload(const char *uri, LSPayloadType payload_type,
+       const char *payload, size_t payload_len, LSError *lserror);
 
 #define LUNA_OLD_PREFIX "luna://"
 #define LUNA_PREFIX "palm://"
@@ -1432,6 +1434,7 @@ _MessageFindTokens(_CallMap *callmap, _LSTransportMessage *msg,
         _get_first_field_tokens(callmap, msg, tokens);
         break;
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
         /* FIXME <tdh> This is here for the java custom mainloop, which
          * calls this function for all types of messages */
@@ -1739,7 +1742,9 @@ _send_reg_service_category(LSHandle     *sh,
 static bool
 _send_method_call(LSHandle *sh,
              _Uri       *luri,
+             LSPayloadType payload_type,
              const char *payload,
+             size_t      payload_len,
              const char *applicationID,
              LSFilterFunc    callback,
              void           *ctx,
@@ -1751,7 +1756,14 @@ _send_method_call(LSHandle *sh,
 
     PMTRACE_CLIENT_PREPARE(sh->name, luri->serviceName, luri->methodName);
 
-    retVal = LSTransportSend(sh->transport, luri->serviceName, luri->objectPath, luri->methodName, payload, applicationID, &token, lserror);
+    if (payload_type == LS_PAYLOAD_TYPE_JSON)
+    {
+        retVal = LSTransportSendLen(sh->transport, luri->serviceName, luri->objectPath, luri->methodName, payload, payload_len, applicationID, &token, lserror);
+    }
+    else
+    {
+        retVal = LSTransportSendBinary(sh->transport, luri->serviceName, luri->objectPath, luri->methodName, payload_type, payload, payload_len, applicationID, &token, lserror);
+    }
     if (!retVal)
     {
         goto error;
@@ -1807,7 +1819,7 @@ _cancel_signal(LSHandle *sh, _Call *call, LSError *lserror)
 
 static bool
 _LSSignalSendCommon(LSHandle *sh, const char *uri, const char *payload,
-             bool typecheck, LSError *lserror)
+             size_t payload_len, bool typecheck, LSError *lserror)
 {
     _Uri *luri;
 
@@ -1823,7 +1835,7 @@ _LSSignalSendCommon(LSHandle *sh, const char *uri, const char *payload,
 
     if (unlikely(_ls_enable_utf8_validation))
     {
-        if (!g_utf8_validate (payload, -1, NULL))
+        if (!g_utf8_validate (payload, payload_len, NULL))
         {
             _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: payload is not utf-8",
                         __FUNCTION__);
@@ -1831,12 +1843,20 @@ _LSSignalSendCommon(LSHandle *sh, const char *uri, const char *payload,
         }
     }
 
-    if (unlikely(!payload || (strcmp(payload, "") == 0)))
+    if (unlikely(!payload || payload_len == 0))
     {
         _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "Empty payload is not valid JSON. Use {}");
         return false;
     }
 
+    /* the receiver finds the fields after the payload by its NUL */
+    if (unlikely(memchr(payload, '\0', payload_len)))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: payload contains a NUL character",
+                    __FUNCTION__);
+        return false;
+    }
+
     if (typecheck)
     {
         /* typecheck the signal, warn if we haven't done a
@@ -1854,7 +1874,7 @@ _LSSignalSendCommon(LSHandle *sh, const char *uri, const char *payload,
         }
     }
 
-    retVal = LSTransportSendSignal(sh->transport, luri->objectPath, luri->methodName, payload, lserror);
+    retVal = LSTransportSendSignalLen(sh->transport, luri->objectPath, luri->methodName, payload, payload_len, lserror);
 
     _UriFree(luri);
 
@@ -1904,8 +1924,8 @@ LSCall(LSHandle *sh, const char *uri, const char *payload,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, LSError *lserror)
 {
-    return _LSCallFromApplicationCommon(sh, uri, payload, NULL, /*AppID*/
-                callback, ctx, ret_token, false, lserror);
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload ? strlen(payload) : 0,
+                NULL, /*AppID*/ callback, ctx, ret_token, false, lserror);
 }
 
 /**
@@ -1928,10 +1948,194 @@ LSCallOneReply(LSHandle *sh, const char *uri, const char *payload,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, LSError *lserror)
 {
-    return _LSCallFromApplicationCommon(sh, uri, payload, NULL, /*AppID*/
-                callback, ctx, ret_token, true, lserror);
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload ? strlen(payload) : 0,
+                NULL, /*AppID*/ callback, ctx, ret_token, true, lserror);
+}
+
+/**
+* @brief Sends a message to service like LSCall(), with a payload of known
+*        length.
+*
+* The payload doesn't have to be NUL-terminated and isn't scanned for its
+* length again, which saves a pass over large payloads.
+*
+* @param  sh
+* @param  uri
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  callback
+* @param  ctx
+* @param  ret_token
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSCallWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror)
+{
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload_len,
+                NULL, /*AppID*/ callback, ctx, ret_token, false, lserror);
+}
+
+/**
+* @brief Sends a message to service like LSCallOneReply(), with a payload of
+*        known length.
+*
+* See LSCallWithLen().
+*
+* @param  sh
+* @param  uri
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  callback
+* @param  ctx
+* @param  ret_token
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSCallOneReplyWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror)
+{
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload_len,
+                NULL, /*AppID*/ callback, ctx, ret_token, true, lserror);
+}
+
+/**
+* @brief Sends a message with a binary payload to service like LSCall().
+*
+* The payload is passed as is, so it may contain NULs, and is neither
+* checked for UTF-8 nor validated against the schema of the method. The
+* service gets it with LSMessageGetPayloadBinary().
+*
+* @param  sh
+* @param  uri
+* @param  payload_type - LS_PAYLOAD_TYPE_BINARY or a service-defined type
+*                        from LS_PAYLOAD_TYPE_USER up
+* @param  payload
+* @param  payload_len  - length of the payload in bytes
+* @param  callback
+* @param  ctx
+* @param  ret_token
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSCallBinary(LSHandle *sh, const char *uri, LSPayloadType payload_type,
+       const void *payload, size_t payload_len,
+       LSFilterFunc callback, void *ctx,
+       LSMessageToken *ret_token, LSError *lserror)
+{
+    if (payload_type == LS_PAYLOAD_TYPE_JSON)
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: JSON payloads are sent with LSCall()",
+                    __FUNCTION__);
+        return false;
+    }
+
+    return _LSCallFromApplicationCommon(sh, uri, payload_type, payload, payload_len,
+                NULL, /*AppID*/ callback, ctx, ret_token, false, lserror);
+}
+
+
+/**
+* @brief Sends a message to service like LSCall(), but doesn't expect any
+*        reply to it.
+*
+* The service drops whatever it replies to the message, and nothing is
+* tracked on the caller's side once the message is sent, so there is no
+* token to cancel. Failures to deliver the message aren't reported either.
+* Calls to the bus itself (com.palm.bus) always need a callback and can't
+* be made this way.
+*
+* @param  sh
+* @param  uri
+* @param  payload
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSCallNoReply(LSHandle *sh, const char *uri, const char *payload,
+       LSError *lserror)
+{
+    return LSCallNoReplyWithLen(sh, uri, payload, payload ? strlen(payload) : 0, lserror);
 }
 
+/**
+* @brief Sends a message to service like LSCallNoReply(), with a payload of
+*        known length.
+*
+* See LSCallWithLen().
+*
+* @param  sh
+* @param  uri
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSCallNoReplyWithLen(LSHandle *sh, const char *uri, const char *payload,
+       size_t payload_len, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    _LSErrorIfFail(uri != NULL, lserror, MSGID_LS_INVALID_URI);
+    _LSErrorIfFail(payload != NULL, lserror, MSGID_LS_INVALID_PAYLOAD);
+
+    LSHANDLE_VALIDATE(sh);
+
+    if (!_LSCallCheckUriAndPayload(uri, LS_PAYLOAD_TYPE_JSON, payload, payload_len, lserror))
+    {
+        return false;
+    }
+
+    _Uri *luri = _UriParse(uri, lserror);
+    if (!luri)
+    {
+        return false;
+    }
+
+    bool retVal = false;
+    LSMessageToken token;
+
+    if (strcmp(luri->serviceName, LUNABUS_SERVICE_NAME) == 0 ||
+        strcmp(luri->serviceName, LUNABUS_SERVICE_NAME_OLD) == 0)
+    {
+        _LSErrorSet(lserror, MSGID_LS_NO_CALLBACK, -EINVAL,
+                    "Invalid parameters to lunabus LSCallNoReply.  "
+                    "Calls to the bus need a callback.");
+        goto exit;
+    }
+
+    PMTRACE_CLIENT_PREPARE(sh->name, luri->serviceName, luri->methodName);
+
+    retVal = LSTransportSendNoReply(sh->transport, luri->serviceName, luri->objectPath, luri->methodName,
+                                    payload, payload_len, NULL, &token, lserror);
+    if (!retVal)
+    {
+        goto exit;
+    }
+
+    PMTRACE_CLIENT_CALL(sh->name, luri->serviceName, luri->methodName, token);
+
+    if (DEBUG_TRACING)
+    {
+        LOG_LS_DEBUG("TX: LSCallNoReply token <<%ld>> %s", token, uri);
+    }
+
+exit:
+    _UriFree(luri);
+    return retVal;
+}
 
 /**
 * @brief Special LSCall() that sends an applicationID.
@@ -1955,8 +2159,8 @@ LSCallFromApplication(LSHandle *sh, const char *uri, const char *payload,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, LSError *lserror)
 {
-    return _LSCallFromApplicationCommon(sh, uri, payload, applicationID,
-                callback, ctx, ret_token, false, lserror);
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload ? strlen(payload) : 0,
+                applicationID, callback, ctx, ret_token, false, lserror);
 }
 
 /**
@@ -1984,13 +2188,58 @@ LSCallFromApplicationOneReply(
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, LSError *lserror)
 {
-    return _LSCallFromApplicationCommon(sh, uri, payload, applicationID,
-                callback, ctx, ret_token, true, lserror);
+    return _LSCallFromApplicationCommon(sh, uri, LS_PAYLOAD_TYPE_JSON, payload, payload ? strlen(payload) : 0,
+                applicationID, callback, ctx, ret_token, true, lserror);
+}
+
+static bool
+_LSCallCheckUriAndPayload(const char *uri, LSPayloadType payload_type,
+                          const char *payload, size_t payload_len, LSError *lserror)
+{
+    if (!g_str_has_prefix(uri, LUNA_PREFIX) &&
+        !g_str_has_prefix(uri, LUNA_OLD_PREFIX)) /* TODO: we need to get rid of this */
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_URI, -EINVAL,
+                "%s: Invalid syntax for uri", __FUNCTION__);
+        return false;
+    }
+
+    /* binary payloads are opaque to us */
+    if (payload_type != LS_PAYLOAD_TYPE_JSON)
+    {
+        return true;
+    }
+
+    if (unlikely(_ls_enable_utf8_validation))
+    {
+        if (!g_utf8_validate (payload, payload_len, NULL))
+        {
+            _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: payload is not utf-8",
+                        __FUNCTION__);
+            return false;
+        }
+    }
+
+    if (unlikely(!payload || payload_len == 0))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "Empty payload is not valid JSON. Use {}");
+        return false;
+    }
+
+    /* the receiver finds the fields after the payload by its NUL */
+    if (unlikely(memchr(payload, '\0', payload_len)))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: payload contains a NUL character",
+                    __FUNCTION__);
+        return false;
+    }
+
+    return true;
 }
 
 static bool
 _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
-       const char *payload,
+       LSPayloadType payload_type, const char *payload, size_t payload_len,
        const char *applicationID,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, bool single, LSError *lserror)
@@ -2009,29 +2258,11 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
 
     _Call *call = NULL;
     _Uri *luri = NULL;
+    char *bus_payload = NULL;
     bool retVal;
 
-    if (!g_str_has_prefix(uri, LUNA_PREFIX) &&
-        !g_str_has_prefix(uri, LUNA_OLD_PREFIX)) /* TODO: we need to get rid of this */
+    if (!_LSCallCheckUriAndPayload(uri, payload_type, payload, payload_len, lserror))
     {
-        _LSErrorSet(lserror, MSGID_LS_INVALID_URI, -EINVAL,
-                "%s: Invalid syntax for uri", __FUNCTION__);
-        return false;
-    }
-
-    if (unlikely(_ls_enable_utf8_validation))
-    {
-        if (!g_utf8_validate (payload, -1, NULL))
-        {
-            _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: payload is not utf-8",
-                        __FUNCTION__);
-            return false;
-        }
-    }
-
-    if (unlikely(!payload || (strcmp(payload, "") == 0)))
-    {
-        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "Empty payload is not valid JSON. Use {}");
         return false;
     }
 
@@ -2047,6 +2278,14 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
     if (strcmp(luri->serviceName, LUNABUS_SERVICE_NAME) == 0 ||
         strcmp(luri->serviceName, LUNABUS_SERVICE_NAME_OLD) == 0)
     {
+        if (payload_type != LS_PAYLOAD_TYPE_JSON)
+        {
+            _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL,
+                        "Invalid parameters to lunabus LSCall.  "
+                        "The bus only takes JSON payloads.");
+            goto error;
+        }
+
         if (!callback)
         {
             _LSErrorSet(lserror, MSGID_LS_NO_CALLBACK, -EINVAL,
@@ -2055,6 +2294,10 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
             goto error;
         }
 
+        /* the payload is parsed locally, so it has to be NUL-terminated */
+        bus_payload = g_strndup(payload, payload_len);
+        payload = bus_payload;
+
         if (strcmp(luri->objectPath, "/signal") == 0)
         {
             // uri == "palm://com.palm.bus/signal/addmatch"
@@ -2097,7 +2340,7 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
     }
     else
     {
-        bool ret = _send_method_call(sh, luri, payload,
+        bool ret = _send_method_call(sh, luri, payload_type, payload, payload_len,
                             applicationID,
                             callback, ctx, &call, lserror);
         if (!ret) goto error;
@@ -2126,8 +2369,8 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
         {
             if (DEBUG_VERBOSE)
             {
-                LOG_LS_DEBUG("TX: LCall token <<%ld>> %s %s",
-                        call->token, uri, payload);
+                LOG_LS_DEBUG("TX: LCall token <<%ld>> %s %.*s",
+                        call->token, uri, (int)payload_len, payload);
             }
             else
             {
@@ -2147,11 +2390,13 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
 
     _CallMapUnlock(map);
     _UriFree(luri);
+    g_free(bus_payload);
     return true;
 
 error:
     _CallMapUnlock(map);
     _UriFree(luri);
+    g_free(bus_payload);
     return false;
 }
 
@@ -2539,7 +2784,28 @@ bool
 LSSignalSendNoTypecheck(LSHandle *sh, const char *uri, const char *payload,
              LSError *lserror)
 {
-    return _LSSignalSendCommon(sh, uri, payload, false, lserror);
+    return _LSSignalSendCommon(sh, uri, payload, payload ? strlen(payload) : 0, false, lserror);
+}
+
+/**
+* @brief Variant of LSSignalSendLen() that does not attempt to check if the
+*        signal is registered via LSRegisterCategory().
+*
+* See LSSignalSendNoTypecheck().
+*
+* @param  sh
+* @param  uri
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSignalSendNoTypecheckLen(LSHandle *sh, const char *uri, const char *payload,
+             size_t payload_len, LSError *lserror)
+{
+    return _LSSignalSendCommon(sh, uri, payload, payload_len, false, lserror);
 }
 
 /**
@@ -2556,7 +2822,28 @@ bool
 LSSignalSend(LSHandle *sh, const char *uri, const char *payload,
              LSError *lserror)
 {
-    return _LSSignalSendCommon(sh, uri, payload, true, lserror);
+    return _LSSignalSendCommon(sh, uri, payload, payload ? strlen(payload) : 0, true, lserror);
+}
+
+/**
+* @brief Send a signal with a payload of known length.
+*
+* Same as LSSignalSend(), but the payload doesn't have to be NUL-terminated
+* and isn't scanned for its length again.
+*
+* @param  sh
+* @param  uri
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSignalSendLen(LSHandle *sh, const char *uri, const char *payload,
+                size_t payload_len, LSError *lserror)
+{
+    return _LSSignalSendCommon(sh, uri, payload, payload_len, true, lserror);
 }
 
 /* @} END OF LunaServiceSignals */
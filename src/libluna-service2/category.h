@@ -84,7 +84,9 @@ static inline LSMessageHandlerResult LSCategoryMethodCall(
                      "Couldn't find method: %s", method_name);
         return LSMessageHandlerResultUnknownMethod;
     }
-    bool validateCall = method->flags & LUNA_METHOD_FLAG_VALIDATE_IN;
+    /* schemas describe JSON, so binary payloads are left to the method */
+    bool validateCall = (method->flags & LUNA_METHOD_FLAG_VALIDATE_IN) &&
+                        LSMessageGetPayloadType(message) == LS_PAYLOAD_TYPE_JSON;
 
     /* XXX: work-around clients that puts garbage in method flags */
     if (unlikely(validateCall && method->schema_call == NULL))
@@ -22,6 +22,7 @@
 #include "base.h"
 #include "category.h"
 #include "simple_pbnjson.h"
+#include "transport_message_pool.h"
 
 #ifdef MALLOC_DEBUG
 #include <malloc.h>
@@ -287,6 +288,130 @@ error:
 }
 #endif  /* MALLOC_DEBUG */
 
+#ifdef MESSAGE_POOL_DEBUG
+bool
+_LSPrivateGetMessagePool(LSHandle* sh, LSMessage *message, void *ctx)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    const char *sender = LSMessageGetSenderServiceName(message);
+
+    if ( !sender ||
+         ( (strcmp(sender, MONITOR_NAME) != 0) && (strcmp(sender, MONITOR_NAME_PUB) != 0)) )
+    {
+        LOG_LS_WARNING(MSGID_LS_MSG_ERR, 1,
+                       PMLOGKS("APP_ID", sender),
+                       "Message pool debug method not called by monitor;"
+                       " ignoring (service name: %s, unique_name: %s)",
+                       sender, LSMessageGetSender(message));
+        return true;
+    }
+
+    _LSTransportMessagePoolStats stats;
+    _LSTransportMessagePoolGetStats(&stats);
+
+    /* returnValue: true,
+     * message_pool: {hits: int, misses: int, bytes_retained: int,
+     *                messages_retained: int, raw_retained: {"<size>": int,...}}
+     */
+    jvalue_ref raw_obj = jobject_create();
+    int i;
+    for (i = 0; i < LS_TRANSPORT_POOL_NUM_CLASSES; i++)
+    {
+        char size_key[16];
+        snprintf(size_key, sizeof(size_key), "%lu", _LSTransportMessagePoolGetClassSize(i + 1));
+        jobject_put(raw_obj, jstring_create(size_key), jnumber_create_i64(stats.raw_retained[i]));
+    }
+
+    jvalue_ref reply = jobject_create_var(
+        jkeyval( J_CSTR_TO_JVAL("returnValue"), jboolean_create(true) ),
+        jkeyval( J_CSTR_TO_JVAL("message_pool"), jobject_create_var(
+            jkeyval( J_CSTR_TO_JVAL("hits"), jnumber_create_i64(stats.hits) ),
+            jkeyval( J_CSTR_TO_JVAL("misses"), jnumber_create_i64(stats.misses) ),
+            jkeyval( J_CSTR_TO_JVAL("bytes_retained"), jnumber_create_i64(stats.bytes_retained) ),
+            jkeyval( J_CSTR_TO_JVAL("messages_retained"), jnumber_create_i64(stats.messages_retained) ),
+            jkeyval( J_CSTR_TO_JVAL("raw_retained"), raw_obj ),
+            J_END_OBJ_DECL
+        )),
+        J_END_OBJ_DECL
+    );
+
+    bool reply_ret = LSMessageReply(sh, message, jvalue_tostring_simple(reply), &lserror);
+    if (!reply_ret)
+    {
+        LOG_LSERROR(MSGID_LS_MSG_POOL_SEND_FAILED, &lserror);
+        LSErrorFree(&lserror);
+    }
+    j_release(&reply);
+
+    return true;
+}
+#endif  /* MESSAGE_POOL_DEBUG */
+
+#ifdef OUTGOING_QUEUE_DEBUG
+static void
+_LSPrivateAddOutgoingQueue(const _LSTransportClient *client, const _LSTransportOutgoingStats *stats, void *data)
+{
+    jvalue_ref queues_array = data;
+    const char *service_name = _LSTransportClientGetServiceName(client);
+    const char *unique_name = _LSTransportClientGetUniqueName(client);
+
+    jarray_append(queues_array, jobject_create_var(
+        jkeyval( J_CSTR_TO_JVAL("service_name"), jstring_create(service_name ? service_name : "") ),
+        jkeyval( J_CSTR_TO_JVAL("unique_name"), jstring_create(unique_name ? unique_name : "") ),
+        jkeyval( J_CSTR_TO_JVAL("messages"), jnumber_create_i64(stats->messages) ),
+        jkeyval( J_CSTR_TO_JVAL("bytes"), jnumber_create_i64(stats->bytes) ),
+        jkeyval( J_CSTR_TO_JVAL("above_high_watermark"), jboolean_create(stats->above_high_watermark) ),
+        jkeyval( J_CSTR_TO_JVAL("dropped"), jnumber_create_i64(stats->dropped) ),
+        J_END_OBJ_DECL
+    ));
+}
+
+bool
+_LSPrivateGetOutgoingQueues(LSHandle* sh, LSMessage *message, void *ctx)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    const char *sender = LSMessageGetSenderServiceName(message);
+
+    if ( !sender ||
+         ( (strcmp(sender, MONITOR_NAME) != 0) && (strcmp(sender, MONITOR_NAME_PUB) != 0)) )
+    {
+        LOG_LS_WARNING(MSGID_LS_MSG_ERR, 1,
+                       PMLOGKS("APP_ID", sender),
+                       "Outgoing queue debug method not called by monitor;"
+                       " ignoring (service name: %s, unique_name: %s)",
+                       sender, LSMessageGetSender(message));
+        return true;
+    }
+
+    /* returnValue: true,
+     * outgoing_queues: [{service_name: string, unique_name: string, messages: int,
+     *                    bytes: int, above_high_watermark: bool, dropped: int},...]
+     */
+    jvalue_ref queues_array = jarray_create(NULL);
+    _LSTransportForeachOutgoing(sh->transport, _LSPrivateAddOutgoingQueue, queues_array);
+
+    jvalue_ref reply = jobject_create_var(
+        jkeyval( J_CSTR_TO_JVAL("returnValue"), jboolean_create(true) ),
+        jkeyval( J_CSTR_TO_JVAL("outgoing_queues"), queues_array ),
+        J_END_OBJ_DECL
+    );
+
+    bool reply_ret = LSMessageReply(sh, message, jvalue_tostring_simple(reply), &lserror);
+    if (!reply_ret)
+    {
+        LOG_LSERROR(MSGID_LS_OUTGOING_SEND_FAILED, &lserror);
+        LSErrorFree(&lserror);
+    }
+    j_release(&reply);
+
+    return true;
+}
+#endif  /* OUTGOING_QUEUE_DEBUG */
+
 #ifdef INTROSPECTION_DEBUG
 static jvalue_ref
 build_categories_flat(LSHandle *sh)
@@ -28,6 +28,8 @@
 #define MALLOC_DEBUG
 #endif
 #define INTROSPECTION_DEBUG
+#define MESSAGE_POOL_DEBUG
+#define OUTGOING_QUEUE_DEBUG
 
 #ifdef SUBSCRIPTION_DEBUG
 bool _LSPrivateGetSubscriptions(LSHandle* sh, LSMessage *message, void *ctx);
@@ -36,6 +38,12 @@ bool _LSPrivateGetSubscriptions(LSHandle* sh, LSMessage *message, void *ctx);
 bool _LSPrivateGetMallinfo(LSHandle* sh, LSMessage *message, void *ctx);
 bool _LSPrivateDoMallocTrim(LSHandle* sh, LSMessage *message, void *ctx);
 #endif
+#ifdef MESSAGE_POOL_DEBUG
+bool _LSPrivateGetMessagePool(LSHandle* sh, LSMessage *message, void *ctx);
+#endif
+#ifdef OUTGOING_QUEUE_DEBUG
+bool _LSPrivateGetOutgoingQueues(LSHandle* sh, LSMessage *message, void *ctx);
+#endif
 #ifdef INTROSPECTION_DEBUG
 bool _LSPrivateInrospection(LSHandle* sh, LSMessage *message, void *ctx);
 #endif
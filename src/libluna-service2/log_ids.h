@@ -97,10 +97,12 @@
 #define MSGID_LS_CANC_WATCH_ERROR               "LS_CANCEL_WATCH"       /** Can not cancel watch status*/
 #define MSGID_LS_CANT_PING                      "LS_CANT_PING"          /** Sending ping failed */
 #define MSGID_LS_CANT_CANCEL_METH               "LS_CANC_METH"          /** Can't cancel method */
+#define MSGID_LS_CAPTURE_ERR                    "LS_CAPTURE"            /** Monitor capture file error */
 #define MSGID_LS_CATALOG_ERR                    "LS_CATALOG_REG"        /** Error in subscription catalog */
 #define MSGID_LS_CATEGORY_REGISTERED            "LS_CATEG_REG"          /** Category is already registered */
 #define MSGID_LS_CHANNEL_ERR                    "LS_CHAN"               /** Channel error */
 #define MSGID_LS_CLOCK_ERROR                    "LS_CLOCK"              /** Monotonic clock error */
+#define MSGID_LS_COMPRESS_ERR                   "LS_COMPRESS"           /** Payload compression error */
 #define MSGID_LS_CONN_ERROR                     "LS_CONN"               /** Failed to connect */
 #define MSGID_LS_DEBG_NOT_SUBSCRIBED            "LS_NO_DBG_SUBS"        /** Subscription debug method not called by monitor */
 #define MSGID_LS_DEBUG_INFO                     "LS_DEBUG_ENABLED"      /** Log mode enabled */
@@ -108,6 +110,7 @@
 #define MSGID_LS_DISCONNECT_ERR                 "LS_DISCONN"            /** Handler disconnect error */
 #define MSGID_LS_DUP_ERR                        "LS_DUP"                /** FD Duplication error */
 #define MSGID_LS_EAGAIN_ERR                     "LS_EAGAIN"             /** Resource temporarily unavailable */
+#define MSGID_LS_EPOLL_ERR                      "LS_EPOLL"              /** epoll event engine error */
 #define MSGID_LS_ERROR_INIT_ERR                 "LS_ERR_INIT"           /** LSError is already initialized */
 #define MSGID_LS_INTROS_SEND_FAILED             "LS_INTROS_SEND_FAIL"   /** Sending introspection data failed */
 #define MSGID_LS_INVALID_BUS                    "LS_BUS"                /** Replying on different bus */
@@ -121,12 +124,14 @@
 #define MSGID_LS_INVALID_URI_PATH               "LS_INV_URI_PATH"       /** Invalid path in URI */
 #define MSGID_LS_INVALID_URI_SERVICE_NAME       "LS_INV_URI_SNAME"      /** Invalid service name in URI */
 #define MSGID_LS_LOCK_FILE_ERR                  "LS_LCK_FILE"           /** Lock file error */
+#define MSGID_LS_LOOPBACK_ERR                   "LS_LOOPBACK"           /** In-process loopback error */
 #define MSGID_LS_MAGIC_ASSERT                   "LS_MAGIC_ASSERT"       /** No LS_MAGIC field */
 #define MSGID_LS_MAINCONTEXT_ERROR              "LS_MCTXT"              /** Maincontext error */
 #define MSGID_LS_MAINLOOP_ERROR                 "LS_MLOOP"              /** Mainloop error */
 #define MSGID_LS_MALLOC_SEND_FAILED             "LS_MALL_SEND_FAIL"     /** Sending malloc info failed */
 #define MSGID_LS_MALLOC_TRIM_SEND_FAILED        "LS_MALLTRIM_SEND_FAIL" /** Sending malloc trim result failed */
 #define MSGID_LS_MSG_ERR                        "LS_MSG"                /** Messages errors */
+#define MSGID_LS_MSG_POOL_SEND_FAILED           "LS_MSGPOOL_SEND_FAIL"  /** Sending message pool info failed */
 #define MSGID_LS_MSG_NOT_HANDLED                "LS_MSG_NOT_HNDLD"      /** Messages not handled */
 #define MSGID_LS_MUTEX_ERR                      "LS_MUTEX"              /** Mutex error */
 #define MSGID_LS_NOT_AN_ERROR                   "LS_NOT_AN"             /** The message type is not an error type */
@@ -139,6 +144,7 @@
 #define MSGID_LS_NULL_CLIENT                    "LS_NULL_CLIENT"        /** Client without client info */
 #define MSGID_LS_NULL_LS_ERROR                  "LS_NULL_LS_ERROR"      /** Null lserror in log function */
 #define MSGID_LS_OOM_ERR                        "LS_MEM"                /** Out of memory error */
+#define MSGID_LS_OUTGOING_SEND_FAILED           "LS_OUTQ_SEND_FAIL"     /** Sending outgoing queue info failed */
 #define MSGID_LS_PARAMETER_IS_NULL              "LS_PARAM"              /** Parameter == NULL */
 #define MSGID_LS_PID_PATH_ERR                   "LS_PID_PATH"           /** Can't get executable for pid */
 #define MSGID_LS_PID_READ_ERR                   "LS_PID_READ"           /** Can't read PID from file */
@@ -153,6 +159,7 @@
 #define MSGID_LS_SHARED_MEMORY_ERR              "LS_SHM"                /** Shared memory error*/
 #define MSGID_LS_SIGNAL_NOT_REGISTERED          "LS_SIG_NREG"           /** Signal not registered */
 #define MSGID_LS_SOCK_ERROR                     "LS_SOCK"               /** Socket error */
+#define MSGID_LS_SUBMIT_ERR                     "LS_SUBMIT"             /** Cross-thread submission queue error */
 #define MSGID_LS_SUBSCRIPTION_ERR               "LS_SUBS"               /** Subscription error */
 #define MSGID_LS_SUBSEND_FAILED                 "LS_SUB_SEND_FAIL"      /** Sending subscription info failed */
 #define MSGID_LS_TIMER_NO_CALLBACK              "LS_TIMER_NO_CBCK"      /** Timeout source dispatched without callback */
@@ -166,7 +173,9 @@
 #define MSGID_LS_UNKNOWN_FAILURE                "LS_UNKNOWN_FLR"        /** Unknown failure */
 #define MSGID_LS_UNKNOWN_GROUP                  "LS_UNKNOWN_GRP"        /** Found unknown group */
 #define MSGID_LS_UNKNOWN_MSG                    "LS_UNKNOWN_MSG"        /** Unknown message */
+#define MSGID_LS_URING_ERR                      "LS_URING"              /** io_uring I/O engine error */
 #define MSGID_LS_UTF8_INFO                      "LS_UTF8_ENABLED"       /** Enable UTF8 validation on payloads */
+#define MSGID_LS_WORKERS_ERR                    "LS_WORKERS"            /** Method call worker pool error */
 #define MSGID_LS_BAD_METHOD_FLAGS               "LS_BAD_MTHD_FLGS"      /** Invalid flags provdied in LSMethod structure */
 #define MSGID_LS_BAD_VALIDATION_FLAG            "LS_BAD_VALID_FLAG"     /** Error in pre-conditions for validation flag (missing validatoin schema) */
 
@@ -350,6 +350,46 @@ LSMessageGetPayload(LSMessage *message)
     return message->payload;
 }
 
+/**
+* @brief Get the type of the payload of this message.
+*
+* @param  message
+*
+* @retval LS_PAYLOAD_TYPE_JSON or the type of a binary payload
+*/
+LSPayloadType
+LSMessageGetPayloadType(LSMessage *message)
+{
+    _LSErrorIfFail(message != NULL, LS_PAYLOAD_TYPE_JSON, MSGID_LS_MSG_ERR);
+
+    return _LSTransportMessageGetPayloadType(message->transport_msg);
+}
+
+/**
+* @brief Get the payload of this message along with its length.
+*
+*        Binary payloads may contain NULs, so this is how they are read;
+*        for JSON payloads it returns the same text as LSMessageGetPayload().
+*        Either way a NUL follows the payload, which isn't counted in len.
+*
+* @param  message
+* @param  len      - length of the payload in bytes
+*
+* @retval payload, or NULL if the message has none
+*/
+const void *
+LSMessageGetPayloadBinary(LSMessage *message, size_t *len)
+{
+    _LSErrorIfFail(message != NULL, NULL, MSGID_LS_MSG_ERR);
+    _LSErrorIfFail(len != NULL, NULL, MSGID_LS_PARAMETER_IS_NULL);
+
+    unsigned long payload_len = 0;
+    const char *payload = _LSTransportMessageGetPayloadBinary(message->transport_msg, &payload_len);
+
+    *len = payload_len;
+    return payload;
+}
+
 /**
 * @brief Get the payload of the message as a JSON object.
 *
@@ -424,50 +464,32 @@ LSMessageRespond(LSMessage *message, const char *reply_payload,
 }
 
 /**
-* @brief Send a reply to a message using the bus identified by LSHandle.
-*
-*        To use the same bus upon which the message arrived, it is
-*        recommended to use LSMessageRespond().
+* @brief Send a reply whose payload has been checked already.
 *
 * @param  sh
 * @param  lsmsg
+* @param  payload_type
 * @param  replyPayload
+* @param  replyPayloadLen
 * @param  lserror
 *
 * @retval
 */
-bool
-LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
-                LSError *lserror)
+static bool
+_LSMessageReplyCommon(LSHandle *sh, LSMessage *lsmsg, LSPayloadType payload_type,
+                      const char *replyPayload, size_t replyPayloadLen, LSError *lserror)
 {
     _LSErrorIfFail (sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
     _LSErrorIfFail (lsmsg != NULL, lserror, MSGID_LS_MSG_ERR);
-    _LSErrorIfFail (replyPayload != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
 
     LSHANDLE_VALIDATE(sh);
 
-    if (unlikely(_ls_enable_utf8_validation))
-    {
-        if (!g_utf8_validate (replyPayload, -1, NULL))
-        {
-            _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "%s: payload is not utf-8",
-                        __FUNCTION__);
-            return false;
-        }
-    }
-
-    if (unlikely(strcmp(replyPayload, "") == 0))
-    {
-        _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "Empty payload is not valid JSON. Use {}");
-        return false;
-    }
-
     if (DEBUG_TRACING)
     {
         if (DEBUG_VERBOSE)
         {
-                LOG_LS_DEBUG("TX: LSMessageReply token <<%ld>> %s",
-                        LSMessageGetToken(lsmsg), replyPayload);
+                LOG_LS_DEBUG("TX: LSMessageReply token <<%ld>> %.*s",
+                        LSMessageGetToken(lsmsg), (int)replyPayloadLen, replyPayload);
         }
         else
         {
@@ -496,11 +518,121 @@ LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
         return false;
     }
 
-    bool retVal = _LSTransportSendReply(lsmsg->transport_msg, replyPayload, lserror);
+    bool retVal;
+
+    if (payload_type == LS_PAYLOAD_TYPE_JSON)
+    {
+        retVal = _LSTransportSendReplyLen(lsmsg->transport_msg, replyPayload, replyPayloadLen, lserror);
+    }
+    else
+    {
+        retVal = _LSTransportSendReplyBinary(lsmsg->transport_msg, payload_type, replyPayload, replyPayloadLen, lserror);
+    }
 
     return retVal;
 }
 
+/**
+* @brief Send a reply to a message using the bus identified by LSHandle.
+*
+*        To use the same bus upon which the message arrived, it is
+*        recommended to use LSMessageRespond().
+*
+* @param  sh
+* @param  lsmsg
+* @param  replyPayload
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                LSError *lserror)
+{
+    _LSErrorIfFail (replyPayload != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    return LSMessageReplyLen(sh, lsmsg, replyPayload, strlen(replyPayload), lserror);
+}
+
+/**
+* @brief Send a reply to a message with a payload of known length.
+*
+*        Same as LSMessageReply(), but the payload doesn't have to be
+*        NUL-terminated and isn't scanned for its length again.
+*
+* @param  sh
+* @param  lsmsg
+* @param  replyPayload     - payload, must not contain NUL characters
+* @param  replyPayloadLen  - length of the payload in bytes, without a terminating NUL
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSMessageReplyLen(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                  size_t replyPayloadLen, LSError *lserror)
+{
+    _LSErrorIfFail (replyPayload != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    if (unlikely(_ls_enable_utf8_validation))
+    {
+        if (!g_utf8_validate (replyPayload, replyPayloadLen, NULL))
+        {
+            _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "%s: payload is not utf-8",
+                        __FUNCTION__);
+            return false;
+        }
+    }
+
+    if (unlikely(replyPayloadLen == 0))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "Empty payload is not valid JSON. Use {}");
+        return false;
+    }
+
+    if (unlikely(memchr(replyPayload, '\0', replyPayloadLen)))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "%s: payload contains a NUL character",
+                    __FUNCTION__);
+        return false;
+    }
+
+    return _LSMessageReplyCommon(sh, lsmsg, LS_PAYLOAD_TYPE_JSON, replyPayload, replyPayloadLen, lserror);
+}
+
+/**
+* @brief Send a reply with a binary payload to a message.
+*
+*        Same as LSMessageReplyLen(), but the payload may contain NULs and
+*        isn't checked for UTF-8. The caller gets it with
+*        LSMessageGetPayloadBinary().
+*
+* @param  sh
+* @param  lsmsg
+* @param  payload_type  - LS_PAYLOAD_TYPE_BINARY or a service-defined type
+*                         from LS_PAYLOAD_TYPE_USER up
+* @param  payload
+* @param  payload_len   - length of the payload in bytes
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSMessageReplyBinary(LSHandle *sh, LSMessage *lsmsg, LSPayloadType payload_type,
+                     const void *payload, size_t payload_len, LSError *lserror)
+{
+    _LSErrorIfFail (payload != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    if (payload_type == LS_PAYLOAD_TYPE_JSON)
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_PAYLOAD, -EINVAL, "%s: JSON payloads are sent with LSMessageReply()",
+                    __FUNCTION__);
+        return false;
+    }
+
+    return _LSMessageReplyCommon(sh, lsmsg, payload_type, payload, payload_len, lserror);
+}
+
 
 /**
 * @brief Send a reply.
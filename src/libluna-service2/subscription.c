@@ -1107,6 +1107,29 @@ LSSubscriptionRemove(LSSubscriptionIter *iter)
 bool
 LSSubscriptionReply(LSHandle *sh, const char *key,
                     const char *payload, LSError *lserror)
+{
+    return LSSubscriptionReplyLen(sh, key, payload, payload ? strlen(payload) : 0, lserror);
+}
+
+/**
+* @brief Sends a message with a payload of known length to subscription list
+*        with name 'key'.
+*
+* Same as LSSubscriptionReply(), but the payload doesn't have to be
+* NUL-terminated and its length is computed by the caller only once for all
+* subscribers.
+*
+* @param  sh
+* @param  key
+* @param  payload      - payload, must not contain NUL characters
+* @param  payload_len  - length of the payload in bytes, without a terminating NUL
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSubscriptionReplyLen(LSHandle *sh, const char *key,
+                       const char *payload, size_t payload_len, LSError *lserror)
 {
     LSHANDLE_VALIDATE(sh);
 
@@ -1133,7 +1156,7 @@ LSSubscriptionReply(LSHandle *sh, const char *key,
 
         LSMessage *message = subs->message;
 
-        retVal = LSMessageReply(sh, message, payload, lserror);
+        retVal = LSMessageReplyLen(sh, message, payload, payload_len, lserror);
         if (!retVal) goto cleanup;
     }
 cleanup:
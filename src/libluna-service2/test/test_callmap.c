@@ -17,6 +17,7 @@
 * LICENSE@@@ */
 
 
+#include <string.h>
 #include <glib.h>
 #include <luna-service2/lunaservice.h>
 #include <base.h>
@@ -36,6 +37,10 @@ typedef struct TestData
     const char *transport_message_method;
     const char *transport_message_payload;
 
+    // arguments of the last LSTransportSendLen call
+    unsigned long transport_send_payload_len;
+    const char *transport_send_application_id;
+
     int transport_send_called;
     int transport_send_signal_called;
     int transport_cancel_method_call_called;
@@ -459,6 +464,37 @@ test_LSCallFromApplicationOneReply(TestData *fixture, gconstpointer user_data)
     LSErrorFree(&error);
 }
 
+static void
+test_LSCallWithLenEmbeddedNul(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    const char *uri = "palm://com.name.service/method";
+    const char *signal_uri = "palm://com.name.service/activated";
+    // the receiver would take what follows the NUL as the app_id
+    const char payload[] = "{}\0com.some.app";
+    LSFilterFunc callback = test_methodcall_callback;
+    LSMessageToken token = LSMESSAGE_TOKEN_INVALID;
+
+    // case: a JSON payload with a NUL is rejected before it is sent
+    g_assert(!LSCallWithLen(&fixture->sh, uri, payload, sizeof(payload) - 1, callback, NULL, &token, &error));
+    g_assert(!LSCallNoReplyWithLen(&fixture->sh, uri, payload, sizeof(payload) - 1, &error));
+    g_assert(!LSSignalSendNoTypecheckLen(&fixture->sh, signal_uri, payload, sizeof(payload) - 1, &error));
+    g_assert_cmpint(fixture->transport_send_called, ==, 0);
+    g_assert_cmpint(fixture->transport_send_signal_called, ==, 0);
+
+    // case: the same call without the tail goes out with no app_id
+    g_assert(LSCallWithLen(&fixture->sh, uri, payload, strlen(payload), callback, NULL, &token, &error));
+    g_assert_cmpint(fixture->transport_send_called, ==, 1);
+    g_assert_cmpint(fixture->transport_send_payload_len, ==, 2);
+    g_assert(NULL == fixture->transport_send_application_id);
+
+    g_assert(LSCallCancel(&fixture->sh, token, &error));
+
+    LSErrorFree(&error);
+}
+
 static void
 test_LSRegisterServerStatusAndCancel(TestData *fixture, gconstpointer user_data)
 {
@@ -626,13 +662,16 @@ void LSErrorFree(LSError *error)
 // transport.c
 
 bool
-LSTransportSend(_LSTransport *transport, const char *service_name,
-                const char *category, const char *method,
-                const char *payload, const char* applicationId,
-                LSMessageToken *token, LSError *lserror)
+LSTransportSendLen(_LSTransport *transport, const char *service_name,
+                   const char *category, const char *method,
+                   const char *payload, unsigned long payload_len,
+                   const char* applicationId,
+                   LSMessageToken *token, LSError *lserror)
 {
     *token = ++test_data->transport_next_serial;
     ++test_data->transport_send_called;
+    test_data->transport_send_payload_len = payload_len;
+    test_data->transport_send_application_id = applicationId;
     return true;
 }
 
@@ -737,7 +776,8 @@ LSTransportUnregisterSignal(_LSTransport *transport, const char *category, const
 }
 
 bool
-LSTransportSendSignal(_LSTransport *transport, const char *category, const char *method, const char *payload, LSError *lserror)
+LSTransportSendSignalLen(_LSTransport *transport, const char *category, const char *method,
+                         const char *payload, unsigned long payload_len, LSError *lserror)
 {
     ++test_data->transport_send_signal_called;
     return true;
@@ -849,6 +889,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSCallOneReply", test_LSCallOneReply);
     LSTEST_ADD("/luna-service2/LSCallFromApplication", test_LSCallFromApplication);
     LSTEST_ADD("/luna-service2/LSCallFromApplicationOneReply", test_LSCallFromApplicationOneReply);
+    LSTEST_ADD("/luna-service2/LSCallWithLenEmbeddedNul", test_LSCallWithLenEmbeddedNul);
     LSTEST_ADD("/luna-service2/LSRegisterServerStatusAndCancel", test_LSRegisterServerStatusAndCancel);
     LSTEST_ADD("/luna-service2/LSSignalCallAndCancel", test_LSSignalCallAndCancel);
     LSTEST_ADD("/luna-service2/LSSignalSendNoTypecheck", test_LSSignalSendNoTypecheck);
@@ -272,6 +272,21 @@ test_LSMessageReply(TestData *fixture, gconstpointer user_data)
     g_assert(LSMessageReply(fixture->sh, fixture->msg, "{}", &error));
 }
 
+static void
+test_LSMessageReplyLen(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    /* only the given length of the buffer is the payload */
+    g_assert(LSMessageReplyLen(fixture->sh, fixture->msg, "{}{\"a\"", 2, &error));
+
+    /* empty payload */
+    g_assert(!LSMessageReplyLen(fixture->sh, fixture->msg, "{}", 0, &error));
+    g_assert(LSErrorIsSet(&error));
+    LSErrorFree(&error);
+}
+
 static void
 test_LSMessageGetUniqueToken(TestData *fixture, gconstpointer user_data)
 {
@@ -375,7 +390,8 @@ _LSTransportMessageGetType(const _LSTransportMessage *message)
 }
 
 bool
-_LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror)
+_LSTransportSendReplyLen(const _LSTransportMessage *message, const char *payload,
+                         unsigned long payload_len, LSError *lserror)
 {
     return true;
 }
@@ -408,6 +424,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSMessageIsSubscription", test_LSMessageIsSubscription);
     LSTEST_ADD("/luna-service2/LSMessageRespond", test_LSMessageRespond);
     LSTEST_ADD("/luna-service2/LSMessageReply", test_LSMessageReply);
+    LSTEST_ADD("/luna-service2/LSMessageReplyLen", test_LSMessageReplyLen);
     LSTEST_ADD("/luna-service2/LSMessageGetKind", test_LSMessageGetKind);
     LSTEST_ADD("/luna-service2/LSMessageGetUniqueToken", test_LSMessageGetUniqueToken);
 
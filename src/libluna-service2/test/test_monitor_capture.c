@@ -0,0 +1,297 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <transport_message.h>
+#include <transport.h>
+#include "monitor_capture.h"
+
+/* Test data ******************************************************************/
+
+/* enough for two full indexes and a partial one written on close */
+#define TEST_MESSAGE_COUNT      (2 * LS_MONITOR_CAPTURE_INDEX_INTERVAL + 452)
+#define TEST_START_SEC          1000
+
+static const char test_sender_service_name[] = "com.palm.sender";
+static const char test_sender_unique_name[] = "_12345.1";
+
+static struct timespec
+test_message_time(int serial)
+{
+    struct timespec time = { TEST_START_SEC + serial, 0 };
+    return time;
+}
+
+/* Build a monitor copy of a method call the way the transport sends it */
+static _LSTransportMessage*
+test_monitor_message_new(int serial)
+{
+    static const char body[] = "cat\0meth\0{}\0app\0com.palm.dest\0_54321.1";
+
+    _LSMonitorMessageData message_data;
+    message_data.serial = serial;
+    message_data.type = _LSMonitorMessageTypeTx;
+    message_data.timestamp = test_message_time(serial);
+
+    const int orig_msg_size = sizeof(_LSTransportHeader) + sizeof(body);
+    unsigned long padding_bytes = PADDING_BYTES_TYPE(void *, orig_msg_size);
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(sizeof(body) + padding_bytes + sizeof(message_data));
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetToken(message, serial);
+
+    char *data = message->raw->data;
+    memcpy(data, body, sizeof(body));
+    data += sizeof(body);
+    memset(data, 0, padding_bytes);
+    data += padding_bytes;
+    memcpy(data, &message_data, sizeof(message_data));
+
+    return message;
+}
+
+static void
+test_capture_write(const char *path)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSMonitorCapture *capture = _LSMonitorCaptureOpen(path, &lserror);
+    g_assert(capture != NULL);
+
+    int i;
+    for (i = 0; i < TEST_MESSAGE_COUNT; i++)
+    {
+        _LSTransportMessage *message = test_monitor_message_new(i);
+        g_assert(_LSMonitorCaptureWrite(capture, message, i % 2));
+        _LSTransportMessageUnref(message);
+    }
+
+    g_assert(_LSMonitorCaptureClose(capture));
+}
+
+static void
+test_capture_assert_entry(const _LSMonitorCaptureEntry *entry, int serial)
+{
+    g_assert_cmpstr(entry->sender_service_name, ==, test_sender_service_name);
+    g_assert_cmpstr(entry->sender_unique_name, ==, test_sender_unique_name);
+    g_assert(entry->public_bus == (serial % 2));
+
+    _LSTransportMessage *message = _LSMonitorCaptureEntryMessageNewRef(entry);
+    const _LSMonitorMessageData *message_data = _LSTransportMessageGetMonitorMessageData(message);
+
+    g_assert_cmpint(_LSTransportMessageGetType(message), ==, _LSTransportMessageTypeMethodCall);
+    g_assert_cmpint(_LSTransportMessageGetToken(message), ==, serial);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(message), ==, "cat");
+    g_assert_cmpstr(_LSTransportMessageGetMethod(message), ==, "meth");
+    g_assert_cmpstr(_LSTransportMessageGetDestServiceName(message), ==, "com.palm.dest");
+    g_assert(message_data != NULL);
+    g_assert_cmpint(message_data->serial, ==, serial);
+    g_assert_cmpint(message_data->timestamp.tv_sec, ==, TEST_START_SEC + serial);
+
+    _LSTransportMessageUnref(message);
+}
+
+/* Seek to the time of a message and check where the reader ends up */
+static void
+test_capture_assert_seek(_LSMonitorCaptureReader *reader, int serial, int expected_serial)
+{
+    struct timespec time = test_message_time(serial);
+    _LSMonitorCaptureEntry entry;
+
+    g_assert(_LSMonitorCaptureReaderSeek(reader, &time));
+    g_assert(_LSMonitorCaptureReaderNext(reader, &entry));
+    test_capture_assert_entry(&entry, expected_serial);
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSMonitorCaptureRoundTrip(void)
+{
+    gchar path[] = "ut_monitor_capture_XXXXXX";
+    int fd = g_mkstemp(path);
+    g_assert(fd != -1);
+    close(fd);
+
+    test_capture_write(path);
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSMonitorCaptureReader *reader = _LSMonitorCaptureReaderOpen(path, &lserror);
+    g_assert(reader != NULL);
+
+    const _LSMonitorCaptureFileHeader *header = _LSMonitorCaptureReaderGetHeader(reader);
+    g_assert(memcmp(header->magic, LS_MONITOR_CAPTURE_MAGIC, sizeof(header->magic)) == 0);
+    g_assert_cmpint(header->version, ==, LS_MONITOR_CAPTURE_VERSION);
+    g_assert_cmpint(header->header_size, ==, sizeof(_LSTransportHeader));
+
+    // every message comes back in order, the indexes and trailer are skipped
+    _LSMonitorCaptureEntry entry;
+    int count = 0;
+    while (_LSMonitorCaptureReaderNext(reader, &entry))
+    {
+        test_capture_assert_entry(&entry, count);
+        count++;
+    }
+    g_assert_cmpint(count, ==, TEST_MESSAGE_COUNT);
+
+    // first message, inside an index, after the last full index
+    test_capture_assert_seek(reader, 0, 0);
+    test_capture_assert_seek(reader, 1500, 1500);
+    test_capture_assert_seek(reader, LS_MONITOR_CAPTURE_INDEX_INTERVAL, LS_MONITOR_CAPTURE_INDEX_INTERVAL);
+    test_capture_assert_seek(reader, TEST_MESSAGE_COUNT - 1, TEST_MESSAGE_COUNT - 1);
+
+    // nothing at or after the time
+    struct timespec time = test_message_time(TEST_MESSAGE_COUNT);
+    g_assert(!_LSMonitorCaptureReaderSeek(reader, &time));
+    g_assert(!_LSMonitorCaptureReaderNext(reader, &entry));
+
+    _LSMonitorCaptureReaderClose(reader);
+
+    unlink(path);
+}
+
+static void
+test_LSMonitorCaptureTruncated(void)
+{
+    gchar path[] = "ut_monitor_capture_XXXXXX";
+    int fd = g_mkstemp(path);
+    g_assert(fd != -1);
+    close(fd);
+
+    test_capture_write(path);
+
+    // cut the trailer off and the end of the last index with it, as if the
+    // monitor died while writing it
+    gchar *contents = NULL;
+    gsize length = 0;
+    g_assert(g_file_get_contents(path, &contents, &length, NULL));
+    g_assert(length > sizeof(_LSMonitorCaptureTrailer) + 8);
+    g_assert(g_file_set_contents(path, contents, length - sizeof(_LSMonitorCaptureTrailer) - 8, NULL));
+    g_free(contents);
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSMonitorCaptureReader *reader = _LSMonitorCaptureReaderOpen(path, &lserror);
+    g_assert(reader != NULL);
+
+    // every message is still there
+    _LSMonitorCaptureEntry entry;
+    int count = 0;
+    while (_LSMonitorCaptureReaderNext(reader, &entry))
+    {
+        test_capture_assert_entry(&entry, count);
+        count++;
+    }
+    g_assert_cmpint(count, ==, TEST_MESSAGE_COUNT);
+
+    // the complete indexes are found by scanning from the start
+    test_capture_assert_seek(reader, 0, 0);
+    test_capture_assert_seek(reader, 1500, 1500);
+
+    // past them the reader stops at the first message nobody indexed
+    test_capture_assert_seek(reader, TEST_MESSAGE_COUNT - 1, 2 * LS_MONITOR_CAPTURE_INDEX_INTERVAL);
+
+    count = 1;
+    while (_LSMonitorCaptureReaderNext(reader, &entry))
+    {
+        count++;
+    }
+    g_assert_cmpint(count, ==, TEST_MESSAGE_COUNT - 2 * LS_MONITOR_CAPTURE_INDEX_INTERVAL);
+
+    _LSMonitorCaptureReaderClose(reader);
+
+    unlink(path);
+}
+
+static void
+test_LSMonitorCaptureIndexLoop(void)
+{
+    gchar path[] = "ut_monitor_capture_XXXXXX";
+    int fd = g_mkstemp(path);
+    g_assert(fd != -1);
+    close(fd);
+
+    test_capture_write(path);
+
+    // point the last index back at itself
+    gchar *contents = NULL;
+    gsize length = 0;
+    g_assert(g_file_get_contents(path, &contents, &length, NULL));
+    g_assert(length > sizeof(_LSMonitorCaptureTrailer));
+
+    const _LSMonitorCaptureTrailer *trailer =
+        (const _LSMonitorCaptureTrailer*)(contents + length - sizeof(_LSMonitorCaptureTrailer));
+    uint64_t last_index = trailer->last_index;
+    g_assert(last_index != 0 && last_index + sizeof(_LSMonitorCaptureIndex) <= length);
+
+    _LSMonitorCaptureIndex *index = (_LSMonitorCaptureIndex*)(contents + last_index);
+    index->prev = last_index;
+
+    g_assert(g_file_set_contents(path, contents, length, NULL));
+    g_free(contents);
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSMonitorCaptureReader *reader = _LSMonitorCaptureReaderOpen(path, &lserror);
+    g_assert(reader != NULL);
+
+    // the walk back stops at the bad link instead of going round forever
+    test_capture_assert_seek(reader, 0, 2 * LS_MONITOR_CAPTURE_INDEX_INTERVAL);
+
+    _LSMonitorCaptureReaderClose(reader);
+
+    unlink(path);
+}
+
+/* Mocks **********************************************************************/
+
+/* The copies are written with the names of the client that sent them */
+const char*
+_LSTransportClientGetServiceName(const _LSTransportClient *client)
+{
+    return test_sender_service_name;
+}
+
+const char*
+_LSTransportClientGetUniqueName(const _LSTransportClient *client)
+{
+    return test_sender_unique_name;
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSMonitorCaptureRoundTrip", test_LSMonitorCaptureRoundTrip);
+    g_test_add_func("/luna-service2/LSMonitorCaptureTruncated", test_LSMonitorCaptureTruncated);
+    g_test_add_func("/luna-service2/LSMonitorCaptureIndexLoop", test_LSMonitorCaptureIndexLoop);
+
+    return g_test_run();
+}
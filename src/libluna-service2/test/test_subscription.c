@@ -439,12 +439,12 @@ LSCall(LSHandle *sh, const char *uri, const char *payload,
 }
 
 bool
-LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
-                LSError *lserror)
+LSMessageReplyLen(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                  size_t replyPayloadLen, LSError *lserror)
 {
     ++test_data->lsmessagereply_call_count;
     g_free(test_data->lsmessagereply_payload);
-    test_data->lsmessagereply_payload = g_strdup(replyPayload);
+    test_data->lsmessagereply_payload = g_strndup(replyPayload, replyPayloadLen);
     return true;
 }
 
@@ -26,6 +26,7 @@
 
 /* Not in transport.h */
 gboolean _LSTransportSendClient(GIOChannel *source, GIOCondition condition, gpointer data);
+LSMessageToken _LSTransportGetNextToken(_LSTransport *transport);
 
 int calls_to_disconnect;
 int calls_to_shmdeinit;
@@ -389,9 +390,7 @@ _LSTransportOutgoingNew()
 {
     _LSTransportOutgoing* outgoing = g_slice_new0(_LSTransportOutgoing);
     outgoing->queue = g_queue_new();
-    outgoing->serial = g_slice_new0(_LSTransportSerial);
-    outgoing->serial->queue = g_queue_new();
-    outgoing->serial->map = g_hash_table_new_full(g_int_hash, g_int_equal, NULL, (GDestroyNotify)_LSTransportSerialMapEntryFree);
+    outgoing->serial = _LSTransportSerialNew();
 
     return outgoing;
 }
@@ -725,7 +724,7 @@ test_LSTransportSendMessageMonitorRequest()
     /* Test it. */
     /* Message stays at ref==unref+1 because it is pushed in queue and _LSTransportMessageUnref is called when
        the message is sent. */
-    LSTransportSendMessageMonitorRequest(transport, &error);
+    LSTransportSendMessageMonitorRequest(transport, false, NULL, &error);
     g_assert_cmpint(calls_to_messagesettype, ==, 1);
     g_assert_cmpint(calls_to_messageunref, ==, calls_to_messageref + calls_to_messagenewref - 1);
 
@@ -1007,6 +1006,134 @@ test_LSTransportSendClient()
     sendfd_success = true;
 }
 
+void
+test_LSTransportClientSwitchVersion()
+{
+    clear_counters();
+
+    _LSTransportMessageType typelist[1] = { _LSTransportMessageTypeMethodCall };
+    expected_message_types = typelist;
+    expected_calls_to_messagesettype = 1;
+
+    _LSTransportClient *client = g_slice_new0(_LSTransportClient);
+    client->ref = 1;
+    client->outgoing = g_slice_new0(_LSTransportOutgoing);
+    client->outgoing->queue = g_queue_new();
+    pthread_mutex_init(&client->outgoing->lock, NULL);
+
+    _LSTransportMessage *no_reply = _LSTransportMessageNewRef(20);
+    no_reply->raw->header.type = _LSTransportMessageTypeMethodCallNoReply;
+    no_reply->tx_bytes_remaining = _LSTransportMessageGetTxSize(no_reply);
+    g_queue_push_tail(client->outgoing->queue, no_reply);
+
+    _LSTransportMessage *signal = _LSTransportMessageNewRef(20);
+    signal->raw->header.type = _LSTransportMessageTypeSignal;
+    signal->tx_bytes_remaining = _LSTransportMessageGetTxSize(signal);
+    g_queue_push_tail(client->outgoing->queue, signal);
+
+    /* case: a version 1 peer would drop a no-reply call, so it gets a plain one */
+    _LSTransportClientSwitchVersion(client, NULL, 1);
+
+    g_assert_cmpint(calls_to_messagesettype, ==, 1);
+    g_assert_cmpint(_LSTransportMessageGetType(no_reply), ==, _LSTransportMessageTypeMethodCall);
+    g_assert_cmpint(_LSTransportMessageGetType(signal), ==, _LSTransportMessageTypeSignal);
+
+    while (!g_queue_is_empty(client->outgoing->queue))
+    {
+        _LSTransportMessageUnref(g_queue_pop_head(client->outgoing->queue));
+    }
+    pthread_mutex_destroy(&client->outgoing->lock);
+    g_queue_free(client->outgoing->queue);
+    g_slice_free(_LSTransportOutgoing, client->outgoing);
+    g_slice_free(_LSTransportClient, client);
+}
+
+#define TOKEN_THREADS            4
+#define TOKENS_PER_THREAD        10000
+
+typedef struct TokenThreadData {
+    _LSTransport *transport;
+    LSMessageToken tokens[TOKENS_PER_THREAD];
+} TokenThreadData;
+
+static void*
+token_thread(void *arg)
+{
+    TokenThreadData *data = arg;
+    int i;
+
+    for (i = 0; i < TOKENS_PER_THREAD; i++)
+    {
+        data->tokens[i] = _LSTransportGetNextToken(data->transport);
+    }
+
+    return NULL;
+}
+
+void
+test_LSTransportGetNextToken()
+{
+    _LSTransport *transport = g_new0(_LSTransport, 1);
+    transport->global_token = g_new0(_LSTransportGlobalToken, 1);
+    transport->global_token->value = LSMESSAGE_TOKEN_INVALID;
+
+    /* case: tokens taken concurrently are unique */
+    TokenThreadData *data = g_new0(TokenThreadData, TOKEN_THREADS);
+    pthread_t threads[TOKEN_THREADS];
+    int i, j;
+
+    for (i = 0; i < TOKEN_THREADS; i++)
+    {
+        data[i].transport = transport;
+        g_assert_cmpint(pthread_create(&threads[i], NULL, token_thread, &data[i]), ==, 0);
+    }
+
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < TOKEN_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        for (j = 0; j < TOKENS_PER_THREAD; j++)
+        {
+            g_assert(data[i].tokens[j] != LSMESSAGE_TOKEN_INVALID);
+            g_assert(!g_hash_table_lookup(seen, GSIZE_TO_POINTER(data[i].tokens[j])));
+            g_hash_table_insert(seen, GSIZE_TO_POINTER(data[i].tokens[j]), GINT_TO_POINTER(1));
+        }
+    }
+    g_assert_cmpuint(g_hash_table_size(seen), ==, TOKEN_THREADS * TOKENS_PER_THREAD);
+
+    /* case: the invalid token is skipped when the counter wraps */
+    transport->global_token->value = (LSMessageToken)-2;
+    g_assert(_LSTransportGetNextToken(transport) == (LSMessageToken)-1);
+    g_assert(_LSTransportGetNextToken(transport) == LSMESSAGE_TOKEN_INVALID + 1);
+    g_assert(transport->global_token->value == LSMESSAGE_TOKEN_INVALID + 1);
+
+    /* case: threads racing over the wrap never get the invalid token */
+    transport->global_token->value = (LSMessageToken)-(TOKEN_THREADS * TOKENS_PER_THREAD / 2);
+    g_hash_table_remove_all(seen);
+
+    for (i = 0; i < TOKEN_THREADS; i++)
+    {
+        g_assert_cmpint(pthread_create(&threads[i], NULL, token_thread, &data[i]), ==, 0);
+    }
+
+    for (i = 0; i < TOKEN_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        for (j = 0; j < TOKENS_PER_THREAD; j++)
+        {
+            g_assert(data[i].tokens[j] != LSMESSAGE_TOKEN_INVALID);
+            g_assert(!g_hash_table_lookup(seen, GSIZE_TO_POINTER(data[i].tokens[j])));
+            g_hash_table_insert(seen, GSIZE_TO_POINTER(data[i].tokens[j]), GINT_TO_POINTER(1));
+        }
+    }
+    g_assert_cmpuint(g_hash_table_size(seen), ==, TOKEN_THREADS * TOKENS_PER_THREAD);
+
+    g_hash_table_destroy(seen);
+    g_free(data);
+    g_free(transport->global_token);
+    g_free(transport);
+}
+
 /* Test suite **************************************************************/
 
 int
@@ -1021,6 +1148,8 @@ main(int argc, char *argv[])
     g_test_add_func("/luna-service2/LSTransportCancelMethodCall", test_LSTransportCancelMethodCall);
     g_test_add_func("/luna-service2/LSTransportSendQueryServiceStatus", test_LSTransportSendQueryServiceStatus);
     g_test_add_func("/luna-service2/LSTransportSendClient", test_LSTransportSendClient);
+    g_test_add_func("/luna-service2/LSTransportClientSwitchVersion", test_LSTransportClientSwitchVersion);
+    g_test_add_func("/luna-service2/LSTransportGetNextToken", test_LSTransportGetNextToken);
 
     return g_test_run();
 }
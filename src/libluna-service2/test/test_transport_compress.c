@@ -0,0 +1,184 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "transport_compress.h"
+#include "transport_message.h"
+
+/* Test data ******************************************************************/
+
+static char*
+json_payload(int entries)
+{
+    GString *str = g_string_new("{\"entries\":[");
+    int i;
+
+    for (i = 0; i < entries; i++)
+    {
+        g_string_append_printf(str, "%s{\"id\":%d,\"name\":\"entry\",\"enabled\":true}", i ? "," : "", i);
+    }
+    g_string_append(str, "]}");
+
+    return g_string_free(str, FALSE);
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportCompressRoundTrip(void)
+{
+    char *payload = json_payload(100);
+    unsigned long len = strlen(payload);
+    unsigned long compressed_len = 0;
+
+    char *compressed = _LSTransportCompress(payload, len, &compressed_len);
+    g_assert(compressed != NULL);
+    g_assert_cmpuint(compressed_len, <, len);
+    g_assert_cmpint(compressed[compressed_len], ==, '\0');
+    g_assert_cmpuint(_LSTransportCompressGetPlainSize(compressed, compressed_len), ==, len);
+
+    char *plain = _LSTransportDecompress(compressed, compressed_len);
+    g_assert_cmpstr(plain, ==, payload);
+
+    g_free(plain);
+    g_free(compressed);
+    g_free(payload);
+}
+
+static void
+test_LSTransportCompressIncompressible(void)
+{
+    unsigned long compressed_len = 0;
+    char data[256];
+    int i;
+
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (char)g_random_int();
+    }
+
+    /* case: nothing to gain */
+    g_assert(_LSTransportCompress(data, sizeof(data), &compressed_len) == NULL);
+    g_assert(_LSTransportCompress("{}", 2, &compressed_len) == NULL);
+
+    /* case: empty payload */
+    g_assert(_LSTransportCompress("", 0, &compressed_len) == NULL);
+}
+
+static void
+test_LSTransportDecompressCorrupt(void)
+{
+    char *payload = json_payload(100);
+    unsigned long len = strlen(payload);
+    unsigned long compressed_len = 0;
+
+    char *compressed = _LSTransportCompress(payload, len, &compressed_len);
+    g_assert(compressed != NULL);
+
+    /* case: too short for the size prefix */
+    g_assert_cmpuint(_LSTransportCompressGetPlainSize(compressed, 2), ==, 0);
+    g_assert(_LSTransportDecompress(compressed, 2) == NULL);
+
+    /* case: truncated block */
+    g_assert(_LSTransportDecompress(compressed, compressed_len / 2) == NULL);
+
+    /* case: the size prefix doesn't match the block */
+    uint32_t wrong_len = len + 1;
+    memcpy(compressed, &wrong_len, sizeof(wrong_len));
+    g_assert(_LSTransportDecompress(compressed, compressed_len) == NULL);
+
+    /* case: absurd size */
+    wrong_len = G_MAXUINT32;
+    memcpy(compressed, &wrong_len, sizeof(wrong_len));
+    g_assert(_LSTransportDecompress(compressed, compressed_len) == NULL);
+
+    g_free(compressed);
+    g_free(payload);
+}
+
+static void
+test_LSTransportMessageCompressedPayload(void)
+{
+    char *payload = json_payload(100);
+    unsigned long len = strlen(payload);
+    unsigned long compressed_len = 0;
+
+    char *compressed = _LSTransportCompress(payload, len, &compressed_len);
+    g_assert(compressed != NULL);
+
+    /* method call body: category, method, payload, app id */
+    unsigned long body_size = 4 + 5 + compressed_len + 1 + 4;
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(body_size);
+    char *body = _LSTransportMessageGetBody(msg);
+
+    memcpy(body, "cat\0meth\0", 9);
+    memcpy(body + 9, compressed, compressed_len + 1);
+    memcpy(body + 9 + compressed_len + 1, "app\0", 4);
+
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_JSON, 0);
+    _LSTransportMessageSetPayloadCompressed(msg, compressed_len);
+
+    /* case: the payload comes out decompressed, and only once */
+    const char *plain = _LSTransportMessageGetPayload(msg);
+    g_assert_cmpstr(plain, ==, payload);
+    g_assert(_LSTransportMessageGetPayload(msg) == plain);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(msg), ==, "meth");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(msg), ==, "app");
+
+    unsigned long plain_len = 0;
+    g_assert(_LSTransportMessageGetPayloadBinary(msg, &plain_len) == plain);
+    g_assert_cmpuint(plain_len, ==, len);
+
+    /* case: the decompressed copy has the payload inline */
+    _LSTransportMessage *copy = _LSTransportMessageDecompressNewRef(msg);
+    g_assert(!copy->payload_compressed);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(copy), ==, payload);
+    g_assert_cmpstr(_LSTransportMessageGetAppId(copy), ==, "app");
+    g_assert_cmpuint(_LSTransportMessageGetBodySize(copy), ==, 4 + 5 + len + 1 + 4);
+    _LSTransportMessageUnref(copy);
+
+    /* case: a corrupt payload isn't handed out */
+    uint32_t wrong_len = len + 1;
+    memcpy(body + 9, &wrong_len, sizeof(wrong_len));
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_JSON, 0);
+    _LSTransportMessageSetPayloadCompressed(msg, compressed_len);
+    g_assert(_LSTransportMessageGetPayload(msg) == NULL);
+
+    _LSTransportMessageUnref(msg);
+    g_free(compressed);
+    g_free(payload);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSTransportCompressRoundTrip", test_LSTransportCompressRoundTrip);
+    g_test_add_func("/luna-service2/LSTransportCompressIncompressible", test_LSTransportCompressIncompressible);
+    g_test_add_func("/luna-service2/LSTransportDecompressCorrupt", test_LSTransportDecompressCorrupt);
+    g_test_add_func("/luna-service2/LSTransportMessageCompressedPayload", test_LSTransportMessageCompressedPayload);
+
+    return g_test_run();
+}
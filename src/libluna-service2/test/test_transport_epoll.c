@@ -0,0 +1,198 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include "transport.h"
+#include "transport_priv.h"
+#include "transport_epoll.h"
+
+/* Test data ******************************************************************/
+
+typedef struct TestData {
+    GMainContext *context;
+    _LSTransportEpoll *epoll;
+    int fds[2];
+    _LSTransportChannel channel;    /**< watches fds[0] */
+    int calls;
+    GIOCondition condition;
+    gboolean keep;                  /**< return value of the callback */
+    int destroyed;
+} TestData;
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    fixture->context = g_main_context_new();
+    fixture->epoll = _LSTransportEpollNew(fixture->context, G_PRIORITY_DEFAULT, &lserror);
+    g_assert(NULL != fixture->epoll);
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fixture->fds), ==, 0);
+    g_assert(_LSTransportChannelInit(NULL, &fixture->channel, fixture->fds[0], G_PRIORITY_DEFAULT));
+
+    fixture->keep = TRUE;
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportEpollRemoveWatch(&fixture->channel, G_IO_IN);
+    _LSTransportEpollRemoveWatch(&fixture->channel, G_IO_OUT);
+    _LSTransportChannelClose(&fixture->channel, false);
+    _LSTransportChannelDeinit(&fixture->channel);
+    close(fixture->fds[1]);
+
+    _LSTransportEpollFree(fixture->epoll);
+    g_main_context_unref(fixture->context);
+}
+
+static gboolean
+watch_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    TestData *fixture = data;
+
+    fixture->calls++;
+    fixture->condition = condition;
+
+    return fixture->keep;
+}
+
+static void
+watch_destroy(gpointer data)
+{
+    TestData *fixture = data;
+
+    fixture->destroyed++;
+}
+
+static void
+iterate(TestData *fixture)
+{
+    while (g_main_context_iteration(fixture->context, FALSE))
+    {
+    }
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportEpollReceive(TestData *fixture, gconstpointer user_data)
+{
+    char c = 'x';
+
+    g_assert(_LSTransportEpollAddWatch(fixture->epoll, &fixture->channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                       watch_cb, fixture, watch_destroy));
+    g_assert(_LSTransportEpollOwnsWatch(&fixture->channel, _LSTransportEpollGetSource(fixture->epoll)));
+
+    /* case: nothing to read */
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 0);
+
+    /* case: level-triggered, so unread data is reported again */
+    g_assert_cmpint(write(fixture->fds[1], &c, 1), ==, 1);
+    g_assert(g_main_context_iteration(fixture->context, FALSE));
+    g_assert_cmpint(fixture->calls, ==, 1);
+    g_assert(fixture->condition & G_IO_IN);
+    g_assert(g_main_context_iteration(fixture->context, FALSE));
+    g_assert_cmpint(fixture->calls, ==, 2);
+
+    g_assert_cmpint(read(fixture->channel.fd, &c, 1), ==, 1);
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 2);
+
+    /* case: removing the watch runs the destroy notification once */
+    _LSTransportEpollRemoveWatch(&fixture->channel, G_IO_IN);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+    _LSTransportEpollRemoveWatch(&fixture->channel, G_IO_IN);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+
+    g_assert_cmpint(write(fixture->fds[1], &c, 1), ==, 1);
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 2);
+}
+
+static void
+test_LSTransportEpollSend(TestData *fixture, gconstpointer user_data)
+{
+    g_assert(_LSTransportEpollAddWatch(fixture->epoll, &fixture->channel, G_IO_OUT,
+                                       watch_cb, fixture, watch_destroy));
+
+    /* case: writable socket */
+    g_assert(g_main_context_iteration(fixture->context, FALSE));
+    g_assert_cmpint(fixture->calls, ==, 1);
+    g_assert_cmpint(fixture->condition, ==, G_IO_OUT);
+
+    /* case: returning false unsets the watch */
+    fixture->keep = FALSE;
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 2);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 2);
+
+    /* case: the watch can be set again */
+    fixture->keep = TRUE;
+    g_assert(_LSTransportEpollAddWatch(fixture->epoll, &fixture->channel, G_IO_OUT,
+                                       watch_cb, fixture, watch_destroy));
+    g_assert(g_main_context_iteration(fixture->context, FALSE));
+    g_assert_cmpint(fixture->calls, ==, 3);
+}
+
+static void
+test_LSTransportEpollDetach(TestData *fixture, gconstpointer user_data)
+{
+    char c = 'x';
+
+    g_assert(_LSTransportEpollAddWatch(fixture->epoll, &fixture->channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                       watch_cb, fixture, watch_destroy));
+    g_assert_cmpint(write(fixture->fds[1], &c, 1), ==, 1);
+
+    /* case: a closed channel isn't watched, but the watch stays until removed */
+    _LSTransportChannelClose(&fixture->channel, false);
+    iterate(fixture);
+    g_assert_cmpint(fixture->calls, ==, 0);
+    g_assert_cmpint(fixture->destroyed, ==, 0);
+
+    _LSTransportEpollRemoveWatch(&fixture->channel, G_IO_IN);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+
+    /* case: no new watches on a closed channel */
+    g_assert(!_LSTransportEpollAddWatch(fixture->epoll, &fixture->channel, G_IO_OUT,
+                                        watch_cb, fixture, watch_destroy));
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/luna-service2/LSTransportEpollReceive", TestData, NULL, test_setup, test_LSTransportEpollReceive, test_teardown);
+    g_test_add("/luna-service2/LSTransportEpollSend", TestData, NULL, test_setup, test_LSTransportEpollSend, test_teardown);
+    g_test_add("/luna-service2/LSTransportEpollDetach", TestData, NULL, test_setup, test_LSTransportEpollDetach, test_teardown);
+
+    return g_test_run();
+}
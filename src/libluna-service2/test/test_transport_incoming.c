@@ -32,6 +32,10 @@ test_LSTransportIncoming_execute(int number_of_messages)
     g_assert(NULL != inqueue);
     g_assert(NULL != inqueue->complete_messages);
 
+    /* Receive buffer is allocated on first read; no fd pending. */
+    g_assert(NULL == inqueue->rx_buf);
+    g_assert_cmpint(inqueue->rx_fd, ==, -1);
+
     /* The mutex should be initialized. */
     g_assert_cmpint(pthread_mutex_trylock(&inqueue->lock), !=, EINVAL);
     pthread_mutex_unlock(&inqueue->lock);
@@ -22,6 +22,7 @@
 #include <locale.h>
 #include <glib.h>
 #include <transport_message.h>
+#include <transport_message_pool.h>
 #include <transport.h>
 #include <clock.h>
 
@@ -31,6 +32,7 @@
 #define _LST_DIRECTION_ALIGN    25
 #define _LST_DATA_ALIGN         49
 char const* ServiceNameCompactCopy(const char *service_name, char buffer[], size_t buffer_size );
+_LSTransportMessage* _LSTransportMessageBodyExpand(_LSTransportMessage *message, unsigned long bytes_needed);
 int LSTransportMessagePrintCompactHeaderCommon(const char *caller_service_name, const char *callee_service_name, const char *directions, const char *appId, const char *category, const char *method, LSMessageToken messageToken, FILE *file);
 
 typedef struct TestData
@@ -135,6 +137,117 @@ test_LSTransportMessageNewRef(void)
     _LSTransportMessageUnref(msg);
 }
 
+static void
+test_LSTransportMessageShareNewRef(void)
+{
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(10);
+    _LSTransportMessage *shared = _LSTransportMessageShareNewRef(msg);
+
+    // the raw buffer is shared and keeps the original alive
+    g_assert(shared->raw == msg->raw);
+    g_assert(shared->raw_owner == msg);
+    g_assert_cmpint(msg->ref, ==, 2);
+    g_assert_cmpint(shared->ref, ==, 1);
+    g_assert_cmpint(shared->connection_fd, ==, -1);
+
+    // sharing a shared message refs the original owner
+    _LSTransportMessage *shared2 = _LSTransportMessageShareNewRef(shared);
+    g_assert(shared2->raw_owner == msg);
+    g_assert_cmpint(msg->ref, ==, 3);
+
+    _LSTransportMessageUnref(msg);
+    _LSTransportMessageUnref(shared);
+    g_assert_cmpint(msg->ref, ==, 1);
+    g_assert_cmpint(shared2->raw->header.len, ==, 10);
+    _LSTransportMessageUnref(shared2);
+}
+
+#ifndef LS_NO_MESSAGE_POOL
+static void
+test_LSTransportMessagePool(void)
+{
+    _LSTransportMessagePoolStats before, after;
+
+    // freed raw buffers are recycled within their size class
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(100);
+    g_assert_cmpint(msg->raw_pool_class, !=, LS_TRANSPORT_POOL_CLASS_NONE);
+    _LSTransportMessageRaw *raw = msg->raw;
+    _LSTransportMessageUnref(msg);
+
+    _LSTransportMessagePoolGetStats(&before);
+    g_assert_cmpint(before.bytes_retained, >, 0);
+
+    msg = _LSTransportMessageNewRef(120);
+    _LSTransportMessagePoolGetStats(&after);
+    g_assert(msg->raw == raw);
+    g_assert_cmpint(after.hits, ==, before.hits + 2); // message struct and raw buffer
+    g_assert_cmpint(after.misses, ==, before.misses);
+    g_assert_cmpint(msg->alloc_body_size, ==, 120);
+    g_assert_cmpint(msg->raw->header.len, ==, 120);
+    _LSTransportMessageUnref(msg);
+
+    // expanding the body moves it to the next class that fits
+    msg = _LSTransportMessageNewRef(1);
+    int pool_class = msg->raw_pool_class;
+    _LSTransportMessageSetBody(msg, "a", 1);
+    g_assert(_LSTransportMessageBodyExpand(msg, 1000) == msg);
+    g_assert_cmpint(msg->raw_pool_class, >, pool_class);
+    g_assert_cmpint(_LSTransportMessageGetBodySize(msg), ==, 1001);
+    g_assert_cmpint(msg->alloc_body_size, ==, _LSTransportMessagePoolGetClassBodySize(msg->raw_pool_class));
+    g_assert(_LSTransportMessageGetBody(msg)[0] == 'a');
+    _LSTransportMessageUnref(msg);
+
+    // messages too big for the pool get their own allocation
+    msg = _LSTransportMessageNewRef(32 * 1024);
+    g_assert_cmpint(msg->raw_pool_class, ==, LS_TRANSPORT_POOL_CLASS_NONE);
+    _LSTransportMessageUnref(msg);
+}
+#endif
+
+static void
+test_LSTransportMessagePayloadFd(void)
+{
+    const char payload[] = "{\"big\":true}";
+
+    int fd = _LSTransportMessagePayloadFdNew(payload, sizeof(payload));
+    if (fd == -1)
+    {
+        // kernel without memfd support; payloads are sent inline
+        return;
+    }
+
+    unsigned long payload_len = sizeof(payload);
+    _LSTransportMessage *fd_msg = _LSTransportMessageNewRef(sizeof(payload_len));
+    _LSTransportMessageSetType(fd_msg, _LSTransportMessageTypePayloadFd);
+    _LSTransportMessageSetBody(fd_msg, &payload_len, sizeof(payload_len));
+    _LSTransportMessageSetConnectionFd(fd_msg, fd);
+    g_assert(_LSTransportMessageIsConnectionFdType(fd_msg));
+
+    // the message itself carries an empty payload
+    LSMessageToken token = 1;
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(sizeof(token) + 1);
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeReply);
+    memcpy(_LSTransportMessageGetBody(msg), &token, sizeof(token));
+    _LSTransportMessageGetBody(msg)[sizeof(token)] = '\0';
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, "");
+
+    g_assert(_LSTransportMessageAttachPayload(msg, fd_msg));
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, payload);
+    g_assert_cmpint(msg->payload_map_size, ==, sizeof(payload));
+
+    // payload has to fit in the memfd
+    payload_len = sizeof(payload) + 4096;
+    _LSTransportMessageSetBody(fd_msg, &payload_len, sizeof(payload_len));
+    _LSTransportMessage *msg2 = _LSTransportMessageNewRef(sizeof(token) + 1);
+    _LSTransportMessageSetType(msg2, _LSTransportMessageTypeReply);
+    g_assert(!_LSTransportMessageAttachPayload(msg2, fd_msg));
+    g_assert(msg2->payload_map == NULL);
+
+    _LSTransportMessageUnref(msg2);
+    _LSTransportMessageUnref(msg);
+    _LSTransportMessageUnref(fd_msg);
+}
+
 static void
 test_LSTransportMessageEmpty(void)
 {
@@ -278,11 +391,217 @@ test_LSTransportMessageMiscGetSet(TestData *fixture, gconstpointer user_data)
     _LSTransportMessageSetConnectState(fixture->msg, _LSTransportConnectStateOtherFailure);
     g_assert_cmpint(_LSTransportMessageGetConnectState(fixture->msg), ==, _LSTransportConnectStateOtherFailure);
 
-    // get/set app id
-    _LSTransportMessageSetAppId(fixture->msg, "new_app_id");
+    // get app id
+    const char method_call[] = "a\0b\0{}\0new_app_id";
+    _LSTransportMessageSetType(fixture->msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetPayloadType(fixture->msg, LS_PAYLOAD_TYPE_JSON, 0);
+    _LSTransportMessageSetBody(fixture->msg, method_call, sizeof(method_call));
     g_assert_cmpstr(_LSTransportMessageGetAppId(fixture->msg), ==, "new_app_id");
 }
 
+static void
+test_LSTransportMessageFields(TestData *fixture, gconstpointer user_data)
+{
+    const char method_call[] = "cat\0meth\0{\"a\":1}\0app";
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(sizeof(method_call));
+
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetBody(msg, method_call, sizeof(method_call));
+
+    // offsets are found once and point into the body
+    _LSTransportMessageParseFields(msg);
+    g_assert(msg->fields.parsed);
+    g_assert_cmpint(msg->fields.category, ==, 0);
+    g_assert_cmpint(msg->fields.method, ==, 4);
+    g_assert_cmpint(msg->fields.payload, ==, 9);
+    g_assert_cmpint(msg->fields.app_id, ==, 17);
+    g_assert_cmpint(msg->fields.trailer, ==, sizeof(method_call));
+
+    g_assert_cmpstr(_LSTransportMessageGetCategory(msg), ==, "cat");
+    g_assert_cmpstr(_LSTransportMessageGetMethod(msg), ==, "meth");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, "{\"a\":1}");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(msg), ==, "app");
+
+    // the copy keeps the offsets
+    _LSTransportMessage *copy = _LSTransportMessageCopyNewRef(msg);
+    g_assert(copy->fields.parsed);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(copy), ==, "{\"a\":1}");
+    _LSTransportMessageUnref(copy);
+
+    // changing the type drops the offsets
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeSignal);
+    g_assert(!msg->fields.parsed);
+    g_assert(_LSTransportMessageGetAppId(msg) == NULL);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, "{\"a\":1}");
+
+    // the getters leave a message that other threads may read alone
+    g_assert(!msg->fields.parsed);
+
+    // a field running past the end of the body is never returned
+    const char truncated[] = { 'c', 'a', 't', '\0', 'm', 'e', 't', 'h' };
+    _LSTransportMessageSetBody(msg, truncated, sizeof(truncated));
+    _LSTransportMessageGetHeader(msg)->len = sizeof(truncated);
+    _LSTransportMessageParseFields(msg);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(msg), ==, "cat");
+    g_assert(_LSTransportMessageGetMethod(msg) == NULL);
+    g_assert(_LSTransportMessageGetPayload(msg) == NULL);
+
+    _LSTransportMessageUnref(msg);
+}
+
+static void
+test_LSTransportMessageBinaryPayload(void)
+{
+    const char method_call[] = "cat\0meth\0\x01\0\x02\0app";
+    unsigned long len = 0;
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(sizeof(method_call));
+
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetBody(msg, method_call, sizeof(method_call));
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_USER, 3);
+
+    // the payload is framed by its length, so its NULs don't end it
+    const char *payload = _LSTransportMessageGetPayloadBinary(msg, &len);
+    g_assert_cmpint(len, ==, 3);
+    g_assert(0 == memcmp(payload, "\x01\0\x02", 3));
+    g_assert_cmpstr(_LSTransportMessageGetAppId(msg), ==, "app");
+
+    // the copy keeps the payload type
+    _LSTransportMessage *copy = _LSTransportMessageCopyNewRef(msg);
+    g_assert_cmpint(_LSTransportMessageGetPayloadType(copy), ==, LS_PAYLOAD_TYPE_USER);
+    g_assert_cmpstr(_LSTransportMessageGetAppId(copy), ==, "app");
+    _LSTransportMessageUnref(copy);
+
+    // a length running past the body is rejected
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_BINARY, sizeof(method_call));
+    g_assert(_LSTransportMessageGetPayload(msg) == NULL);
+
+    // so is one that isn't followed by a NUL
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_BINARY, 2);
+    g_assert(_LSTransportMessageGetPayload(msg) == NULL);
+
+    // JSON payloads report their text length
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_JSON, 3);
+    payload = _LSTransportMessageGetPayloadBinary(msg, &len);
+    g_assert_cmpint(len, ==, 1);
+    g_assert_cmpint(payload[0], ==, '\x01');
+    g_assert_cmpstr(_LSTransportMessageGetAppId(msg), ==, "\x02");
+
+    _LSTransportMessageUnref(msg);
+}
+
+static _LSTransportMessage*
+receive_v2(const _LSTransportHeaderV2 *wire, const char *body)
+{
+    _LSTransportHeader header;
+
+    if (!_LSTransportHeaderFromV2(wire, &header))
+    {
+        return NULL;
+    }
+
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(header.len);
+    _LSTransportMessageSetHeader(msg, &header);
+    _LSTransportMessageSetWireHeader(msg, wire);
+    memcpy(_LSTransportMessageGetBody(msg), body, header.len);
+    _LSTransportMessageParseFields(msg);
+
+    return msg;
+}
+
+static void
+test_LSTransportMessageHeaderV2(void)
+{
+    const char method_call[] = "cat\0meth\0\x01\0\x02\0app";
+    struct iovec iov[2];
+    unsigned long len = 0;
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(sizeof(method_call));
+
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeMethodCallNoReply);
+    _LSTransportMessageSetBody(msg, method_call, sizeof(method_call));
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_USER, 3);
+    _LSTransportMessageSetToken(msg, 42);
+
+    // case: version 1 goes out as the raw message
+    _LSTransportMessageSetTxVersion(msg, 1);
+    g_assert_cmpint(_LSTransportMessageGetTxSize(msg), ==, sizeof(_LSTransportHeader) + sizeof(method_call));
+    g_assert_cmpint(_LSTransportMessageGetTxIov(msg, iov), ==, 1);
+    g_assert(iov[0].iov_base == (void*)msg->raw);
+
+    // case: version 2 sends the fixed-width header and then the body
+    _LSTransportMessageSetTxVersion(msg, 2);
+    g_assert_cmpint(sizeof(_LSTransportHeaderV2), ==, 48);
+    g_assert_cmpint(_LSTransportMessageGetTxSize(msg), ==, sizeof(_LSTransportHeaderV2) + sizeof(method_call));
+    g_assert_cmpint(_LSTransportMessageGetTxIov(msg, iov), ==, 2);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeaderV2));
+    g_assert_cmpint(iov[1].iov_len, ==, sizeof(method_call));
+
+    _LSTransportHeaderV2 wire;
+    memcpy(&wire, iov[0].iov_base, sizeof(wire));
+    g_assert_cmpint(wire.len, ==, sizeof(method_call));
+    g_assert_cmpint(wire.token, ==, 42);
+    g_assert_cmpint(wire.flags, ==, LS_TRANSPORT_HEADER_FLAG_NO_REPLY | LS_TRANSPORT_HEADER_FLAG_BINARY);
+    g_assert_cmpint(wire.category, ==, 0);
+    g_assert_cmpint(wire.method, ==, 4);
+    g_assert_cmpint(wire.payload, ==, 9);
+    g_assert_cmpint(wire.app_id, ==, 13);
+    g_assert_cmpint(wire.fields_end, ==, sizeof(method_call));
+
+    // case: the rest of a partially sent header comes first
+    msg->tx_bytes_remaining -= 8;
+    g_assert_cmpint(_LSTransportMessageGetTxIov(msg, iov), ==, 2);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeaderV2) - 8);
+
+    msg->tx_bytes_remaining = sizeof(method_call) - 4;
+    g_assert_cmpint(_LSTransportMessageGetTxIov(msg, iov), ==, 1);
+    g_assert(iov[0].iov_base == _LSTransportMessageGetBody(msg) + 4);
+
+    msg->tx_bytes_remaining = 0;
+    g_assert_cmpint(_LSTransportMessageGetTxIov(msg, iov), ==, 0);
+
+    // case: the receiver takes the fields from the header
+    _LSTransportMessage *rx = receive_v2(&wire, method_call);
+    g_assert(NULL != rx);
+    g_assert_cmpint(_LSTransportMessageGetType(rx), ==, _LSTransportMessageTypeMethodCallNoReply);
+    g_assert_cmpint(_LSTransportMessageGetToken(rx), ==, 42);
+    g_assert_cmpint(_LSTransportMessageGetPayloadType(rx), ==, LS_PAYLOAD_TYPE_USER);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(rx), ==, "meth");
+    const char *payload = _LSTransportMessageGetPayloadBinary(rx, &len);
+    g_assert_cmpint(len, ==, 3);
+    g_assert(0 == memcmp(payload, "\x01\0\x02", 3));
+    g_assert_cmpstr(_LSTransportMessageGetAppId(rx), ==, "app");
+    _LSTransportMessageUnref(rx);
+
+    // case: offsets that don't match the body are rejected
+    _LSTransportHeaderV2 bad = wire;
+    bad.method = 5;
+    rx = receive_v2(&bad, method_call);
+    g_assert(NULL != rx);
+    g_assert(_LSTransportMessageGetMethod(rx) == NULL);
+    g_assert(_LSTransportMessageGetAppId(rx) == NULL);
+    _LSTransportMessageUnref(rx);
+
+    // case: so is a field that isn't NUL-terminated
+    char corrupt[sizeof(method_call)];
+    memcpy(corrupt, method_call, sizeof(corrupt));
+    corrupt[3] = 'x';
+    rx = receive_v2(&wire, corrupt);
+    g_assert(NULL != rx);
+    g_assert(_LSTransportMessageGetCategory(rx) == NULL);
+    _LSTransportMessageUnref(rx);
+
+    // case: unknown flags and a binary flag that doesn't match the payload type
+    bad = wire;
+    bad.flags |= 1 << 15;
+    g_assert(receive_v2(&bad, method_call) == NULL);
+
+    bad = wire;
+    bad.flags &= ~LS_TRANSPORT_HEADER_FLAG_BINARY;
+    g_assert(receive_v2(&bad, method_call) == NULL);
+
+    _LSTransportMessageUnref(msg);
+}
+
 static void
 test_LSTransportMessageGetError(TestData *fixture, gconstpointer user_data)
 {
@@ -372,6 +691,31 @@ test_LSTransportMessageGetDestUniqueName(TestData *fixture, gconstpointer user_d
     g_assert_cmpstr(_LSTransportMessageGetDestUniqueName(fixture->msg), ==, dest_uniquename);
 }
 
+static void
+test_LSTransportMessageMethodCallNoReply(TestData *fixture, gconstpointer user_data)
+{
+    const char *category = "a";
+    const char *method = "b";
+    const char *payload = "{}";
+    const char *appid = "c";
+    const char *dest_servicename = "d";
+    const char *dest_uniquename = "e";
+
+    fixture->msg->raw->header.len = formatTransportMessageMethodCallBuffer(fixture->msg->raw->data, category, method, payload, appid, dest_servicename, dest_uniquename);
+    fixture->msg->raw->header.type = _LSTransportMessageTypeMethodCallNoReply;
+
+    /* laid out the same way as a regular method call */
+    g_assert_cmpstr(_LSTransportMessageGetCategory(fixture->msg), ==, category);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(fixture->msg), ==, method);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(fixture->msg), ==, payload);
+    g_assert_cmpstr(_LSTransportMessageGetAppId(fixture->msg), ==, appid);
+    g_assert_cmpstr(_LSTransportMessageGetDestServiceName(fixture->msg), ==, dest_servicename);
+    g_assert_cmpstr(_LSTransportMessageGetDestUniqueName(fixture->msg), ==, dest_uniquename);
+
+    g_assert(_LSTransportMessageIsMonitorType(fixture->msg));
+    g_assert(!_LSTransportMessageIsReplyType(fixture->msg));
+}
+
 static void
 test_LSTransportMessageGetMonitorMessageData(TestData *fixture, gconstpointer user_data)
 {
@@ -849,11 +1193,12 @@ test_LSTransportMessageTypes(TestData *fixture, gconstpointer user_data)
         _LSTransportMessageTypeMethodCall,
         _LSTransportMessageTypeReply,
         _LSTransportMessageTypeSignal,
-        _LSTransportMessageTypeCancelMethodCall
+        _LSTransportMessageTypeCancelMethodCall,
+        _LSTransportMessageTypeMethodCallNoReply
     };
     types = g_array_append_vals(types, monitor_types, G_N_ELEMENTS(monitor_types));
 
-    for (i=0; i<_LSTransportMessageTypeUnknown+1; ++i)
+    for (i=0; i<_LSTransportMessageTypeMethodCallNoReply+1; ++i)
     {
         _LSTransportMessageSetType(fixture->msg, i);
 
@@ -1085,7 +1430,14 @@ main(int argc, char *argv[])
 
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/luna-service2/LSTransportMessageNewRef", test_LSTransportMessageNewRef);
+    g_test_add_func("/luna-service2/LSTransportMessageShareNewRef", test_LSTransportMessageShareNewRef);
     g_test_add_func("/luna-service2/LSTransportMessageEmpty", test_LSTransportMessageEmpty);
+#ifndef LS_NO_MESSAGE_POOL
+    g_test_add_func("/luna-service2/LSTransportMessagePool", test_LSTransportMessagePool);
+#endif
+    g_test_add_func("/luna-service2/LSTransportMessagePayloadFd", test_LSTransportMessagePayloadFd);
+    g_test_add_func("/luna-service2/LSTransportMessageBinaryPayload", test_LSTransportMessageBinaryPayload);
+    g_test_add_func("/luna-service2/LSTransportMessageHeaderV2", test_LSTransportMessageHeaderV2);
 
     LSTEST_ADD("/luna-service2/LSTransportMessageCopyNewRef", test_LSTransportMessageCopyNewRef);
     LSTEST_ADD("/luna-service2/LSTransportMessageCopy", test_LSTransportMessageCopy);
@@ -1093,6 +1445,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSTransportMessageReset", test_LSTransportMessageReset);
     LSTEST_ADD("/luna-service2/LSTransportMessageRefAndUnref", test_LSTransportMessageRefAndUnref);
     LSTEST_ADD("/luna-service2/LSTransportMessageMiscGetSet", test_LSTransportMessageMiscGetSet);
+    LSTEST_ADD("/luna-service2/LSTransportMessageFields", test_LSTransportMessageFields);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetError", test_LSTransportMessageGetError);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetReplyToken", test_LSTransportMessageGetReplyToken);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetMethod", test_LSTransportMessageGetMethod);
@@ -1100,6 +1453,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSTransportMessageGetSenderUniqueName", test_LSTransportMessageGetSenderUniqueName);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetDestServiceName", test_LSTransportMessageGetDestServiceName);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetDestUniqueName", test_LSTransportMessageGetDestUniqueName);
+    LSTEST_ADD("/luna-service2/LSTransportMessageMethodCallNoReply", test_LSTransportMessageMethodCallNoReply);
     LSTEST_ADD("/luna-service2/LSTransportMessageGetMonitorMessageData", test_LSTransportMessageGetMonitorMessageData);
     LSTEST_ADD("/luna-service2/LSTransportMessageFilterMatch", test_LSTransportMessageFilterMatch);
     LSTEST_ADD("/luna-service2/LSTransportMessageTypes", test_LSTransportMessageTypes);
@@ -0,0 +1,161 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "transport_monitor_filter.h"
+#include "transport_message.h"
+
+/* Test cases *****************************************************************/
+
+static bool
+match_call(const _LSTransportMonitorFilter *filter, const char *category, const char *method,
+           const char *peer, unsigned long payload_len)
+{
+    return _LSTransportMonitorFilterMatch(filter, _LSTransportMessageTypeMethodCall, category, method,
+                                          "com.palm.self", "com.palm.self.unique", peer, "peer.unique",
+                                          payload_len);
+}
+
+static void
+test_LSTransportMonitorFilterMatchAll(void)
+{
+    /* case: no filter */
+    g_assert(match_call(NULL, "/cat", "meth", "com.palm.peer", 0));
+
+    /* case: empty filter */
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterNew("", "", 0, 0);
+    g_assert(filter->name == NULL);
+    g_assert(filter->method_pattern == NULL);
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.peer", 0));
+    _LSTransportMonitorFilterFree(filter);
+}
+
+static void
+test_LSTransportMonitorFilterMatchName(void)
+{
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterNew("palm.peer", NULL, 0, 0);
+
+    /* case: either side matches */
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.peer", 0));
+    g_assert(match_call(filter, "/cat", "meth", NULL, 0) == false);
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.other", 0) == false);
+    _LSTransportMonitorFilterFree(filter);
+
+    filter = _LSTransportMonitorFilterNew("self", NULL, 0, 0);
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.other", 0));
+    _LSTransportMonitorFilterFree(filter);
+}
+
+static void
+test_LSTransportMonitorFilterMatchMethod(void)
+{
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterNew(NULL, "/cat/get*", 0, 0);
+
+    g_assert(match_call(filter, "/cat", "getStatus", "com.palm.peer", 0));
+    g_assert(match_call(filter, "/cat", "setStatus", "com.palm.peer", 0) == false);
+    g_assert(match_call(filter, "/other", "getStatus", "com.palm.peer", 0) == false);
+
+    /* case: replies have no method, so they get through */
+    g_assert(_LSTransportMonitorFilterMatch(filter, _LSTransportMessageTypeReply, NULL, NULL,
+                                            "com.palm.self", NULL, "com.palm.peer", NULL, 0));
+
+    _LSTransportMonitorFilterFree(filter);
+}
+
+static void
+test_LSTransportMonitorFilterMatchTypeSize(void)
+{
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterNew(NULL, NULL,
+                                                                     LS_TRANSPORT_MONITOR_FILTER_SIGNAL |
+                                                                     LS_TRANSPORT_MONITOR_FILTER_REPLY, 0);
+
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.peer", 0) == false);
+    g_assert(_LSTransportMonitorFilterMatch(filter, _LSTransportMessageTypeSignal, "/cat", "sig",
+                                            "com.palm.self", NULL, "com.palm.hub", NULL, 0));
+    g_assert(_LSTransportMonitorFilterMatch(filter, _LSTransportMessageTypeReply, NULL, NULL,
+                                            "com.palm.self", NULL, "com.palm.peer", NULL, 0));
+    g_assert(_LSTransportMonitorFilterMatch(filter, _LSTransportMessageTypeCancelMethodCall, NULL, NULL,
+                                            "com.palm.self", NULL, "com.palm.peer", NULL, 0) == false);
+    _LSTransportMonitorFilterFree(filter);
+
+    filter = _LSTransportMonitorFilterNew(NULL, NULL, 0, 100);
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.peer", 99) == false);
+    g_assert(match_call(filter, "/cat", "meth", "com.palm.peer", 100));
+    _LSTransportMonitorFilterFree(filter);
+}
+
+static void
+test_LSTransportMonitorFilterAppendRead(void)
+{
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterNew("com.palm.peer", "/cat/*",
+                                                                     LS_TRANSPORT_MONITOR_FILTER_CALL, 10);
+
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
+    _LSTransportMessageIter iter;
+
+    _LSTransportMessageIterInit(msg, &iter);
+    g_assert(_LSTransportMonitorFilterAppend(filter, &iter));
+    g_assert(_LSTransportMessageAppendInvalid(&iter));
+
+    /* case: the filter comes out as it went in */
+    _LSTransportMessageIterInit(msg, &iter);
+    _LSTransportMonitorFilter *copy = _LSTransportMonitorFilterRead(&iter);
+    g_assert(copy != NULL);
+    g_assert_cmpstr(copy->name, ==, "com.palm.peer");
+    g_assert_cmpstr(copy->method, ==, "/cat/*");
+    g_assert_cmpint(copy->types, ==, LS_TRANSPORT_MONITOR_FILTER_CALL);
+    g_assert_cmpint(copy->min_payload_size, ==, 10);
+    _LSTransportMonitorFilterFree(copy);
+    _LSTransportMessageUnref(msg);
+
+    /* case: no filter reads back as none */
+    msg = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
+    _LSTransportMessageIterInit(msg, &iter);
+    g_assert(_LSTransportMonitorFilterAppend(NULL, &iter));
+    g_assert(_LSTransportMessageAppendInvalid(&iter));
+    _LSTransportMessageIterInit(msg, &iter);
+    g_assert(_LSTransportMonitorFilterRead(&iter) == NULL);
+    _LSTransportMessageUnref(msg);
+
+    /* case: older peers don't send a filter */
+    msg = _LSTransportMessageNewRef(0);
+    _LSTransportMessageIterInit(msg, &iter);
+    g_assert(_LSTransportMonitorFilterRead(&iter) == NULL);
+    _LSTransportMessageUnref(msg);
+
+    _LSTransportMonitorFilterFree(filter);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSTransportMonitorFilterMatchAll", test_LSTransportMonitorFilterMatchAll);
+    g_test_add_func("/luna-service2/LSTransportMonitorFilterMatchName", test_LSTransportMonitorFilterMatchName);
+    g_test_add_func("/luna-service2/LSTransportMonitorFilterMatchMethod", test_LSTransportMonitorFilterMatchMethod);
+    g_test_add_func("/luna-service2/LSTransportMonitorFilterMatchTypeSize", test_LSTransportMonitorFilterMatchTypeSize);
+    g_test_add_func("/luna-service2/LSTransportMonitorFilterAppendRead", test_LSTransportMonitorFilterAppendRead);
+
+    return g_test_run();
+}
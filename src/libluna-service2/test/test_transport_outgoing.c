@@ -68,6 +68,87 @@ test_LSTransportOutgoing(void)
     g_assert_cmpint(mvar_serial_freed, !=, 0);
 }
 
+static _LSTransportMessage*
+test_message_new(_LSTransportMessageType type, bool is_update)
+{
+    _LSTransportMessage *message = _LSTransportMessageNewRef(100 - sizeof(_LSTransportHeader));
+
+    _LSTransportMessageSetType(message, type);
+    message->is_update = is_update;
+    message->tx_bytes_remaining = message->raw->header.len + sizeof(_LSTransportHeader);
+
+    return message;
+}
+
+static void
+test_LSTransportOutgoingWatermarks(void)
+{
+    _LSTransportOutgoing *outqueue = _LSTransportOutgoingNew();
+    _LSTransportOutgoingLimits limits = {
+        .high_bytes = 300,
+        .low_bytes = 100,
+        .high_messages = 0,
+        .low_messages = 0,
+        .policy = LSOutgoingPolicyDropOldestUpdate,
+    };
+    _LSTransportMessage *first = test_message_new(_LSTransportMessageTypeReply, false);
+    _LSTransportMessage *update = test_message_new(_LSTransportMessageTypeReply, true);
+    _LSTransportMessage *fd_message = test_message_new(_LSTransportMessageTypePayloadFd, false);
+    _LSTransportMessage *fd_update = test_message_new(_LSTransportMessageTypeReply, true);
+
+    /* case: pushes are accounted for */
+    _LSTransportOutgoingPush(outqueue, update, false);
+    _LSTransportOutgoingPush(outqueue, first, true);
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 200);
+    g_assert(!_LSTransportOutgoingIsAboveHigh(outqueue, &limits));
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkNone);
+
+    /* case: crossing the high watermark is reported once */
+    _LSTransportOutgoingPush(outqueue, fd_message, false);
+    _LSTransportOutgoingPush(outqueue, fd_update, false);
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 400);
+    g_assert(_LSTransportOutgoingIsAboveHigh(outqueue, &limits));
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkHigh);
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkNone);
+    g_assert(outqueue->above_high_watermark);
+
+    /* case: the partially sent head is never dropped, nor a first reply */
+    first->is_update = true;
+    first->tx_bytes_remaining -= 10;
+    g_assert(_LSTransportOutgoingDropOldestUpdate(outqueue));
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 300);
+    g_assert(g_queue_peek_head(outqueue->queue) == first);
+    g_assert(g_queue_peek_nth(outqueue->queue, 1) == fd_message);
+
+    /* case: an update goes together with the fd holding its payload */
+    g_assert(_LSTransportOutgoingDropOldestUpdate(outqueue));
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 100);
+    g_assert_cmpuint(g_queue_get_length(outqueue->queue), ==, 1);
+    g_assert_cmpuint(outqueue->dropped, ==, 2);
+    g_assert(!_LSTransportOutgoingDropOldestUpdate(outqueue));
+
+    /* case: draining to the low watermark is reported */
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkLow);
+    g_assert(!outqueue->above_high_watermark);
+
+    /* case: the message limit works on its own */
+    limits.high_bytes = 0;
+    limits.high_messages = 2;
+    limits.low_messages = 1;
+    _LSTransportOutgoingPush(outqueue, update, false);
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkHigh);
+
+    /* case: pops are accounted for */
+    g_assert(_LSTransportOutgoingPop(outqueue) == first);
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 100);
+    g_assert_cmpint(_LSTransportOutgoingCheckWatermarks(outqueue, &limits), ==, _LSTransportOutgoingWatermarkLow);
+    g_assert(_LSTransportOutgoingPop(outqueue) == update);
+    g_assert(_LSTransportOutgoingPop(outqueue) == NULL);
+    g_assert_cmpuint(outqueue->queue_bytes, ==, 0);
+
+    _LSTransportOutgoingFree(outqueue);
+}
+
 /* Mocks **********************************************************************/
 
 _LSTransportSerial*
@@ -106,6 +187,8 @@ main(int argc, char *argv[])
 
     g_test_add_func("/luna-service2/LSTransportOutgoing",
                     test_LSTransportOutgoing);
+    g_test_add_func("/luna-service2/LSTransportOutgoingWatermarks",
+                    test_LSTransportOutgoingWatermarks);
 
     return g_test_run();
 }
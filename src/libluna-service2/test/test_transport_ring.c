@@ -0,0 +1,257 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <glib.h>
+#include "transport_ring.h"
+
+/* Test data ******************************************************************/
+
+typedef struct TestData {
+    _LSTransportRing *initiator;
+    _LSTransportRing *acceptor;
+} TestData;
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+    int i;
+
+    fixture->initiator = _LSTransportRingNew(LS_TRANSPORT_RING_MIN_SIZE);
+    g_assert(NULL != fixture->initiator);
+
+    /* hand the fds over the way the ring setup messages do */
+    fixture->acceptor = _LSTransportRingNewEmpty();
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        _LSTransportRingSetup setup = { .capacity = LS_TRANSPORT_RING_MIN_SIZE, .which = i };
+
+        g_assert(!_LSTransportRingIsComplete(fixture->acceptor));
+        g_assert(_LSTransportRingSetFd(fixture->acceptor, &setup, dup(fixture->initiator->fds[i])));
+    }
+
+    g_assert(_LSTransportRingIsComplete(fixture->acceptor));
+    g_assert(_LSTransportRingMap(fixture->acceptor, &lserror));
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportRingFree(fixture->initiator);
+    _LSTransportRingFree(fixture->acceptor);
+}
+
+static bool
+has_wakeup(int event_fd)
+{
+    eventfd_t value = 0;
+
+    return eventfd_read(event_fd, &value) == 0 && value > 0;
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportRingRoundCapacity(void)
+{
+    g_assert_cmpuint(_LSTransportRingRoundCapacity(0), ==, LS_TRANSPORT_RING_MIN_SIZE);
+    g_assert_cmpuint(_LSTransportRingRoundCapacity(LS_TRANSPORT_RING_MIN_SIZE + 1), ==, 2 * LS_TRANSPORT_RING_MIN_SIZE);
+    g_assert_cmpuint(_LSTransportRingRoundCapacity(64 * 1024), ==, 64 * 1024);
+    g_assert_cmpuint(_LSTransportRingRoundCapacity(G_MAXULONG), ==, LS_TRANSPORT_RING_MAX_SIZE);
+}
+
+static void
+test_LSTransportRingRoundTrip(TestData *fixture, gconstpointer user_data)
+{
+    char buf[64];
+    struct iovec iov[2] = {
+        { .iov_base = "hello ", .iov_len = 6 },
+        { .iov_base = "world", .iov_len = 6 },
+    };
+
+    /* case: nothing to read yet */
+    errno = 0;
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, sizeof(buf)), ==, -1);
+    g_assert_cmpint(errno, ==, EAGAIN);
+
+    /* case: writing to an empty ring wakes up the far side */
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, iov, 2), ==, 12);
+    g_assert(has_wakeup(fixture->acceptor->rx_event_fd));
+
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, sizeof(buf)), ==, 12);
+    g_assert_cmpstr(buf, ==, "hello world");
+
+    /* case: the other direction is independent */
+    g_assert_cmpint(_LSTransportRingWrite(fixture->acceptor, iov, 1), ==, 6);
+    g_assert(has_wakeup(fixture->initiator->rx_event_fd));
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, sizeof(buf)), ==, -1);
+    g_assert_cmpint(_LSTransportRingRead(fixture->initiator, buf, sizeof(buf)), ==, 6);
+    g_assert(0 == memcmp(buf, "hello ", 6));
+}
+
+static void
+test_LSTransportRingWrapAround(TestData *fixture, gconstpointer user_data)
+{
+    unsigned long capacity = fixture->initiator->capacity;
+    char *data = g_malloc(capacity);
+    char *buf = g_malloc(capacity);
+    unsigned long i;
+
+    for (i = 0; i < capacity; i++)
+    {
+        data[i] = (char)(i * 7);
+    }
+
+    /* move the read and write positions close to the end of the ring */
+    struct iovec iov = { .iov_base = data, .iov_len = capacity - 10 };
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, &iov, 1), ==, capacity - 10);
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, capacity), ==, capacity - 10);
+
+    /* case: data crossing the end of the ring comes out intact */
+    iov.iov_len = 100;
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, &iov, 1), ==, 100);
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, capacity), ==, 100);
+    g_assert(0 == memcmp(buf, data, 100));
+
+    g_free(data);
+    g_free(buf);
+}
+
+static void
+test_LSTransportRingFull(TestData *fixture, gconstpointer user_data)
+{
+    unsigned long capacity = fixture->initiator->capacity;
+    char *data = g_malloc0(capacity + 100);
+    char buf[50];
+
+    struct iovec iov = { .iov_base = data, .iov_len = capacity + 100 };
+
+    /* case: only what fits is written */
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, &iov, 1), ==, capacity);
+    g_assert(has_wakeup(fixture->acceptor->rx_event_fd));
+
+    /* case: a full ring doesn't take anything */
+    errno = 0;
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, &iov, 1), ==, -1);
+    g_assert_cmpint(errno, ==, EAGAIN);
+    g_assert(!has_wakeup(fixture->initiator->rx_event_fd));
+
+    /* case: making room wakes up the waiting writer, once */
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, sizeof(buf)), ==, sizeof(buf));
+    g_assert(has_wakeup(fixture->initiator->rx_event_fd));
+    g_assert_cmpint(_LSTransportRingRead(fixture->acceptor, buf, sizeof(buf)), ==, sizeof(buf));
+    g_assert(!has_wakeup(fixture->initiator->rx_event_fd));
+
+    g_assert_cmpint(_LSTransportRingWrite(fixture->initiator, &iov, 1), ==, 2 * sizeof(buf));
+
+    g_free(data);
+}
+
+static void
+test_LSTransportRingSetFd(void)
+{
+    _LSTransportRing *ring = _LSTransportRingNewEmpty();
+    int fd = eventfd(0, EFD_CLOEXEC);
+
+    _LSTransportRingSetup setup = { .capacity = LS_TRANSPORT_RING_MIN_SIZE, .which = _LSTransportRingFdShm };
+
+    /* case: bad capacity */
+    setup.capacity = LS_TRANSPORT_RING_MIN_SIZE + 1;
+    g_assert(!_LSTransportRingSetFd(ring, &setup, dup(fd)));
+
+    /* case: bad fd index */
+    setup.capacity = LS_TRANSPORT_RING_MIN_SIZE;
+    setup.which = _LSTransportRingFdCount;
+    g_assert(!_LSTransportRingSetFd(ring, &setup, dup(fd)));
+
+    /* case: no fd */
+    setup.which = _LSTransportRingFdShm;
+    g_assert(!_LSTransportRingSetFd(ring, &setup, -1));
+
+    g_assert(_LSTransportRingSetFd(ring, &setup, dup(fd)));
+
+    /* case: same fd twice */
+    g_assert(!_LSTransportRingSetFd(ring, &setup, dup(fd)));
+
+    /* case: capacity differs from the earlier fds */
+    setup.which = _LSTransportRingFdInitiatorEvent;
+    setup.capacity = 2 * LS_TRANSPORT_RING_MIN_SIZE;
+    g_assert(!_LSTransportRingSetFd(ring, &setup, dup(fd)));
+
+    g_assert(!_LSTransportRingIsComplete(ring));
+
+    _LSTransportRingFree(ring);
+    close(fd);
+}
+
+static void
+test_LSTransportRingMapUnsealed(void)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportRing *ring = _LSTransportRingNewEmpty();
+    gchar templ[] = "ut_transport_ring_XXXXXX";
+    int shm_fd = g_mkstemp(templ);
+    int event_fd = eventfd(0, EFD_CLOEXEC);
+    int i;
+
+    /* big enough, but the far side could still shrink it under us */
+    g_assert(ftruncate(shm_fd, 4 * LS_TRANSPORT_RING_MAX_SIZE) == 0);
+    unlink(templ);
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        _LSTransportRingSetup setup = { .capacity = LS_TRANSPORT_RING_MIN_SIZE, .which = i };
+
+        g_assert(_LSTransportRingSetFd(ring, &setup, dup(i == _LSTransportRingFdShm ? shm_fd : event_fd)));
+    }
+
+    g_assert(!_LSTransportRingMap(ring, &lserror));
+    g_assert(LSErrorIsSet(&lserror));
+    LSErrorFree(&lserror);
+
+    _LSTransportRingFree(ring);
+    close(shm_fd);
+    close(event_fd);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSTransportRingRoundCapacity", test_LSTransportRingRoundCapacity);
+    g_test_add("/luna-service2/LSTransportRingRoundTrip", TestData, NULL, test_setup, test_LSTransportRingRoundTrip, test_teardown);
+    g_test_add("/luna-service2/LSTransportRingWrapAround", TestData, NULL, test_setup, test_LSTransportRingWrapAround, test_teardown);
+    g_test_add("/luna-service2/LSTransportRingFull", TestData, NULL, test_setup, test_LSTransportRingFull, test_teardown);
+    g_test_add_func("/luna-service2/LSTransportRingSetFd", test_LSTransportRingSetFd);
+    g_test_add_func("/luna-service2/LSTransportRingMapUnsealed", test_LSTransportRingMapUnsealed);
+
+    return g_test_run();
+}
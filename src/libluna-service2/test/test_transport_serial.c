@@ -49,38 +49,6 @@ test_teardown(TestData *fixture, gconstpointer user_data)
 
 /* Test cases *****************************************************************/
 
-static void
-test_LSTransportSerialMapEntryNewAndFree()
-{
-    _LSTransportSerialMapEntry *entry = _LSTransportSerialMapEntryNew(1, GINT_TO_POINTER(2));
-    g_assert(NULL != entry);
-
-    g_assert_cmpint(entry->serial, ==, 1);
-    g_assert_cmpint(GPOINTER_TO_INT(entry->serial_list_item), ==, GPOINTER_TO_INT(2));
-
-    _LSTransportSerialMapEntryFree(entry);
-}
-
-static void
-test_LSTransportSerialListItemNewAndFree()
-{
-    transport_message_ref_call_count = 0;
-
-    _LSTransportSerialListItem *item = _LSTransportSerialListItemNew(1, GINT_TO_POINTER(2));
-    g_assert(NULL != item);
-
-    g_assert_cmpint(item->serial, ==, 1);
-    g_assert_cmpint(GPOINTER_TO_INT(item->message), ==, GPOINTER_TO_INT(2));
-
-    // _LSTransportSerialListItemNew should increment message ref count
-    g_assert_cmpint(transport_message_ref_call_count, ==, 1);
-
-    _LSTransportSerialListItemFree(item);
-
-    // _LSTransportSerialListItemFree should decrement message ref count
-    g_assert_cmpint(transport_message_ref_call_count, ==, 0);
-}
-
 static void
 test_LSTransportSerialNewAndFree()
 {
@@ -89,21 +57,16 @@ test_LSTransportSerialNewAndFree()
     _LSTransportSerial *serial = _LSTransportSerialNew();
     g_assert(NULL != serial);
 
-    g_assert_cmpint(GPOINTER_TO_INT(serial->queue), !=, GPOINTER_TO_INT(NULL));
-    g_assert_cmpint(GPOINTER_TO_INT(serial->map), !=, GPOINTER_TO_INT(NULL));
+    g_assert(NULL != serial->entries);
+    g_assert_cmpuint(serial->capacity, ==, LS_TRANSPORT_SERIAL_INITIAL_SIZE);
+    g_assert_cmpuint(serial->length, ==, 0);
 
-    _LSTransportSerialListItem *items[] =
-    {
-        _LSTransportSerialListItemNew(1, GINT_TO_POINTER(2)),
-        _LSTransportSerialListItemNew(3, GINT_TO_POINTER(4))
-    };
-    g_assert_cmpint(transport_message_ref_call_count, ==, 2);
+    LSError error;
+    LSErrorInit(&error);
 
-    int i;
-    for (i = 0; i < sizeof(items)/sizeof(items[0]); ++i)
-    {
-        g_queue_push_tail(serial->queue, items[i]);
-    }
+    g_assert(_LSTransportSerialSave(serial, GINT_TO_POINTER(1), &error));
+    g_assert(_LSTransportSerialSave(serial, GINT_TO_POINTER(3), &error));
+    g_assert_cmpint(transport_message_ref_call_count, ==, 2);
 
     _LSTransportSerialFree(serial);
 
@@ -122,14 +85,20 @@ test_LSTransportSerialSaveAndRemove(TestData *fixture, gconstpointer user_data)
 
     g_assert(_LSTransportSerialSave(serial, message, &error));
 
-    g_assert_cmpint(g_hash_table_size(serial->map), ==, 1);
-    g_assert_cmpint(g_queue_get_length(serial->queue), ==, 1);
+    g_assert_cmpuint(serial->count, ==, 1);
+    g_assert_cmpuint(serial->length, ==, 1);
     g_assert_cmpint(transport_message_ref_call_count, ==, 1);
+    g_assert(_LSTransportSerialContains(serial, 1));
 
     _LSTransportSerialRemove(serial, 1);
 
-    g_assert_cmpint(g_hash_table_size(serial->map), ==, 0);
-    g_assert_cmpint(g_queue_get_length(serial->queue), ==, 0);
+    g_assert_cmpuint(serial->count, ==, 0);
+    g_assert_cmpuint(serial->length, ==, 0);
+    g_assert_cmpint(transport_message_ref_call_count, ==, 0);
+    g_assert(!_LSTransportSerialContains(serial, 1));
+
+    /* case: removing an unknown serial does nothing */
+    _LSTransportSerialRemove(serial, 1);
     g_assert_cmpint(transport_message_ref_call_count, ==, 0);
 }
 
@@ -148,13 +117,95 @@ test_LSTransportSerialPopHead(TestData *fixture, gconstpointer user_data)
     message = _LSTransportSerialPopHead(serial);
     g_assert_cmpint(GPOINTER_TO_INT(message), ==, 1);
 
-    g_assert_cmpint(g_hash_table_size(serial->map), ==, 0);
-    g_assert_cmpint(g_queue_get_length(serial->queue), ==, 0);
+    g_assert_cmpuint(serial->count, ==, 0);
+    g_assert_cmpuint(serial->length, ==, 0);
+    g_assert(NULL == _LSTransportSerialPopHead(serial));
 
     // Message returned, there should be one reference!
     g_assert_cmpint(transport_message_ref_call_count, ==, 1);
 }
 
+static void
+test_LSTransportSerialOrder(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportSerial *serial = fixture->serial;
+
+    LSError error;
+    LSErrorInit(&error);
+
+    /* case: a serial saved late still comes out in order */
+    _LSTransportSerialSave(serial, GINT_TO_POINTER(2), &error);
+    _LSTransportSerialSave(serial, GINT_TO_POINTER(5), &error);
+    _LSTransportSerialSave(serial, GINT_TO_POINTER(3), &error);
+    _LSTransportSerialSave(serial, GINT_TO_POINTER(7), &error);
+
+    g_assert_cmpuint(_LSTransportSerialGetHeadSerial(serial), ==, 2);
+
+    /* case: removing from the middle keeps the others */
+    _LSTransportSerialRemove(serial, 3);
+    g_assert(!_LSTransportSerialContains(serial, 3));
+    g_assert(_LSTransportSerialContains(serial, 5));
+    g_assert_cmpuint(serial->count, ==, 3);
+
+    /* case: removing the head skips over removed entries */
+    _LSTransportSerialRemove(serial, 2);
+    g_assert_cmpuint(_LSTransportSerialGetHeadSerial(serial), ==, 5);
+    g_assert_cmpuint(serial->length, ==, 2);
+
+    g_assert_cmpint(GPOINTER_TO_INT(_LSTransportSerialPopHead(serial)), ==, 5);
+    g_assert_cmpint(GPOINTER_TO_INT(_LSTransportSerialPopHead(serial)), ==, 7);
+    g_assert(NULL == _LSTransportSerialPopHead(serial));
+    g_assert_cmpuint(_LSTransportSerialGetHeadSerial(serial), ==, LSMESSAGE_TOKEN_INVALID);
+
+    g_assert_cmpint(transport_message_ref_call_count, ==, 2);
+}
+
+static void
+test_LSTransportSerialGrow(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportSerial *serial = fixture->serial;
+    int i;
+
+    LSError error;
+    LSErrorInit(&error);
+
+    /* case: a call that never gets a reply doesn't make the ring grow
+     * with the calls after it */
+    _LSTransportSerialSave(serial, GINT_TO_POINTER(1), &error);
+
+    for (i = 2; i < 1000; i++)
+    {
+        _LSTransportSerialSave(serial, GINT_TO_POINTER(i), &error);
+        _LSTransportSerialRemove(serial, i);
+    }
+
+    g_assert_cmpuint(serial->capacity, ==, LS_TRANSPORT_SERIAL_INITIAL_SIZE);
+    g_assert_cmpuint(serial->count, ==, 1);
+    g_assert_cmpint(transport_message_ref_call_count, ==, 1);
+
+    /* case: the ring grows when it's full of calls and wraps around */
+    for (i = 1000; i < 1000 + 3 * LS_TRANSPORT_SERIAL_INITIAL_SIZE; i++)
+    {
+        _LSTransportSerialSave(serial, GINT_TO_POINTER(i), &error);
+    }
+
+    g_assert_cmpuint(serial->capacity, >=, 4 * LS_TRANSPORT_SERIAL_INITIAL_SIZE);
+    g_assert_cmpuint(serial->count, ==, 1 + 3 * LS_TRANSPORT_SERIAL_INITIAL_SIZE);
+
+    for (i = 1000; i < 1000 + 3 * LS_TRANSPORT_SERIAL_INITIAL_SIZE; i += 2)
+    {
+        _LSTransportSerialRemove(serial, i);
+    }
+
+    g_assert(_LSTransportSerialContains(serial, 1));
+    g_assert(!_LSTransportSerialContains(serial, 1000));
+    g_assert(_LSTransportSerialContains(serial, 1001));
+
+    g_assert_cmpint(GPOINTER_TO_INT(_LSTransportSerialPopHead(serial)), ==, 1);
+    g_assert_cmpint(GPOINTER_TO_INT(_LSTransportSerialPopHead(serial)), ==, 1001);
+    g_assert_cmpint(GPOINTER_TO_INT(_LSTransportSerialPopHead(serial)), ==, 1003);
+}
+
 /* Mocks **********************************************************************/
 
 _LSTransportMessage*
@@ -186,12 +237,12 @@ main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
 
-    g_test_add_func("/luna-service2/LSTransportSerialMapEntryNew", test_LSTransportSerialMapEntryNewAndFree);
-    g_test_add_func("/luna-service2/LSTransportSerialListItemNew", test_LSTransportSerialListItemNewAndFree);
     g_test_add_func("/luna-service2/LSTransportSerialNew", test_LSTransportSerialNewAndFree);
 
     LSTEST_ADD("/luna-service2/LSTransportSerialSaveAndRemove", test_LSTransportSerialSaveAndRemove);
     LSTEST_ADD("/luna-service2/LSTransportSerialPopHead", test_LSTransportSerialPopHead);
+    LSTEST_ADD("/luna-service2/LSTransportSerialOrder", test_LSTransportSerialOrder);
+    LSTEST_ADD("/luna-service2/LSTransportSerialGrow", test_LSTransportSerialGrow);
 
     return g_test_run();
 }
@@ -77,6 +77,43 @@ test_LSTransportShm(void)
     g_assert(NULL == private_shm);
 }
 
+static void
+test_LSTransportShmSerialBlocks(void)
+{
+    _LSTransportShm *shm = NULL;
+
+    LSError error;
+    LSErrorInit(&error);
+    int i = 0;
+
+    g_assert(_LSTransportShmInit(&shm, true, &error));
+
+    _LSTransportMonitorSerial first = _LSTransportShmGetSerial(shm) + 1;
+
+    if (g_test_trap_fork(0, G_TEST_TRAP_SILENCE_STDOUT))
+    {
+        _LSTransportShm *block_shm = NULL;
+
+        setenv("LS_MONITOR_SERIAL_BLOCKS", "1", 1);
+        g_assert(_LSTransportShmInit(&block_shm, true, &error));
+
+        // serials come from the reserved block one after another
+        for (i = 0; i < 10; ++i)
+        {
+            g_assert_cmpint(_LSTransportShmGetSerial(block_shm), ==, first + i);
+        }
+
+        _LSTransportShmDeinit(&block_shm);
+        exit(0);
+    }
+    g_test_trap_assert_passed();
+
+    // the whole block of 1024 serials was taken at once
+    g_assert_cmpint(_LSTransportShmGetSerial(shm), ==, first + 1024);
+
+    _LSTransportShmDeinit(&shm);
+}
+
 /* Test suite *****************************************************************/
 
 int
@@ -85,6 +122,7 @@ main(int argc, char *argv[])
     g_test_init(&argc, &argv, NULL);
 
     g_test_add_func("/luna-service2/LSTransportShm", test_LSTransportShm);
+    g_test_add_func("/luna-service2/LSTransportShmSerialBlocks", test_LSTransportShmSerialBlocks);
 
     return g_test_run();
 }
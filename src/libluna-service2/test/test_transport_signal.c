@@ -147,6 +147,24 @@ test_LSTransportMessageSignalNewRef(TestData *fixture, gconstpointer user_data)
     _LSTransportMessageUnref(msg);
 }
 
+static void
+test_LSTransportMessageSignalNewRefLen(TestData *fixture, gconstpointer user_data)
+{
+    const char *category = "a";
+    const char *method = "b";
+    const char payload[] = { '{', '}', 'x' };
+
+    /* the payload isn't NUL-terminated, the message has to add the NUL */
+    _LSTransportMessage *msg = LSTransportMessageSignalNewRefLen(category, method, payload, 2);
+    g_assert(NULL != msg);
+    g_assert_cmpint(_LSTransportMessageGetType(msg), ==, _LSTransportMessageTypeSignal);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(msg), ==, category);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(msg), ==, method);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, "{}");
+
+    _LSTransportMessageUnref(msg);
+}
+
 static void
 test_LSTransportSendSignal(TestData *fixture, gconstpointer user_data)
 {
@@ -220,6 +238,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSTransportRegisterSignalServiceStatus", test_LSTransportRegisterSignalServiceStatus);
     LSTEST_ADD("/luna-service2/LSTransportUnregisterSignalServiceStatus", test_LSTransportUnregisterSignalServiceStatus);
     LSTEST_ADD("/luna-service2/LSTransportMessageSignalNewRef", test_LSTransportMessageSignalNewRef);
+    LSTEST_ADD("/luna-service2/LSTransportMessageSignalNewRefLen", test_LSTransportMessageSignalNewRefLen);
     LSTEST_ADD("/luna-service2/LSTransportSendSignal", test_LSTransportSendSignal);
     LSTEST_ADD("/luna-service2/LSTransportServiceStatusSignalGetServiceName", test_LSTransportServiceStatusSignalGetServiceName);
 
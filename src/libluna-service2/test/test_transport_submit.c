@@ -0,0 +1,180 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <glib.h>
+#include "transport.h"
+#include "transport_submit.h"
+
+#define NUM_PRODUCERS           4
+#define MESSAGES_PER_PRODUCER   1000
+
+/* Test data ******************************************************************/
+
+typedef struct TestData {
+    _LSTransportSubmit *submit;
+} TestData;
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    fixture->submit = _LSTransportSubmitNew(&lserror);
+    g_assert(NULL != fixture->submit);
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportSubmitFree(fixture->submit);
+}
+
+static bool
+has_wakeup(int event_fd)
+{
+    eventfd_t value = 0;
+
+    return eventfd_read(event_fd, &value) == 0 && value > 0;
+}
+
+/* the token carries the producer in the high bits and the sequence number
+ * in the low ones */
+static _LSTransportMessage*
+new_message(int producer, int seq)
+{
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+    _LSTransportMessageSetToken(message, ((LSMessageToken)producer << 16) | seq);
+    return message;
+}
+
+static gpointer
+producer_thread(gpointer data)
+{
+    TestData *fixture = data;
+    static gint next_producer = 0;
+    int producer = g_atomic_int_add(&next_producer, 1);
+    int i;
+
+    for (i = 0; i < MESSAGES_PER_PRODUCER; i++)
+    {
+        _LSTransportSubmitPush(fixture->submit, NULL, new_message(producer, i));
+    }
+
+    return NULL;
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportSubmitOrder(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportSubmitNode *node;
+    int i;
+
+    /* case: nothing to take */
+    g_assert(NULL == _LSTransportSubmitTakeAll(fixture->submit));
+    g_assert(!has_wakeup(fixture->submit->event_fd));
+
+    /* case: only the first push wakes up the main loop */
+    for (i = 0; i < 3; i++)
+    {
+        _LSTransportSubmitPush(fixture->submit, NULL, new_message(0, i));
+    }
+    g_assert(has_wakeup(fixture->submit->event_fd));
+    g_assert(!has_wakeup(fixture->submit->event_fd));
+
+    /* case: messages come out in the order they were pushed */
+    node = _LSTransportSubmitTakeAll(fixture->submit);
+
+    for (i = 0; i < 3; i++)
+    {
+        g_assert(NULL != node);
+        g_assert_cmpuint(_LSTransportMessageGetToken(node->message), ==, i);
+
+        _LSTransportSubmitNode *next = node->next;
+        _LSTransportSubmitNodeFree(node);
+        node = next;
+    }
+    g_assert(NULL == node);
+
+    /* case: pushing onto the emptied queue wakes up the main loop again */
+    _LSTransportSubmitPush(fixture->submit, NULL, new_message(0, 0));
+    g_assert(has_wakeup(fixture->submit->event_fd));
+
+    /* the last message is freed with the queue */
+}
+
+static void
+test_LSTransportSubmitProducers(TestData *fixture, gconstpointer user_data)
+{
+    GThread *threads[NUM_PRODUCERS];
+    int expected[NUM_PRODUCERS] = { 0 };
+    int received = 0;
+    int i;
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+    {
+        threads[i] = g_thread_new("producer", producer_thread, fixture);
+    }
+
+    /* case: taking while the producers push keeps each producer's order */
+    while (received < NUM_PRODUCERS * MESSAGES_PER_PRODUCER)
+    {
+        _LSTransportSubmitNode *node = _LSTransportSubmitTakeAll(fixture->submit);
+
+        while (node)
+        {
+            LSMessageToken token = _LSTransportMessageGetToken(node->message);
+            int producer = token >> 16;
+
+            g_assert_cmpint(producer, <, NUM_PRODUCERS);
+            g_assert_cmpint(token & 0xffff, ==, expected[producer]);
+            expected[producer]++;
+            received++;
+
+            _LSTransportSubmitNode *next = node->next;
+            _LSTransportSubmitNodeFree(node);
+            node = next;
+        }
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+    {
+        g_thread_join(threads[i]);
+        g_assert_cmpint(expected[i], ==, MESSAGES_PER_PRODUCER);
+    }
+
+    g_assert(NULL == _LSTransportSubmitTakeAll(fixture->submit));
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/luna-service2/LSTransportSubmitOrder", TestData, NULL, test_setup, test_LSTransportSubmitOrder, test_teardown);
+    g_test_add("/luna-service2/LSTransportSubmitProducers", TestData, NULL, test_setup, test_LSTransportSubmitProducers, test_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,247 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "transport_trace.h"
+#include "transport_message.h"
+
+/* Test data ******************************************************************/
+
+static _LSTransportMessage*
+method_call_new(const char *payload)
+{
+    /* method call body: category, method, payload, app id */
+    unsigned long payload_len = strlen(payload);
+    unsigned long body_size = 5 + 5 + payload_len + 1 + 4;
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(body_size);
+    char *body = _LSTransportMessageGetBody(msg);
+
+    memcpy(body, "/cat\0meth\0", 10);
+    memcpy(body + 10, payload, payload_len + 1);
+    memcpy(body + 10 + payload_len + 1, "app\0", 4);
+
+    _LSTransportMessageSetType(msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetPayloadType(msg, LS_PAYLOAD_TYPE_JSON, 0);
+    _LSTransportMessageSetToken(msg, 42);
+
+    return msg;
+}
+
+static void
+write_record(_LSTransportTrace *trace, _LSTransportMessage *msg, _LSTransportMonitorSerial serial)
+{
+    _LSMonitorMessageData data;
+    data.serial = serial;
+    data.type = _LSMonitorMessageTypeTx;
+    data.timestamp.tv_sec = 1;
+    data.timestamp.tv_nsec = 2;
+
+    unsigned long payload_len = 0;
+    const char *payload = _LSTransportMessageGetPayloadBinary(msg, &payload_len);
+
+    _LSTransportTraceWrite(trace, &data, msg, "com.palm.peer", payload, payload_len);
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportTraceRoundTrip(void)
+{
+    _LSTransportTrace *trace = _LSTransportTraceNew(8);
+    g_assert(trace != NULL);
+
+    _LSTransportTraceReader *reader = _LSTransportTraceReaderNew(dup(trace->fd), NULL);
+    g_assert(reader != NULL);
+
+    _LSTransportTraceRecord record;
+    g_assert(!_LSTransportTraceReaderNext(reader, &record));
+
+    _LSTransportMessage *msg = method_call_new("{\"a\":1}");
+    write_record(trace, msg, 7);
+
+    /* case: the record comes out as written */
+    g_assert(_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(record.serial, ==, 7);
+    g_assert_cmpint(record.monitor_type, ==, _LSMonitorMessageTypeTx);
+    g_assert_cmpint(record.message_type, ==, _LSTransportMessageTypeMethodCall);
+    g_assert_cmpuint(record.token, ==, 42);
+    g_assert_cmpuint(record.reply_token, ==, LSMESSAGE_TOKEN_INVALID);
+    g_assert_cmpint(record.timestamp.tv_sec, ==, 1);
+    g_assert_cmpint(record.timestamp.tv_nsec, ==, 2);
+    g_assert_cmpstr(record.peer, ==, "com.palm.peer");
+    g_assert_cmpstr(record.method, ==, "/cat/meth");
+    g_assert_cmpstr(record.payload, ==, "{\"a\":1}");
+    g_assert_cmpuint(record.payload_len, ==, 7);
+
+    /* case: nothing more to read */
+    g_assert(!_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(reader->dropped, ==, 0);
+
+    _LSTransportMessageUnref(msg);
+    _LSTransportTraceReaderFree(reader);
+    _LSTransportTraceFree(trace);
+}
+
+static void
+test_LSTransportTraceTruncate(void)
+{
+    _LSTransportTrace *trace = _LSTransportTraceNew(8);
+    g_assert(trace != NULL);
+
+    _LSTransportTraceReader *reader = _LSTransportTraceReaderNew(dup(trace->fd), NULL);
+    g_assert(reader != NULL);
+
+    char payload[LS_TRANSPORT_TRACE_PAYLOAD_SIZE * 2 + 1];
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+
+    _LSTransportMessage *msg = method_call_new(payload);
+    write_record(trace, msg, 1);
+
+    /* case: the payload is cut to fit, but its length is kept */
+    _LSTransportTraceRecord record;
+    g_assert(_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(strlen(record.payload), ==, LS_TRANSPORT_TRACE_PAYLOAD_SIZE - 1);
+    g_assert_cmpuint(record.payload_len, ==, sizeof(payload) - 1);
+
+    _LSTransportMessageUnref(msg);
+    _LSTransportTraceReaderFree(reader);
+    _LSTransportTraceFree(trace);
+}
+
+static void
+test_LSTransportTraceOverrun(void)
+{
+    _LSTransportTrace *trace = _LSTransportTraceNew(8);
+    g_assert(trace != NULL);
+
+    _LSTransportTraceReader *reader = _LSTransportTraceReaderNew(dup(trace->fd), NULL);
+    g_assert(reader != NULL);
+
+    _LSTransportMessage *msg = method_call_new("{}");
+    int i;
+
+    for (i = 0; i < 20; i++)
+    {
+        write_record(trace, msg, i);
+    }
+
+    /* case: the oldest records were overwritten and are counted as dropped */
+    _LSTransportTraceRecord record;
+    for (i = 12; i < 20; i++)
+    {
+        g_assert(_LSTransportTraceReaderNext(reader, &record));
+        g_assert_cmpuint(record.serial, ==, i);
+    }
+    g_assert(!_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(reader->dropped, ==, 12);
+
+    /* case: the ring can't be resized under the reader */
+    g_assert(ftruncate(trace->fd, 0) != 0);
+    g_assert(ftruncate(trace->fd, 2 * trace->map_size) != 0);
+
+    _LSTransportMessageUnref(msg);
+    _LSTransportTraceReaderFree(reader);
+    _LSTransportTraceFree(trace);
+}
+
+static void
+test_LSTransportTraceStalled(void)
+{
+    _LSTransportTrace *trace = _LSTransportTraceNew(8);
+    g_assert(trace != NULL);
+
+    _LSTransportTraceReader *reader = _LSTransportTraceReaderNew(dup(trace->fd), NULL);
+    g_assert(reader != NULL);
+
+    _LSTransportMessage *msg = method_call_new("{}");
+    write_record(trace, msg, 1);
+    write_record(trace, msg, 2);
+
+    /* pretend the writer of the first record never finished */
+    trace->records[0].seq = UINT64_MAX;
+
+    /* case: we wait for it once, then skip it */
+    _LSTransportTraceRecord record;
+    g_assert(!_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(reader->dropped, ==, 0);
+
+    g_assert(_LSTransportTraceReaderNext(reader, &record));
+    g_assert_cmpuint(record.serial, ==, 2);
+    g_assert_cmpuint(reader->dropped, ==, 1);
+
+    _LSTransportMessageUnref(msg);
+    _LSTransportTraceReaderFree(reader);
+    _LSTransportTraceFree(trace);
+}
+
+static void
+test_LSTransportTraceReaderInvalid(void)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    /* case: no fd */
+    g_assert(_LSTransportTraceReaderNew(-1, &lserror) == NULL);
+    g_assert(LSErrorIsSet(&lserror));
+    LSErrorFree(&lserror);
+
+    /* case: not a trace ring */
+    int fds[2];
+    g_assert(pipe(fds) == 0);
+    g_assert(_LSTransportTraceReaderNew(fds[0], &lserror) == NULL);
+    g_assert(LSErrorIsSet(&lserror));
+    LSErrorFree(&lserror);
+    close(fds[1]);
+
+    /* case: a valid ring that its writer could still shrink */
+    _LSTransportTrace *trace = _LSTransportTraceNew(8);
+    g_assert(trace != NULL);
+
+    gchar templ[] = "ut_transport_trace_XXXXXX";
+    int fd = g_mkstemp(templ);
+    g_assert(fd != -1);
+    unlink(templ);
+    g_assert(write(fd, trace->header, trace->map_size) == (ssize_t)trace->map_size);
+
+    g_assert(_LSTransportTraceReaderNew(fd, &lserror) == NULL);
+    g_assert(LSErrorIsSet(&lserror));
+    LSErrorFree(&lserror);
+
+    _LSTransportTraceFree(trace);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSTransportTraceRoundTrip", test_LSTransportTraceRoundTrip);
+    g_test_add_func("/luna-service2/LSTransportTraceTruncate", test_LSTransportTraceTruncate);
+    g_test_add_func("/luna-service2/LSTransportTraceOverrun", test_LSTransportTraceOverrun);
+    g_test_add_func("/luna-service2/LSTransportTraceStalled", test_LSTransportTraceStalled);
+    g_test_add_func("/luna-service2/LSTransportTraceReaderInvalid", test_LSTransportTraceReaderInvalid);
+
+    return g_test_run();
+}
@@ -0,0 +1,341 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib.h>
+#include "transport.h"
+#include "transport_priv.h"
+#include "transport_uring.h"
+
+/* Test data ******************************************************************/
+
+typedef struct TestData {
+    GMainContext *context;
+    _LSTransportUring *uring;
+    int fds[2];
+    _LSTransportChannel channel;    /**< watches fds[0] */
+    int calls;
+    char buf[64];
+    int buf_len;                    /**< bytes received into @ref buf */
+    int fd_recvd;
+    bool eof;
+    int send_ret;
+    int destroyed;
+} TestData;
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    fixture->context = g_main_context_new();
+    fixture->uring = _LSTransportUringNew(fixture->context, G_PRIORITY_DEFAULT, &lserror);
+    g_assert(NULL != fixture->uring);
+
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, fixture->fds), ==, 0);
+    g_assert(_LSTransportChannelInit(NULL, &fixture->channel, fixture->fds[0], G_PRIORITY_DEFAULT));
+
+    fixture->fd_recvd = -1;
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportUringRemoveWatch(&fixture->channel, G_IO_IN);
+    _LSTransportUringRemoveWatch(&fixture->channel, G_IO_OUT);
+    _LSTransportChannelClose(&fixture->channel, false);
+    _LSTransportChannelDeinit(&fixture->channel);
+    close(fixture->fds[1]);
+
+    if (fixture->fd_recvd != -1)
+    {
+        close(fixture->fd_recvd);
+    }
+
+    _LSTransportUringFree(fixture->uring);
+    g_main_context_unref(fixture->context);
+}
+
+static gboolean
+recv_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    TestData *fixture = data;
+
+    fixture->calls++;
+
+    /* take everything, the way _LSTransportReceiveStream does */
+    while (1)
+    {
+        int ret = _LSTransportUringRecv(&fixture->channel, fixture->buf + fixture->buf_len,
+                                        sizeof(fixture->buf) - fixture->buf_len, &fixture->fd_recvd);
+        if (ret <= 0)
+        {
+            fixture->eof = (ret == 0);
+            break;
+        }
+        fixture->buf_len += ret;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+send_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    TestData *fixture = data;
+
+    fixture->calls++;
+
+    if (!_LSTransportUringTakeSendResult(&fixture->channel, &fixture->send_ret))
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+watch_destroy(gpointer data)
+{
+    TestData *fixture = data;
+
+    fixture->destroyed++;
+}
+
+/* completions come in asynchronously, so wait for the callback */
+static void
+wait_for_calls(TestData *fixture, int calls)
+{
+    while (fixture->calls < calls)
+    {
+        g_main_context_iteration(fixture->context, TRUE);
+    }
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSTransportUringReceive(TestData *fixture, gconstpointer user_data)
+{
+    g_assert(_LSTransportUringAddWatch(fixture->uring, &fixture->channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                       recv_cb, fixture, watch_destroy));
+    g_assert(_LSTransportUringOwnsWatch(&fixture->channel, _LSTransportUringGetSource(fixture->uring)));
+    g_assert(_LSTransportUringOwnsChannel(&fixture->channel));
+
+    /* case: nothing to read */
+    while (g_main_context_iteration(fixture->context, FALSE))
+    {
+    }
+    g_assert_cmpint(fixture->calls, ==, 0);
+
+    /* case: data */
+    g_assert_cmpint(write(fixture->fds[1], "hello", 5), ==, 5);
+    wait_for_calls(fixture, 1);
+    g_assert_cmpint(fixture->buf_len, ==, 5);
+    g_assert(0 == memcmp(fixture->buf, "hello", 5));
+    g_assert(!fixture->eof);
+
+    /* case: data with an fd */
+    int pipe_fds[2];
+    char c = 'x';
+    char cmsg_buf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    g_assert_cmpint(pipe(pipe_fds), ==, 0);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &pipe_fds[0], sizeof(int));
+
+    g_assert_cmpint(sendmsg(fixture->fds[1], &msg, 0), ==, 1);
+    wait_for_calls(fixture, 2);
+    g_assert_cmpint(fixture->buf_len, ==, 6);
+    g_assert_cmpint(fixture->buf[5], ==, 'x');
+    g_assert_cmpint(fixture->fd_recvd, !=, -1);
+    g_assert_cmpint(fixture->fd_recvd, !=, pipe_fds[0]);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    /* case: orderly shutdown */
+    shutdown(fixture->fds[1], SHUT_WR);
+    wait_for_calls(fixture, 3);
+    g_assert(fixture->eof);
+
+    /* case: removing the watch runs the destroy notification once */
+    _LSTransportUringRemoveWatch(&fixture->channel, G_IO_IN);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+    _LSTransportUringRemoveWatch(&fixture->channel, G_IO_IN);
+    g_assert_cmpint(fixture->destroyed, ==, 1);
+}
+
+static void
+test_LSTransportUringSend(TestData *fixture, gconstpointer user_data)
+{
+    char buf[16];
+    struct iovec iov[2] = {
+        { .iov_base = "hello ", .iov_len = 6 },
+        { .iov_base = "world", .iov_len = 5 },
+    };
+
+    g_assert(_LSTransportUringAddWatch(fixture->uring, &fixture->channel, G_IO_OUT,
+                                       send_cb, fixture, watch_destroy));
+
+    /* case: the callback runs again once the send is done */
+    _LSTransportUringSend(&fixture->channel, iov, 2, NULL, false, -1);
+    wait_for_calls(fixture, 1);
+    while (fixture->destroyed == 0)
+    {
+        g_main_context_iteration(fixture->context, TRUE);
+    }
+
+    g_assert_cmpint(fixture->send_ret, ==, 11);
+    g_assert(!_LSTransportUringTakeFdSent(&fixture->channel));
+    g_assert_cmpint(read(fixture->fds[1], buf, sizeof(buf)), ==, 11);
+    g_assert(0 == memcmp(buf, "hello world", 11));
+}
+
+static void
+test_LSTransportUringSendFd(TestData *fixture, gconstpointer user_data)
+{
+    int pipe_fds[2];
+    char buf[16];
+    char cmsg_buf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = "body", .iov_len = 4 };
+
+    g_assert_cmpint(pipe(pipe_fds), ==, 0);
+    g_assert(_LSTransportUringAddWatch(fixture->uring, &fixture->channel, G_IO_OUT,
+                                       send_cb, fixture, watch_destroy));
+
+    /* case: the fd goes out after the body, in a send of its own */
+    _LSTransportUringSend(&fixture->channel, &iov, 1, NULL, true, pipe_fds[0]);
+    g_assert(_LSTransportUringWaitSend(&fixture->channel, &fixture->send_ret));
+    g_assert_cmpint(fixture->send_ret, ==, 4);
+    g_assert(_LSTransportUringTakeFdSent(&fixture->channel));
+    g_assert(!_LSTransportUringTakeFdSent(&fixture->channel));
+
+    g_assert_cmpint(read(fixture->fds[1], buf, 4), ==, 4);
+
+    struct iovec rx_iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+    struct msghdr msg = {
+        .msg_iov = &rx_iov,
+        .msg_iovlen = 1,
+        .msg_control = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+    };
+
+    g_assert_cmpint(recvmsg(fixture->fds[1], &msg, 0), ==, 1);
+    g_assert(CMSG_FIRSTHDR(&msg) != NULL);
+    g_assert_cmpint(CMSG_FIRSTHDR(&msg)->cmsg_type, ==, SCM_RIGHTS);
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(CMSG_FIRSTHDR(&msg)), sizeof(int));
+    close(fd);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    /* case: nothing in flight */
+    g_assert(!_LSTransportUringWaitSend(&fixture->channel, &fixture->send_ret));
+}
+
+static void
+test_LSTransportUringAccept(TestData *fixture, gconstpointer user_data)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    _LSTransportChannel listen_channel;
+
+    /* abstract socket, so there's nothing to clean up */
+    snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "ls2-test-uring-%d", getpid());
+    socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr.sun_path + 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert_cmpint(bind(listen_fd, (struct sockaddr*)&addr, addr_len), ==, 0);
+    g_assert_cmpint(listen(listen_fd, 4), ==, 0);
+    g_assert(_LSTransportChannelInit(NULL, &listen_channel, listen_fd, G_PRIORITY_DEFAULT));
+
+    g_assert(_LSTransportUringAddWatch(fixture->uring, &listen_channel, G_IO_IN,
+                                       recv_cb, fixture, watch_destroy));
+
+    /* case: no connection yet */
+    errno = 0;
+    g_assert_cmpint(_LSTransportUringAccept(&listen_channel), ==, -1);
+    g_assert_cmpint(errno, ==, EAGAIN);
+
+    /* case: connections are accepted without re-arming */
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        g_assert_cmpint(connect(client_fd, (struct sockaddr*)&addr, addr_len), ==, 0);
+
+        int fd = -1;
+        while (fd < 0)
+        {
+            g_main_context_iteration(fixture->context, TRUE);
+            fd = _LSTransportUringAccept(&listen_channel);
+        }
+        close(fd);
+        close(client_fd);
+    }
+
+    _LSTransportUringRemoveWatch(&listen_channel, G_IO_IN);
+    _LSTransportChannelClose(&listen_channel, false);
+    _LSTransportChannelDeinit(&listen_channel);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    /* the transport falls back to plain socket I/O on such kernels */
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportUring *uring = _LSTransportUringNew(NULL, G_PRIORITY_DEFAULT, &lserror);
+    if (!uring)
+    {
+        g_print("io_uring is unavailable, skipping: %s\n", lserror.message);
+        LSErrorFree(&lserror);
+        return 0;
+    }
+    _LSTransportUringFree(uring);
+
+    g_test_add("/luna-service2/LSTransportUringReceive", TestData, NULL, test_setup, test_LSTransportUringReceive, test_teardown);
+    g_test_add("/luna-service2/LSTransportUringSend", TestData, NULL, test_setup, test_LSTransportUringSend, test_teardown);
+    g_test_add("/luna-service2/LSTransportUringSendFd", TestData, NULL, test_setup, test_LSTransportUringSendFd, test_teardown);
+    g_test_add("/luna-service2/LSTransportUringAccept", TestData, NULL, test_setup, test_LSTransportUringAccept, test_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,225 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <unistd.h>
+#include <glib.h>
+#include "workers.h"
+
+/* Test data ******************************************************************/
+
+typedef struct TestJob {
+    int id;
+    GAsyncQueue *done;      /**< ids of the finished jobs */
+    volatile gint *gate;    /**< the job waits while this is set */
+    int *freed;
+} TestJob;
+
+static void
+test_job_run(void *data)
+{
+    TestJob *job = data;
+
+    while (job->gate && g_atomic_int_get(job->gate))
+    {
+        g_usleep(1000);
+    }
+
+    g_async_queue_push(job->done, GINT_TO_POINTER(job->id));
+}
+
+static void
+test_job_free(void *data)
+{
+    TestJob *job = data;
+
+    g_atomic_int_inc(job->freed);
+    g_free(job);
+}
+
+static void
+push_job(_LSWorkers *workers, const void *key, int id, GAsyncQueue *done, volatile gint *gate, int *freed)
+{
+    TestJob *job = g_new0(TestJob, 1);
+
+    job->id = id;
+    job->done = done;
+    job->gate = gate;
+    job->freed = freed;
+
+    g_assert(_LSWorkersPush(workers, key, test_job_run, job, test_job_free, NULL));
+}
+
+static int
+pop_done(GAsyncQueue *done)
+{
+    gpointer id = g_async_queue_timeout_pop(done, 5 * G_USEC_PER_SEC);
+
+    g_assert(id != NULL);
+    return GPOINTER_TO_INT(id);
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSWorkersOrdered(void)
+{
+    static const int key;
+    GAsyncQueue *done = g_async_queue_new();
+    int freed = 0;
+    int i;
+
+    _LSWorkers *workers = _LSWorkersNew(4, NULL);
+    g_assert(workers != NULL);
+
+    /* case: jobs with the same key run one at a time, in order */
+    for (i = 1; i <= 100; i++)
+    {
+        push_job(workers, &key, i, done, NULL, &freed);
+    }
+
+    for (i = 1; i <= 100; i++)
+    {
+        g_assert_cmpint(pop_done(done), ==, i);
+    }
+
+    _LSWorkersFree(workers);
+    g_assert_cmpint(freed, ==, 100);
+    g_async_queue_unref(done);
+}
+
+static void
+test_LSWorkersConcurrent(void)
+{
+    static const int key1, key2;
+    GAsyncQueue *done = g_async_queue_new();
+    volatile gint gate = 1;
+    int freed = 0;
+
+    _LSWorkers *workers = _LSWorkersNew(2, NULL);
+    g_assert(workers != NULL);
+
+    /* case: a job that blocks doesn't hold up other keys or unordered jobs */
+    push_job(workers, &key1, 1, done, &gate, &freed);
+    push_job(workers, &key1, 2, done, NULL, &freed);
+    push_job(workers, &key2, 3, done, NULL, &freed);
+    g_assert_cmpint(pop_done(done), ==, 3);
+    push_job(workers, NULL, 4, done, NULL, &freed);
+    g_assert_cmpint(pop_done(done), ==, 4);
+
+    /* case: but it does hold up the jobs behind it */
+    g_assert(g_async_queue_timeout_pop(done, G_USEC_PER_SEC / 10) == NULL);
+
+    g_atomic_int_set(&gate, 0);
+    g_assert_cmpint(pop_done(done), ==, 1);
+    g_assert_cmpint(pop_done(done), ==, 2);
+
+    _LSWorkersFree(workers);
+    g_assert_cmpint(freed, ==, 4);
+    g_async_queue_unref(done);
+}
+
+static gpointer
+open_gate_later(gpointer data)
+{
+    g_usleep(G_USEC_PER_SEC / 10);
+    g_atomic_int_set((volatile gint*)data, 0);
+    return NULL;
+}
+
+static void
+test_LSWorkersFree(void)
+{
+    static const int key;
+    GAsyncQueue *done = g_async_queue_new();
+    volatile gint gate = 1;
+    int freed = 0;
+
+    _LSWorkers *workers = _LSWorkersNew(1, NULL);
+    g_assert(workers != NULL);
+
+    push_job(workers, &key, 1, done, &gate, &freed);
+    push_job(workers, &key, 2, done, NULL, &freed);
+
+    /* case: the running job is waited for, the queued one is dropped */
+    GThread *thread = g_thread_new("gate", open_gate_later, (gpointer)&gate);
+    _LSWorkersFree(workers);
+    g_thread_join(thread);
+
+    g_assert_cmpint(freed, ==, 2);
+    g_assert_cmpint(g_async_queue_length(done), ==, 1);
+    g_assert_cmpint(pop_done(done), ==, 1);
+
+    g_async_queue_unref(done);
+}
+
+static gboolean
+open_gate_idle(gpointer data)
+{
+    g_atomic_int_set((volatile gint*)data, 0);
+    return FALSE;
+}
+
+static void
+test_LSWorkersCloseDispatches(void)
+{
+    GAsyncQueue *done = g_async_queue_new();
+    GMainContext *context = g_main_context_new();
+    volatile gint gate = 1;
+    int freed = 0;
+
+    _LSWorkers *workers = _LSWorkersNew(1, NULL);
+    g_assert(workers != NULL);
+
+    push_job(workers, NULL, 1, done, &gate, &freed);
+
+    /* case: a running job that waits on the main loop can finish, since the
+     * context keeps being dispatched while its owner waits */
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, open_gate_idle, (gpointer)&gate, NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+
+    _LSWorkersClose(workers, context);
+
+    g_assert_cmpint(freed, ==, 1);
+    g_assert_cmpint(pop_done(done), ==, 1);
+
+    /* case: no more jobs once closed */
+    TestJob job = { 0 };
+    g_assert(!_LSWorkersPush(workers, NULL, test_job_run, &job, NULL, NULL));
+
+    _LSWorkersFree(workers);
+    g_main_context_unref(context);
+    g_async_queue_unref(done);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSWorkersOrdered", test_LSWorkersOrdered);
+    g_test_add_func("/luna-service2/LSWorkersConcurrent", test_LSWorkersConcurrent);
+    g_test_add_func("/luna-service2/LSWorkersFree", test_LSWorkersFree);
+    g_test_add_func("/luna-service2/LSWorkersCloseDispatches", test_LSWorkersCloseDispatches);
+
+    return g_test_run();
+}
@@ -19,6 +19,7 @@
 
 #include <glib.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -33,6 +34,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <poll.h>
 #include <pbnjson.h>
 
 #include "transport.h"
@@ -56,6 +58,10 @@
 
 #define LISTEN_BACKLOG  30
 
+#ifndef IOV_MAX
+#define IOV_MAX         1024    /**< Linux UIO_MAXIOV */
+#endif
+
 #if 0
 FILE *debug_print_file = NULL;
 
@@ -93,10 +99,22 @@ void _LSTransportRemoveReceiveWatch(_LSTransportChannel *channel);
 
 bool _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror);
 
+static void _LSTransportRingOffer(_LSTransportClient *client);
+static void _LSTransportHandleRingSetup(_LSTransportClient *client, _LSTransportMessage *message);
+static void _LSTransportHandleRingReady(_LSTransportClient *client);
+static gboolean _LSTransportSubmitWakeup(GIOChannel *source, GIOCondition condition, gpointer data);
+static void _LSTransportOfferLoopback(_LSTransportClient *client);
+static void _LSTransportHandleLoopbackOffer(_LSTransportClient *client, _LSTransportMessage *message);
+static void _LSTransportHandleLoopbackReady(_LSTransportClient *client);
+static void _LSTransportReceiveLoopback(_LSTransport *transport);
+static gboolean _LSTransportLoopbackWakeup(GIOChannel *source, GIOCondition condition, gpointer data);
+static bool _LSTransportIsLoopThread(_LSTransport *transport);
 
-bool _LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *service_name, const char *unique_name, bool prepend, LSError *lserror);
+
+bool _LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *service_name, const char *unique_name, int version, bool prepend, LSError *lserror);
 static bool _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient *monitor, _LSMonitorMessageType type, const struct timespec *timestamp, LSError *lserror);
 static bool _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *client, bool set_token, LSMessageToken *token, bool prepend, LSError *lserror);
+static bool _LSTransportSendMethodCall(_LSTransport *transport, _LSTransportMessageType type, const char *service_name, const char *category, const char *method, LSPayloadType payload_type, const char *payload, unsigned long payload_len, const char* applicationId, LSMessageToken *token, LSError *lserror);
 bool _LSTransportSendMessageToService(_LSTransport *transport, const char *service_name, _LSTransportMessage *message, LSMessageToken *token, LSError *lserror);
 bool _LSTransportAddPendingMessageWithToken(_LSTransport *transport, const char *service_name, _LSTransportMessage *message, LSMessageToken msg_token, LSError *lserror);
 bool _LSTransportAddPendingMessage(_LSTransport *transport, const char *service_name, _LSTransportMessage *message, LSMessageToken *token, LSError *lserror);
@@ -117,7 +135,9 @@ static bool s_is_hub = false;   /**< true if the process using this library is
  * @brief Get the next token for the given transport. This will wrap around
  * when exceeding the size of @ref LSMessageToken.
  *
- * @attention Locks the global token lock.
+ * Lock-free; every caller claims a distinct value with a compare-and-swap,
+ * so tokens stay unique across threads until the counter wraps. The counter
+ * steps over the invalid token, so it is never handed out.
  *
  * @param  transport    IN  transport
  *
@@ -127,20 +147,59 @@ static bool s_is_hub = false;   /**< true if the process using this library is
 LSMessageToken
 _LSTransportGetNextToken(_LSTransport *transport)
 {
-    LSMessageToken ret;
+    LSMessageToken old = transport->global_token->value;
+
+    while (1)
+    {
+        LSMessageToken ret = old + 1;
+
+        /* skip over invalid token */
+        bool rolled_over = (ret == LSMESSAGE_TOKEN_INVALID);
+        if (G_UNLIKELY(rolled_over))
+        {
+            ret++;
+        }
+
+        LSMessageToken seen = __sync_val_compare_and_swap(&transport->global_token->value, old, ret);
+        if (seen == old)
+        {
+            if (G_UNLIKELY(rolled_over))
+            {
+                LOG_LS_ERROR(MSGID_LS_TOKEN_ERR, 0, "Token value rolled over");
+            }
+            return ret;
+        }
 
-    GLOBAL_TOKEN_LOCK(&transport->global_token->lock);
-    ret = ++transport->global_token->value;
+        old = seen;
+    }
+}
 
-    /* skip over invalid token */
-    if (ret == LSMESSAGE_TOKEN_INVALID)
+/**
+ *******************************************************************************
+ * @brief Look up a connected client by service name.
+ *
+ * Only takes the clients read lock, so senders to different services don't
+ * serialize on the transport lock.
+ *
+ * @param  transport        IN  transport
+ * @param  service_name     IN  service name
+ *
+ * @retval client with a ref that the caller must drop
+ * @retval NULL if we aren't connected to the service
+ *******************************************************************************
+ */
+static _LSTransportClient*
+_LSTransportLookupClientRef(_LSTransport *transport, const char *service_name)
+{
+    CLIENTS_READ_LOCK(&transport->clients_lock);
+    _LSTransportClient *client = g_hash_table_lookup(transport->clients, service_name);
+    if (client)
     {
-        LOG_LS_ERROR(MSGID_LS_TOKEN_ERR, 0, "Token value rolled over");
-        ret = ++transport->global_token->value;
+        _LSTransportClientRef(client);
     }
-    GLOBAL_TOKEN_UNLOCK(&transport->global_token->lock);
+    CLIENTS_UNLOCK(&transport->clients_lock);
 
-    return ret;
+    return client;
 }
 
 void
@@ -156,6 +215,9 @@ _LSHandleDisconnect(_LSTransport *client, _LSTransportDisconnectType type, LSMes
  * @brief  Calls the message failure handler callback for outstanding method
  * calls (i.e., method calls that haven't received a reply).
  *
+ * The failure callbacks are only called after the serial ring has been
+ * emptied, since they can result in recursion.
+ *
  * @attention locks the serial info lock.
  *
  * @param  serial_info   IN  serial info
@@ -181,15 +243,14 @@ _LSTransportSerialHandleShutdown(_LSTransportSerial *serial_info, LSMessageToken
 
     GQueue *failure_queue = g_queue_new();
 
-    SERIAL_INFO_LOCK(&serial_info->lock);
-
-    GList *iter = g_queue_peek_head_link(serial_info->queue);
+    _LSTransportMessage *message;
     bool not_processed = false;
 
-    while (iter != NULL)
+    while ((message = _LSTransportSerialPopHead(serial_info)) != NULL)
     {
-        GList *tmp = iter;
-        LSMessageToken serial = ((_LSTransportSerialListItem*)(iter->data))->serial;
+        LSMessageToken serial = _LSTransportMessageGetToken(message);
+
+        _LSTransportMessageUnref(message);
 
         if (serial > last_serial)
         {
@@ -223,20 +284,8 @@ _LSTransportSerialHandleShutdown(_LSTransportSerial *serial_info, LSMessageToken
 
             g_queue_push_tail(failure_queue, fail_item);
         }
-
-        iter = g_list_next(iter);
-
-        /* remove item from list */
-        _LSTransportSerialListItemFree(tmp->data);
-        g_queue_delete_link(serial_info->queue, tmp);
-
-        /* remove from hash table */
-        _LSTransportSerialMapEntry *entry = g_hash_table_lookup(serial_info->map, &serial);
-        g_hash_table_remove(serial_info->map, &entry->serial);
     }
 
-    SERIAL_INFO_UNLOCK(&serial_info->lock);
-
     if (failure_queue)
     {
         while (!g_queue_is_empty(failure_queue))
@@ -273,6 +322,14 @@ _LSTransportDisconnectCleanup(_LSTransportClient *client)
         _LSTransportRemoveSendWatch(&client->channel);
     }
 
+    if (client->ring && client->ring->channel.recv_watch)
+    {
+        _LSTransportRemoveReceiveWatch(&client->ring->channel);
+    }
+
+    /* drops the refs that the two ends of the link hold on each other */
+    _LSTransportLoopbackUnpair(client);
+
     /* receive watch will be removed by return value in ReceiveWatch
      * (also rest of client info destruction happens then) */
 }
@@ -352,7 +409,7 @@ _LSTransportClientShutdownProcessQueue(_LSTransport *transport, _LSTransportOutg
         while (!g_queue_is_empty(outgoing->queue))
         {
             /* grab message off queue */
-            _LSTransportMessage *failed_message = (_LSTransportMessage*)g_queue_pop_head(outgoing->queue);
+            _LSTransportMessage *failed_message = _LSTransportOutgoingPop(outgoing);
 
             // We can be reentered from the callback. So don't hold the lock during the callback
             OUTGOING_UNLOCK(&outgoing->lock);
@@ -483,24 +540,9 @@ void
 _LSTransportClientShutdownDirty(_LSTransportClient *client)
 {
     /* "last_serial" is the first item on the serial list because we
-     * need to treat all of them as having failed */
-    LSMessageToken last_serial;
-
-    OUTGOING_SERIAL_LOCK(&client->outgoing->serial->lock);
-
-    _LSTransportSerialListItem *item = (_LSTransportSerialListItem*) g_queue_peek_head(client->outgoing->serial->queue);
-
-    if (item)
-    {
-        last_serial = item->serial;
-    }
-    else
-    {
-        /* no outstanding method calls */
-        last_serial = LSMESSAGE_TOKEN_INVALID;
-    }
-
-    OUTGOING_SERIAL_UNLOCK(&client->outgoing->serial->lock);
+     * need to treat all of them as having failed; it is
+     * LSMESSAGE_TOKEN_INVALID when there are no outstanding method calls */
+    LSMessageToken last_serial = _LSTransportSerialGetHeadSerial(client->outgoing->serial);
 
     _LSTransportClientShutdown(client, last_serial, _LSTransportDisconnectTypeDirty, false);
 
@@ -549,7 +591,7 @@ _call_pending(_LSTransportClient *client, int serial)
 
     if (pending)
     {
-        return g_hash_table_lookup(pending->serial->map, &serial) != NULL;
+        return _LSTransportSerialContains(pending->serial, serial);
     }
     else
     {
@@ -598,7 +640,8 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
             A message can be:
                 - only in the serial queue, it was completely sent.
                 - in the serial and outgoing queues, 0 to n-1 bytes have been sent.
-                - only in the outgoing queue, it isn't a method call.
+                - only in the outgoing queue, it isn't a method call, or it is a
+                  no-reply call sent as a plain one to a version 1 peer.
         */
 
         // Move the contents (if any) of the serial queue to the new pending queue
@@ -621,11 +664,12 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
                    (outgoing_message_token = _LSTransportMessageGetToken(outgoing_message)) <= serial_message_token
             )
             {
-                outgoing_message = g_queue_pop_head(client->outgoing->queue);
+                outgoing_message = _LSTransportOutgoingPop(client->outgoing);
 
                 if (outgoing_message_token < serial_message_token)
                 {
-                    LS_ASSERT(_LSTransportMessageTypeMethodCall != _LSTransportMessageGetType(outgoing_message));
+                    LS_ASSERT(_LSTransportMessageTypeMethodCall != _LSTransportMessageGetType(outgoing_message) ||
+                              _LSTransportClientGetVersion(client) < 2);
                     g_queue_push_tail(new_pending, outgoing_message);
                 }
                 else
@@ -641,9 +685,10 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
         }
 
         // Move the remaining contents (if any) of the outgoing queue to the new pending queue
-        while ((outgoing_message = g_queue_pop_head(client->outgoing->queue)) != NULL)
+        while ((outgoing_message = _LSTransportOutgoingPop(client->outgoing)) != NULL)
         {
-            LS_ASSERT(_LSTransportMessageTypeMethodCall != _LSTransportMessageGetType(outgoing_message));
+            LS_ASSERT(_LSTransportMessageTypeMethodCall != _LSTransportMessageGetType(outgoing_message) ||
+                      _LSTransportClientGetVersion(client) < 2);
             LS_ASSERT(_LSTransportMessageGetToken(outgoing_message) > serial_message_token);
             g_queue_push_tail(new_pending, outgoing_message);
         }
@@ -731,6 +776,11 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
  *******************************************************************************
  * @brief Add a watch to a channel and attach it to the main context.
  *
+ * With the epoll or io_uring engine the channel is registered with the
+ * transport's engine, and @ref out_watch refers to the engine's source.
+ * Channels watched in another main context get a GIOChannel watch of their
+ * own, and so do channels the engine can't serve.
+ *
  * @param  channel       IN  channel to watch
  * @param  condition     IN  condition to watch
  * @param  context       IN  main context
@@ -749,6 +799,38 @@ _LSTransportAddWatch(_LSTransportChannel *channel, GIOCondition condition, GMain
     LS_ASSERT(out_watch != NULL);
     LS_ASSERT(*out_watch == NULL);
 
+    _LSTransportUring *uring = channel->transport ? channel->transport->uring : NULL;
+
+    if (uring && g_source_get_context(_LSTransportUringGetSource(uring)) == context)
+    {
+        /* set before registering, since the callback may run right away */
+        *out_watch = g_source_ref(_LSTransportUringGetSource(uring));
+
+        if (_LSTransportUringAddWatch(uring, channel, condition, transport_cb, user_data, destroy_cb))
+        {
+            return;
+        }
+
+        g_source_unref(*out_watch);
+        *out_watch = NULL;
+    }
+
+    _LSTransportEpoll *epoll = channel->transport ? channel->transport->epoll : NULL;
+
+    if (epoll && g_source_get_context(_LSTransportEpollGetSource(epoll)) == context)
+    {
+        /* set before registering, since the callback may run right away */
+        *out_watch = g_source_ref(_LSTransportEpollGetSource(epoll));
+
+        if (_LSTransportEpollAddWatch(epoll, channel, condition, transport_cb, user_data, destroy_cb))
+        {
+            return;
+        }
+
+        g_source_unref(*out_watch);
+        *out_watch = NULL;
+    }
+
     GSource *watch = g_io_create_watch(channel->channel, condition);
 
     if (channel->priority != G_PRIORITY_DEFAULT)
@@ -776,18 +858,30 @@ _LSTransportAddWatch(_LSTransportChannel *channel, GIOCondition condition, GMain
  * @brief Remove a watch from a channel.
  *
  * @param  channel      IN      channel that watch is on
+ * @param  condition    IN      condition the watch was added with
  * @param  *out_watch   IN/OUT  watch (set to NULL after destroying)
  *******************************************************************************
  */
 static void
-_LSTransportRemoveWatch(_LSTransportChannel *channel, GSource **out_watch)
+_LSTransportRemoveWatch(_LSTransportChannel *channel, GIOCondition condition, GSource **out_watch)
 {
     LS_ASSERT(channel != NULL);
     LS_ASSERT(out_watch != NULL);
     LS_ASSERT(*out_watch != NULL);
 
     /* The user_data will be cleaned up by the GDestroyNotify callback */
-    g_source_destroy(*out_watch);
+    if (_LSTransportUringOwnsWatch(channel, *out_watch))
+    {
+        _LSTransportUringRemoveWatch(channel, condition);
+    }
+    else if (_LSTransportEpollOwnsWatch(channel, *out_watch))
+    {
+        _LSTransportEpollRemoveWatch(channel, condition);
+    }
+    else
+    {
+        g_source_destroy(*out_watch);
+    }
     g_source_unref(*out_watch);
     *out_watch = NULL;
 }
@@ -807,6 +901,14 @@ _LSTransportAddSendWatch(_LSTransportChannel *channel, GMainContext *context, _L
     LS_ASSERT(channel != NULL);
     LS_ASSERT(context != NULL);
 
+    /* The socket is always writable, so once we send through the ring we
+     * rely on its wakeups instead */
+    if (client->ring && client->ring->tx_active)
+    {
+        _LSTransportRingKick(client->ring);
+        return;
+    }
+
     if (!channel->send_watch)
     {
         LOG_LS_DEBUG("%s: channel: %p, context: %p, client: %p\n", __func__, channel, context, client);
@@ -833,7 +935,7 @@ _LSTransportRemoveSendWatch(_LSTransportChannel *channel)
 
     if (channel->send_watch)
     {
-        _LSTransportRemoveWatch(channel, &channel->send_watch);
+        _LSTransportRemoveWatch(channel, G_IO_OUT, &channel->send_watch);
         /* client is unref'd by GDestroyNotify callback */
     }
 }
@@ -879,7 +981,7 @@ _LSTransportRemoveReceiveWatch(_LSTransportChannel *channel)
 
     if (channel->recv_watch)
     {
-        _LSTransportRemoveWatch(channel, &channel->recv_watch);
+        _LSTransportRemoveWatch(channel, G_IO_IN, &channel->recv_watch);
         /* client is unref'd by GDestroyNotify callback */
     }
 }
@@ -919,7 +1021,7 @@ _LSTransportRemoveAcceptWatch(_LSTransportChannel *channel)
 
     LOG_LS_DEBUG("%s: channel: %p\n", __func__, channel);
 
-    _LSTransportRemoveWatch(channel, &channel->accept_watch);
+    _LSTransportRemoveWatch(channel, G_IO_IN, &channel->accept_watch);
 }
 
 /**
@@ -956,6 +1058,37 @@ _LSTransportAddClientWatches(void *ignored, _LSTransportClient *client, GMainCon
 void
 _LSTransportAddInitialWatches(_LSTransport *transport, GMainContext *context)
 {
+    if (transport->use_uring && !transport->uring)
+    {
+        LSError lserror;
+        LSErrorInit(&lserror);
+
+        transport->uring = _LSTransportUringNew(context, transport->source_priority, &lserror);
+        if (!transport->uring)
+        {
+            /* e.g., the kernel is too old; sockets are read and written
+             * directly instead */
+            LOG_LS_WARNING(MSGID_LS_URING_ERR, 1,
+                           PMLOGKS("ERROR", lserror.message),
+                           "io_uring engine unavailable, falling back to direct socket I/O");
+            LSErrorFree(&lserror);
+        }
+    }
+
+    if (transport->use_epoll && !transport->epoll && !transport->uring)
+    {
+        LSError lserror;
+        LSErrorInit(&lserror);
+
+        transport->epoll = _LSTransportEpollNew(context, transport->source_priority, &lserror);
+        if (!transport->epoll)
+        {
+            /* channels get GIOChannel watches instead */
+            LOG_LSERROR(MSGID_LS_EPOLL_ERR, &lserror);
+            LSErrorFree(&lserror);
+        }
+    }
+
     /* set up send/receive watches on all clients and hub so we can
      * kickstart sending of messages */
     TRANSPORT_LOCK(&transport->lock);
@@ -970,6 +1103,24 @@ _LSTransportAddInitialWatches(_LSTransport *transport, GMainContext *context)
 
     /* Watch and accept incoming connections */
     _LSTransportAddAcceptWatch(&transport->listen_channel, context, transport);
+
+    /* Pick up the messages sent from other threads */
+    if (transport->submit && !transport->submit->channel.recv_watch)
+    {
+        _LSTransportChannelInit(transport, &transport->submit->channel, transport->submit->event_fd, transport->source_priority);
+        _LSTransportAddWatch(&transport->submit->channel, G_IO_IN, context,
+                             _LSTransportSubmitWakeup, transport, NULL,
+                             &transport->submit->channel.recv_watch);
+    }
+
+    /* Pick up the messages from linked clients in this process */
+    if (transport->loopback && !transport->loopback->channel.recv_watch)
+    {
+        _LSTransportChannelInit(transport, &transport->loopback->channel, transport->loopback->event_fd, transport->source_priority);
+        _LSTransportAddWatch(&transport->loopback->channel, G_IO_IN, context,
+                             _LSTransportLoopbackWakeup, transport, NULL,
+                             &transport->loopback->channel.recv_watch);
+    }
 }
 
 /**
@@ -988,6 +1139,9 @@ _LSTransportGmainAttach(_LSTransport *transport, GMainContext *context)
 
     LOG_LS_DEBUG("%s: mainloop_context: %p\n", __func__, transport->mainloop_context);
 
+    /* checked by every send from another thread, so it's not worth asking
+     * the context itself and taking its lock each time */
+    transport->loop_thread = pthread_self();
     transport->mainloop_context = g_main_context_ref(context);
 
     _LSTransportAddInitialWatches(transport, transport->mainloop_context);
@@ -1054,6 +1208,17 @@ _LSTransportGmainSetPriority(_LSTransport *transport, int priority, LSError *lse
     /* set the priority for our accept watch */
     _LSTransportChannelSetPriority(&transport->listen_channel, priority);
 
+    /* the engine serves all of the watches above */
+    if (transport->epoll)
+    {
+        g_source_set_priority(_LSTransportEpollGetSource(transport->epoll), priority);
+    }
+
+    if (transport->uring)
+    {
+        g_source_set_priority(_LSTransportUringGetSource(transport->uring), priority);
+    }
+
     /* keep track of priority for future source creation */
     transport->source_priority = priority;
 
@@ -1304,7 +1469,7 @@ error:
  *******************************************************************************
  * @brief Add client to hash of service name to client.
  *
- * @attention should be called with transport lock
+ * @attention should be called with transport lock; locks the clients lock
  *
  * @param  transport    IN  transport
  * @param  client       IN  client to add (value)
@@ -1328,7 +1493,9 @@ _LSTransportAddClientHash(_LSTransport *transport, _LSTransportClient *client, c
     _LSTransportClientRef(client);
 
     /* TODO: insert or replace ? */
+    CLIENTS_WRITE_LOCK(&transport->clients_lock);
     g_hash_table_insert(transport->clients, (gpointer)name, client);
+    CLIENTS_UNLOCK(&transport->clients_lock);
 
     return true;
 }
@@ -1363,6 +1530,8 @@ _LSTransportClientHashRemoveFunc(gpointer key, gpointer value, gpointer user_dat
  *******************************************************************************
  * @brief Remove the specified client from the client hash.
  *
+ * @attention should be called with transport lock; locks the clients lock
+ *
  * @param  transport    IN  transport
  * @param  client       IN  client to remove
  *******************************************************************************
@@ -1376,7 +1545,9 @@ _LSTransportRemoveClientHash(_LSTransport *transport, _LSTransportClient *client
      * TODO: this is a linear search; it's only done on shutdown, but we should
      * still probably change it.
      */
+    CLIENTS_WRITE_LOCK(&transport->clients_lock);
     int ret = g_hash_table_foreach_remove(transport->clients, _LSTransportClientHashRemoveFunc, client);
+    CLIENTS_UNLOCK(&transport->clients_lock);
 
     LS_ASSERT(ret == 1 || ret == 0);
 }
@@ -1410,6 +1581,32 @@ _LSTransportAddAllConnectionHash(_LSTransport *transport, _LSTransportClient *cl
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Replace the filter of the monitor.
+ *
+ * Threads that copy messages to the monitor read the filter without a lock,
+ * so the old one is only retired here and freed with the transport.
+ *
+ * @param  transport    IN  transport
+ * @param  filter       IN  new filter (ownership transferred); NULL for all
+ *******************************************************************************
+ */
+static void
+_LSTransportSetMonitorFilter(_LSTransport *transport, _LSTransportMonitorFilter *filter)
+{
+    _LSTransportMonitorFilter *old_filter = transport->monitor_filter;
+
+    /* the filter has to be complete before other threads can see it */
+    __sync_synchronize();
+    transport->monitor_filter = filter;
+
+    if (old_filter)
+    {
+        transport->monitor_filters_retired = g_slist_prepend(transport->monitor_filters_retired, old_filter);
+    }
+}
+
 /**
  *******************************************************************************
  * @brief Remove specified client from the all connection hash.
@@ -1432,6 +1629,9 @@ _LSTransportRemoveAllConnectionHash(_LSTransport *transport, _LSTransportClient
         /* we had a ref associated with this */
         _LSTransportClientUnref(client);
         transport->monitor = NULL;
+        transport->monitor_trace = false;
+
+        _LSTransportSetMonitorFilter(transport, NULL);
     }
 
     /* destroy function will unref client */
@@ -1904,6 +2104,65 @@ _LSTransportSendFd(int fd, int fd_to_send, bool *retry, LSError *lserror)
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Non-blocking read of as much data as is available into @ref buf.
+ *
+ * A file descriptor passed with _LSTransportSendFd() can arrive as part of
+ * the data, so the read is done with room for one in the ancillary data. The
+ * kernel ends the read right after the byte that carries it.
+ *
+ * @param  fd           IN      fd to read from
+ * @param  buf          IN      buffer to read into
+ * @param  len          IN      size of @ref buf
+ * @param  fd_recvd     IN/OUT  set to the received file descriptor, if any
+ *
+ * @retval  same as recv()
+ *******************************************************************************
+ */
+static int
+_LSTransportRecvBuffered(int fd, char *buf, size_t len, int *fd_recvd)
+{
+    char cmsg_buf[FD_CMSG_SPACE];
+    struct msghdr msg;
+    struct cmsghdr *cmsg = NULL;
+    struct iovec iov[1];
+
+    iov[0].iov_base = buf;
+    iov[0].iov_len = len;
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = ARRAY_SIZE(iov);
+    msg.msg_name = NULL;
+    msg.msg_namelen = 0;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+    msg.msg_flags = 0;
+
+    int ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            if (*fd_recvd != -1)
+            {
+                /* the previous one was never claimed by a message */
+                LOG_LS_WARNING(MSGID_LS_SOCK_ERROR, 0, "Dropping unexpected fd: %d", *fd_recvd);
+                close(*fd_recvd);
+            }
+            memcpy(fd_recvd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    return ret;
+}
+
 /**
  *******************************************************************************
  * @brief Send data until all has been sent or an error is encountered.
@@ -2027,6 +2286,7 @@ _LSTransportRecvMessageBlocking(_LSTransportClient *client, _LSTransportMessageT
     bool restore_watch = false;
     _LSTransportMessage *message = NULL;
     _LSTransportHeader header;
+    _LSTransportHeaderV2 wire;
     bool old_block_state = false;
 
     /* If there is a send watch for this client, temporarily remove it so that
@@ -2047,14 +2307,23 @@ _LSTransportRecvMessageBlocking(_LSTransportClient *client, _LSTransportMessageT
      * to be handled later -- how do we kick the message handler? */
 
     /* TODO: use poll() with timeout value */
-    int bytes_recvd = _LSTransportRecvComplete(client->channel.fd, &header, sizeof(header), lserror);
+    int rx_version = client->rx_version;
+    unsigned long hdr_size = _LSTransportHeaderSize(rx_version);
+    int bytes_recvd = _LSTransportRecvComplete(client->channel.fd, rx_version >= 2 ? (void*)&wire : (void*)&header,
+                                               hdr_size, lserror);
 
     if (bytes_recvd == -1)
     {
         goto exit;
     }
 
-    LS_ASSERT(bytes_recvd == sizeof(header));
+    LS_ASSERT(bytes_recvd == hdr_size);
+
+    if (rx_version >= 2 && !_LSTransportHeaderFromV2(&wire, &header))
+    {
+        _LSErrorSet(lserror, MSGID_LS_MSG_ERR, -1, "Received a message header with unknown flags: 0x%x", wire.flags);
+        goto exit;
+    }
 
     int i;
     bool msg_type_match = false;
@@ -2073,6 +2342,11 @@ _LSTransportRecvMessageBlocking(_LSTransportClient *client, _LSTransportMessageT
 
     _LSTransportMessageSetHeader(message, &header);
 
+    if (rx_version >= 2)
+    {
+        _LSTransportMessageSetWireHeader(message, &wire);
+    }
+
     bytes_recvd = _LSTransportRecvComplete(client->channel.fd, _LSTransportMessageGetBody(message), message->raw->header.len, lserror);
 
     if (bytes_recvd == -1)
@@ -2160,17 +2434,25 @@ _LSTransportSendMessageBlocking(_LSTransportMessage *message, _LSTransportClient
     /* LOCK -- this grabs global_token lock */
     _LSTransportMessageSetToken(message, _LSTransportGetNextToken(client->transport));
 
-    message->tx_bytes_remaining = message->raw->header.len + sizeof(_LSTransportHeader);
+    _LSTransportMessageSetTxVersion(message, client->tx_version);
 
-    int send_ret = _LSTransportSendComplete(client->channel.fd, (char*)message->raw + message->raw->header.len + sizeof(_LSTransportHeader) - message->tx_bytes_remaining, message->tx_bytes_remaining, lserror);
+    struct iovec iov[2];
+    int iov_count = _LSTransportMessageGetTxIov(message, iov);
+    int i;
 
-    if (send_ret == -1)
+    for (i = 0; i < iov_count; i++)
     {
-        ret = false;
-        goto exit;
+        int send_ret = _LSTransportSendComplete(client->channel.fd, iov[i].iov_base, iov[i].iov_len, lserror);
+
+        if (send_ret == -1)
+        {
+            ret = false;
+            goto exit;
+        }
+
+        LS_ASSERT(send_ret == iov[i].iov_len);
     }
 
-    LS_ASSERT(send_ret == message->tx_bytes_remaining);
     message->tx_bytes_remaining = 0;
 
     if (token)
@@ -2194,6 +2476,47 @@ exit:
     return ret;
 }
 
+/**
+ *******************************************************************************
+ * @brief Hand our trace ring to the monitor.
+ *
+ * The monitor maps the ring read-only and polls it, so nothing but this
+ * message goes over the socket until the monitor goes away.
+ *
+ * @param  transport    IN  transport connected to a monitor in trace mode
+ *******************************************************************************
+ */
+static void
+_LSTransportSendMessageTraceRing(_LSTransport *transport)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    /* the message closes its fd once it has been sent */
+    int fd = dup(transport->trace->fd);
+    if (fd == -1)
+    {
+        LOG_LS_ERROR(MSGID_LS_DUP_ERR, 2,
+                     PMLOGKFV("ERROR_CODE", "%d", errno),
+                     PMLOGKS("ERROR", g_strerror(errno)),
+                     "%s: dup() failed", __func__);
+        return;
+    }
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeTraceRing);
+    _LSTransportMessageSetConnectionFd(message, fd);
+
+    if (!_LSTransportSendMessage(message, transport->monitor, NULL, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    _LSTransportMessageUnref(message);
+}
+
 /**
  *******************************************************************************
  * @brief Process a monitor message, which involves connecting to the monitor
@@ -2226,10 +2549,34 @@ _LSTransportHandleMonitor(_LSTransportMessage *message)
         return;
     }
 
+    int32_t monitor_version = 0;
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageGetInt32(&iter, &monitor_version);
+
+    /* older hubs don't send the mode */
+    int32_t monitor_trace = 0;
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageGetInt32(&iter, &monitor_trace);
+
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMonitorFilter *monitor_filter = _LSTransportMonitorFilterRead(&iter);
+
     LS_ASSERT(_LSTransportMessageGetType(message) != _LSTransportMessageTypeMonitorNotConnected);
 
     LOG_LS_DEBUG("%s: connecting to monitor: %s\n", __func__, unique_name);
 
+    /* the ring outlives the monitor, so a monitor that comes back later
+     * picks up where the last one left */
+    if (monitor_trace && !transport->trace)
+    {
+        transport->trace = _LSTransportTraceNew(LS_TRANSPORT_TRACE_RECORDS);
+    }
+
+    /* without a ring the monitor gets copies as usual */
+    transport->monitor_trace = monitor_trace && transport->trace;
+
+    _LSTransportSetMonitorFilter(transport, monitor_filter);
+
     transport->monitor = _LSTransportConnectClient(transport, NULL, unique_name, dup(_LSTransportMessageGetConnectionFd(message)), NULL, &lserror);
 
     if (!transport->monitor)
@@ -2240,12 +2587,18 @@ _LSTransportHandleMonitor(_LSTransportMessage *message)
     }
 
     /* MONITOR -- send client info so monitor knows who we are */
-    if (!_LSTransportSendMessageClientInfo(transport->monitor, transport->service_name, transport->unique_name, false, &lserror))
+    if (!_LSTransportSendMessageClientInfo(transport->monitor, transport->service_name, transport->unique_name,
+                                           _LSTransportNegotiateVersion(monitor_version), false, &lserror))
     {
         LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
         LSErrorFree(&lserror);
     }
 
+    if (transport->monitor_trace)
+    {
+        _LSTransportSendMessageTraceRing(transport);
+    }
+
     /* add to hash of all connected clients, but not named client hash */
     TRANSPORT_LOCK(&transport->lock);
     /* client ref +1 (total = 2) */
@@ -2261,26 +2614,21 @@ _LSTransportHandleMonitor(_LSTransportMessage *message)
 
 /**
  *******************************************************************************
- * @brief Run the user's message handler for the message. If the message is of
- * method call type, check the return value from the callback and possibly
- * send an error message in reply.
+ * @brief Send an error in reply to a method call that wasn't handled.
  *
- * @param  message  IN  message
+ * Also used for method calls that were handled off the main loop, once the
+ * handler has run.
+ *
+ * @param  message  IN  method call
+ * @param  ret      IN  result of the handler
  *******************************************************************************
  */
-static void
-_LSTransportHandleUserMessageHandler(_LSTransportMessage *message)
+void
+_LSTransportReplyToHandlerResult(const _LSTransportMessage *message, LSMessageHandlerResult ret)
 {
-    LOG_LS_DEBUG("%s: calling user's msg_handler\n", __func__);
-
     LSError lserror;
     LSErrorInit(&lserror);
 
-    _LSTransportClient *client = _LSTransportMessageGetClient(message);
-    void *msg_context = client->transport->msg_context;
-
-    LSMessageHandlerResult ret = (*client->transport->msg_handler)(message, msg_context);
-
     /*
      * We only care about whether the message was handled if the message type
      * is a method call, since we need to send a reply error message in that
@@ -2339,6 +2687,28 @@ _LSTransportHandleUserMessageHandler(_LSTransportMessage *message)
     return;
 }
 
+/**
+ *******************************************************************************
+ * @brief Run the user's message handler for the message. If the message is of
+ * method call type, check the return value from the callback and possibly
+ * send an error message in reply.
+ *
+ * @param  message  IN  message
+ *******************************************************************************
+ */
+static void
+_LSTransportHandleUserMessageHandler(_LSTransportMessage *message)
+{
+    LOG_LS_DEBUG("%s: calling user's msg_handler\n", __func__);
+
+    _LSTransportClient *client = _LSTransportMessageGetClient(message);
+    void *msg_context = client->transport->msg_context;
+
+    LSMessageHandlerResult ret = (*client->transport->msg_handler)(message, msg_context);
+
+    _LSTransportReplyToHandlerResult(message, ret);
+}
+
 /**
  *******************************************************************************
  * @brief Get the status of the monitor when first connecting to the hub so we
@@ -2375,14 +2745,39 @@ _LSTransportReceiveMonitorStatus(_LSTransport *transport, _LSTransportClient *cl
 
 /**
  *******************************************************************************
- * @brief Request a service name from the hub. NULL means we just need a unique
- * name.
+ * @brief Get the features we announce to the hub and to peers.
  *
- * @attention This call blocks until a name has been received from the hub.
+ * @param  transport    IN  transport
  *
- * @param  requested_name   IN  service name or NULL for only unique name
- * @param  client           IN  client
- * @param  fd               OUT fd passed from hub that we should listen on
+ * @retval bitmask of LS_TRANSPORT_FEATURE_* values
+ *******************************************************************************
+ */
+static int
+_LSTransportGetFeatures(const _LSTransport *transport)
+{
+    int features = _LSTransportCompressGetFeatures();
+
+    if (transport->ring_size)
+    {
+        features |= LS_TRANSPORT_FEATURE_RING;
+    }
+
+    return features;
+}
+
+/**
+ *******************************************************************************
+ * @brief Request a service name from the hub. NULL means we just need a unique
+ * name.
+ *
+ * @attention This call blocks until a name has been received from the hub.
+ *
+ * A hub that rejects our protocol version is asked again with
+ * @ref LS_TRANSPORT_PROTOCOL_VERSION_MIN, and the link stays on the v1 header.
+ *
+ * @param  requested_name   IN  service name or NULL for only unique name
+ * @param  client           IN  client
+ * @param  fd               OUT fd passed from hub that we should listen on
  * @param  privileged       OUT true if the service is privileged
  * @param  lserror          OUT set on error
  *
@@ -2396,16 +2791,20 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
     _LSTransportMessageIter iter;
     const char *unique_name_tmp = NULL;
     char *unique_name = NULL;
+    int32_t protocol_version = LS_TRANSPORT_PROTOCOL_VERSION;
+    _LSTransportMessage *message = NULL;
 
     LOG_LS_DEBUG("%s: requested_name: %s, client: %p\n", __func__, requested_name, client);
 
-    _LSTransportMessage *message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
+retry:
+    message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
 
     _LSTransportMessageSetType(message, _LSTransportMessageTypeRequestNameLocal);
 
     _LSTransportMessageIterInit(message, &iter);
-    if (!_LSTransportMessageAppendInt32(&iter, LS_TRANSPORT_PROTOCOL_VERSION)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, protocol_version)) goto error;
     if (!_LSTransportMessageAppendString(&iter, requested_name)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, _LSTransportGetFeatures(client->transport))) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     if (!_LSTransportSendMessageBlocking(message, client, NULL, lserror))
@@ -2446,6 +2845,17 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
         _LSTransportMessageIterNext(&iter);
         _LSTransportMessageGetString(&iter, &unique_name_tmp);
 
+        /* hubs that predate the v2 header don't say which version they speak */
+        int32_t hub_version = 0;
+        _LSTransportMessageIterNext(&iter);
+        _LSTransportMessageGetInt32(&iter, &hub_version);
+
+        /* nor do they compress anything */
+        int32_t compress_threshold = 0;
+        _LSTransportMessageIterNext(&iter);
+        _LSTransportMessageGetInt32(&iter, &compress_threshold);
+        client->transport->compress_threshold = MAX(compress_threshold, 0);
+
         /* need copy since iterator points inside message */
         unique_name = g_strdup(unique_name_tmp);
 
@@ -2469,6 +2879,8 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
 
         LOG_LS_DEBUG("%s: received unique_name: %s, %sprivileged\n", __func__, unique_name, *privileged ? "" : "not ");
 
+        _LSTransportClientSwitchVersion(client, NULL, _LSTransportNegotiateVersion(hub_version));
+
         break;
     }
 
@@ -2480,6 +2892,21 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
         _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_DUPLICATE_NAME, LS_ERROR_TEXT_DUPLICATE_NAME, requested_name);
         break;
 
+    case LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION:
+        /* hubs that predate the v2 header only take the version they speak */
+        if (protocol_version > LS_TRANSPORT_PROTOCOL_VERSION_MIN)
+        {
+            LOG_LS_DEBUG("%s: hub rejected version %"PRId32", retrying with %d\n", __func__,
+                         protocol_version, LS_TRANSPORT_PROTOCOL_VERSION_MIN);
+            protocol_version = LS_TRANSPORT_PROTOCOL_VERSION_MIN;
+            _LSTransportMessageUnref(message);
+            message = NULL;
+            goto retry;
+        }
+
+        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, protocol_version);
+        break;
+
     default:
         _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_UNKNOWN_ERROR, LS_ERROR_TEXT_UNKNOWN_ERROR);
         break;
@@ -2502,6 +2929,9 @@ error:
  *
  * @attention This call blocks until a name has been received from the hub.
  *
+ * A hub that rejects our protocol version is asked again with
+ * @ref LS_TRANSPORT_PROTOCOL_VERSION_MIN, and the link stays on the v1 header.
+ *
  * @param  requested_name   IN  service name or NULL for only unique name
  * @param  client           IN  client
  * @param  privileged       OUT true if the service is privileged
@@ -2520,6 +2950,7 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
     _LSTransportMessage *message = NULL;
     bool alloc_error = true;
     _LSTransportMessageIter iter;
+    int32_t protocol_version = LS_TRANSPORT_PROTOCOL_VERSION;
 
     LOG_LS_DEBUG("%s: requested_name: %s, client: %p\n", __func__, requested_name, client);
 
@@ -2539,14 +2970,16 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
 
     LOG_LS_DEBUG("%s: port: %d\n", __func__, port);
 
+retry:
     message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
 
     _LSTransportMessageSetType(message, _LSTransportMessageTypeRequestNameInet);
 
     _LSTransportMessageIterInit(message, &iter);
-    if (!_LSTransportMessageAppendInt32(&iter, LS_TRANSPORT_PROTOCOL_VERSION)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, protocol_version)) goto error;
     if (!_LSTransportMessageAppendString(&iter, requested_name)) goto error;
     if (!_LSTransportMessageAppendInt32(&iter, port)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, _LSTransportGetFeatures(client->transport))) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     if (!_LSTransportSendMessageBlocking(message, client, NULL, lserror)) goto exit;
@@ -2580,6 +3013,17 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
         _LSTransportMessageIterNext(&iter);
         _LSTransportMessageGetString(&iter, &unique_name_tmp);
 
+        /* hubs that predate the v2 header don't say which version they speak */
+        int32_t hub_version = 0;
+        _LSTransportMessageIterNext(&iter);
+        _LSTransportMessageGetInt32(&iter, &hub_version);
+
+        /* nor do they compress anything */
+        int32_t compress_threshold = 0;
+        _LSTransportMessageIterNext(&iter);
+        _LSTransportMessageGetInt32(&iter, &compress_threshold);
+        client->transport->compress_threshold = MAX(compress_threshold, 0);
+
         /* need copy since iterator points inside message */
         unique_name = g_strdup(unique_name_tmp);
 
@@ -2590,6 +3034,8 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
 
         LOG_LS_DEBUG("%s: received unique_name: %s, %sprivileged\n", __func__, unique_name, *privileged ? "" : "not ");
 
+        _LSTransportClientSwitchVersion(client, NULL, _LSTransportNegotiateVersion(hub_version));
+
         break;
     }
 
@@ -2602,8 +3048,18 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
         break;
 
     case LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION:
-        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, LS_TRANSPORT_PROTOCOL_VERSION);
+        /* hubs that predate the v2 header only take the version they speak */
+        if (protocol_version > LS_TRANSPORT_PROTOCOL_VERSION_MIN)
+        {
+            LOG_LS_DEBUG("%s: hub rejected version %"PRId32", retrying with %d\n", __func__,
+                         protocol_version, LS_TRANSPORT_PROTOCOL_VERSION_MIN);
+            protocol_version = LS_TRANSPORT_PROTOCOL_VERSION_MIN;
+            _LSTransportMessageUnref(message);
+            message = NULL;
+            goto retry;
+        }
 
+        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, protocol_version);
         break;
 
     default:
@@ -2811,6 +3267,71 @@ _LSTransportQueryNameReplyGetIsDynamic(_LSTransportMessage *message)
     return false;
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the protocol version of the far side out of a "QueryName" reply
+ * message.
+ *
+ * @param  message  IN  query name message
+ *
+ * @retval  protocol version the far side speaks with the hub
+ * @retval  0 if the hub didn't say
+ *******************************************************************************
+ */
+int32_t
+_LSTransportQueryNameReplyGetVersion(_LSTransportMessage *message)
+{
+    LS_ASSERT(message != NULL);
+    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeQueryNameReply);
+    _LSTransportMessageIter iter;
+    int32_t ret = 0;
+
+    _LSTransportMessageIterInit(message, &iter);
+
+    /* move past return code, service name, unique name and is_dynamic */
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+
+    _LSTransportMessageGetInt32(&iter, &ret);
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the features the far side announced to the hub out of a
+ * "QueryName" reply message.
+ *
+ * @param  message  IN  query name message
+ *
+ * @retval  LS_TRANSPORT_FEATURE_* values
+ * @retval  0 if the hub didn't say
+ *******************************************************************************
+ */
+int32_t
+_LSTransportQueryNameReplyGetFeatures(_LSTransportMessage *message)
+{
+    LS_ASSERT(message != NULL);
+    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeQueryNameReply);
+    _LSTransportMessageIter iter;
+    int32_t ret = 0;
+
+    _LSTransportMessageIterInit(message, &iter);
+
+    /* move past return code, service name, unique name, is_dynamic and version */
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+
+    _LSTransportMessageGetInt32(&iter, &ret);
+
+    return ret;
+}
+
 /**
  *******************************************************************************
  * @brief Helper callback to send a message to a monitor if it's a message
@@ -2897,7 +3418,7 @@ _LSTransportHandleQueryNameFailure(_LSTransportMessage *message, long err_code,
 
     /* Grab the first message on the pending queue, since the target that it is
      * destined for has failed in some manner */
-    _LSTransportMessage *failed_message = g_queue_pop_head(pending->queue);
+    _LSTransportMessage *failed_message = _LSTransportOutgoingPop(pending);
 
     LS_ASSERT(failed_message);
 
@@ -2906,6 +3427,7 @@ _LSTransportHandleQueryNameFailure(_LSTransportMessage *message, long err_code,
      * See LSCall_kill_server_continue_sending_messages test for an example of the latter */
     _LSTransportMessageType msg_type = _LSTransportMessageGetType(failed_message);
     LS_ASSERT(msg_type == _LSTransportMessageTypeMethodCall
+              || msg_type == _LSTransportMessageTypeMethodCallNoReply
               || msg_type == _LSTransportMessageTypeCancelMethodCall);
 
 
@@ -2913,7 +3435,7 @@ _LSTransportHandleQueryNameFailure(_LSTransportMessage *message, long err_code,
     {
         if (--failed_message->retries > 0)
         {
-            g_queue_push_head(pending->queue, failed_message);
+            _LSTransportOutgoingPush(pending, failed_message, true);
             OUTGOING_UNLOCK(&pending->lock);
 
             LOG_LS_WARNING(MSGID_LS_MSG_ERR, 1,
@@ -3110,6 +3632,15 @@ _LSTransportHandleQueryNameReply(_LSTransportMessage *message)
 
     client->is_dynamic = is_dynamic;
 
+    /* a far side in this process gets a direct link rather than the rings */
+    bool local_peer = transport->loopback && transport->loopback->channel.recv_watch &&
+                      _LSTransportLoopbackHasName(unique_name);
+
+    if (local_peer)
+    {
+        _LSTransportOfferLoopback(client);
+    }
+
     /* We successfully connected to the far side, so remove the service from
      * the transport lookup queue.
      *
@@ -3143,12 +3674,24 @@ _LSTransportHandleQueryNameReply(_LSTransportMessage *message)
      * to know our service name and unique name so that it can put that in
      * the message to the monitor)
      */
-    if (!_LSTransportSendMessageClientInfo(client, transport->service_name, transport->unique_name, true, &lserror))
+    int version = _LSTransportNegotiateVersion(_LSTransportQueryNameReplyGetVersion(message));
+    client->features = _LSTransportQueryNameReplyGetFeatures(message);
+
+    if (!_LSTransportSendMessageClientInfo(client, transport->service_name, transport->unique_name, version, true, &lserror))
     {
         LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
         LSErrorFree(&lserror);
     }
 
+    /* the ring setup messages carry fds, which only a far side that speaks
+     * v2 and maps rings itself knows what to do with; until it answers they
+     * just follow the pending messages on the socket */
+    if (transport->ring_size && !local_peer && client->tx_version >= 2 &&
+        (client->features & LS_TRANSPORT_FEATURE_RING))
+    {
+        _LSTransportRingOffer(client);
+    }
+
     /* kickstart sending to the monitor */
     if (transport->monitor)
     {
@@ -3371,11 +3914,17 @@ _LSTransportConnect(_LSTransport *transport, bool local, bool public_bus, LSErro
     }
 
     /* MONITOR: send *our* information to the client (hub in this case) */
-    if (!_LSTransportSendMessageClientInfo(hub, transport->service_name, transport->unique_name, false, lserror))
+    if (!_LSTransportSendMessageClientInfo(hub, transport->service_name, transport->unique_name, _LSTransportClientGetVersion(hub), false, lserror))
     {
         goto Done;
     }
 
+    /* let the other transports in this process offer us direct links */
+    if (transport->loopback && transport->type == _LSTransportTypeLocal)
+    {
+        _LSTransportLoopbackAddName(transport->unique_name);
+    }
+
     ret = true;
 
 Done:
@@ -3437,254 +3986,1039 @@ error:
 
 /**
  *******************************************************************************
- * @brief Called when watch indicates that there is data to be read from a
- * channel. This function does non-blocking reads of the incoming data and
- * processes the complete messages.
+ * @brief Get the protocol version to speak with the sender of a
+ * "ClientInfo" message.
  *
- * @param  source       IN  io source
- * @param  condition    IN  condition that triggered this callback
- * @param  data         IN  client
+ * @param  message  IN  client info message
  *
- * @retval TRUE when client is still alive
- * @retval FALSE when client goes away so that this watch is removed
+ * @retval protocol version
  *******************************************************************************
  */
-gboolean
-_LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
-                         gpointer data)
+static int
+_LSTransportMessageClientInfoGetVersion(_LSTransportMessage *message)
 {
-    LSError lserror;
-    LSErrorInit(&lserror);
+    _LSTransportMessageIter iter;
+    int32_t version = 0;
 
-    _LSTransportClient *client = (_LSTransportClient*)data;
+    /* move past service name and unique name */
+    _LSTransportMessageIterInit(message, &iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
 
-    LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
+    /* senders that predate the v2 header don't append a version */
+    _LSTransportMessageGetInt32(&iter, &version);
 
-    /* calculate bytes remaining in buf */
-    int num_bytes_to_read;
-    unsigned long offset;
+    return _LSTransportNegotiateVersion(version);
+}
 
-    /* we're using the client's incoming buffer, so ref it */
-    _LSTransportClientRef(client);
-    _LSTransportIncoming *incoming = client->incoming;
+/**
+ *******************************************************************************
+ * @brief Get the features the sender of a "ClientInfo" message announced.
+ *
+ * @param  message  IN  client info message
+ *
+ * @retval LS_TRANSPORT_FEATURE_* values
+ *******************************************************************************
+ */
+static int
+_LSTransportMessageClientInfoGetFeatures(_LSTransportMessage *message)
+{
+    _LSTransportMessageIter iter;
+    int32_t features = 0;
 
-    bool shutdown = false;
+    /* move past service name, unique name and version */
+    _LSTransportMessageIterInit(message, &iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageIterNext(&iter);
 
-    /*
-     * TODO: limit the number of messages that we queue up before processing
-     * them. We don't want to starve other parts of the program's operation
-     * and we don't want to use too much memory; this should be configurable
-     */
+    _LSTransportMessageGetInt32(&iter, &features);
 
-    /* TODO: review locking */
+    return features;
+}
 
-    //INCOMING_LOCK(&incoming->lock);
+/**
+ *******************************************************************************
+ * @brief Queue a completely received message for processing.
+ *
+ * A @ref _LSTransportMessageTypePayloadFd message is held back and its
+ * payload is attached to the message that follows it. If that fails, the
+ * message is dropped and a method call gets an error reply.
+ * @ref _LSTransportMessageTypeRingSetup, @ref _LSTransportMessageTypeRingReady
+ * and the loopback handshake messages are consumed right away.
+ *
+ * @param  client   IN  client the message was received from
+ * @param  message  IN  message (the queue takes over the reference)
+ *******************************************************************************
+ */
+static void
+_LSTransportIncomingPushMessage(_LSTransportClient *client, _LSTransportMessage *message)
+{
+    _LSTransportIncoming *incoming = client->incoming;
 
-    while (1)
+    /* find and bounds check the fields once, before anyone looks at them */
+    _LSTransportMessageParseFields(message);
+
+    /* the ring and loopback handshakes are handled by the transport itself */
+    switch (_LSTransportMessageGetType(message))
     {
-        char* buf = (char*)&incoming->tmp_header;
+    case _LSTransportMessageTypeRingSetup:
+        _LSTransportHandleRingSetup(client, message);
+        _LSTransportMessageUnref(message);
+        return;
+    case _LSTransportMessageTypeRingReady:
+        _LSTransportHandleRingReady(client);
+        _LSTransportMessageUnref(message);
+        return;
+    case _LSTransportMessageTypeLoopbackOffer:
+        _LSTransportHandleLoopbackOffer(client, message);
+        _LSTransportMessageUnref(message);
+        return;
+    case _LSTransportMessageTypeLoopbackReady:
+        _LSTransportHandleLoopbackReady(client);
+        _LSTransportMessageUnref(message);
+        return;
+    case _LSTransportMessageTypeClientInfo:
+        /* the far side switches to the negotiated version right after this
+         * message, so we have to do the same before parsing what follows */
+        _LSTransportClientSwitchVersion(client, NULL, _LSTransportMessageClientInfoGetVersion(message));
+        client->features = _LSTransportMessageClientInfoGetFeatures(message);
+        break;
+    default:
+        break;
+    }
 
-        if (incoming->tmp_msg)
-        {
-            /* We have a message with at least a header, so attempt to read
-             * in the rest of the message */
-            num_bytes_to_read = incoming->tmp_msg->raw->header.len - incoming->tmp_msg_offset;
-            buf = incoming->tmp_msg->raw->data;
-            offset = incoming->tmp_msg_offset;
-        }
-        else
+    if (_LSTransportMessageGetType(message) == _LSTransportMessageTypePayloadFd)
+    {
+        if (incoming->payload_fd_msg)
         {
-            /* We haven't read in a complete header yet, so attempt to construct
-             * a complete header */
-            num_bytes_to_read = sizeof(client->incoming->tmp_header) - incoming->tmp_header_offset;
-            offset = incoming->tmp_header_offset;
+            LOG_LS_WARNING(MSGID_LS_MSG_ERR, 2,
+                           PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                           PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                           "Dropping unused payload fd");
+            _LSTransportMessageUnref(incoming->payload_fd_msg);
         }
+        incoming->payload_fd_msg = message;
+        return;
+    }
 
-        if (num_bytes_to_read > 0)
-        {
-            int ret = recv(client->channel.fd, buf + offset, num_bytes_to_read, MSG_DONTWAIT);
+    if (incoming->payload_fd_msg)
+    {
+        bool attached = _LSTransportMessageAttachPayload(message, incoming->payload_fd_msg);
 
-            /* If there was an error or we would block, we're done reading in data */
-            if (ret <= 0)
+        _LSTransportMessageUnref(incoming->payload_fd_msg);
+        incoming->payload_fd_msg = NULL;
+
+        if (!attached)
+        {
+            LOG_LS_ERROR(MSGID_LS_MSG_ERR, 2,
+                         PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                         PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                         "Could not map payload fd, dropping message type: %d",
+                         _LSTransportMessageGetType(message));
+
+            /* the message is useless without its payload, but a caller still
+             * gets an answer */
+            if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCall)
             {
-                if (ret == 0)
-                {
-                    LOG_LS_DEBUG("%s: Orderly shutdown\n", __func__);
-                    shutdown = true;
-                    break;
-                }
-                else if (errno == EAGAIN || errno == EINTR)
-                {
-                    /* We don't retry immediately relying on the main loop
-                     * to signal socket readiness again.
-                     */
-                    break;
-                }
-                else if (errno == ECONNRESET)
-                {
-                    /* Client disappearance isn't LS2 problem */
-                    LOG_LS_WARNING(MSGID_LS_MSG_ERR, 4,
-                                   PMLOGKFV("ERROR_CODE", "%d", errno),
-                                   PMLOGKS("ERROR", g_strerror(errno)),
-                                   PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
-                                   PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
-                                   "Encountered ECONNRESET during recv: fd: %d", client->channel.fd);
-                    shutdown = true;
-                    break;
-                }
-                else
+                LSError lserror;
+                LSErrorInit(&lserror);
+
+                if (!_LSTransportSendErrorReply(message, _LSTransportMessageTypeError,
+                                                "Could not map the payload of the call", &lserror))
                 {
-                    LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
-                                 PMLOGKFV("ERROR_CODE", "%d", errno),
-                                 PMLOGKS("ERROR", g_strerror(errno)),
-                                 PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
-                                 PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
-                                 "Encountered error during recv: fd: %d", client->channel.fd);
-                    shutdown = true;
-                    break;
+                    LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+                    LSErrorFree(&lserror);
                 }
             }
 
-            /* ret > 0 */
-            LS_ASSERT(ret > 0);
+            _LSTransportMessageUnref(message);
+            return;
+        }
+    }
+
+    g_queue_push_tail(incoming->complete_messages, message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Do non-blocking reads of the incoming data from a client's socket
+ * or ring and queue the complete messages.
+ *
+ * Stops reading once the transport's incoming budget for this wakeup is
+ * used up, so that a client that floods us can't starve the other clients
+ * and sources in the main loop. Whatever is left is picked up on the next
+ * wakeup.
+ *
+ * @param  client       IN  client
+ * @param  incoming     IN  receive state of the socket or the ring
+ * @param  ring         IN  ring to read from; NULL to read from the socket
+ * @param  bytes_read   IN/OUT  bytes read from the client during this wakeup
+ *
+ * @retval true when the client has to be shut down
+ * @retval false otherwise
+ *******************************************************************************
+ */
+static bool
+_LSTransportReceiveStream(_LSTransportClient *client, _LSTransportIncoming *incoming, _LSTransportRing *ring,
+                          unsigned long *bytes_read)
+{
+    bool shutdown = false;
+    const _LSTransportIncomingBudget *budget = &client->transport->incoming_budget;
+
+    /* TODO: review locking */
+
+    //INCOMING_LOCK(&incoming->lock);
+
+    if (!incoming->rx_buf)
+    {
+        incoming->rx_buf = g_malloc(LS_TRANSPORT_INCOMING_BUF_SIZE);
+    }
+
+    while (1)
+    {
+        unsigned long avail = incoming->rx_end - incoming->rx_start;
+
+        /* When NULL after the checks below, we need more data in rx_buf */
+        char *buf = NULL;
+        unsigned long num_bytes_to_read = 0;
 
-            if (incoming->tmp_msg)
+        if (incoming->tmp_msg)
+        {
+            _LSTransportMessage *msg = incoming->tmp_msg;
+            unsigned long body_len = msg->raw->header.len;
+
+            if (incoming->tmp_msg_offset < body_len)
             {
-                /* We're continuing an already allocated msg */
-                incoming->tmp_msg_offset += ret;
+                /* Message doesn't fit in rx_buf. Use up what has been buffered
+                 * and read the rest of the body directly into the message */
+                if (avail > 0)
+                {
+                    unsigned long chunk = MIN(avail, body_len - incoming->tmp_msg_offset);
+                    memcpy(msg->raw->data + incoming->tmp_msg_offset, incoming->rx_buf + incoming->rx_start, chunk);
+                    incoming->tmp_msg_offset += chunk;
+                    incoming->rx_start += chunk;
+                    continue;
+                }
+
+                buf = msg->raw->data + incoming->tmp_msg_offset;
+                num_bytes_to_read = body_len - incoming->tmp_msg_offset;
             }
-            else
+            else if (ring || !_LSTransportMessageIsConnectionFdType(msg))
             {
-                /* We're reading in the header */
-                incoming->tmp_header_offset += ret;
+                /* fds can't be passed through the ring */
+                _LSTransportIncomingPushMessage(client, msg);
+                incoming->tmp_msg = NULL;
+                incoming->tmp_msg_offset = 0;
+                continue;
             }
-        }
-
-        if (incoming->tmp_msg)
-        {
-            /* complete message */
-            if (incoming->tmp_msg_offset == incoming->tmp_msg->raw->header.len)
+            else if (avail > 0)
             {
-                //printf("recvd message: token %d, type: %d, len: %d\n", (int)incoming->tmp_msg->raw->header.token, (int)incoming->tmp_msg->raw->header.type, (int)incoming->tmp_msg->raw->header.len);
+                /* The fd is sent right after the message along with a one
+                 * byte marker; see _LSTransportSendFd() */
+                char marker = incoming->rx_buf[incoming->rx_start++];
+                int recv_fd = -1;
 
-                /* check to see if we need to read in the special file
-                 * descriptor message for this type of message */
-                if (_LSTransportMessageIsConnectionFdType(incoming->tmp_msg))
+                if (marker == 0)
                 {
-                    LSError lserror;
-                    LSErrorInit(&lserror);
-                    int recv_fd = -1;
-                    bool need_retry = false;
-
-                    if (!_LSTransportRecvFd(client->channel.fd, &recv_fd, &need_retry, &lserror))
+                    if (incoming->rx_fd == -1)
                     {
-                        if (need_retry)
-                        {
-                            /* We would have blocked, so now we retry by
-                             * breaking out of the while loop */
-                            break;
-                        }
-                        else
-                        {
-                            /* real error */
-                            LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
-                            LSErrorFree(&lserror);
-                        }
+                        LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 0, "Expected an fd in message, but didn't receive one");
                     }
-
-                    _LSTransportMessageSetConnectionFd(incoming->tmp_msg, recv_fd);
+                    recv_fd = incoming->rx_fd;
+                    incoming->rx_fd = -1;
                 }
 
-                g_queue_push_tail(incoming->complete_messages, incoming->tmp_msg);
+                _LSTransportMessageSetConnectionFd(msg, recv_fd);
+
+                _LSTransportIncomingPushMessage(client, msg);
                 incoming->tmp_msg = NULL;
                 incoming->tmp_msg_offset = 0;
+                continue;
             }
         }
-        else
+        else if (avail >= _LSTransportHeaderSize(client->rx_version))
         {
-            LS_ASSERT(incoming->tmp_header_offset <= sizeof(_LSTransportHeader));
+            _LSTransportHeader header;
+            _LSTransportHeaderV2 wire;
+            int rx_version = client->rx_version;
+            unsigned long hdr_size = _LSTransportHeaderSize(rx_version);
 
-            if (incoming->tmp_header_offset == sizeof(incoming->tmp_header))
+            /* rx_buf data isn't necessarily aligned */
+            if (rx_version >= 2)
             {
-                /* construct the new message */
-                LS_ASSERT(incoming->tmp_msg == NULL);
+                memcpy(&wire, incoming->rx_buf + incoming->rx_start, sizeof(wire));
 
-                if (incoming->tmp_header.len > MAX_MESSAGE_SIZE_BYTES)
+                if (!_LSTransportHeaderFromV2(&wire, &header))
                 {
-                    const _LSTransportCred *cred = _LSTransportClientGetCred(client);
-                    LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
+                    LOG_LS_ERROR(MSGID_LS_MSG_ERR, 2,
                                  PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
                                  PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
-                                 PMLOGKS("EXE", _LSTransportCredGetExePath(cred)),
-                                 PMLOGKS("CMD", _LSTransportCredGetCmdLine(cred)),
-                                 "Received message of size %ld bytes; shutting down client",
-                                 incoming->tmp_header.len);
+                                 "Received message header with flags 0x%x; shutting down client",
+                                 wire.flags);
                     shutdown = true;
                     break;
                 }
+            }
+            else
+            {
+                memcpy(&header, incoming->rx_buf + incoming->rx_start, sizeof(header));
+            }
+
+            if (header.len > MAX_MESSAGE_SIZE_BYTES)
+            {
+                const _LSTransportCred *cred = _LSTransportClientGetCred(client);
+                LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
+                             PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                             PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                             PMLOGKS("EXE", _LSTransportCredGetExePath(cred)),
+                             PMLOGKS("CMD", _LSTransportCredGetCmdLine(cred)),
+                             "Received message of size %ld bytes; shutting down client",
+                             header.len);
+                shutdown = true;
+                break;
+            }
+
+            /* Construct the message once it has been buffered completely, or
+             * right away if it will never fit in rx_buf */
+            if (header.len <= avail - hdr_size ||
+                header.len > LS_TRANSPORT_INCOMING_BUF_SIZE - hdr_size)
+            {
+                unsigned long chunk = MIN(avail - hdr_size, header.len);
+
+                incoming->tmp_msg = _LSTransportMessageNewRef(header.len);
+
+                /* copy header and sender */
+                _LSTransportMessageSetHeader(incoming->tmp_msg, &header);
+                _LSTransportMessageSetClient(incoming->tmp_msg, client);
+
+                if (rx_version >= 2)
+                {
+                    _LSTransportMessageSetWireHeader(incoming->tmp_msg, &wire);
+                }
+
+                memcpy(incoming->tmp_msg->raw->data, incoming->rx_buf + incoming->rx_start + hdr_size, chunk);
+                incoming->tmp_msg_offset = chunk;
+                incoming->rx_start += hdr_size + chunk;
+                continue;
+            }
+        }
+
+        bool buffered = (buf == NULL);
+
+        if (buffered)
+        {
+            /* Move the partial message to the front of rx_buf and fill the
+             * rest of it with as much as the socket has for us */
+            if (incoming->rx_start > 0)
+            {
+                memmove(incoming->rx_buf, incoming->rx_buf + incoming->rx_start, avail);
+                incoming->rx_start = 0;
+                incoming->rx_end = avail;
+            }
+
+            buf = incoming->rx_buf + incoming->rx_end;
+            num_bytes_to_read = LS_TRANSPORT_INCOMING_BUF_SIZE - incoming->rx_end;
+        }
+
+        LS_ASSERT(num_bytes_to_read > 0);
+
+        /* Everything that was buffered has been parsed at this point, so
+         * the rest is still in the socket or the ring */
+        if ((budget->bytes && *bytes_read >= budget->bytes) ||
+            (budget->messages && g_queue_get_length(client->incoming->complete_messages) >= budget->messages))
+        {
+            if (ring)
+            {
+                /* the far side only signals us when the ring was empty */
+                _LSTransportRingKick(ring);
+            }
+            break;
+        }
+
+        int ret;
+
+        if (ring)
+        {
+            ret = _LSTransportRingRead(ring, buf, num_bytes_to_read);
+        }
+        else if (_LSTransportUringOwnsChannel(&client->channel))
+        {
+            /* the engine has already read the data from the socket */
+            ret = _LSTransportUringRecv(&client->channel, buf, num_bytes_to_read,
+                                        buffered ? &incoming->rx_fd : NULL);
+        }
+        else if (buffered)
+        {
+            ret = _LSTransportRecvBuffered(client->channel.fd, buf, num_bytes_to_read, &incoming->rx_fd);
+        }
+        else
+        {
+            ret = recv(client->channel.fd, buf, num_bytes_to_read, MSG_DONTWAIT);
+        }
+
+        /* If there was an error or we would block, we're done reading in data */
+        if (ret <= 0)
+        {
+            if (ret == 0)
+            {
+                LOG_LS_DEBUG("%s: Orderly shutdown\n", __func__);
+                shutdown = true;
+                break;
+            }
+            else if (errno == EAGAIN || errno == EINTR)
+            {
+                /* We don't retry immediately relying on the main loop
+                 * to signal socket readiness again.
+                 */
+                break;
+            }
+            else if (errno == ECONNRESET)
+            {
+                /* Client disappearance isn't LS2 problem */
+                LOG_LS_WARNING(MSGID_LS_MSG_ERR, 4,
+                               PMLOGKFV("ERROR_CODE", "%d", errno),
+                               PMLOGKS("ERROR", g_strerror(errno)),
+                               PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                               PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                               "Encountered ECONNRESET during recv: fd: %d", client->channel.fd);
+                shutdown = true;
+                break;
+            }
+            else
+            {
+                LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
+                             PMLOGKFV("ERROR_CODE", "%d", errno),
+                             PMLOGKS("ERROR", g_strerror(errno)),
+                             PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                             PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                             "Encountered error during recv: fd: %d", client->channel.fd);
+                shutdown = true;
+                break;
+            }
+        }
+
+        /* ret > 0 */
+        LS_ASSERT(ret > 0);
+
+        *bytes_read += ret;
+
+        if (buffered)
+        {
+            incoming->rx_end += ret;
+        }
+        else
+        {
+            /* We're continuing an already allocated msg */
+            incoming->tmp_msg_offset += ret;
+        }
+    }
+
+    return shutdown;
+}
+
+/**
+ *******************************************************************************
+ * @brief Called when watch indicates that there is data to be read from a
+ * channel. This function does non-blocking reads of the incoming data and
+ * processes the complete messages.
+ *
+ * @param  source       IN  io source
+ * @param  condition    IN  condition that triggered this callback
+ * @param  data         IN  client
+ *
+ * @retval TRUE when client is still alive
+ * @retval FALSE when client goes away so that this watch is removed
+ *******************************************************************************
+ */
+gboolean
+_LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
+                         gpointer data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportClient *client = (_LSTransportClient*)data;
+
+    LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
+
+    /* we're using the client's incoming buffer, so ref it */
+    _LSTransportClientRef(client);
+
+    bool shutdown = false;
+    unsigned long bytes_read = 0;
+
+    /* The far side hands messages over the link before it sends the shutdown
+     * message, so take them first */
+    if (client->loopback)
+    {
+        _LSTransportReceiveLoopback(client->transport);
+    }
+
+    /* Once the far side has switched to the ring, the socket only brings the
+     * shutdown message, which it sends after flushing the ring */
+    if (client->ring && client->ring->rx_active)
+    {
+        shutdown = _LSTransportReceiveStream(client, client->ring->incoming, client->ring, &bytes_read);
+    }
+
+    if (!shutdown)
+    {
+        shutdown = _LSTransportReceiveStream(client, client->incoming, NULL, &bytes_read);
+    }
+
+    /*
+     * Call the callbacks for methods and filter function callbacks for replies.
+     *
+     * The incoming budget bounds what we queued up above, so processing all
+     * of it here stays short. A client with more to send is left readable
+     * and the main loop gets back to it after it has dispatched the other
+     * ready clients, which gives each of them a turn per iteration.
+     */
+
+    //INCOMING_UNLOCK(&incoming->lock);
+
+    if (!_LSTransportProcessIncomingMessages(client, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    if (shutdown)
+    {
+        if (client->state != _LSTransportClientStateShutdown)
+        {
+            /* we didn't get a shutdown message, so we need to clean up */
+            _LSTransportClientShutdownDirty(client);
+        }
+
+        _LSTransportClientUnref(client);
+
+        return FALSE;
+    }
+    else
+    {
+        _LSTransportClientUnref(client);
+        return TRUE;    /* FALSE means this source should be removed */
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Callback that is called when the far side has written to our ring or
+ * made room in its ring.
+ *
+ * @param  source       IN  io source
+ * @param  condition    IN  condition that triggered the watch
+ * @param  data         IN  client
+ *
+ * @retval TRUE when client is still alive
+ * @retval FALSE when client goes away so that this watch is removed
+ *******************************************************************************
+ */
+static gboolean
+_LSTransportRingWakeup(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportClient *client = (_LSTransportClient*)data;
+    _LSTransportRing *ring = client->ring;
+    bool shutdown = false;
+    unsigned long bytes_read = 0;
+
+    LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
+
+    _LSTransportClientRef(client);
+
+    _LSTransportRingClearWakeup(ring);
+
+    if (ring->rx_active)
+    {
+        shutdown = _LSTransportReceiveStream(client, ring->incoming, ring, &bytes_read);
+    }
+
+    if (ring->tx_active)
+    {
+        (void)_LSTransportSendClient(NULL, G_IO_OUT, client);
+    }
+
+    if (!_LSTransportProcessIncomingMessages(client, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    if (shutdown && client->state != _LSTransportClientStateShutdown)
+    {
+        _LSTransportClientShutdownDirty(client);
+    }
+
+    _LSTransportClientUnref(client);
+
+    return shutdown ? FALSE : TRUE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Start watching our eventfd of the client's rings.
+ *
+ * @param  client   IN  client with mapped rings
+ *******************************************************************************
+ */
+static void
+_LSTransportAddRingWatch(_LSTransportClient *client)
+{
+    _LSTransport *transport = client->transport;
+    _LSTransportRing *ring = client->ring;
+
+    _LSTransportChannelInit(transport, &ring->channel, ring->rx_event_fd, transport->source_priority);
+
+    /* the watch holds a ref to the client */
+    _LSTransportClientRef(client);
+
+    _LSTransportAddWatch(&ring->channel, G_IO_IN, transport->mainloop_context,
+                         _LSTransportRingWakeup, client,
+                         (GDestroyNotify)_LSTransportClientUnref,
+                         &ring->channel.recv_watch);
+}
+
+/**
+ *******************************************************************************
+ * @brief Tell the far side that everything we send from now on goes through
+ * the ring.
+ *
+ * @param  client   IN  client
+ *******************************************************************************
+ */
+static void
+_LSTransportSendRingReady(_LSTransportClient *client)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeRingReady);
+
+    if (!_LSTransportSendMessage(message, client, NULL, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    _LSTransportMessageUnref(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Create the shared memory rings for a client we connected to and
+ * pass them to the far side.
+ *
+ * Nothing switches over to the rings until the far side has mapped them and
+ * answered with a @ref _LSTransportMessageTypeRingReady message. If it can't
+ * map them, both sides simply stay on the socket.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  newly connected client
+ *******************************************************************************
+ */
+static void
+_LSTransportRingOffer(_LSTransportClient *client)
+{
+    _LSTransportRing *ring = _LSTransportRingNew(client->transport->ring_size);
+    int i;
+
+    if (!ring) return;
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    client->ring = ring;
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        LSError lserror;
+        LSErrorInit(&lserror);
+
+        _LSTransportRingSetup setup = { .capacity = ring->capacity, .which = i };
+
+        /* the message closes its fd once it has been sent */
+        int fd = dup(ring->fds[i]);
+        if (fd == -1)
+        {
+            LOG_LS_ERROR(MSGID_LS_DUP_ERR, 2,
+                         PMLOGKFV("ERROR_CODE", "%d", errno),
+                         PMLOGKS("ERROR", g_strerror(errno)),
+                         "%s: dup() failed", __func__);
+            break;
+        }
+
+        _LSTransportMessage *message = _LSTransportMessageNewRef(sizeof(setup));
+
+        _LSTransportMessageSetType(message, _LSTransportMessageTypeRingSetup);
+        _LSTransportMessageSetBody(message, &setup, sizeof(setup));
+        _LSTransportMessageSetConnectionFd(message, fd);
+
+        if (!_LSTransportSendMessage(message, client, NULL, &lserror))
+        {
+            LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+            LSErrorFree(&lserror);
+        }
+
+        _LSTransportMessageUnref(message);
+    }
+
+    _LSTransportAddRingWatch(client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle a @ref _LSTransportMessageTypeRingSetup message.
+ *
+ * Once all of the fds have arrived, the rings are mapped and we tell the far
+ * side that we're switching over.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  client the message was received from
+ * @param  message  IN  ring setup message
+ *******************************************************************************
+ */
+static void
+_LSTransportHandleRingSetup(_LSTransportClient *client, _LSTransportMessage *message)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    /* take over the fd */
+    int fd = _LSTransportMessageGetConnectionFd(message);
+    _LSTransportMessageSetConnectionFd(message, -1);
+
+    /* only map rings if we were asked to use them ourselves */
+    if (!client->transport->ring_size ||
+        _LSTransportMessageGetBodySize(message) != sizeof(_LSTransportRingSetup) ||
+        (client->ring && (client->ring->initiator || client->ring->map)))
+    {
+        LOG_LS_WARNING(MSGID_LS_MSG_ERR, 2,
+                       PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                       PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                       "Ignoring unexpected ring setup message");
+        if (fd != -1) close(fd);
+        return;
+    }
+
+    _LSTransportRingSetup setup;
+    memcpy(&setup, _LSTransportMessageGetBody(message), sizeof(setup));
+
+    if (!client->ring)
+    {
+        _LSTransportRing *ring = _LSTransportRingNewEmpty();
+
+        OUTGOING_LOCK(&client->outgoing->lock);
+        client->ring = ring;
+        OUTGOING_UNLOCK(&client->outgoing->lock);
+    }
+
+    if (!_LSTransportRingSetFd(client->ring, &setup, fd) ||
+        !_LSTransportRingIsComplete(client->ring))
+    {
+        return;
+    }
+
+    if (!_LSTransportRingMap(client->ring, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_SHARED_MEMORY_ERR, &lserror);
+        LSErrorFree(&lserror);
+        return;
+    }
+
+    _LSTransportAddRingWatch(client);
+    _LSTransportSendRingReady(client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle a @ref _LSTransportMessageTypeRingReady message.
+ *
+ * The far side sends everything after this message through the ring. The
+ * initiator answers with its own ready message.
+ *
+ * @param  client   IN  client the message was received from
+ *******************************************************************************
+ */
+static void
+_LSTransportHandleRingReady(_LSTransportClient *client)
+{
+    _LSTransportRing *ring = client->ring;
+
+    if (!ring || !ring->map || ring->rx_active)
+    {
+        LOG_LS_ERROR(MSGID_LS_MSG_ERR, 2,
+                     PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                     PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                     "Ring ready message without a mapped ring");
+        return;
+    }
+
+    ring->rx_active = true;
+
+    /* read whatever has already been written to the ring */
+    _LSTransportRingKick(ring);
+
+    if (ring->initiator)
+    {
+        _LSTransportSendRingReady(client);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Tell the far side that everything we send from now on goes over the
+ * direct link.
+ *
+ * @param  client   IN  client
+ *******************************************************************************
+ */
+static void
+_LSTransportSendLoopbackReady(_LSTransportClient *client)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeLoopbackReady);
+
+    if (!_LSTransportSendMessage(message, client, NULL, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    _LSTransportMessageUnref(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Offer a direct link to a client we connected to that lives in this
+ * process.
+ *
+ * Nothing switches over to the link until the far side has taken it and
+ * answered with a @ref _LSTransportMessageTypeLoopbackReady message. If it
+ * doesn't, both sides simply stay on the socket.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  newly connected client
+ *******************************************************************************
+ */
+static void
+_LSTransportOfferLoopback(_LSTransportClient *client)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportLoopback *loopback = _LSTransportLoopbackNewOffer(client);
+
+    if (!loopback) return;
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    client->loopback = loopback;
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    _LSTransportLoopbackOffer offer = { .id = loopback->id };
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(sizeof(offer));
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeLoopbackOffer);
+    _LSTransportMessageSetBody(message, &offer, sizeof(offer));
+
+    if (!_LSTransportSendMessage(message, client, NULL, &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    _LSTransportMessageUnref(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle a @ref _LSTransportMessageTypeLoopbackOffer message.
+ *
+ * Only the initiator's offers are in this process's offer table, so a peer
+ * in another process gets no further than the socket.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  client the message was received from
+ * @param  message  IN  loopback offer message
+ *******************************************************************************
+ */
+static void
+_LSTransportHandleLoopbackOffer(_LSTransportClient *client, _LSTransportMessage *message)
+{
+    if (_LSTransportMessageGetBodySize(message) != sizeof(_LSTransportLoopbackOffer) ||
+        client->loopback || client->initiator)
+    {
+        LOG_LS_WARNING(MSGID_LS_LOOPBACK_ERR, 2,
+                       PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                       PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                       "Ignoring unexpected loopback offer");
+        return;
+    }
+
+    /* we need somewhere to receive the messages */
+    if (!client->transport->loopback || !client->transport->loopback->channel.recv_watch)
+    {
+        return;
+    }
+
+    _LSTransportLoopbackOffer offer;
+    memcpy(&offer, _LSTransportMessageGetBody(message), sizeof(offer));
+
+    _LSTransportLoopback *loopback = _LSTransportLoopbackAccept(client, offer.id);
+
+    if (!loopback)
+    {
+        LOG_LS_WARNING(MSGID_LS_LOOPBACK_ERR, 2,
+                       PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                       PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                       "Loopback offer is gone");
+        return;
+    }
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    client->loopback = loopback;
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    _LSTransportSendLoopbackReady(client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle a @ref _LSTransportMessageTypeLoopbackReady message.
+ *
+ * The far side hands everything after this message over the link, and
+ * whatever it has handed over already is processed now. The initiator
+ * answers with its own ready message.
+ *
+ * @param  client   IN  client the message was received from
+ *******************************************************************************
+ */
+static void
+_LSTransportHandleLoopbackReady(_LSTransportClient *client)
+{
+    _LSTransportLoopback *loopback = client->loopback;
 
-                incoming->tmp_msg = _LSTransportMessageNewRef(incoming->tmp_header.len);
-
-                /* copy header and sender */
-                _LSTransportMessageSetHeader(incoming->tmp_msg, &incoming->tmp_header);
-                //printf("recvd message alloc: token %d, type: %d, len: %d\n", (int)incoming->tmp_msg->raw->header.token, (int)incoming->tmp_msg->raw->header.type, (int)incoming->tmp_msg->raw->header.len);
+    if (!loopback || loopback->id || loopback->rx_active)
+    {
+        LOG_LS_ERROR(MSGID_LS_LOOPBACK_ERR, 2,
+                     PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                     PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                     "Loopback ready message without a link");
+        return;
+    }
 
-                _LSTransportMessageSetClient(incoming->tmp_msg, client);
+    loopback->rx_active = true;
 
-                /* TODO: can we fold this in better to the above code? */
-                if (_LSTransportMessageGetHeader(incoming->tmp_msg)->len == 0)
-                {
-                    g_queue_push_tail(incoming->complete_messages, incoming->tmp_msg);
-                    incoming->tmp_msg = NULL;
-                }
+    /* what's still in the loopback queue comes after these, and the queue's
+     * wakeup is pending for it */
+    while (!g_queue_is_empty(loopback->held))
+    {
+        _LSTransportIncomingPushMessage(client, g_queue_pop_head(loopback->held));
+    }
 
-                incoming->tmp_msg_offset = 0;
-                incoming->tmp_header_offset = 0;
-            }
-        }
+    if (client->initiator)
+    {
+        _LSTransportSendLoopbackReady(client);
     }
+}
 
-    /*
-     * Call the callbacks for methods and filter function callbacks for replies
-     * TODO: should this be done in another callback (idle handler?)
-
-     * <eeh> probably.  You want watch callbacks to return quickly.  But you
-     * don't want heavy network activity to starve message handlers either.
-     * Can you schedule the incomming queue to be processed in the main loop
-     * at a higher priority than idle?  Caveate: if this function and the one
-     * to process the queue have to hold the same mutex then they're going to
-     * starve one another anyway.  To avoid that you'd have to allow
-     * _LSTransportProcessIncomingMessages to return without emptying the
-     * queue and then reschedule it.  Maybe leave things alone but be aware
-     * when evaluating bug reports and performance data that this could be an
-     * issue.
-     */
+/**
+ *******************************************************************************
+ * @brief Queue the messages that linked clients in this process have handed
+ * over to ours, and process them.
+ *
+ * Messages from a client whose ready message hasn't come through the socket
+ * yet are held back until it has.
+ *
+ * @param  transport    IN  transport
+ *******************************************************************************
+ */
+static void
+_LSTransportReceiveLoopback(_LSTransport *transport)
+{
+    GList *clients = NULL;
 
-    //INCOMING_UNLOCK(&incoming->lock);
+    if (!transport->loopback) return;
 
-    if (!_LSTransportProcessIncomingMessages(client, &lserror))
-    {
-        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
-        LSErrorFree(&lserror);
-    }
+    SUBMIT_LOCK(&transport->loopback->lock);
+    _LSTransportSubmitNode *node = _LSTransportSubmitTakeAll(transport->loopback);
+    SUBMIT_UNLOCK(&transport->loopback->lock);
 
-    if (shutdown)
+    while (node)
     {
-        if (client->state != _LSTransportClientStateShutdown)
+        _LSTransportSubmitNode *next = node->next;
+        _LSTransportClient *client = node->client;
+        _LSTransportMessage *message = node->message;
+
+        /* the message goes on with the node's ref */
+        node->message = NULL;
+
+        if (!client->loopback->rx_active)
         {
-            /* we didn't get a shutdown message, so we need to clean up */
-            _LSTransportClientShutdownDirty(client);
+            g_queue_push_tail(client->loopback->held, message);
         }
+        else
+        {
+            _LSTransportIncomingPushMessage(client, message);
 
-        _LSTransportClientUnref(client);
+            if (!g_list_find(clients, client))
+            {
+                _LSTransportClientRef(client);
+                clients = g_list_prepend(clients, client);
+            }
+        }
 
-        return FALSE;
+        _LSTransportSubmitNodeFree(node);
+        node = next;
     }
-    else
+
+    GList *iter;
+    for (iter = clients; iter; iter = iter->next)
     {
-        _LSTransportClientUnref(client);
-        return TRUE;    /* FALSE means this source should be removed */
+        LSError lserror;
+        LSErrorInit(&lserror);
+
+        if (!_LSTransportProcessIncomingMessages(iter->data, &lserror))
+        {
+            LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+            LSErrorFree(&lserror);
+        }
     }
+
+    g_list_free_full(clients, (GDestroyNotify)_LSTransportClientUnref);
+}
+
+/**
+ *******************************************************************************
+ * @brief Callback for the loopback queue's eventfd becoming readable.
+ *
+ * @param  source       IN  io channel
+ * @param  condition    IN  condition that triggered the callback
+ * @param  data         IN  transport
+ *
+ * @retval  TRUE always, the watch stays until the transport is disconnected
+ *******************************************************************************
+ */
+static gboolean
+_LSTransportLoopbackWakeup(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    _LSTransportReceiveLoopback(data);
+
+    return TRUE;
 }
 
 /**
@@ -3714,7 +5048,21 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
          * watching this socket), so we won't block.
          */
         socklen_t len = sizeof(client_addr);
-        int fd = accept(g_io_channel_unix_get_fd(source), (struct sockaddr*) &client_addr, &len);
+        int fd;
+
+        if (_LSTransportUringOwnsChannel(&transport->listen_channel))
+        {
+            /* the engine accepts the connections for us */
+            fd = _LSTransportUringAccept(&transport->listen_channel);
+            if (fd < 0 && errno == EAGAIN)
+            {
+                return TRUE;
+            }
+        }
+        else
+        {
+            fd = accept(g_io_channel_unix_get_fd(source), (struct sockaddr*) &client_addr, &len);
+        }
 
         if (fd < 0)
         {
@@ -3756,6 +5104,319 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
     return TRUE;    /* FALSE means this source should be removed */
 }
 
+/**
+ *******************************************************************************
+ * @brief Wait until the outgoing queue of a client drains to its low
+ * watermark, sending from it in the meantime.
+ *
+ * Used for @ref LSOutgoingPolicyBlock. Gives up when the connection goes
+ * away or after @ref LS_TRANSPORT_OUTGOING_BLOCK_TIMEOUT_MS, leaving the
+ * rest queued. The main loop thread is never blocked, since it is the one
+ * that drains the queue.
+ *
+ * @attention locks outgoing lock
+ *
+ * @param  client   IN  client
+ *******************************************************************************
+ */
+static void
+_LSTransportOutgoingWaitForLow(_LSTransportClient *client)
+{
+    if (_LSTransportIsLoopThread(client->transport))
+    {
+        return;
+    }
+
+    struct timespec deadline;
+    ClockGetTime(&deadline);
+    ClockAccumMs(&deadline, LS_TRANSPORT_OUTGOING_BLOCK_TIMEOUT_MS);
+
+    while (1)
+    {
+        struct pollfd pfd = { .fd = client->channel.fd, .events = POLLOUT };
+
+        OUTGOING_LOCK(&client->outgoing->lock);
+        bool above = client->outgoing->above_high_watermark;
+        if (client->ring && client->ring->tx_active)
+        {
+            /* the far side kicks our eventfd when it makes room in the ring */
+            pfd.fd = client->ring->rx_event_fd;
+            pfd.events = POLLIN;
+        }
+        OUTGOING_UNLOCK(&client->outgoing->lock);
+
+        /* io_uring sends only complete from the main loop, which is the
+         * thread we would be blocking */
+        if (!above || _LSTransportUringOwnsChannel(&client->channel))
+        {
+            return;
+        }
+
+        struct timespec now;
+        ClockGetTime(&now);
+        if (ClockTimeIsGreater(&now, &deadline))
+        {
+            LOG_LS_WARNING(MSGID_LS_QUEUE_ERROR, 2,
+                           PMLOGKS("APP_ID", client->service_name),
+                           PMLOGKS("UNIQUE_NAME", client->unique_name),
+                           "Gave up waiting for the outgoing queue to drain");
+            return;
+        }
+
+        int ret = poll(&pfd, 1, LS_TRANSPORT_OUTGOING_BLOCK_POLL_MS);
+
+        if (ret < 0 && errno != EINTR)
+        {
+            return;
+        }
+
+        if (ret > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            return;
+        }
+
+        _LSTransportSendClient(NULL, G_IO_OUT, client);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Apply the outgoing watermarks of the transport to a client queue
+ * and release the outgoing lock.
+ *
+ * Called after messages have been added to or removed from the queue.
+ * Applies @ref LSOutgoingPolicy and lets the transport know when the queue
+ * crosses a watermark. The watermark handler is called without the lock
+ * held.
+ *
+ * @attention the caller must hold the outgoing lock; it is unlocked on return
+ *
+ * @param  client       IN  client
+ * @param  may_block    IN  true if the caller may be blocked by
+ *                          @ref LSOutgoingPolicyBlock
+ *******************************************************************************
+ */
+static void
+_LSTransportOutgoingUnlock(_LSTransportClient *client, bool may_block)
+{
+    _LSTransport *transport = client->transport;
+    const _LSTransportOutgoingLimits *limits = &transport->outgoing_limits;
+    _LSTransportOutgoing *outgoing = client->outgoing;
+
+    if (!limits->high_bytes && !limits->high_messages)
+    {
+        OUTGOING_UNLOCK(&outgoing->lock);
+        return;
+    }
+
+    if (limits->policy == LSOutgoingPolicyDropOldestUpdate)
+    {
+        while (_LSTransportOutgoingIsAboveHigh(outgoing, limits) &&
+               _LSTransportOutgoingDropOldestUpdate(outgoing))
+        {
+        }
+    }
+
+    _LSTransportOutgoingWatermark crossed = _LSTransportOutgoingCheckWatermarks(outgoing, limits);
+    bool above = outgoing->above_high_watermark;
+    unsigned long queue_bytes = outgoing->queue_bytes;
+    unsigned int queue_length = g_queue_get_length(outgoing->queue);
+
+    if (crossed == _LSTransportOutgoingWatermarkHigh &&
+        limits->policy == LSOutgoingPolicyDisconnect && client != transport->hub)
+    {
+        LOG_LS_WARNING(MSGID_LS_QUEUE_ERROR, 4,
+                       PMLOGKS("APP_ID", client->service_name),
+                       PMLOGKS("UNIQUE_NAME", client->unique_name),
+                       PMLOGKFV("BYTES", "%lu", queue_bytes),
+                       PMLOGKFV("MESSAGES", "%u", queue_length),
+                       "Disconnecting client that doesn't read its messages");
+
+        /* the receive watch sees the hangup and cleans up the connection */
+        shutdown(client->channel.fd, SHUT_RDWR);
+    }
+
+    OUTGOING_UNLOCK(&outgoing->lock);
+
+    if (crossed != _LSTransportOutgoingWatermarkNone)
+    {
+        if (crossed == _LSTransportOutgoingWatermarkHigh)
+        {
+            LOG_LS_WARNING(MSGID_LS_QUEUE_ERROR, 4,
+                           PMLOGKS("APP_ID", client->service_name),
+                           PMLOGKS("UNIQUE_NAME", client->unique_name),
+                           PMLOGKFV("BYTES", "%lu", queue_bytes),
+                           PMLOGKFV("MESSAGES", "%u", queue_length),
+                           "Outgoing queue above high watermark");
+        }
+
+        if (transport->outgoing_watermark_handler)
+        {
+            transport->outgoing_watermark_handler(client, above, transport->outgoing_watermark_context);
+        }
+    }
+
+    if (may_block && above && limits->policy == LSOutgoingPolicyBlock)
+    {
+        _LSTransportOutgoingWaitForLow(client);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether we're on the thread that attached the transport to
+ * its main loop, or the transport isn't attached.
+ *
+ * @param  transport    IN  transport
+ *
+ * @retval  true if the calling thread may use the outgoing queues directly
+ *          without getting in the way of the main loop
+ * @retval  false if the main loop is run by another thread
+ *******************************************************************************
+ */
+static bool
+_LSTransportIsLoopThread(_LSTransport *transport)
+{
+    return !transport->mainloop_context || pthread_equal(transport->loop_thread, pthread_self());
+}
+
+/**
+ *******************************************************************************
+ * @brief Move the messages that other threads have handed over to the
+ * outgoing queues of their clients.
+ *
+ * @param  transport    IN  transport
+ * @param  send         IN  true to also send as much of them as we can right
+ *                          away (main loop thread only)
+ *******************************************************************************
+ */
+static void
+_LSTransportQueueSubmitted(_LSTransport *transport, bool send)
+{
+    GList *clients = NULL;
+
+    SUBMIT_LOCK(&transport->submit->lock);
+
+    _LSTransportSubmitNode *node = _LSTransportSubmitTakeAll(transport->submit);
+
+    while (node)
+    {
+        _LSTransportSubmitNode *next = node->next;
+        _LSTransportClient *client = node->client;
+
+        OUTGOING_LOCK(&client->outgoing->lock);
+
+        if (g_queue_is_empty(client->outgoing->queue) && transport->mainloop_context)
+        {
+            _LSTransportAddSendWatch(&client->channel, transport->mainloop_context, client);
+        }
+
+        /* the queue takes over the node's ref */
+        _LSTransportOutgoingPush(client->outgoing, node->message, false);
+        node->message = NULL;
+
+        _LSTransportOutgoingUnlock(client, false);
+
+        if (send && !g_list_find(clients, client))
+        {
+            _LSTransportClientRef(client);
+            clients = g_list_prepend(clients, client);
+        }
+
+        _LSTransportSubmitNodeFree(node);
+        node = next;
+    }
+
+    SUBMIT_UNLOCK(&transport->submit->lock);
+
+    /* one write per client for the whole batch */
+    GList *iter;
+    for (iter = clients; iter; iter = iter->next)
+    {
+        _LSTransportSendClient(NULL, G_IO_OUT, iter->data);
+    }
+
+    g_list_free_full(clients, (GDestroyNotify)_LSTransportClientUnref);
+}
+
+/**
+ *******************************************************************************
+ * @brief Prepare for queueing a message under the outgoing lock. On threads
+ * other than the main loop thread, the messages this thread handed over
+ * earlier are queued first so that they're sent in order.
+ *
+ * @param  transport    IN  transport
+ *******************************************************************************
+ */
+static void
+_LSTransportSubmitBarrier(_LSTransport *transport)
+{
+    if (transport->submit && transport->submit->head && !_LSTransportIsLoopThread(transport))
+    {
+        _LSTransportQueueSubmitted(transport, false);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether a message to a client should be handed over to the
+ * main loop thread with @ref _LSTransportSubmitPush instead of being queued
+ * under the outgoing lock.
+ *
+ * @param  client   IN  client
+ *
+ * @retval  true if we're on another thread than the main loop thread
+ * @retval  false if the caller has to queue the message itself
+ *******************************************************************************
+ */
+static bool
+_LSTransportShouldSubmit(_LSTransportClient *client)
+{
+    _LSTransport *transport = client->transport;
+
+    if (!transport->submit || _LSTransportIsLoopThread(transport))
+    {
+        return false;
+    }
+
+    /* nothing drains the queue after the transport is disconnected, so we
+     * queue the message ourselves, behind what this thread handed over */
+    if (!transport->submit->channel.recv_watch)
+    {
+        _LSTransportSubmitBarrier(transport);
+        return false;
+    }
+
+    /* senders have to wait for the queue to drain under LSOutgoingPolicyBlock */
+    if (transport->outgoing_limits.policy == LSOutgoingPolicyBlock &&
+        client->outgoing->above_high_watermark)
+    {
+        _LSTransportQueueSubmitted(transport, false);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Callback for the submission queue's eventfd becoming readable.
+ *
+ * @param  source       IN  io channel
+ * @param  condition    IN  condition that triggered the callback
+ * @param  data         IN  transport
+ *
+ * @retval  TRUE always, the watch stays until the transport is disconnected
+ *******************************************************************************
+ */
+static gboolean
+_LSTransportSubmitWakeup(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    _LSTransportQueueSubmitted(data, true);
+
+    return TRUE;
+}
+
 /**
  *******************************************************************************
  * @brief Send a message that has been constructed as an io vector.
@@ -3769,7 +5430,9 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
  * @param  iov              IN  array of io vectors
  * @param  iovcnt           IN  size of @ref iov array
  * @param  total_len        IN  total size of @ref iov array
- * @param  app_id_offset    IN  offset of app_id from beginning of raw message
+ * @param  payload_type     IN  @ref LS_PAYLOAD_TYPE_JSON or the type of a
+ *                              binary payload in the vector
+ * @param  payload_len      IN  length of a binary payload
  * @param  client           IN  client
  * @param  lserror          OUT set on error
  *
@@ -3778,13 +5441,36 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
  *******************************************************************************
  */
 bool
-_LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_len, unsigned long app_id_offset, _LSTransportClient *client, LSError *lserror)
+_LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_len,
+                       LSPayloadType payload_type, unsigned long payload_len,
+                       _LSTransportClient *client, LSError *lserror)
 {
     /* FIXME - review locking */
     //int i = 0;
     int bytes_written = 0;
 
-    LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
+    LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
+
+    /* the version 2 header is built from a message, so there is no point
+     * in writing the vector directly */
+    if (_LSTransportShouldSubmit(client) || client->tx_version >= 2)
+    {
+        _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, total_len);
+
+        if (!message)
+        {
+            LS_ASSERT(0);
+            return false;
+        }
+
+        _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
+
+        /* the token is in the vector already */
+        bool ret = _LSTransportSendMessageRaw(message, client, false, NULL, false, lserror);
+
+        _LSTransportMessageUnref(message);
+        return ret;
+    }
 
     /* If there is anything in the queue, we can't do a fast send
      * or we risk re-ordering the messages */
@@ -3794,8 +5480,35 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
     {
         //int total_bytes = 0;
 
+        if (client->loopback && client->loopback->tx_active)
+        {
+            _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, total_len);
+
+            if (message)
+            {
+                _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
+            }
+
+            bool handed_over = message && _LSTransportLoopbackSend(client, message);
+
+            if (message) _LSTransportMessageUnref(message);
+
+            if (handed_over)
+            {
+                OUTGOING_UNLOCK(&client->outgoing->lock);
+                return true;
+            }
+        }
+
         /* writev -- send as much of the message as possible without blocking */
-        bytes_written = writev(client->channel.fd, iov, iovcnt);
+        if (client->ring && client->ring->tx_active)
+        {
+            bytes_written = _LSTransportRingWrite(client->ring, iov, iovcnt);
+        }
+        else
+        {
+            bytes_written = writev(client->channel.fd, iov, iovcnt);
+        }
 
         if (bytes_written < 0)
         {
@@ -3852,8 +5565,7 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
         return false;
     }
 
-    _LSTransportMessageSetAppId(message, _LSTransportMessageGetBody(message) + app_id_offset);
-
+    _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
     message->tx_bytes_remaining = total_len - bytes_written;
 
     /* if the queue is empty, there's no send watch set on it, so we
@@ -3868,9 +5580,9 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
         }
     }
 
-    g_queue_push_tail(client->outgoing->queue, message);
+    _LSTransportOutgoingPush(client->outgoing, message, false);
 
-    OUTGOING_UNLOCK(&client->outgoing->lock);
+    _LSTransportOutgoingUnlock(client, true);
 
     return true;
 }
@@ -3888,7 +5600,9 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
  * @param  iov              IN  array of io vectors
  * @param  iovcnt           IN  size of @ref iov array
  * @param  total_len        IN  total size of @ref iov array
- * @param  app_id_offset    IN  offset of app_id from beginning of raw message
+ * @param  payload_type     IN  @ref LS_PAYLOAD_TYPE_JSON or the type of a
+ *                              binary payload in the vector
+ * @param  payload_len      IN  length of a binary payload
  * @param  client           IN  client
  * @param  lserror          OUT set on error
  *
@@ -3897,7 +5611,9 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
  *******************************************************************************
  */
 _LSTransportMessage *
-_LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long total_len, unsigned long app_id_offset, _LSTransportClient *client, LSError *lserror)
+_LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long total_len,
+                          LSPayloadType payload_type, unsigned long payload_len,
+                          _LSTransportClient *client, LSError *lserror)
 {
     /* FIXME - review locking */
     //int i = 0;
@@ -3905,6 +5621,24 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
 
     LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
 
+    if (_LSTransportShouldSubmit(client))
+    {
+        _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, total_len);
+
+        if (!message)
+        {
+            LS_ASSERT(0);
+            return NULL;
+        }
+
+        _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
+        _LSTransportMessageSetTxVersion(message, client->tx_version);
+
+        _LSTransportMessageRef(message);
+        _LSTransportSubmitPush(client->transport->submit, client, message);
+        return message;
+    }
+
     /* If there is anything in the queue, we can't do a fast send
      * or we risk re-ordering the messages */
     OUTGOING_LOCK(&client->outgoing->lock);
@@ -3918,14 +5652,32 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
         return NULL;
     }
 
-    _LSTransportMessageSetAppId(message, _LSTransportMessageGetBody(message) + app_id_offset);
+    _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
+    _LSTransportMessageSetTxVersion(message, client->tx_version);
 
     if (g_queue_is_empty(client->outgoing->queue))
     {
         //int total_bytes = 0;
 
+        if (client->loopback && client->loopback->tx_active &&
+            _LSTransportLoopbackSend(client, message))
+        {
+            OUTGOING_UNLOCK(&client->outgoing->lock);
+            return message;
+        }
+
         /* write -- send as much of the message as possible without blocking */
-        bytes_written = write(client->channel.fd, message->raw, total_len);
+        struct iovec tx_iov[2];
+        int tx_iovcnt = _LSTransportMessageGetTxIov(message, tx_iov);
+
+        if (client->ring && client->ring->tx_active)
+        {
+            bytes_written = _LSTransportRingWrite(client->ring, tx_iov, tx_iovcnt);
+        }
+        else
+        {
+            bytes_written = writev(client->channel.fd, tx_iov, tx_iovcnt);
+        }
 
         if (bytes_written < 0)
         {
@@ -3963,7 +5715,7 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
         }
 
         //printf("writev: sent %d bytes out of %ld\n", bytes_written, total_len);
-        if (bytes_written == total_len)
+        if (bytes_written == _LSTransportMessageGetTxSize(message))
         {
             //_LSTransportHeader *header = (_LSTransportHeader*)iov[0].iov_base;
             //printf("writev: sent message: token %d, type: %d, len: %d\n", (int)header->token, (int)header->type, (int)header->len);
@@ -3987,13 +5739,54 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
     }
 
     _LSTransportMessageRef(message);
-    g_queue_push_tail(client->outgoing->queue, message);
+    _LSTransportOutgoingPush(client->outgoing, message, false);
 
-    OUTGOING_UNLOCK(&client->outgoing->lock);
+    _LSTransportOutgoingUnlock(client, true);
 
     return message;
 }
 
+/**
+ *******************************************************************************
+ * @brief Check whether the monitor wants a copy of a message.
+ *
+ * @param  message  IN  message sent to or received from @ref client
+ * @param  client   IN  client on the other side
+ *
+ * @retval true if the message matches the filter of the monitor
+ * @retval false otherwise
+ *******************************************************************************
+ */
+static bool
+_LSTransportMonitorFilterMatchMessage(const _LSTransportMessage *message, const _LSTransportClient *client)
+{
+    const _LSTransport *transport = client->transport;
+    const _LSTransportMonitorFilter *filter = transport->monitor_filter;
+
+    if (!filter) return true;
+
+    _LSTransportMessageType type = _LSTransportMessageGetType(message);
+    const char *category = NULL;
+    const char *method = NULL;
+    unsigned long payload_len = 0;
+
+    if (type != _LSTransportMessageTypeReply)
+    {
+        category = _LSTransportMessageGetCategory(message);
+        method = _LSTransportMessageGetMethod(message);
+    }
+
+    /* only look at the payload if the size matters */
+    if (filter->min_payload_size > 0)
+    {
+        _LSTransportMessageGetPayloadBinary(message, &payload_len);
+    }
+
+    return _LSTransportMonitorFilterMatch(filter, type, category, method,
+                                          transport->service_name, transport->unique_name,
+                                          client->service_name, client->unique_name, payload_len);
+}
+
 /**
  *******************************************************************************
  * @brief Send a message to the monitor.
@@ -4015,6 +5808,48 @@ _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient
 {
     bool ret = true;
 
+    if (!_LSTransportMonitorFilterMatchMessage(message, client))
+    {
+        return true;
+    }
+
+    /* a monitor in trace mode reads a record from our trace ring instead
+     * of getting a copy */
+    if (client->transport->monitor_trace)
+    {
+        _LSMonitorMessageData trace_data;
+        trace_data.serial = _LSTransportShmGetSerial(client->transport->shm);
+        trace_data.type = type;
+        if (timestamp)
+        {
+            trace_data.timestamp = *timestamp;
+        }
+        else
+        {
+            ClockGetTime(&trace_data.timestamp);
+        }
+
+        unsigned long payload_len = 0;
+        const char *payload = _LSTransportMessageGetPayloadBinary(message, &payload_len);
+
+        _LSTransportTraceWrite(client->transport->trace, &trace_data, message,
+                               client->service_name ? client->service_name : client->unique_name,
+                               payload, payload_len);
+        return true;
+    }
+
+    /* the monitor gets to see the plain payload */
+    _LSTransportMessage *plain_message = NULL;
+    if (message->payload_compressed)
+    {
+        plain_message = _LSTransportMessageDecompressNewRef(message);
+        if (!plain_message)
+        {
+            return false;
+        }
+        message = plain_message;
+    }
+
     _LSMonitorMessageData message_data;
     /* Get a serial number from the shared memory area (global serial) */
     message_data.serial = _LSTransportShmGetSerial(client->transport->shm);
@@ -4072,6 +5907,11 @@ _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient
     }
     _LSTransportMessageUnref(monitor_message);
 
+    if (plain_message)
+    {
+        _LSTransportMessageUnref(plain_message);
+    }
+
     return ret;
 }
 
@@ -4081,6 +5921,9 @@ _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient
  * the hub so that the hub can tell all the clients to connect to the monitor.
  *
  * @param  transport    IN   transport
+ * @param  trace        IN   true to have clients write to trace rings instead
+ *                           of sending message copies
+ * @param  filter       IN   messages clients should copy to the monitor; NULL for all
  * @param  lserror      OUT  set on error
  *
  * @retval true on success
@@ -4088,16 +5931,26 @@ _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient
  *******************************************************************************
  */
 bool
-LSTransportSendMessageMonitorRequest(_LSTransport *transport, LSError *lserror)
+LSTransportSendMessageMonitorRequest(_LSTransport *transport, bool trace, const _LSTransportMonitorFilter *filter,
+                                     LSError *lserror)
 {
     LS_ASSERT(transport != NULL);
     LS_ASSERT(transport->hub != NULL);
 
-    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+    _LSTransportMessage *message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
 
     _LSTransportMessageSetType(message, _LSTransportMessageTypeMonitorRequest);
 
-    /* no body for the message */
+    _LSTransportMessageIter iter;
+    _LSTransportMessageIterInit(message, &iter);
+    if (!_LSTransportMessageAppendInt32(&iter, trace) ||
+        !_LSTransportMonitorFilterAppend(filter, &iter) ||
+        !_LSTransportMessageAppendInvalid(&iter))
+    {
+        _LSTransportMessageUnref(message);
+        _LSErrorSetOOM(lserror);
+        return false;
+    }
 
     /* send special message to the hub so that it can tell clients
      * to connect */
@@ -4230,15 +6083,20 @@ _LSTransportSendMessagePrepend(_LSTransportMessage *message, _LSTransportClient
  *******************************************************************************
  * @brief Allocate a new "ClientInfo" message with ref count of 1.
  *
+ * Our features go along with it, so that the far side knows what it may
+ * send us.
+ *
  * @param  service_name     IN  service name
  * @param  unique_name      IN  unique name
+ * @param  version          IN  protocol version we switch to after this message
+ * @param  features         IN  LS_TRANSPORT_FEATURE_* values we announce
  *
  * @retval message on success
  * @retval NULL on failure
  *******************************************************************************
  */
 _LSTransportMessage*
-_LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique_name)
+_LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique_name, int version, int features)
 {
     LS_ASSERT(unique_name != NULL);
     _LSTransportMessageIter iter;
@@ -4250,6 +6108,8 @@ _LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique
     _LSTransportMessageIterInit(message, &iter);
     if (!_LSTransportMessageAppendString(&iter, service_name)) goto error;
     if (!_LSTransportMessageAppendString(&iter, unique_name)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, version)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, features)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     return message;
@@ -4264,9 +6124,13 @@ error:
  * @brief Send a "ClientInfo" message, which contains the service name and
  * unique name of the client so the newly connected client knows who we are.
  *
+ * It also tells the far side which protocol version we speak from now on;
+ * the ClientInfo message itself still goes out in the version before.
+ *
  * @param  client        IN  destination client
  * @param  service_name  IN  service name of client
  * @param  unique_name   IN  unique name of client
+ * @param  version       IN  protocol version to switch to
  * @param  prepend       IN  true means put this message at beginning of
  *                           outgoing queue
  * @param  lserror       OUT set on error
@@ -4276,13 +6140,14 @@ error:
  *******************************************************************************
  */
 bool
-_LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *service_name, const char *unique_name, bool prepend, LSError *lserror)
+_LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *service_name, const char *unique_name, int version, bool prepend, LSError *lserror)
 {
     LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
 
     bool ret = false;
 
-    _LSTransportMessage *message = _LSTransportMessageClientInfoNewRef(service_name, unique_name);
+    _LSTransportMessage *message = _LSTransportMessageClientInfoNewRef(service_name, unique_name, version,
+                                                                       _LSTransportGetFeatures(client->transport));
 
     if (!message)
     {
@@ -4305,6 +6170,8 @@ _LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *servic
         }
     }
 
+    _LSTransportClientSwitchVersion(client, message, version);
+
     ret = true;
 
 error:
@@ -4345,6 +6212,96 @@ _LSTransportSendMessageNodeUp(_LSTransportClient *client, LSError *lserror)
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Switch the protocol version spoken with a client after a handshake
+ * message.
+ *
+ * The far side switches once it has received @ref message, so the messages
+ * queued behind it are prepared again for the new version. A far side that
+ * stays on version 1 doesn't know @ref _LSTransportMessageTypeMethodCallNoReply,
+ * so the no-reply calls queued for it go out as plain calls, whose replies
+ * nobody waits for.
+ *
+ * @attention locks outgoing lock
+ *
+ * @param  client   IN  client
+ * @param  message  IN  handshake message that has just been queued for the
+ *                      client; NULL when the far side has switched already
+ * @param  version  IN  protocol version
+ *******************************************************************************
+ */
+void
+_LSTransportClientSwitchVersion(_LSTransportClient *client, const _LSTransportMessage *message, int version)
+{
+    OUTGOING_LOCK(&client->outgoing->lock);
+
+    client->tx_version = version;
+    client->rx_version = version;
+
+    GList *iter = client->outgoing->queue->head;
+    int index = 0;
+
+    if (message)
+    {
+        /* if it hasn't reached the queue yet, neither has anything after it */
+        GList *link = g_queue_find(client->outgoing->queue, message);
+
+        iter = link ? link->next : NULL;
+        index = g_queue_link_index(client->outgoing->queue, link) + 1;
+    }
+
+    for (; iter; iter = iter->next, index++)
+    {
+        _LSTransportMessage *queued = iter->data;
+
+        /* leave alone whatever has started to go out */
+        if (queued && (unsigned int)index >= client->outgoing->tx_in_flight &&
+            queued->tx_bytes_remaining == _LSTransportMessageGetTxSize(queued))
+        {
+            if (version < 2 && _LSTransportMessageGetType(queued) == _LSTransportMessageTypeMethodCallNoReply)
+            {
+                _LSTransportMessageSetType(queued, _LSTransportMessageTypeMethodCall);
+            }
+
+            _LSTransportMessageSetTxVersion(queued, version);
+        }
+    }
+
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the protocol version spoken with a client.
+ *
+ * @param  client   IN  client
+ *
+ * @retval protocol version
+ *******************************************************************************
+ */
+int
+_LSTransportClientGetVersion(const _LSTransportClient *client)
+{
+    return client->tx_version;
+}
+
+/**
+ *******************************************************************************
+ * @brief Pick the protocol version to speak with a peer.
+ *
+ * @param  peer_version     IN  highest version the peer announced (0 if it
+ *                              didn't announce one)
+ *
+ * @retval protocol version both sides understand
+ *******************************************************************************
+ */
+int
+_LSTransportNegotiateVersion(int32_t peer_version)
+{
+    return CLAMP(peer_version, LS_TRANSPORT_PROTOCOL_VERSION_MIN, LS_TRANSPORT_PROTOCOL_VERSION);
+}
+
 /**
  *******************************************************************************
  * @brief Underlying message sending function.
@@ -4373,7 +6330,6 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
 
     /* add message to outgoing queue */
     _LSTransportMessageRef(message);
-    message->tx_bytes_remaining = message->raw->header.len + sizeof(message->raw->header);
 
     /* For some messages we may not want to set the token
      * (e.g., monitor messages are clones of regular messages, so we
@@ -4390,9 +6346,34 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
         }
     }
 
+    /* the header on the wire depends on the version spoken with the client
+     * when the message is queued, which is also when the far side expects it */
+    _LSTransportMessageSetTxVersion(message, client->tx_version);
+
+    if (prepend)
+    {
+        _LSTransportSubmitBarrier(client->transport);
+    }
+    else if (_LSTransportShouldSubmit(client))
+    {
+        _LSTransportSubmitPush(client->transport->submit, client, message);
+        return true;
+    }
+
     /* TODO: lock the hash table of queues as well? (or only that?) */
     OUTGOING_LOCK(&client->outgoing->lock);
 
+    /* hand it straight to a linked client in this process unless there are
+     * messages queued ahead of it */
+    if (!prepend && client->loopback && client->loopback->tx_active &&
+        g_queue_is_empty(client->outgoing->queue) &&
+        _LSTransportLoopbackSend(client, message))
+    {
+        OUTGOING_UNLOCK(&client->outgoing->lock);
+        _LSTransportMessageUnref(message);
+        return true;
+    }
+
     /* if the queue is empty, there's no send watch set on it, so we
      * need to add one */
     if (g_queue_is_empty(client->outgoing->queue))
@@ -4435,91 +6416,296 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
         _LSTransportMessageSetToken(cur_msg, msg_token);
 #endif
 
-        /*
-         * Note that we don't preserve the ordering of serial numbers
-         * when we do this. If we re-ordered the serial numbers as shown above,
-         * we would be changing the serial number that could have been saved
-         * by a caller. In our current usage, that means that we would break
-         * the callmap lookups for a message.
-         */
-        g_queue_push_head(client->outgoing->queue, message);
-    }
-    else
+        /*
+         * Note that we don't preserve the ordering of serial numbers
+         * when we do this. If we re-ordered the serial numbers as shown above,
+         * we would be changing the serial number that could have been saved
+         * by a caller. In our current usage, that means that we would break
+         * the callmap lookups for a message.
+         */
+        _LSTransportOutgoingPush(client->outgoing, message, true);
+    }
+    else
+    {
+        _LSTransportOutgoingPush(client->outgoing, message, false);
+    }
+    _LSTransportOutgoingUnlock(client, true);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a message.
+ *
+ * @param  message  IN  message to send
+ * @param  client   IN  client
+ * @param  token    OUT token
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendMessage(_LSTransportMessage *message, _LSTransportClient *client,
+                        LSMessageToken *token, LSError *lserror)
+{
+    /* current time to add proper timestamp into the monitor message copy */
+    struct timespec now;
+
+    if (client->transport->monitor)
+    {
+        ClockGetTime(&now);
+    }
+
+    /* sets the token field in the message */
+    bool ret = _LSTransportSendMessageRaw(message, client, true, token, false, lserror);
+
+    /* MONITOR */
+    if (client->transport->monitor)
+    {
+        if (_LSTransportMessageIsMonitorType(message))
+        {
+            _LSTransportSendMessageMonitor(message, client, _LSMonitorMessageTypeTx, &now, lserror);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Move a payload out of line if it is large enough.
+ *
+ * Payloads stay inline while a monitor is attached, so that the monitor
+ * copies remain complete (a monitor in trace mode only records the start of
+ * each payload), and on connections with shared memory rings or
+ * a direct link.
+ *
+ * Peers that speak protocol version 1 don't know
+ * @ref _LSTransportMessageTypePayloadFd messages, and neither does a peer
+ * whose version hasn't been negotiated yet, so they get the payload inline.
+ *
+ * @param  client       IN  client the payload is sent to
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_len  IN  size of @ref payload plus one for the terminating NUL
+ *
+ * @retval sealed memfd holding the payload
+ * @retval -1 if the payload should be sent inline
+ *******************************************************************************
+ */
+static int
+_LSTransportPayloadFdNew(_LSTransportClient *client, const char *payload, unsigned long payload_len)
+{
+    _LSTransport *transport = client->transport;
+
+    if (transport->payload_fd_threshold == 0 ||
+        payload_len < transport->payload_fd_threshold ||
+        (transport->monitor && !transport->monitor_trace) || client->ring || client->loopback ||
+        client->tx_version < 2)
+    {
+        return -1;
+    }
+
+    return _LSTransportMessagePayloadFdNew(payload, payload_len);
+}
+
+/**
+ *******************************************************************************
+ * @brief Compress a payload if it is large enough and the client can take it.
+ *
+ * The threshold comes from the hub. Only direct links between clients are
+ * compressed; the hub and the monitor never announce the feature.
+ *
+ * @param  client           IN  client the payload is sent to
+ * @param  payload          IN  payload (need not be NUL-terminated)
+ * @param  payload_len      IN  length of @ref payload without a terminating NUL
+ * @param  compressed_len   OUT length of the compressed payload
+ *
+ * @retval compressed payload followed by a NUL, free with g_free()
+ * @retval NULL if the payload should be sent as it is
+ *******************************************************************************
+ */
+static char*
+_LSTransportPayloadCompress(_LSTransportClient *client, const char *payload, unsigned long payload_len,
+                            unsigned long *compressed_len)
+{
+    _LSTransport *transport = client->transport;
+
+    if (transport->compress_threshold == 0 ||
+        payload_len < transport->compress_threshold ||
+        client->tx_version < 2 || client->loopback ||
+        !(client->features & _LSTransportCompressGetFeatures() & LS_TRANSPORT_FEATURE_COMPRESS_LZ4))
     {
-        g_queue_push_tail(client->outgoing->queue, message);
+        return NULL;
     }
-    OUTGOING_UNLOCK(&client->outgoing->lock);
 
-    return true;
+    return _LSTransportCompress(payload, payload_len, compressed_len);
 }
 
 /**
  *******************************************************************************
- * @brief Send a message.
+ * @brief Send a message whose payload was moved into a memfd.
  *
- * @param  message  IN  message to send
- * @param  client   IN  client
- * @param  token    OUT token
- * @param  lserror  OUT set on error
+ * A @ref _LSTransportMessageTypePayloadFd message carrying the memfd is
+ * queued right in front of the message itself. Both are queued under a single
+ * hold of the outgoing lock so that no other message can get between them.
+ *
+ * If shared memory rings or a direct link were set up with the client in the
+ * meantime, the payload is put back inline since fds can't be passed through
+ * them.
+ *
+ * @warning Make sure that the message token has been set before calling this
+ * function.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  message      IN  message with an empty payload
+ * @param  client       IN  client
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_fd   IN  memfd with the payload; owned by this function
+ * @param  payload_len  IN  size of the payload in @ref payload_fd, including
+ *                          the terminating NUL
+ * @param  lserror      OUT set on error
  *
  * @retval  true on success
  * @retval  false on failure
  *******************************************************************************
  */
-bool
-_LSTransportSendMessage(_LSTransportMessage *message, _LSTransportClient *client,
-                        LSMessageToken *token, LSError *lserror)
+static bool
+_LSTransportSendMessagePayloadFd(_LSTransportMessage *message, _LSTransportClient *client,
+                                 const char *payload, int payload_fd, unsigned long payload_len,
+                                 LSError *lserror)
 {
-    /* current time to add proper timestamp into the monitor message copy */
-    struct timespec now;
+    _LSTransportMessage *fd_message = NULL;
 
-    if (client->transport->monitor)
+    /* the payload has to be copied or its fd queued right now, so this
+     * always takes the locked path */
+    _LSTransportSubmitBarrier(client->transport);
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+
+    if (client->ring || client->loopback)
     {
-        ClockGetTime(&now);
+        close(payload_fd);
+
+        message = _LSTransportMessageInlinePayloadNewRef(message, payload, payload_len);
+        if (!message)
+        {
+            OUTGOING_UNLOCK(&client->outgoing->lock);
+            _LSErrorSet(lserror, MSGID_LS_MSG_ERR, -1, "Could not put payload back inline");
+            return false;
+        }
     }
+    else
+    {
+        fd_message = _LSTransportMessageNewRef(sizeof(payload_len));
 
-    /* sets the token field in the message */
-    bool ret = _LSTransportSendMessageRaw(message, client, true, token, false, lserror);
+        _LSTransportMessageSetType(fd_message, _LSTransportMessageTypePayloadFd);
+        _LSTransportMessageSetBody(fd_message, &payload_len, sizeof(payload_len));
+        _LSTransportMessageSetConnectionFd(fd_message, payload_fd);
+        _LSTransportMessageSetTxVersion(fd_message, client->tx_version);
 
-    /* MONITOR */
-    if (client->transport->monitor)
+        _LSTransportMessageRef(message);
+    }
+
+    _LSTransportMessageSetTxVersion(message, client->tx_version);
+
+    /* if the queue is empty, there's no send watch set on it, so we
+     * need to add one */
+    if (g_queue_is_empty(client->outgoing->queue))
     {
-        if (_LSTransportMessageIsMonitorType(message))
+        /* we can only do this once the mainloop has been attached with
+         * LSGmainAttach */
+        if (client->transport->mainloop_context)
         {
-            _LSTransportSendMessageMonitor(message, client, _LSMonitorMessageTypeTx, &now, lserror);
+            _LSTransportAddSendWatch(&client->channel, client->transport->mainloop_context, client);
         }
     }
 
-    return ret;
+    /* the queue takes over our refs */
+    if (fd_message)
+    {
+        _LSTransportOutgoingPush(client->outgoing, fd_message, false);
+    }
+    _LSTransportOutgoingPush(client->outgoing, message, false);
+
+    _LSTransportOutgoingUnlock(client, true);
+
+    return true;
 }
 
 /**
  *******************************************************************************
  * @brief Underlying message reply implementation.
  *
- * @param  message  IN  message to reply to
- * @param  type     IN  reply type
- * @param  payload  IN  payload
- * @param  lserror  OUT set on error
+ * @param  message      IN  message to reply to
+ * @param  type         IN  reply type
+ * @param  payload_type IN  @ref LS_PAYLOAD_TYPE_JSON or the type of a binary payload
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_len  IN  length of @ref payload without a terminating NUL
+ * @param  lserror      OUT set on error
  *
  * @retval  true on success
  * @retval  false on failure
  *******************************************************************************
  */
 static bool
-_LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessageType type, const char *payload, LSError *lserror)
+_LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessageType type,
+                         LSPayloadType payload_type, const char *payload, unsigned long payload_len,
+                         LSError *lserror)
 {
     LS_ASSERT(_LSTransportMessageTypeIsReplyType(type));
 
+    /* the caller asked not to be replied to */
+    if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCallNoReply)
+    {
+        return true;
+    }
+
+    if (payload_type != LS_PAYLOAD_TYPE_JSON && _LSTransportClientGetVersion(message->client) < 2)
+    {
+        _LSErrorSet(lserror, MSGID_LS_MSG_ERR, -1, "Caller does not support binary payloads");
+        return false;
+    }
+
     /* TODO: use vector send */
 
     /* construct the reply message */
-    unsigned long payload_size = strlen(payload) + 1;
+    unsigned long payload_size = payload_len + 1;
+    unsigned long inline_len = payload_len;
+    int payload_fd = -1;
+    char *compressed = NULL;
+
+    /* error replies are small, so only regular replies go out of line */
+    if (type == _LSTransportMessageTypeReply)
+    {
+        payload_fd = _LSTransportPayloadFdNew(message->client, payload, payload_size);
+        if (payload_fd != -1)
+        {
+            /* leave an empty payload in the message itself */
+            inline_len = 0;
+        }
+        else
+        {
+            compressed = _LSTransportPayloadCompress(message->client, payload, payload_len, &inline_len);
+            if (compressed)
+            {
+                payload = compressed;
+            }
+        }
+    }
 
-    _LSTransportMessage *reply = _LSTransportMessageNewRef(payload_size + sizeof(LSMessageToken));
+    _LSTransportMessage *reply = _LSTransportMessageNewRef(inline_len + 1 + sizeof(LSMessageToken));
 
     /* set type */
     _LSTransportMessageSetType(reply, type);
+    _LSTransportMessageSetPayloadType(reply, payload_type, inline_len);
+    if (compressed)
+    {
+        _LSTransportMessageSetPayloadCompressed(reply, inline_len);
+    }
 
     /* format: reply_serial + payload */
     int offset = 0;
@@ -4528,11 +6714,30 @@ _LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessage
 
     memcpy(body + offset, &msg_token, sizeof(LSMessageToken));
     offset += sizeof(LSMessageToken);
-    memcpy(body + offset, payload, payload_size);
+    memcpy(body + offset, payload, inline_len);
+    body[offset + inline_len] = '\0';
+
+    g_free(compressed);
+
+    /* every reply after the first one to a call is a subscription update,
+     * which LSOutgoingPolicyDropOldestUpdate may drop */
+    if (type == _LSTransportMessageTypeReply &&
+        g_atomic_int_add(&((_LSTransportMessage*)message)->replies_sent, 1) > 0)
+    {
+        reply->is_update = true;
+    }
 
     LOG_LS_DEBUG("sending reply reply_token %d, type: %d, len: %d\n", (int)msg_token, (int)reply->raw->header.type, (int)reply->raw->header.len);
 
-    _LSTransportSendMessage(reply, message->client, NULL, NULL);
+    if (payload_fd != -1)
+    {
+        _LSTransportMessageSetToken(reply, _LSTransportGetNextToken(message->client->transport));
+        _LSTransportSendMessagePayloadFd(reply, message->client, payload, payload_fd, payload_size, NULL);
+    }
+    else
+    {
+        _LSTransportSendMessage(reply, message->client, NULL, NULL);
+    }
 
     _LSTransportMessageUnref(reply);
 
@@ -4557,7 +6762,7 @@ _LSTransportSendErrorReply(const _LSTransportMessage *message, _LSTransportMessa
 {
     LS_ASSERT(_LSTransportMessageTypeIsErrorType(error_type));
 
-    return _LSTransportSendReplyRaw(message, error_type, error_msg, lserror);
+    return _LSTransportSendReplyRaw(message, error_type, LS_PAYLOAD_TYPE_JSON, error_msg, strlen(error_msg), lserror);
 }
 
 /**
@@ -4575,7 +6780,51 @@ _LSTransportSendErrorReply(const _LSTransportMessage *message, _LSTransportMessa
 bool
 _LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror)
 {
-    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload, lserror);
+    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, LS_PAYLOAD_TYPE_JSON, payload, strlen(payload), lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a reply to a message with a payload of known length.
+ *
+ * @param  message      IN  message to reply to
+ * @param  payload      IN  payload to send (need not be NUL-terminated)
+ * @param  payload_len  IN  length of @ref payload without a terminating NUL;
+ *                          the payload must not contain NULs
+ * @param  lserror      OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendReplyLen(const _LSTransportMessage *message, const char *payload,
+                         unsigned long payload_len, LSError *lserror)
+{
+    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, LS_PAYLOAD_TYPE_JSON, payload, payload_len, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a reply to a message with a binary payload.
+ *
+ * @param  message      IN  message to reply to
+ * @param  payload_type IN  type of the payload (not @ref LS_PAYLOAD_TYPE_JSON)
+ * @param  payload      IN  payload (may contain NULs)
+ * @param  payload_len  IN  length of @ref payload
+ * @param  lserror      OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendReplyBinary(const _LSTransportMessage *message, LSPayloadType payload_type,
+                            const char *payload, unsigned long payload_len, LSError *lserror)
+{
+    LS_ASSERT(payload_type != LS_PAYLOAD_TYPE_JSON);
+
+    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload_type, payload, payload_len, lserror);
 }
 
 /**
@@ -4769,7 +7018,7 @@ _LSTransportAddPendingMessageWithToken(_LSTransport *transport, const char *serv
         LOG_LS_DEBUG("%s: adding message to queue: serial: %d\n", __func__, (int)msg_token);
 
         _LSTransportMessageRef(message);
-        g_queue_push_tail(pending->queue, message);
+        _LSTransportOutgoingPush(pending, message, false);
         OUTGOING_UNLOCK(&pending->lock);
         TRANSPORT_UNLOCK(&transport->lock);
     }
@@ -4797,7 +7046,7 @@ _LSTransportAddPendingMessageWithToken(_LSTransport *transport, const char *serv
 
         LOG_LS_DEBUG("%s: adding message to new pending: %p, serial: %d\n", __func__, out, (int)msg_token);
         _LSTransportMessageRef(message);
-        g_queue_push_tail(out->queue, message);
+        _LSTransportOutgoingPush(out, message, false);
 
         LOG_LS_DEBUG("%s: inserting \"%s\" into pending: %p\n", __func__, service_name, transport->pending);
         g_hash_table_insert(transport->pending, g_strdup(service_name), out);
@@ -4850,7 +7099,7 @@ _LSTransportAddPendingMessage(_LSTransport *transport, const char *service_name,
  *******************************************************************************
  * @brief Send a message to the specified service.
  *
- * @attention locks the transport lock
+ * @attention locks the clients lock
  *
  * @param  transport        IN  transport
  * @param  service_name     IN  service
@@ -4865,9 +7114,7 @@ _LSTransportAddPendingMessage(_LSTransport *transport, const char *service_name,
 bool
 _LSTransportSendMessageToService(_LSTransport *transport, const char *service_name, _LSTransportMessage *message, LSMessageToken *token, LSError *lserror)
 {
-    TRANSPORT_LOCK(&transport->lock);
-    _LSTransportClient *client = g_hash_table_lookup(transport->clients, service_name);
-    TRANSPORT_UNLOCK(&transport->lock);
+    _LSTransportClient *client = _LSTransportLookupClientRef(transport, service_name);
 
     if (!client)
     {
@@ -4875,7 +7122,9 @@ _LSTransportSendMessageToService(_LSTransport *transport, const char *service_na
     }
     else
     {
-        return _LSTransportSendMessage(message, client, token, lserror);
+        bool ret = _LSTransportSendMessage(message, client, token, lserror);
+        _LSTransportClientUnref(client);
+        return ret;
     }
 }
 
@@ -4901,18 +7150,154 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
                 const char *category, const char *method,
                 const char *payload, const char* applicationId,
                 LSMessageToken *token, LSError *lserror)
+{
+    return LSTransportSendLen(transport, service_name, category, method,
+                              payload, strlen(payload), applicationId,
+                              token, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a method call with a payload of known length.
+ *
+ * @param  transport        IN  transport
+ * @param  service_name     IN  destination service name
+ * @param  category         IN  method category
+ * @param  method           IN  method
+ * @param  payload          IN  payload (need not be NUL-terminated)
+ * @param  payload_len      IN  length of @ref payload without a terminating
+ *                              NUL; the payload must not contain NULs
+ * @param  applicationId    IN  application id
+ * @param  token            OUT message token
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+LSTransportSendLen(_LSTransport *transport, const char *service_name,
+                   const char *category, const char *method,
+                   const char *payload, unsigned long payload_len,
+                   const char* applicationId,
+                   LSMessageToken *token, LSError *lserror)
+{
+    return _LSTransportSendMethodCall(transport, _LSTransportMessageTypeMethodCall,
+                                      service_name, category, method,
+                                      LS_PAYLOAD_TYPE_JSON, payload, payload_len,
+                                      applicationId, token, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a method call with a binary payload.
+ *
+ * @param  transport        IN  transport
+ * @param  service_name     IN  destination service name
+ * @param  category         IN  method category
+ * @param  method           IN  method
+ * @param  payload_type     IN  type of the payload (not @ref LS_PAYLOAD_TYPE_JSON)
+ * @param  payload          IN  payload (may contain NULs)
+ * @param  payload_len      IN  length of @ref payload
+ * @param  applicationId    IN  application id
+ * @param  token            OUT message token
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+LSTransportSendBinary(_LSTransport *transport, const char *service_name,
+                      const char *category, const char *method,
+                      LSPayloadType payload_type, const char *payload, unsigned long payload_len,
+                      const char* applicationId,
+                      LSMessageToken *token, LSError *lserror)
+{
+    LS_ASSERT(payload_type != LS_PAYLOAD_TYPE_JSON);
+
+    return _LSTransportSendMethodCall(transport, _LSTransportMessageTypeMethodCall,
+                                      service_name, category, method,
+                                      payload_type, payload, payload_len,
+                                      applicationId, token, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a method call that doesn't expect a reply.
+ *
+ * The peer drops any reply to the call, so the message isn't kept around
+ * for the reply serial bookkeeping once it's been sent.
+ *
+ * @param  transport        IN  transport
+ * @param  service_name     IN  destination service name
+ * @param  category         IN  method category
+ * @param  method           IN  method
+ * @param  payload          IN  payload (need not be NUL-terminated)
+ * @param  payload_len      IN  length of @ref payload without a terminating
+ *                              NUL; the payload must not contain NULs
+ * @param  applicationId    IN  application id
+ * @param  token            OUT message token
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+LSTransportSendNoReply(_LSTransport *transport, const char *service_name,
+                       const char *category, const char *method,
+                       const char *payload, unsigned long payload_len,
+                       const char* applicationId,
+                       LSMessageToken *token, LSError *lserror)
+{
+    return _LSTransportSendMethodCall(transport, _LSTransportMessageTypeMethodCallNoReply,
+                                      service_name, category, method,
+                                      LS_PAYLOAD_TYPE_JSON, payload, payload_len,
+                                      applicationId, token, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Underlying method call implementation.
+ *
+ * @param  transport        IN  transport
+ * @param  type             IN  @ref _LSTransportMessageTypeMethodCall or
+ *                              @ref _LSTransportMessageTypeMethodCallNoReply
+ * @param  service_name     IN  destination service name
+ * @param  category         IN  method category
+ * @param  method           IN  method
+ * @param  payload_type     IN  @ref LS_PAYLOAD_TYPE_JSON or the type of a
+ *                              binary payload
+ * @param  payload          IN  payload (need not be NUL-terminated)
+ * @param  payload_len      IN  length of @ref payload without a terminating
+ *                              NUL; JSON payloads must not contain NULs
+ * @param  applicationId    IN  application id
+ * @param  token            OUT message token
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+static bool
+_LSTransportSendMethodCall(_LSTransport *transport, _LSTransportMessageType type,
+                           const char *service_name,
+                           const char *category, const char *method,
+                           LSPayloadType payload_type, const char *payload, unsigned long payload_len,
+                           const char* applicationId,
+                           LSMessageToken *token, LSError *lserror)
 {
     _LSTransportMessage *message = NULL;
     _LSTransportHeader header;
-    struct iovec iov[5];
+    struct iovec iov[6];
     char nul = '\0';
-    unsigned long app_id_offset = 0;
 
     unsigned long category_len = strlen(category) + 1;
     unsigned long method_len = strlen(method) + 1;
-    unsigned long payload_len = strlen(payload) + 1;
+    unsigned long payload_size = payload_len + 1;
     unsigned long app_id_len = strlen_safe(applicationId) + 1;
-    unsigned long total_size =  sizeof(_LSTransportMessageRaw) + category_len + method_len + payload_len + app_id_len;
+    unsigned long total_size =  sizeof(_LSTransportMessageRaw) + category_len + method_len + payload_size + app_id_len;
 
     struct timespec now;
 
@@ -4928,33 +7313,31 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
     iov[2].iov_base = (char*)method;
     iov[2].iov_len = method_len;
 
-    /* payload */
+    /* payload and its NUL */
     iov[3].iov_base = (char*)payload;
     iov[3].iov_len = payload_len;
+    iov[4].iov_base = &nul;
+    iov[4].iov_len = 1;
 
     /* app id */
     if (!applicationId)
     {
-        iov[4].iov_base = &nul;
+        iov[5].iov_base = &nul;
     }
     else
     {
-        iov[4].iov_base = (char*)applicationId;
+        iov[5].iov_base = (char*)applicationId;
     }
-    iov[4].iov_len = app_id_len;
-
-    /* The _LSTransportMessageGetBody() function skips the header */
-    app_id_offset = iov[1].iov_len + iov[2].iov_len + iov[3].iov_len;
+    iov[5].iov_len = app_id_len;
 
     /* TODO: use accessors */
-    header.len = category_len + method_len + payload_len + app_id_len;
-    header.type = _LSTransportMessageTypeMethodCall;
+    header.len = category_len + method_len + payload_size + app_id_len;
+    header.type = type;
 
-    /* Look up destination and connect to it if we haven't already */
-    TRANSPORT_LOCK(&transport->lock);
-    _LSTransportClient *client = g_hash_table_lookup(transport->clients, service_name);
+    unsigned long inline_len = payload_len;
 
-    TRANSPORT_UNLOCK(&transport->lock);
+    /* Look up destination and connect to it if we haven't already */
+    _LSTransportClient *client = _LSTransportLookupClientRef(transport, service_name);
 
     if (!client)
     {
@@ -4968,8 +7351,7 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
             return false;
         }
 
-        const char *app_id_in_raw_msg = _LSTransportMessageGetBody(message) + app_id_offset;
-        _LSTransportMessageSetAppId(message, app_id_in_raw_msg);
+        _LSTransportMessageSetPayloadType(message, payload_type, payload_len);
 
         /* ref's the message */
         if (!_LSTransportAddPendingMessage(transport, service_name, message, token, lserror))
@@ -4988,34 +7370,144 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
         /* we have to set the token here SendVector doesn't know which vector
          * has the token */
 
+        if (payload_type != LS_PAYLOAD_TYPE_JSON && _LSTransportClientGetVersion(client) < 2)
+        {
+            _LSErrorSet(lserror, MSGID_LS_MSG_ERR, -1, "%s does not support binary payloads", service_name);
+            _LSTransportClientUnref(client);
+            return false;
+        }
+
+        /* nobody waits for the reply to a no-reply call */
+        bool save_serial = (type == _LSTransportMessageTypeMethodCall);
+
+        /* a far side that predates the v2 header would drop a no-reply
+         * call, so it gets a plain one and we ignore its reply */
+        if (type == _LSTransportMessageTypeMethodCallNoReply && _LSTransportClientGetVersion(client) < 2)
+        {
+            type = _LSTransportMessageTypeMethodCall;
+            header.type = type;
+        }
+
         LSMessageToken msg_token = _LSTransportGetNextToken(transport);
 
+        int payload_fd = _LSTransportPayloadFdNew(client, payload, payload_size);
+        if (payload_fd != -1)
+        {
+            /* leave an empty payload in the message itself */
+            iov[3].iov_len = 0;
+            header.len -= payload_len;
+            inline_len = 0;
+            total_size -= payload_len;
+        }
+
+        unsigned long compressed_len = 0;
+        char *compressed = NULL;
+        if (payload_fd == -1)
+        {
+            compressed = _LSTransportPayloadCompress(client, payload, payload_len, &compressed_len);
+        }
+
+        /* the monitor only gets a copy if its filter says so */
+        bool monitor_match = transport->monitor &&
+                             _LSTransportMonitorFilterMatch(transport->monitor_filter, type, category, method,
+                                                            transport->service_name, transport->unique_name,
+                                                            client->service_name, client->unique_name,
+                                                            payload_len);
+
         _LSTransportMonitorSerial monitor_serial = 0;
-        if (transport->monitor)
+        if (monitor_match)
         {
             monitor_serial = _LSTransportShmGetSerial(client->transport->shm);
             ClockGetTime(&now);
         }
 
-        LOG_LS_DEBUG("method call: token: %d, category: %s, method: %s, payload: %s\n", (int)msg_token, category, method, payload);
+        LOG_LS_DEBUG("method call: token: %d, category: %s, method: %s, payload: %.*s\n", (int)msg_token, category, method, (int)payload_len, payload);
 
         header.token = msg_token;
 
-        message = _LSTransportSendVectorRet(iov, ARRAY_SIZE(iov), total_size, app_id_offset, client, lserror);
-        if (!message)
+        if (payload_fd != -1)
+        {
+            message = _LSTransportMessageFromVectorNewRef(iov, ARRAY_SIZE(iov), total_size);
+            if (!message)
+            {
+                close(payload_fd);
+                _LSTransportClientUnref(client);
+                return false;
+            }
+
+            _LSTransportMessageSetPayloadType(message, payload_type, inline_len);
+
+            if (!_LSTransportSendMessagePayloadFd(message, client, payload, payload_fd, payload_size, lserror))
+            {
+                _LSTransportMessageUnref(message);
+                _LSTransportClientUnref(client);
+                return false;
+            }
+        }
+        else if (compressed)
+        {
+            /* iov keeps the plain payload for the monitor copy below */
+            _LSTransportHeader compressed_header = header;
+            struct iovec compressed_iov[ARRAY_SIZE(iov)];
+            memcpy(compressed_iov, iov, sizeof(iov));
+
+            compressed_header.len = header.len - payload_len + compressed_len;
+            compressed_iov[0].iov_base = &compressed_header;
+            compressed_iov[3].iov_base = compressed;
+            compressed_iov[3].iov_len = compressed_len;
+
+            message = _LSTransportMessageFromVectorNewRef(compressed_iov, ARRAY_SIZE(compressed_iov),
+                                                          total_size - payload_len + compressed_len);
+            g_free(compressed);
+            if (!message)
+            {
+                _LSTransportClientUnref(client);
+                return false;
+            }
+
+            _LSTransportMessageSetPayloadType(message, payload_type, compressed_len);
+            _LSTransportMessageSetPayloadCompressed(message, compressed_len);
+
+            /* the token is already in the header */
+            if (!_LSTransportSendMessageRaw(message, client, false, NULL, false, lserror))
+            {
+                _LSTransportMessageUnref(message);
+                _LSTransportClientUnref(client);
+                return false;
+            }
+        }
+        else
         {
-            return false;
+            message = _LSTransportSendVectorRet(iov, ARRAY_SIZE(iov), total_size, payload_type, inline_len, client, lserror);
+            if (!message)
+            {
+                _LSTransportClientUnref(client);
+                return false;
+            }
         }
 
         /* Successfully sent the message so save the serial and set the
          * return token val */
 
-        /* Ref's the message */
-        _LSTransportSerialSave(client->outgoing->serial, message, lserror);
+        if (save_serial)
+        {
+            /* Ref's the message */
+            _LSTransportSerialSave(client->outgoing->serial, message, lserror);
+        }
         *token = msg_token;
 
         /* MONITOR */
-        if (transport->monitor)
+        if (monitor_match && transport->monitor_trace)
+        {
+            _LSMonitorMessageData trace_data;
+            trace_data.serial = monitor_serial;
+            trace_data.type = _LSMonitorMessageTypeTx;
+            trace_data.timestamp = now;
+
+            _LSTransportTraceWrite(transport->trace, &trace_data, message,
+                                   client->service_name, payload, payload_len);
+        }
+        else if (monitor_match)
         {
             /*
              * Add destination service name and destination unique name
@@ -5066,18 +7558,90 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
 
             /* We don't really care if this fails and it may fail when the
              * monitor goes down */
-            (void)_LSTransportSendVector(iov_monitor, ARRAY_SIZE(iov_monitor), monitor_total_size, app_id_offset, transport->monitor, lserror);
+            (void)_LSTransportSendVector(iov_monitor, ARRAY_SIZE(iov_monitor), monitor_total_size,
+                                         payload_type, inline_len, transport->monitor, lserror);
         }
+
+        _LSTransportClientUnref(client);
     }
     _LSTransportMessageUnref(message);
 
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Send a batch of messages through the io_uring engine.
+ *
+ * The first call submits the batch and fails with EAGAIN; the call after the
+ * engine is done with it returns the result. The messages stay at the head of
+ * the queue meanwhile, so that the caller gathers the same batch again (and
+ * possibly more) and accounts for the result as usual.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  client       IN  client
+ * @param  iov          IN  batch
+ * @param  iov_count    IN  number of elements in @ref iov
+ * @param  batch_len    IN  number of messages in @ref iov
+ *
+ * @retval  same as sendmsg()
+ *******************************************************************************
+ */
+static int
+_LSTransportSendClientUring(_LSTransportClient *client, const struct iovec *iov, int iov_count, int batch_len)
+{
+    int ret;
+
+    if (_LSTransportUringTakeSendResult(&client->channel, &ret))
+    {
+        /* the batch gathered now starts with the one that was in flight */
+        client->outgoing->tx_in_flight = 0;
+        return ret;
+    }
+
+    if (iov_count == 0)
+    {
+        return 0;
+    }
+
+    if (client->outgoing->tx_in_flight > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    /* keep the messages alive until the kernel is done with their buffers */
+    GPtrArray *holds = g_ptr_array_new_with_free_func((GDestroyNotify)_LSTransportMessageUnref);
+    _LSTransportMessage *last = NULL;
+    GList *iter = client->outgoing->queue->head;
+    int i;
+
+    for (i = 0; i < batch_len; i++, iter = iter->next)
+    {
+        last = iter->data;
+        g_ptr_array_add(holds, _LSTransportMessageRef(last));
+    }
+
+    bool link_fd = last && _LSTransportMessageIsConnectionFdType(last);
+
+    _LSTransportUringSend(&client->channel, iov, iov_count, holds, link_fd,
+                          link_fd ? _LSTransportMessageGetConnectionFd(last) : -1);
+    client->outgoing->tx_in_flight = batch_len;
+
+    /* the result is picked up the next time we're called */
+    errno = EAGAIN;
+    return -1;
+}
+
 /**
  *******************************************************************************
  * @brief Callback that is called when a watch is ready to send.
  *
+ * The unsent data of up to IOV_MAX queued messages is written with a single
+ * call. A message that carries a connection fd ends the batch, since the fd
+ * has to follow its message on the socket, and so does a switch to the ring.
+ *
  * @attention locks the outgoing lock
  *
  * @param  source       IN  io source
@@ -5096,6 +7660,7 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
      * and quit if the call will block */
 
     _LSTransportClient *client = (_LSTransportClient*)data;
+    struct iovec iov[IOV_MAX];
 
     LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
 
@@ -5108,47 +7673,95 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
 
     	if (g_queue_is_empty (client->outgoing->queue))
     	{
-                /* remove the watch since we're done sending */
-                _LSTransportRemoveSendWatch(&client->channel);
+                /* remove the watch since we're done sending (there is none
+                 * when we were called for the ring) */
+                if (client->channel.send_watch)
+                {
+                    _LSTransportRemoveSendWatch(&client->channel);
+                }
 
-                OUTGOING_UNLOCK(&client->outgoing->lock);
+                _LSTransportOutgoingUnlock(client, false);
                 return FALSE;
     	}
 
-        /* grab message off queue */
-        _LSTransportMessage *message = g_queue_pop_head(client->outgoing->queue);
-
-        /* Warn and exit if we dequeue a null */
-        if (!message)
+        /* Warn and drop it if we find a null at the head of the queue */
+        if (!g_queue_peek_head(client->outgoing->queue))
         {
+            _LSTransportOutgoingPop(client->outgoing);
             LOG_LS_WARNING(MSGID_LS_QUEUE_ERROR, 0, "%s: Found null message in outgoing queue", __func__);
             continue;
         }
 
-        //printf("SendClient: sending message: token %d, type: %d, len: %d, data: %s\n", (int)_LSTransportMessageGetToken(message), (int)_LSTransportMessageGetType(message), (int)message->raw->header.len, _LSTransportMessageGetBody(message));
-        //printf("sending %ld bytes\n", message->tx_bytes_remaining);
+        /* what was queued up before the switch to the link is handed over
+         * one by one */
+        if (client->loopback && client->loopback->tx_active &&
+            _LSTransportLoopbackSend(client, g_queue_peek_head(client->outgoing->queue)))
+        {
+            _LSTransportMessageUnref(_LSTransportOutgoingPop(client->outgoing));
+            continue;
+        }
+
+        /* gather the batch, starting with the (possibly partially sent) head */
+        int iov_count = 0;
+        int batch_len = 0;
+        GList *iter = client->outgoing->queue->head;
 
-        if (message->tx_bytes_remaining > 0)
+        /* a message takes up to two io vectors: its header and its body */
+        while (iter && iter->data && iov_count < ARRAY_SIZE(iov) - 1)
         {
-            /* attempt to send message */
+            _LSTransportMessage *message = iter->data;
 
-            /* TODO */
-            /* <eeh> This is a lot of math.  Can you calc a ptr upfront and increment it by ret? */
-            ret = send(client->channel.fd, (char*)message->raw + message->raw->header.len + sizeof(_LSTransportHeader) - message->tx_bytes_remaining, message->tx_bytes_remaining, MSG_DONTWAIT);
+            iov_count += _LSTransportMessageGetTxIov(message, &iov[iov_count]);
 
-            if (ret >= 0)
-            {
-                message->tx_bytes_remaining -= ret;
+            batch_len++;
 
+            /* the messages after a ring or link switch must not go out on
+             * the socket */
+            if (_LSTransportMessageIsConnectionFdType(message) ||
+                _LSTransportMessageGetType(message) == _LSTransportMessageTypeRingReady ||
+                _LSTransportMessageGetType(message) == _LSTransportMessageTypeLoopbackReady)
+            {
+                break;
             }
-            else if (errno == EAGAIN || errno == EINTR)
+
+            iter = iter->next;
+        }
+
+        if (client->ring && client->ring->tx_active)
+        {
+            ret = _LSTransportRingWrite(client->ring, iov, iov_count);
+        }
+        else if (_LSTransportUringOwnsChannel(&client->channel))
+        {
+            ret = _LSTransportSendClientUring(client, iov, iov_count, batch_len);
+        }
+        else if (iov_count == 1)
+        {
+            ret = send(client->channel.fd, iov[0].iov_base, iov[0].iov_len, MSG_DONTWAIT);
+        }
+        else if (iov_count > 1)
+        {
+            struct msghdr msg;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count;
+
+            ret = sendmsg(client->channel.fd, &msg, MSG_DONTWAIT);
+        }
+
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
             {
-                /* still have data left, so put it back on the queue
-                 * from where we took it off */
-                g_queue_push_head(client->outgoing->queue, message);
+                /* still have data left, and it's all still on the queue */
                 goto Done;
             }
-            else if (errno == EPIPE)
+
+            /* the head message is lost */
+            _LSTransportMessage *message = _LSTransportOutgoingPop(client->outgoing);
+
+            if (errno == EPIPE)
             {
                 /* Broken pipe is considered a normal situation, because it means
                  * the peer has disconnected suddenly.
@@ -5159,8 +7772,6 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
                                PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
                                PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
                                "Error when attempting to send to fd: %d", client->channel.fd);
-                _LSTransportMessageUnref(message);
-                goto Done;
             }
             else
             {
@@ -5171,14 +7782,33 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
                              PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
                              PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
                              "Error when attempting to send to fd: %d", client->channel.fd);
-                _LSTransportMessageUnref(message);
-                goto Done;     /* <eeh> You're going to return TRUE here.  Want that? */
             }
+            _LSTransportMessageUnref(message);
+            goto Done;     /* <eeh> You're going to return TRUE here.  Want that? */
         }
 
-        if (message->tx_bytes_remaining == 0)
+        /* advance tx_bytes_remaining across the batch and retire the
+         * messages that have been transmitted entirely */
+        unsigned long bytes_sent = ret;
+        int i;
+
+        for (i = 0; i < batch_len; i++)
         {
-            /* transmitted entire message */
+            _LSTransportMessage *message = g_queue_peek_head(client->outgoing->queue);
+            unsigned long sent = MIN(bytes_sent, message->tx_bytes_remaining);
+
+            message->tx_bytes_remaining -= sent;
+            bytes_sent -= sent;
+
+            if (message->tx_bytes_remaining > 0)
+            {
+                /* still have data left, so it stays at the head of the queue
+                 *
+                 * TODO: we don't actually have to exit the loop here; as long as we're
+                 * calling send with MSG_DONTWAIT, it won't block and we can
+                 * give it another shot.. we'll get EAGAIN if we would block */
+                goto Done;
+            }
 
             /* Send the connection fd if we have one
              *
@@ -5190,14 +7820,14 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
                 LSError lserror;
                 LSErrorInit(&lserror);
 
-                if (!_LSTransportSendFd(client->channel.fd, _LSTransportMessageGetConnectionFd(message), &need_retry, &lserror))
+                if (!_LSTransportUringTakeFdSent(&client->channel) &&
+                    !_LSTransportSendFd(client->channel.fd, _LSTransportMessageGetConnectionFd(message), &need_retry, &lserror))
                 {
                     if (need_retry)
                     {
-                        /* Still need to send fd, so push message back on
-                         * queue where it was and wait for fd to become
+                        /* Still need to send fd, so leave message on the
+                         * queue where it is and wait for fd to become
                          * ready for sending */
-                        g_queue_push_head(client->outgoing->queue, message);
                         goto Done;
                     }
                     else
@@ -5210,7 +7840,18 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
 
             /* the fd is closed when the message ref count goes to 0 */
 
-            //_LSTransportHeader *header = &message->raw->header;
+            _LSTransportOutgoingPop(client->outgoing);
+
+            /* everything after this goes through the ring or the link */
+            if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeRingReady && client->ring)
+            {
+                client->ring->tx_active = true;
+            }
+            else if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeLoopbackReady && client->loopback)
+            {
+                client->loopback->tx_active = true;
+            }
+
             LOG_LS_DEBUG("%s: sent message: client: %p, token %d, type: %d, len: %d\n",
                         __func__,
                         client,
@@ -5220,21 +7861,21 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
 
             _LSTransportMessageUnref(message);
         }
-        else
-        {
-            /* still have data left, so put it back on the queue from
-             * where we took it off.
-             *
-             * TODO: we don't actually have to exit the loop here; as long as we're
-             * calling send with MSG_DONTWAIT, it won't block and we can
-             * give it another shot.. we'll get EAGAIN if we would block */
-            g_queue_push_head(client->outgoing->queue, message);
-            goto Done;
-        }
+
+        LS_ASSERT(bytes_sent == 0);
     }
 
 Done:
-    OUTGOING_UNLOCK(&client->outgoing->lock);
+    /* The ring is full, and the far side wakes us up once it has made room.
+     * Don't keep polling the socket, which is always writable */
+    if (client->ring && client->ring->tx_active && client->channel.send_watch)
+    {
+        _LSTransportRemoveSendWatch(&client->channel);
+        _LSTransportOutgoingUnlock(client, false);
+        return FALSE;
+    }
+
+    _LSTransportOutgoingUnlock(client, false);
     return TRUE;    /* FALSE means this source should be removed */
 }
 
@@ -5270,18 +7911,9 @@ _LSTransportGlobalTokenNew()
 {
     _LSTransportGlobalToken* ret = g_new0(_LSTransportGlobalToken, 1);
 
-    if (pthread_mutex_init(&ret->lock, NULL))
-    {
-        LOG_LS_ERROR(MSGID_LS_MUTEX_ERR, 0, "Could not initialize mutex");
-        goto error;
-    }
     ret->value = LSMESSAGE_TOKEN_INVALID;
 
     return ret;
-
-error:
-    _LSTransportGlobalTokenFree(ret);
-    return NULL;
 }
 
 /**
@@ -5358,6 +7990,12 @@ _LSTransportInit(_LSTransport **ret_transport, const char *service_name,
         goto error;
     }
 
+    if (pthread_rwlock_init(&transport->clients_lock, NULL))
+    {
+        _LSErrorSet(lserror, MSGID_LS_MUTEX_ERR, -1, "Could not initialize rwlock");
+        goto error;
+    }
+
     transport->global_token = _LSTransportGlobalTokenNew();
     if (!transport->global_token)
     {
@@ -5380,6 +8018,57 @@ _LSTransportInit(_LSTransport **ret_transport, const char *service_name,
     transport->msg_handler = handlers->msg_handler;
     transport->msg_context = handlers->msg_context;
 
+    transport->outgoing_watermark_handler = handlers->outgoing_watermark_handler;
+    transport->outgoing_watermark_context = handlers->outgoing_watermark_context;
+
+    transport->incoming_budget.bytes = LS_TRANSPORT_INCOMING_BUDGET_BYTES;
+    transport->incoming_budget.messages = LS_TRANSPORT_INCOMING_BUDGET_MESSAGES;
+
+    /* LS_PAYLOAD_FD_THRESHOLD=0 keeps all payloads inline */
+    const char *payload_fd_threshold = getenv("LS_PAYLOAD_FD_THRESHOLD");
+    transport->payload_fd_threshold = payload_fd_threshold
+                                      ? strtoul(payload_fd_threshold, NULL, 10)
+                                      : LS_TRANSPORT_PAYLOAD_FD_THRESHOLD;
+
+    /* LS_TRANSPORT_ENGINE=epoll watches all channels with a single epoll fd
+     * once the transport is attached to a main context */
+    const char *engine = getenv("LS_TRANSPORT_ENGINE");
+    transport->use_epoll = engine && strcmp(engine, "epoll") == 0;
+
+    /* without it, other threads queue their messages under the outgoing
+     * lock like the main loop thread does */
+    LSError submit_error;
+    LSErrorInit(&submit_error);
+    transport->submit = _LSTransportSubmitNew(&submit_error);
+    if (!transport->submit)
+    {
+        LOG_LSERROR(MSGID_LS_SUBMIT_ERR, &submit_error);
+        LSErrorFree(&submit_error);
+    }
+
+    /* LS_LOOPBACK=0 keeps the connections between transports in this
+     * process on their sockets */
+    const char *loopback = getenv("LS_LOOPBACK");
+    if (!loopback || strcmp(loopback, "0") != 0)
+    {
+        LSError loopback_error;
+        LSErrorInit(&loopback_error);
+        transport->loopback = _LSTransportSubmitNew(&loopback_error);
+        if (!transport->loopback)
+        {
+            LOG_LSERROR(MSGID_LS_LOOPBACK_ERR, &loopback_error);
+            LSErrorFree(&loopback_error);
+        }
+    }
+
+    /* LS_PEER_RING_SIZE sets the size of the shared memory rings that we
+     * offer to the services we connect to; unset or 0 disables them */
+    const char *ring_size = getenv("LS_PEER_RING_SIZE");
+    if (ring_size && strtoul(ring_size, NULL, 10) > 0)
+    {
+        transport->ring_size = _LSTransportRingRoundCapacity(strtoul(ring_size, NULL, 10));
+    }
+
     *ret_transport = transport;
     return true;
 
@@ -5538,6 +8227,7 @@ _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror
             break;
 
         case _LSTransportMessageTypeMethodCall:
+        case _LSTransportMessageTypeMethodCallNoReply:
             /* Save message serial so we know what has been processed */
             incoming->last_serial_processed = _LSTransportMessageGetToken(tmsg);
             /* fallthrough */
@@ -5563,6 +8253,9 @@ _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror
  *******************************************************************************
  * @brief Flush all messages in the outgoing queue.
  *
+ * Waiting for room in a shared memory ring stops at the flush deadline of
+ * the transport; what doesn't fit by then is dropped.
+ *
  * @attention locks the outgoing queue
  *
  * @param  client   IN  client
@@ -5581,9 +8274,31 @@ _LSTransportFlushOutgoingMessages(_LSTransportClient *client, LSError *lserror)
 
     OUTGOING_LOCK(&client->outgoing->lock);
 
+    /* don't send again what the io_uring engine has sent already */
+    int sent;
+
+    if (_LSTransportUringWaitSend(&client->channel, &sent))
+    {
+        while (sent > 0 && !g_queue_is_empty(client->outgoing->queue))
+        {
+            _LSTransportMessage *message = g_queue_peek_head(client->outgoing->queue);
+
+            if (message->tx_bytes_remaining > sent)
+            {
+                message->tx_bytes_remaining -= sent;
+                break;
+            }
+
+            sent -= message->tx_bytes_remaining;
+            _LSTransportMessageUnref(_LSTransportOutgoingPop(client->outgoing));
+        }
+    }
+
+    client->outgoing->tx_in_flight = 0;
+
     while (!g_queue_is_empty(client->outgoing->queue))
     {
-        _LSTransportMessage *message = g_queue_pop_head(client->outgoing->queue);
+        _LSTransportMessage *message = _LSTransportOutgoingPop(client->outgoing);
         if (!message)
         {
             /* LOCKED */
@@ -5603,7 +8318,36 @@ _LSTransportFlushOutgoingMessages(_LSTransportClient *client, LSError *lserror)
                            _LSTransportMessageTypeQueryNameGetQueryName(message));
         }
 
-        ret = _LSTransportSendMessageBlocking(message, client, NULL, lserror);
+        if (client->loopback && client->loopback->tx_active &&
+            _LSTransportLoopbackSend(client, message))
+        {
+            ret = true;
+        }
+        else if (client->ring && client->ring->tx_active)
+        {
+            struct iovec iov[2];
+            int iov_count = _LSTransportMessageGetTxIov(message, iov);
+            int i;
+
+            for (i = 0; ret && i < iov_count; i++)
+            {
+                ret = _LSTransportRingWriteBlocking(client->ring, iov[i].iov_base, iov[i].iov_len,
+                                                    &client->transport->flush_deadline, lserror);
+            }
+        }
+        else
+        {
+            ret = _LSTransportSendMessageBlocking(message, client, NULL, lserror);
+
+            if (ret && _LSTransportMessageGetType(message) == _LSTransportMessageTypeRingReady && client->ring)
+            {
+                client->ring->tx_active = true;
+            }
+            else if (ret && _LSTransportMessageGetType(message) == _LSTransportMessageTypeLoopbackReady && client->loopback)
+            {
+                client->loopback->tx_active = true;
+            }
+        }
 
         _LSTransportMessageUnref(message);
     }
@@ -5647,6 +8391,11 @@ _LSTransportSendShutdownMessages(gpointer key, gpointer value, gpointer user_dat
         _LSTransportRemoveReceiveWatch(&client->channel);
     }
 
+    if (client->ring && client->ring->channel.recv_watch)
+    {
+        _LSTransportRemoveReceiveWatch(&client->ring->channel);
+    }
+
     _LSTransport *transport = _LSTransportClientGetTransport(client);
     if (transport->listen_channel.accept_watch)
     {
@@ -5700,6 +8449,9 @@ _LSTransportSendShutdownMessages(gpointer key, gpointer value, gpointer user_dat
         }
     }
 
+    /* everything has been handed over the link by now */
+    _LSTransportLoopbackUnpair(client);
+
     /* close connections */
     _LSTransportChannelClose(&client->channel, flush_and_send_shutdown);
     _LSTransportChannelDeinit(&client->channel);
@@ -5777,6 +8529,31 @@ _LSTransportDisconnect(_LSTransport *transport, bool flush_and_send_shutdown)
 
     LOG_LS_DEBUG("%s: transport: %p\n", __func__, transport);
 
+    /* nobody offers us new links from now on */
+    if (transport->loopback && transport->unique_name)
+    {
+        _LSTransportLoopbackRemoveName(transport->unique_name);
+    }
+
+    if (transport->loopback && transport->loopback->channel.recv_watch)
+    {
+        _LSTransportRemoveReceiveWatch(&transport->loopback->channel);
+    }
+
+    /* messages handed over by other threads go out with the flush */
+    if (transport->submit)
+    {
+        if (transport->submit->channel.recv_watch)
+        {
+            _LSTransportRemoveReceiveWatch(&transport->submit->channel);
+        }
+        _LSTransportQueueSubmitted(transport, false);
+    }
+
+    /* the main loop waits for slow readers of all rings together at most this long */
+    ClockGetTime(&transport->flush_deadline);
+    ClockAccumMs(&transport->flush_deadline, LS_TRANSPORT_RING_FLUSH_TIMEOUT_MS);
+
     TRANSPORT_LOCK(&transport->lock);
     g_hash_table_foreach(transport->all_connections, _LSTransportSendShutdownMessages, GINT_TO_POINTER((gint)flush_and_send_shutdown));
     TRANSPORT_UNLOCK(&transport->lock);
@@ -5786,8 +8563,36 @@ _LSTransportDisconnect(_LSTransport *transport, bool flush_and_send_shutdown)
     _LSTransportChannelClose(&transport->listen_channel, flush_and_send_shutdown);
     _LSTransportChannelDeinit(&transport->listen_channel);
 
+    /* clients that outlive the transport keep the engine until released */
+    if (transport->epoll)
+    {
+        _LSTransportEpollFree(transport->epoll);
+        transport->epoll = NULL;
+    }
+
+    if (transport->uring)
+    {
+        _LSTransportUringFree(transport->uring);
+        transport->uring = NULL;
+    }
+
     if (transport->shm) _LSTransportShmDeinit(&transport->shm);
 
+    if (transport->trace)
+    {
+        _LSTransportTraceFree(transport->trace);
+        transport->trace = NULL;
+    }
+
+    if (transport->monitor_filter)
+    {
+        _LSTransportMonitorFilterFree(transport->monitor_filter);
+        transport->monitor_filter = NULL;
+    }
+
+    g_slist_free_full(transport->monitor_filters_retired, (GDestroyNotify)_LSTransportMonitorFilterFree);
+    transport->monitor_filters_retired = NULL;
+
     return true;
 }
 
@@ -5819,6 +8624,14 @@ _LSTransportDeinit(_LSTransport *transport)
 
     if (transport)
     {
+        /* drops the refs on clients of messages sent after the disconnect */
+        if (transport->submit) _LSTransportSubmitFree(transport->submit);
+        transport->submit = NULL;
+
+        /* all links were broken on disconnect, so nobody adds to it anymore */
+        if (transport->loopback) _LSTransportSubmitFree(transport->loopback);
+        transport->loopback = NULL;
+
         /* destroy all hash tables */
         if (transport->clients) g_hash_table_unref(transport->clients);
         transport->clients = NULL;
@@ -5826,6 +8639,8 @@ _LSTransportDeinit(_LSTransport *transport)
         if (transport->all_connections) g_hash_table_unref(transport->all_connections);
         transport->all_connections = NULL;
 
+        pthread_rwlock_destroy(&transport->clients_lock);
+
         g_hash_table_foreach_remove(transport->pending, (GHRFunc)_freePending, NULL);
         if (transport->pending) g_hash_table_unref(transport->pending);
         transport->pending = NULL;
@@ -5864,6 +8679,112 @@ _LSTransportGetPrivileged(const _LSTransport *transport)
     return transport->privileged;
 }
 
+/**
+ *******************************************************************************
+ * @brief Set the watermarks applied to the outgoing queue of every client.
+ *
+ * The limits are expected to be set up before messages start flowing; queues
+ * pick up the new limits the next time they change.
+ *
+ * @param  transport    IN  transport
+ * @param  limits       IN  watermarks
+ *******************************************************************************
+ */
+void
+_LSTransportSetOutgoingLimits(_LSTransport *transport, const _LSTransportOutgoingLimits *limits)
+{
+    LS_ASSERT(transport != NULL);
+    LS_ASSERT(limits != NULL);
+
+    transport->outgoing_limits = *limits;
+}
+
+/**
+ *******************************************************************************
+ * @brief Set how much is read from a single client before yielding back to
+ * the main loop.
+ *
+ * @param  transport    IN  transport
+ * @param  budget       IN  budget per wakeup
+ *******************************************************************************
+ */
+void
+_LSTransportSetIncomingBudget(_LSTransport *transport, const _LSTransportIncomingBudget *budget)
+{
+    LS_ASSERT(transport != NULL);
+    LS_ASSERT(budget != NULL);
+
+    transport->incoming_budget = *budget;
+}
+
+/**
+ *******************************************************************************
+ * @brief Do the socket I/O of the transport through io_uring once it's
+ * attached to a main context. Falls back to direct socket I/O if the kernel
+ * doesn't support it, and does nothing when built without io_uring.
+ *
+ * The engine isn't thread safe, so the transport has to be used from the
+ * thread running its main context only.
+ *
+ * @param  transport    IN  transport
+ * @param  use_uring    IN  true to use the engine
+ *******************************************************************************
+ */
+void
+_LSTransportSetUseUring(_LSTransport *transport, bool use_uring)
+{
+    LS_ASSERT(transport != NULL);
+
+#ifdef HAS_IO_URING
+    transport->use_uring = use_uring;
+#endif
+}
+
+struct _LSTransportForeachOutgoingData {
+    _LSTransportOutgoingStatsFunc func;
+    void *data;
+};
+
+static void
+_LSTransportForeachOutgoingClient(gpointer key, gpointer value, gpointer user_data)
+{
+    _LSTransportClient *client = value;
+    struct _LSTransportForeachOutgoingData *foreach_data = user_data;
+    _LSTransportOutgoingStats stats;
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    stats.messages = g_queue_get_length(client->outgoing->queue);
+    stats.bytes = client->outgoing->queue_bytes;
+    stats.above_high_watermark = client->outgoing->above_high_watermark;
+    stats.dropped = client->outgoing->dropped;
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    foreach_data->func(client, &stats, foreach_data->data);
+}
+
+/**
+ *******************************************************************************
+ * @brief Call a function with the outgoing queue state of every connection.
+ *
+ * @attention locks the transport lock
+ *
+ * @param  transport    IN  transport
+ * @param  func         IN  function to call
+ * @param  data         IN  passed to @ref func
+ *******************************************************************************
+ */
+void
+_LSTransportForeachOutgoing(_LSTransport *transport, _LSTransportOutgoingStatsFunc func, void *data)
+{
+    struct _LSTransportForeachOutgoingData foreach_data = { .func = func, .data = data };
+
+    LS_ASSERT(transport != NULL);
+
+    TRANSPORT_LOCK(&transport->lock);
+    g_hash_table_foreach(transport->all_connections, _LSTransportForeachOutgoingClient, &foreach_data);
+    TRANSPORT_UNLOCK(&transport->lock);
+}
+
 /* NOTE: This is a blocking call */
 static bool
 _LSTransportSendMessagePushRole(_LSTransportClient *hub, const char *role_path, LSError *lserror)
@@ -40,6 +40,7 @@ typedef struct LSTransport _LSTransport;
 #include "transport_client.h"
 #include "transport_security.h"
 #include "transport_utils.h"
+#include "transport_monitor_filter.h"
 
 /* older versions of gcc only recognize __FUNCTION__ */
 #if (__STDC_VERSION__ < 199901L)
@@ -79,8 +80,14 @@ _padding_bytes(unsigned int align_bytes, unsigned int size_bytes)
  * Used to determine protocol compatibility when registering with the hub.
  * The value is an integer that should be incremented whenever the low level
  * message format changes.
+ *
+ * The hub accepts clients from @ref LS_TRANSPORT_PROTOCOL_VERSION_MIN up and
+ * both ends of a connection switch to the lower of their versions after the
+ * handshake (RequestName with the hub, ClientInfo with other clients).
+ * Version 2 has the fixed-width @ref _LSTransportHeaderV2 and binary payloads.
  */
-#define LS_TRANSPORT_PROTOCOL_VERSION   1
+#define LS_TRANSPORT_PROTOCOL_VERSION       2
+#define LS_TRANSPORT_PROTOCOL_VERSION_MIN   1
 
 /* can override these with environment variable */
 #define HUB_DEFAULT_INET_ADDRESS        192.168.2.101
@@ -182,21 +189,38 @@ bool _LSTransportSetupListenerLocal(_LSTransport *transport, const char *name, m
 bool _LSTransportSetupListenerInet(_LSTransport *transport, int port, LSError *lserror);
 bool _LSTransportSendMessage(_LSTransportMessage *message, _LSTransportClient *client,
                         LSMessageToken *token, LSError *lserror);
+void _LSTransportClientSwitchVersion(_LSTransportClient *client, const _LSTransportMessage *message, int version);
+int _LSTransportClientGetVersion(const _LSTransportClient *client);
+int _LSTransportNegotiateVersion(int32_t peer_version);
 void _LSTransportAddInitialWatches(_LSTransport *transport, GMainContext *context);
 _LSTransportType _LSTransportGetTransportType(const _LSTransport *transport);
 bool _LSTransportGetPrivileged(const _LSTransport *tansport);
 
+typedef void (*_LSTransportOutgoingStatsFunc)(const _LSTransportClient *client, const _LSTransportOutgoingStats *stats, void *data);
+
+void _LSTransportSetOutgoingLimits(_LSTransport *transport, const _LSTransportOutgoingLimits *limits);
+void _LSTransportSetIncomingBudget(_LSTransport *transport, const _LSTransportIncomingBudget *budget);
+void _LSTransportSetUseUring(_LSTransport *transport, bool use_uring);
+void _LSTransportForeachOutgoing(_LSTransport *transport, _LSTransportOutgoingStatsFunc func, void *data);
+
 inline bool _LSTransportIsHub(void);
 
 bool LSTransportSend(_LSTransport *transport, const char *service_name, const char *category, const char *method, const char *payload, const char* applicationId, LSMessageToken *token, LSError *lserror);
+bool LSTransportSendLen(_LSTransport *transport, const char *service_name, const char *category, const char *method, const char *payload, unsigned long payload_len, const char* applicationId, LSMessageToken *token, LSError *lserror);
+bool LSTransportSendBinary(_LSTransport *transport, const char *service_name, const char *category, const char *method, LSPayloadType payload_type, const char *payload, unsigned long payload_len, const char* applicationId, LSMessageToken *token, LSError *lserror);
+bool LSTransportSendNoReply(_LSTransport *transport, const char *service_name, const char *category, const char *method, const char *payload, unsigned long payload_len, const char* applicationId, LSMessageToken *token, LSError *lserror);
 bool _LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror);
+bool _LSTransportSendReplyLen(const _LSTransportMessage *message, const char *payload, unsigned long payload_len, LSError *lserror);
+bool _LSTransportSendReplyBinary(const _LSTransportMessage *message, LSPayloadType payload_type, const char *payload, unsigned long payload_len, LSError *lserror);
+void _LSTransportReplyToHandlerResult(const _LSTransportMessage *message, LSMessageHandlerResult ret);
 
 bool LSTransportCancelMethodCall(_LSTransport *transport, const char *service_name, LSMessageToken serial, LSError *lserror);
 
 bool LSTransportPushRole(_LSTransport *transport, const char *path, LSError *lserror);
 
 /* TODO: move these */
-bool LSTransportSendMessageMonitorRequest(_LSTransport *transport, LSError *lserror);
+bool LSTransportSendMessageMonitorRequest(_LSTransport *transport, bool trace, const _LSTransportMonitorFilter *filter,
+                                          LSError *lserror);
 bool _LSTransportSendMessageListClients(_LSTransport *transport, LSError *lserror);
 bool _LSTransportSendMessageListServiceMethods(_LSTransport *transport, const char *service_name, LSError *lserror);
 bool LSTransportSendQueryServiceStatus(_LSTransport *transport, const char *service_name, LSMessageToken *serial, LSError *lserror);
@@ -23,6 +23,8 @@
 #include "error.h"
 #include "transport_utils.h"
 #include "transport_channel.h"
+#include "transport_epoll.h"
+#include "transport_uring.h"
 
 void _LSTransportRemoveSendWatch(_LSTransportChannel *channel);
 void _LSTransportRemoveReceiveWatch(_LSTransportChannel *channel);
@@ -64,6 +66,8 @@ _LSTransportChannelInit(_LSTransport *transport, _LSTransportChannel *channel, i
     channel->send_watch = NULL;
     channel->recv_watch = NULL;
     channel->accept_watch = NULL;
+    channel->epoll_entry = NULL;
+    channel->uring_entry = NULL;
 
     return true;
 }
@@ -95,6 +99,9 @@ _LSTransportChannelDeinit(_LSTransportChannel *channel)
         _LSTransportRemoveAcceptWatch(channel);
     }
 
+    _LSTransportEpollRelease(channel);
+    _LSTransportUringRelease(channel);
+
     if (channel->channel)
     {
         g_io_channel_unref(channel->channel);
@@ -135,6 +142,10 @@ _LSTransportChannelClose(_LSTransportChannel *channel, bool flush)
     GIOStatus status;
     GError *err = NULL;
 
+    /* before the fd number can be reused */
+    _LSTransportEpollDetach(channel);
+    _LSTransportUringDetach(channel);
+
     if (channel->channel)
     {
         status = g_io_channel_shutdown(channel->channel, flush, &err);
@@ -36,6 +36,8 @@ struct LSTransportChannel {
     GSource *send_watch;
     GSource *recv_watch;
     GSource *accept_watch;      /**< only used on listen channel (one per transport */
+    struct LSTransportEpollEntry *epoll_entry;  /**< registration with the transport's epoll engine, if any */
+    struct LSTransportUringEntry *uring_entry;  /**< registration with the transport's io_uring engine, if any */
 };
 
 typedef struct LSTransportChannel _LSTransportChannel;
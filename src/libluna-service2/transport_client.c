@@ -64,6 +64,9 @@ _LSTransportClientNew(_LSTransport* transport, int fd, const char *service_name,
     new_client->is_sysmgr_app_proxy = false;
     new_client->is_dynamic = false;
     new_client->initiator = initiator;
+    new_client->tx_version = LS_TRANSPORT_PROTOCOL_VERSION_MIN;
+    new_client->rx_version = LS_TRANSPORT_PROTOCOL_VERSION_MIN;
+    new_client->features = 0;
 
     _LSTransportChannelInit(transport, &new_client->channel, fd, transport->source_priority);
 
@@ -139,6 +142,8 @@ _LSTransportClientFree(_LSTransportClient* client)
     _LSTransportCredFree(client->cred);
     _LSTransportOutgoingFree(client->outgoing);
     _LSTransportIncomingFree(client->incoming);
+    if (client->ring) _LSTransportRingFree(client->ring);
+    if (client->loopback) _LSTransportLoopbackFree(client->loopback);
     _LSTransportChannelClose(&client->channel, true);
     _LSTransportChannelDeinit(&client->channel);
 
@@ -25,6 +25,8 @@
 #include "transport_channel.h"
 #include "transport_serial.h"
 #include "transport_security.h"
+#include "transport_ring.h"
+#include "transport_loopback.h"
 
 typedef enum LSTransportClientState {
     _LSTransportClientStateInvalid = -1,
@@ -59,6 +61,13 @@ struct LSTransportClient {
                                           used by apps */
     bool is_dynamic;                    /**< true for a dynamic service */
     bool initiator;                     /**< true if this is side that initiated the connection (typically by a method call) */
+    _LSTransportRing *ring;             /**< shared memory rings to the far side; NULL if not used.
+                                             Set with the outgoing lock held */
+    _LSTransportLoopback *loopback;     /**< direct link to a far side in the same process; NULL if not used.
+                                             Set with the outgoing lock held */
+    int tx_version;                     /**< protocol version of the messages we send */
+    int rx_version;                     /**< protocol version of the messages we receive */
+    int features;                       /**< LS_TRANSPORT_FEATURE_* values the far side announced */
 };
 
 _LSTransportClient* _LSTransportClientNew(_LSTransport* transport, int fd, const char *service_name, const char *unique_name, _LSTransportOutgoing *outgoing, bool initiator);
@@ -0,0 +1,134 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <lz4.h>
+
+#include "error.h"
+#include "transport.h"
+#include "transport_compress.h"
+
+/**
+ * @defgroup LunaServiceTransportCompress
+ * @ingroup LunaServiceTransport
+ * @brief Payload compression between clients
+ */
+
+/**
+ * @addtogroup LunaServiceTransportCompress
+ * @{
+ */
+
+/**
+ *******************************************************************************
+ * @brief Get the features this build announces to the hub and to peers.
+ *
+ * @retval bitmask of LS_TRANSPORT_FEATURE_* values
+ *******************************************************************************
+ */
+int
+_LSTransportCompressGetFeatures(void)
+{
+    return LS_TRANSPORT_FEATURE_COMPRESS_LZ4;
+}
+
+/**
+ *******************************************************************************
+ * @brief Compress a payload.
+ *
+ * The result is the plain size followed by an LZ4 block and a NUL, which
+ * isn't counted in @ref compressed_len, so it can take the place of a
+ * binary payload in a message body.
+ *
+ * @param  payload          IN  payload
+ * @param  len              IN  length of @ref payload
+ * @param  compressed_len   OUT length of the compressed payload
+ *
+ * @retval compressed payload, free with g_free()
+ * @retval NULL if the payload doesn't get any smaller
+ *******************************************************************************
+ */
+char*
+_LSTransportCompress(const char *payload, unsigned long len, unsigned long *compressed_len)
+{
+    if (len == 0 || len > MAX_MESSAGE_SIZE_BYTES)
+    {
+        return NULL;
+    }
+
+    int bound = LZ4_compressBound(len);
+    char *buf = g_malloc(LS_TRANSPORT_COMPRESS_PREFIX_SIZE + bound + 1);
+
+    int ret = LZ4_compress_default(payload, buf + LS_TRANSPORT_COMPRESS_PREFIX_SIZE, len, bound);
+
+    /* don't bother the far side with something that didn't shrink */
+    if (ret <= 0 || LS_TRANSPORT_COMPRESS_PREFIX_SIZE + ret >= len)
+    {
+        g_free(buf);
+        return NULL;
+    }
+
+    uint32_t plain_len = len;
+    memcpy(buf, &plain_len, sizeof(plain_len));
+
+    *compressed_len = LS_TRANSPORT_COMPRESS_PREFIX_SIZE + ret;
+    buf[*compressed_len] = '\0';
+
+    return buf;
+}
+
+/**
+ *******************************************************************************
+ * @brief Decompress a payload compressed with @ref _LSTransportCompress.
+ *
+ * @param  compressed       IN  compressed payload
+ * @param  compressed_len   IN  length of @ref compressed
+ *
+ * @retval plain payload followed by a NUL, free with g_free()
+ * @retval NULL if the compressed payload is corrupt
+ *******************************************************************************
+ */
+char*
+_LSTransportDecompress(const char *compressed, unsigned long compressed_len)
+{
+    unsigned long plain_len = _LSTransportCompressGetPlainSize(compressed, compressed_len);
+
+    if (plain_len == 0 || plain_len > MAX_MESSAGE_SIZE_BYTES)
+    {
+        return NULL;
+    }
+
+    char *plain = g_malloc(plain_len + 1);
+
+    int ret = LZ4_decompress_safe(compressed + LS_TRANSPORT_COMPRESS_PREFIX_SIZE, plain,
+                                  compressed_len - LS_TRANSPORT_COMPRESS_PREFIX_SIZE, plain_len);
+
+    if (ret < 0 || (unsigned long)ret != plain_len)
+    {
+        g_free(plain);
+        return NULL;
+    }
+
+    plain[plain_len] = '\0';
+
+    return plain;
+}
+
+/** @} LunaServiceTransportCompress */
@@ -0,0 +1,106 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_COMPRESS_H_
+#define _TRANSPORT_COMPRESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+
+/**
+ * @addtogroup LunaServiceTransportCompress
+ *
+ * @{
+ */
+
+/**
+ * Features a client announces to the hub when requesting its name, and to
+ * the peers it connects to in its "ClientInfo" message.
+ */
+#define LS_TRANSPORT_FEATURE_COMPRESS_LZ4   (1 << 0)    /**< can take LZ4 compressed payloads */
+
+/**
+ * A compressed payload starts with the size of the plain payload, so that
+ * the receiver knows how much to allocate for it.
+ */
+#define LS_TRANSPORT_COMPRESS_PREFIX_SIZE   sizeof(uint32_t)
+
+/**
+ *******************************************************************************
+ * @brief Get the size of a payload before it was compressed.
+ *
+ * @param  compressed       IN  compressed payload
+ * @param  compressed_len   IN  length of @ref compressed
+ *
+ * @retval size of the plain payload
+ * @retval 0 if @ref compressed is too short to be a compressed payload
+ *******************************************************************************
+ */
+static inline unsigned long
+_LSTransportCompressGetPlainSize(const char *compressed, unsigned long compressed_len)
+{
+    uint32_t plain_len = 0;
+
+    if (compressed_len < LS_TRANSPORT_COMPRESS_PREFIX_SIZE)
+    {
+        return 0;
+    }
+
+    /* the prefix isn't necessarily aligned */
+    memcpy(&plain_len, compressed, sizeof(plain_len));
+
+    return plain_len;
+}
+
+#ifdef HAS_LZ4
+
+int _LSTransportCompressGetFeatures(void);
+char* _LSTransportCompress(const char *payload, unsigned long len, unsigned long *compressed_len);
+char* _LSTransportDecompress(const char *compressed, unsigned long compressed_len);
+
+#else
+
+/* Built without LZ4: we never announce the feature, so nobody sends us
+ * compressed payloads and we never compress our own */
+
+static inline int
+_LSTransportCompressGetFeatures(void)
+{
+    return 0;
+}
+
+static inline char*
+_LSTransportCompress(const char *payload, unsigned long len, unsigned long *compressed_len)
+{
+    return NULL;
+}
+
+static inline char*
+_LSTransportDecompress(const char *compressed, unsigned long compressed_len)
+{
+    return NULL;
+}
+
+#endif
+
+/** @} LunaServiceTransportCompress */
+
+#endif      // _TRANSPORT_COMPRESS_H_
@@ -0,0 +1,652 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "error.h"
+#include "transport_utils.h"
+#include "transport_epoll.h"
+
+/**
+ * @defgroup LunaServiceTransportEpoll
+ * @ingroup LunaServiceTransport
+ * @brief epoll based event engine for transport channels
+ */
+
+/**
+ * @addtogroup LunaServiceTransportEpoll
+ * @{
+ */
+
+/**
+ * A callback waiting for conditions on a channel.
+ */
+typedef struct LSTransportEpollWatch {
+    GIOCondition condition;     /**< conditions the callback is called for */
+    GIOFunc func;               /**< NULL if the watch isn't set */
+    void *user_data;
+    GDestroyNotify destroy;     /**< called for @ref user_data when the watch goes away */
+    unsigned int serial;        /**< bumped every time the watch is set */
+} _LSTransportEpollWatch;
+
+/**
+ * Registration of a channel's fd with the engine. It lives apart from the
+ * channel, since events that are already fetched may still refer to it after
+ * a callback has freed the channel.
+ */
+typedef struct LSTransportEpollEntry {
+    _LSTransportEpoll *epoll;   /**< engine (holds a ref to its source) */
+    int fd;                     /**< -1 once the fd isn't watched anymore */
+    GIOChannel *io;             /**< passed to the callbacks */
+    int ref;                    /**< the channel's ref plus one per pending event */
+    bool registered;            /**< fd is in the epoll set */
+    uint32_t events;            /**< events the fd is registered for */
+    _LSTransportEpollWatch in;  /**< receive or accept watch */
+    _LSTransportEpollWatch out; /**< send watch */
+} _LSTransportEpollEntry;
+
+/**
+ * Destroy notification that has to wait until the callbacks are done.
+ */
+typedef struct LSTransportEpollDeferred {
+    GDestroyNotify destroy;
+    void *user_data;
+} _LSTransportEpollDeferred;
+
+struct LSTransportEpoll {
+    GSource source;
+    GPollFD poll_fd;            /**< the epoll fd */
+    pthread_mutex_t lock;       /**< protects the entries and the fields below */
+    bool dispatching;           /**< callbacks are running */
+    GArray *deferred;           /**< @ref _LSTransportEpollDeferred to run after dispatching */
+};
+
+static gboolean _LSTransportEpollPrepare(GSource *source, gint *timeout_ms);
+static gboolean _LSTransportEpollCheck(GSource *source);
+static gboolean _LSTransportEpollDispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+static void _LSTransportEpollFinalize(GSource *source);
+
+static GSourceFuncs _LSTransportEpollFuncs = {
+    .prepare  = _LSTransportEpollPrepare,
+    .check    = _LSTransportEpollCheck,
+    .dispatch = _LSTransportEpollDispatch,
+    .finalize = _LSTransportEpollFinalize,
+};
+
+static GIOCondition
+_LSTransportEpollToCondition(uint32_t events)
+{
+    GIOCondition condition = 0;
+
+    if (events & EPOLLIN) condition |= G_IO_IN;
+    if (events & EPOLLPRI) condition |= G_IO_PRI;
+    if (events & EPOLLOUT) condition |= G_IO_OUT;
+    if (events & EPOLLERR) condition |= G_IO_ERR;
+    if (events & EPOLLHUP) condition |= G_IO_HUP;
+
+    return condition;
+}
+
+/**
+ *******************************************************************************
+ * @brief Bring the epoll registration of an entry in line with its watches.
+ *
+ * Registrations are level-triggered: the callbacks bound the work they do per
+ * wakeup and rely on being called again while there is more to do.
+ *
+ * @attention epoll lock must be held
+ *
+ * @param  entry    IN  entry
+ *
+ * @retval  true on success
+ * @retval  false if epoll_ctl() failed
+ *******************************************************************************
+ */
+static bool
+_LSTransportEpollUpdate(_LSTransportEpollEntry *entry)
+{
+    uint32_t events = 0;
+
+    if (entry->in.func) events |= EPOLLIN;
+    if (entry->out.func) events |= EPOLLOUT;
+
+    if (entry->fd == -1 || (entry->registered && events == entry->events))
+    {
+        return true;
+    }
+
+    int ret;
+    int epoll_fd = entry->epoll->poll_fd.fd;
+
+    if (events == 0)
+    {
+        /* a registration without events would still report hangups */
+        ret = entry->registered ? epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL) : 0;
+    }
+    else
+    {
+        struct epoll_event event = { .events = events, .data.ptr = entry };
+        ret = epoll_ctl(epoll_fd, entry->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, entry->fd, &event);
+    }
+
+    if (ret == -1)
+    {
+        LOG_LS_ERROR(MSGID_LS_EPOLL_ERR, 2,
+                     PMLOGKFV("FD", "%d", entry->fd),
+                     PMLOGKFV("ERROR_CODE", "%d", errno),
+                     "%s: epoll_ctl failed: %s", __func__, g_strerror(errno));
+        return false;
+    }
+
+    entry->registered = (events != 0);
+    entry->events = events;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Unset a watch.
+ *
+ * @attention epoll lock must be held
+ *
+ * @param  entry    IN  entry
+ * @param  watch    IN  watch of @ref entry to unset
+ * @param  deferred OUT destroy notification to run once the lock is dropped
+ *******************************************************************************
+ */
+static void
+_LSTransportEpollClearWatch(_LSTransportEpollEntry *entry, _LSTransportEpollWatch *watch,
+                            _LSTransportEpollDeferred *deferred)
+{
+    deferred->destroy = watch->destroy;
+    deferred->user_data = watch->user_data;
+
+    watch->condition = 0;
+    watch->func = NULL;
+    watch->user_data = NULL;
+    watch->destroy = NULL;
+
+    (void)_LSTransportEpollUpdate(entry);
+}
+
+/**
+ *******************************************************************************
+ * @brief Run a destroy notification, or hold on to it while callbacks are
+ * running, since they may still use the data.
+ *
+ * @attention epoll lock must be held
+ *
+ * @param  epoll        IN  engine
+ * @param  deferred     IN/OUT  notification; cleared if it was queued
+ *******************************************************************************
+ */
+static void
+_LSTransportEpollDefer(_LSTransportEpoll *epoll, _LSTransportEpollDeferred *deferred)
+{
+    if (deferred->destroy && epoll->dispatching)
+    {
+        g_array_append_val(epoll->deferred, *deferred);
+        deferred->destroy = NULL;
+    }
+}
+
+static void
+_LSTransportEpollEntryFree(_LSTransportEpollEntry *entry)
+{
+    g_io_channel_unref(entry->io);
+    g_source_unref(&entry->epoll->source);
+    g_slice_free(_LSTransportEpollEntry, entry);
+}
+
+/**
+ *******************************************************************************
+ * @brief Call a watch's callback if the events are for it, and unset the
+ * watch if the callback returns false.
+ *
+ * @param  epoll        IN  engine
+ * @param  entry        IN  entry the events came for
+ * @param  watch        IN  watch of @ref entry
+ * @param  condition    IN  conditions on the fd
+ *******************************************************************************
+ */
+static void
+_LSTransportEpollCall(_LSTransportEpoll *epoll, _LSTransportEpollEntry *entry,
+                      _LSTransportEpollWatch *watch, GIOCondition condition)
+{
+    EPOLL_LOCK(&epoll->lock);
+
+    condition &= watch->condition;
+    if (!watch->func || !condition)
+    {
+        EPOLL_UNLOCK(&epoll->lock);
+        return;
+    }
+
+    GIOFunc func = watch->func;
+    void *user_data = watch->user_data;
+    unsigned int serial = watch->serial;
+
+    EPOLL_UNLOCK(&epoll->lock);
+
+    if (!func(entry->io, condition, user_data))
+    {
+        EPOLL_LOCK(&epoll->lock);
+
+        /* unless the callback has already replaced the watch */
+        if (watch->func && watch->serial == serial)
+        {
+            _LSTransportEpollDeferred deferred;
+            _LSTransportEpollClearWatch(entry, watch, &deferred);
+            _LSTransportEpollDefer(epoll, &deferred);
+        }
+
+        EPOLL_UNLOCK(&epoll->lock);
+    }
+}
+
+static gboolean
+_LSTransportEpollPrepare(GSource *source, gint *timeout_ms)
+{
+    *timeout_ms = -1;
+    return FALSE;
+}
+
+static gboolean
+_LSTransportEpollCheck(GSource *source)
+{
+    _LSTransportEpoll *epoll = (_LSTransportEpoll*)source;
+
+    return (epoll->poll_fd.revents & G_IO_IN) != 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Fetch up to @ref LS_TRANSPORT_EPOLL_MAX_EVENTS ready fds and run
+ * their callbacks. Anything left over keeps the epoll fd readable, so it's
+ * handled in the next main loop iteration.
+ *******************************************************************************
+ */
+static gboolean
+_LSTransportEpollDispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    _LSTransportEpoll *epoll = (_LSTransportEpoll*)source;
+    struct epoll_event events[LS_TRANSPORT_EPOLL_MAX_EVENTS];
+    int i;
+
+    int count = epoll_wait(epoll->poll_fd.fd, events, LS_TRANSPORT_EPOLL_MAX_EVENTS, 0);
+
+    if (count <= 0)
+    {
+        if (count == -1 && errno != EINTR)
+        {
+            LOG_LS_ERROR(MSGID_LS_EPOLL_ERR, 1,
+                         PMLOGKFV("ERROR_CODE", "%d", errno),
+                         "%s: epoll_wait failed: %s", __func__, g_strerror(errno));
+        }
+        return TRUE;
+    }
+
+    EPOLL_LOCK(&epoll->lock);
+    epoll->dispatching = true;
+    for (i = 0; i < count; i++)
+    {
+        /* a callback may release the entries of later events */
+        ((_LSTransportEpollEntry*)events[i].data.ptr)->ref++;
+    }
+    EPOLL_UNLOCK(&epoll->lock);
+
+    for (i = 0; i < count; i++)
+    {
+        _LSTransportEpollEntry *entry = events[i].data.ptr;
+        GIOCondition condition = _LSTransportEpollToCondition(events[i].events);
+
+        _LSTransportEpollCall(epoll, entry, &entry->in, condition);
+        _LSTransportEpollCall(epoll, entry, &entry->out, condition);
+    }
+
+    GSList *unused = NULL;
+
+    EPOLL_LOCK(&epoll->lock);
+    epoll->dispatching = false;
+    for (i = 0; i < count; i++)
+    {
+        _LSTransportEpollEntry *entry = events[i].data.ptr;
+
+        /* several events for the same entry are counted once per event */
+        if (--entry->ref == 0)
+        {
+            unused = g_slist_prepend(unused, entry);
+        }
+    }
+    GArray *deferred = epoll->deferred;
+    epoll->deferred = g_array_new(FALSE, FALSE, sizeof(_LSTransportEpollDeferred));
+    EPOLL_UNLOCK(&epoll->lock);
+
+    for (i = 0; i < deferred->len; i++)
+    {
+        _LSTransportEpollDeferred *item = &g_array_index(deferred, _LSTransportEpollDeferred, i);
+        item->destroy(item->user_data);
+    }
+    g_array_free(deferred, TRUE);
+
+    g_slist_free_full(unused, (GDestroyNotify)_LSTransportEpollEntryFree);
+
+    return TRUE;
+}
+
+static void
+_LSTransportEpollFinalize(GSource *source)
+{
+    _LSTransportEpoll *epoll = (_LSTransportEpoll*)source;
+
+    LS_ASSERT(epoll->deferred->len == 0);
+
+    close(epoll->poll_fd.fd);
+    g_array_free(epoll->deferred, TRUE);
+    pthread_mutex_destroy(&epoll->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Create an engine and attach its source to a main context.
+ *
+ * @param  context      IN  main loop context
+ * @param  priority     IN  priority of the source
+ * @param  lserror      OUT set on error
+ *
+ * @retval  engine on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportEpoll*
+_LSTransportEpollNew(GMainContext *context, int priority, LSError *lserror)
+{
+    LS_ASSERT(context != NULL);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_EPOLL_ERR, errno);
+        return NULL;
+    }
+
+    GSource *source = g_source_new(&_LSTransportEpollFuncs, sizeof(_LSTransportEpoll));
+    _LSTransportEpoll *epoll = (_LSTransportEpoll*)source;
+
+    pthread_mutex_init(&epoll->lock, NULL);
+    epoll->dispatching = false;
+    epoll->deferred = g_array_new(FALSE, FALSE, sizeof(_LSTransportEpollDeferred));
+
+    epoll->poll_fd.fd = epoll_fd;
+    epoll->poll_fd.events = G_IO_IN;
+    g_source_add_poll(source, &epoll->poll_fd);
+
+    if (priority != G_PRIORITY_DEFAULT)
+    {
+        g_source_set_priority(source, priority);
+    }
+
+    g_source_attach(source, context);
+
+    return epoll;
+}
+
+/**
+ *******************************************************************************
+ * @brief Detach an engine from its main context and drop the caller's ref.
+ *
+ * Channels that are still registered keep the engine alive until they're
+ * released, but their callbacks aren't called anymore.
+ *
+ * @param  epoll    IN  engine
+ *******************************************************************************
+ */
+void
+_LSTransportEpollFree(_LSTransportEpoll *epoll)
+{
+    LS_ASSERT(epoll != NULL);
+
+    g_source_destroy(&epoll->source);
+    g_source_unref(&epoll->source);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the engine's GSource (not ref counted).
+ *
+ * @param  epoll    IN  engine
+ *
+ * @retval  source
+ *******************************************************************************
+ */
+GSource*
+_LSTransportEpollGetSource(_LSTransportEpoll *epoll)
+{
+    return &epoll->source;
+}
+
+/**
+ *******************************************************************************
+ * @brief Start watching a channel.
+ *
+ * A channel has at most one watch that includes G_IO_OUT (send) and one that
+ * doesn't (receive or accept).
+ *
+ * @param  epoll        IN  engine
+ * @param  channel      IN  channel
+ * @param  condition    IN  conditions to call @ref func for
+ * @param  func         IN  callback; returning false unsets the watch
+ * @param  user_data    IN  passed to @ref func
+ * @param  destroy      IN  called for @ref user_data when the watch is unset
+ *
+ * @retval  true on success
+ * @retval  false if the fd can't be watched; @ref destroy isn't called then
+ *******************************************************************************
+ */
+bool
+_LSTransportEpollAddWatch(_LSTransportEpoll *epoll, _LSTransportChannel *channel, GIOCondition condition,
+                          GIOFunc func, void *user_data, GDestroyNotify destroy)
+{
+    LS_ASSERT(epoll != NULL);
+    LS_ASSERT(channel != NULL);
+    LS_ASSERT(func != NULL);
+
+    EPOLL_LOCK(&epoll->lock);
+
+    _LSTransportEpollEntry *entry = channel->epoll_entry;
+
+    if (!entry)
+    {
+        entry = g_slice_new0(_LSTransportEpollEntry);
+        entry->epoll = epoll;
+        g_source_ref(&epoll->source);
+        entry->fd = channel->fd;
+        entry->io = g_io_channel_ref(channel->channel);
+        entry->ref = 1;
+        channel->epoll_entry = entry;
+    }
+
+    LS_ASSERT(entry->epoll == epoll);
+
+    _LSTransportEpollWatch *watch = (condition & G_IO_OUT) ? &entry->out : &entry->in;
+
+    LS_ASSERT(watch->func == NULL);
+
+    if (entry->fd == -1)
+    {
+        EPOLL_UNLOCK(&epoll->lock);
+        return false;
+    }
+
+    watch->condition = condition;
+    watch->func = func;
+    watch->user_data = user_data;
+    watch->destroy = destroy;
+    watch->serial++;
+
+    if (!_LSTransportEpollUpdate(entry))
+    {
+        /* the caller still owns user_data */
+        watch->condition = 0;
+        watch->func = NULL;
+        watch->user_data = NULL;
+        watch->destroy = NULL;
+
+        EPOLL_UNLOCK(&epoll->lock);
+        return false;
+    }
+
+    EPOLL_UNLOCK(&epoll->lock);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Stop watching a channel for the given conditions. Does nothing if
+ * the watch isn't set (e.g., its callback returned false).
+ *
+ * @param  channel      IN  channel
+ * @param  condition    IN  conditions the watch was added with
+ *******************************************************************************
+ */
+void
+_LSTransportEpollRemoveWatch(_LSTransportChannel *channel, GIOCondition condition)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportEpollEntry *entry = channel->epoll_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportEpoll *epoll = entry->epoll;
+    _LSTransportEpollWatch *watch = (condition & G_IO_OUT) ? &entry->out : &entry->in;
+    _LSTransportEpollDeferred deferred = { NULL, NULL };
+
+    EPOLL_LOCK(&epoll->lock);
+    if (watch->func)
+    {
+        _LSTransportEpollClearWatch(entry, watch, &deferred);
+        _LSTransportEpollDefer(epoll, &deferred);
+    }
+    EPOLL_UNLOCK(&epoll->lock);
+
+    if (deferred.destroy)
+    {
+        deferred.destroy(deferred.user_data);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether a channel's watch is served by the engine.
+ *
+ * @param  channel      IN  channel
+ * @param  watch        IN  watch source stored in the channel
+ *
+ * @retval  true if @ref watch is the source of the channel's engine
+ *******************************************************************************
+ */
+bool
+_LSTransportEpollOwnsWatch(const _LSTransportChannel *channel, const GSource *watch)
+{
+    LS_ASSERT(channel != NULL);
+
+    return channel->epoll_entry && watch == &channel->epoll_entry->epoll->source;
+}
+
+/**
+ *******************************************************************************
+ * @brief Take a channel's fd out of the epoll set before it's closed, so
+ * that a new fd with the same number can't be confused with it.
+ *
+ * The watches stay set until they're removed.
+ *
+ * @param  channel      IN  channel
+ *******************************************************************************
+ */
+void
+_LSTransportEpollDetach(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportEpollEntry *entry = channel->epoll_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportEpoll *epoll = entry->epoll;
+
+    EPOLL_LOCK(&epoll->lock);
+    if (entry->registered)
+    {
+        (void)epoll_ctl(epoll->poll_fd.fd, EPOLL_CTL_DEL, entry->fd, NULL);
+        entry->registered = false;
+    }
+    entry->fd = -1;
+    EPOLL_UNLOCK(&epoll->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Drop a channel's registration. Its watches must have been removed.
+ *
+ * @param  channel      IN  channel
+ *******************************************************************************
+ */
+void
+_LSTransportEpollRelease(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportEpollEntry *entry = channel->epoll_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportEpollDetach(channel);
+
+    _LSTransportEpoll *epoll = entry->epoll;
+    bool unused;
+
+    EPOLL_LOCK(&epoll->lock);
+    LS_ASSERT(entry->in.func == NULL && entry->out.func == NULL);
+    unused = (--entry->ref == 0);
+    EPOLL_UNLOCK(&epoll->lock);
+
+    channel->epoll_entry = NULL;
+
+    if (unused)
+    {
+        _LSTransportEpollEntryFree(entry);
+    }
+}
+
+/* @} END OF LunaServiceTransportEpoll */
@@ -0,0 +1,59 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_EPOLL_H_
+#define _TRANSPORT_EPOLL_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_channel.h"
+
+/**
+ * @addtogroup LunaServiceTransportEpoll
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_EPOLL_MAX_EVENTS   64  /**< events handled per dispatch of the engine */
+
+/**
+ * Event engine that watches the channels of a transport with a single epoll
+ * fd, which is polled by one GSource, instead of attaching GIOChannel
+ * watches for every channel. Starting and stopping a watch is an epoll_ctl()
+ * call, so the main context's poll array doesn't change when queues fill up
+ * and drain.
+ */
+typedef struct LSTransportEpoll _LSTransportEpoll;
+
+_LSTransportEpoll* _LSTransportEpollNew(GMainContext *context, int priority, LSError *lserror);
+void _LSTransportEpollFree(_LSTransportEpoll *epoll);
+GSource* _LSTransportEpollGetSource(_LSTransportEpoll *epoll);
+
+bool _LSTransportEpollAddWatch(_LSTransportEpoll *epoll, _LSTransportChannel *channel, GIOCondition condition,
+                               GIOFunc func, void *user_data, GDestroyNotify destroy);
+void _LSTransportEpollRemoveWatch(_LSTransportChannel *channel, GIOCondition condition);
+bool _LSTransportEpollOwnsWatch(const _LSTransportChannel *channel, const GSource *watch);
+void _LSTransportEpollDetach(_LSTransportChannel *channel);
+void _LSTransportEpollRelease(_LSTransportChannel *channel);
+
+/** @} LunaServiceTransportEpoll */
+
+#endif      // _TRANSPORT_EPOLL_H_
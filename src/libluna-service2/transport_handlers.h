@@ -53,6 +53,9 @@ typedef enum {
 
 typedef void (*LSTransportMessageFailure)(LSMessageToken global_token, _LSTransportMessageFailureType failure_type, void *context);
 
+/* client -- client whose outgoing queue crossed a watermark */
+typedef void (*LSTransportOutgoingWatermarkHandler)(_LSTransportClient *client, bool above_high_watermark, void *context);
+
 typedef struct LSTransportHandlers {
     LSTransportMessageFailure    message_failure_handler;   /**< callback to handle when a message fails to be delivered to the other side */
     void *message_failure_context;
@@ -62,6 +65,9 @@ typedef struct LSTransportHandlers {
 
     LSTransportMessageHandler msg_handler;                  /**< callback to handle incoming messages */
     void *msg_context;
+
+    LSTransportOutgoingWatermarkHandler outgoing_watermark_handler; /**< callback to handle when an outgoing queue crosses a watermark (optional) */
+    void *outgoing_watermark_context;
 } LSTransportHandlers;
 
 #endif      // _TRANSPORT_HANDLERS_H_
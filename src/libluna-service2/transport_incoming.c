@@ -18,6 +18,7 @@
 
 
 #include <string.h>
+#include <unistd.h>
 
 #include "error.h"
 #include "transport_incoming.h"
@@ -52,6 +53,7 @@ _LSTransportIncoming* _LSTransportIncomingNew(void)
         goto error;
     }
     incoming->complete_messages = g_queue_new();
+    incoming->rx_fd = -1;
 
     return incoming;
 
@@ -76,6 +78,19 @@ void _LSTransportIncomingFree(_LSTransportIncoming *incoming)
     LS_ASSERT(g_queue_is_empty(incoming->complete_messages));
     g_queue_free(incoming->complete_messages);
 
+    /* an fd that arrived without the message it belongs to */
+    if (incoming->rx_fd != -1)
+    {
+        close(incoming->rx_fd);
+    }
+    g_free(incoming->rx_buf);
+
+    /* payload of a message that never arrived */
+    if (incoming->payload_fd_msg)
+    {
+        _LSTransportMessageUnref(incoming->payload_fd_msg);
+    }
+
 #ifdef MEMCHECK
     memset(incoming, 0xFF, sizeof(_LSTransportIncoming));
 #endif
@@ -25,13 +25,32 @@
 #include <luna-service2/lunaservice.h>
 #include "transport_message.h"
 
+/** Size of the per-client receive buffer. Messages that don't fit are read
+ * directly into their own allocation */
+#define LS_TRANSPORT_INCOMING_BUF_SIZE  (16 * 1024)
+
+#define LS_TRANSPORT_INCOMING_BUDGET_BYTES      (256 * 1024)    /**< default bytes read from a client per wakeup */
+#define LS_TRANSPORT_INCOMING_BUDGET_MESSAGES   64              /**< default messages queued from a client per wakeup */
+
+/**
+ * How much is read from a single client before yielding back to the main
+ * loop. Zero disables that limit.
+ */
+typedef struct LSTransportIncomingBudget {
+    unsigned long bytes;        /**< bytes read per wakeup */
+    unsigned int messages;      /**< complete messages queued per wakeup */
+} _LSTransportIncomingBudget;
+
 struct LSTransportIncoming {
     pthread_mutex_t lock;
     LSMessageToken last_serial_processed;   /**< last reply processed -- see LSTransportSerial */
-    _LSTransportHeader tmp_header;          /**< temp location when reading in the header */
-    unsigned long tmp_header_offset;        /**< end of valid data in temp header */
+    char *rx_buf;                           /**< receive buffer; allocated on first read */
+    unsigned long rx_start;                 /**< start of unparsed data in rx_buf */
+    unsigned long rx_end;                   /**< end of valid data in rx_buf */
+    int rx_fd;                              /**< fd received along with rx_buf data; -1 if none */
     _LSTransportMessage *tmp_msg;           /**< temp location when building up a message */
     unsigned long tmp_msg_offset;           /**< end of data in temp message */
+    _LSTransportMessage *payload_fd_msg;    /**< payload fd for the next message; NULL if none */
     GQueue *complete_messages;              /**< completed messages; ready for processing */
 };
 
@@ -0,0 +1,336 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "transport.h"
+#include "transport_priv.h"
+#include "transport_utils.h"
+#include "transport_loopback.h"
+
+/**
+ * @defgroup LunaServiceTransportLoopback
+ * @ingroup LunaServiceTransport
+ * @brief Direct links between transports in the same process
+ */
+
+/**
+ * @addtogroup LunaServiceTransportLoopback
+ * @{
+ */
+
+static pthread_mutex_t loopback_lock = PTHREAD_MUTEX_INITIALIZER;  /**< guards everything below and the peers of the links */
+static GHashTable *local_names = NULL;  /**< unique names of the transports in this process */
+static GHashTable *offers = NULL;       /**< offer id -> initiator's client (ref) */
+
+/**
+ *******************************************************************************
+ * @brief Remember that a unique name belongs to a transport in this process.
+ *
+ * @param  unique_name  IN  unique name the hub gave the transport
+ *******************************************************************************
+ */
+void
+_LSTransportLoopbackAddName(const char *unique_name)
+{
+    LS_ASSERT(unique_name != NULL);
+
+    LOOPBACK_LOCK(&loopback_lock);
+
+    if (!local_names)
+    {
+        local_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    g_hash_table_add(local_names, g_strdup(unique_name));
+
+    LOOPBACK_UNLOCK(&loopback_lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Forget a unique name added with @ref _LSTransportLoopbackAddName.
+ *
+ * @param  unique_name  IN  unique name
+ *******************************************************************************
+ */
+void
+_LSTransportLoopbackRemoveName(const char *unique_name)
+{
+    LS_ASSERT(unique_name != NULL);
+
+    LOOPBACK_LOCK(&loopback_lock);
+
+    if (local_names)
+    {
+        g_hash_table_remove(local_names, unique_name);
+    }
+
+    LOOPBACK_UNLOCK(&loopback_lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether a unique name belongs to a transport in this process.
+ *
+ * @param  unique_name  IN  unique name
+ *
+ * @retval  true if it does
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+bool
+_LSTransportLoopbackHasName(const char *unique_name)
+{
+    bool ret;
+
+    LOOPBACK_LOCK(&loopback_lock);
+    ret = local_names && g_hash_table_contains(local_names, unique_name);
+    LOOPBACK_UNLOCK(&loopback_lock);
+
+    return ret;
+}
+
+/* Offer ids can't be guessed, so only whoever the offer was sent to can take
+ * it. The sockets can't tell us who's on the other end, since the hub both
+ * listens for the services and connects on behalf of the callers. */
+static bool
+_LSTransportLoopbackRandomId(uint64_t *id)
+{
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) return false;
+
+    bool ret = read(fd, id, sizeof(*id)) == sizeof(*id);
+    close(fd);
+
+    return ret;
+}
+
+static _LSTransportLoopback*
+_LSTransportLoopbackNew(void)
+{
+    _LSTransportLoopback *loopback = g_slice_new0(_LSTransportLoopback);
+    loopback->held = g_queue_new();
+    return loopback;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create the link state for a client we connected to and put it in the
+ * offer table, so that the far side can find the client by the id in a
+ * @ref _LSTransportMessageTypeLoopbackOffer message.
+ *
+ * @param  client   IN  initiator's client
+ *
+ * @retval  link state to attach to the client
+ * @retval  NULL if no offer id could be made
+ *******************************************************************************
+ */
+_LSTransportLoopback*
+_LSTransportLoopbackNewOffer(_LSTransportClient *client)
+{
+    _LSTransportLoopback *loopback = _LSTransportLoopbackNew();
+    bool added = false;
+
+    while (!added)
+    {
+        if (!_LSTransportLoopbackRandomId(&loopback->id))
+        {
+            loopback->id = 0;
+            _LSTransportLoopbackFree(loopback);
+            return NULL;
+        }
+
+        LOOPBACK_LOCK(&loopback_lock);
+
+        if (!offers)
+        {
+            offers = g_hash_table_new(g_int64_hash, g_int64_equal);
+        }
+
+        if (loopback->id && !g_hash_table_contains(offers, &loopback->id))
+        {
+            /* the offer table holds a ref until the offer is taken or withdrawn */
+            _LSTransportClientRef(client);
+            g_hash_table_insert(offers, &loopback->id, client);
+            added = true;
+        }
+
+        LOOPBACK_UNLOCK(&loopback_lock);
+    }
+
+    return loopback;
+}
+
+/**
+ *******************************************************************************
+ * @brief Take an offer and link the two clients.
+ *
+ * @param  client   IN  far side's client that received the offer
+ * @param  id       IN  offer id
+ *
+ * @retval  link state to attach to @ref client
+ * @retval  NULL if there is no such offer
+ *******************************************************************************
+ */
+_LSTransportLoopback*
+_LSTransportLoopbackAccept(_LSTransportClient *client, uint64_t id)
+{
+    _LSTransportLoopback *loopback = NULL;
+
+    LOOPBACK_LOCK(&loopback_lock);
+
+    _LSTransportClient *initiator = offers ? g_hash_table_lookup(offers, &id) : NULL;
+
+    if (initiator)
+    {
+        g_hash_table_remove(offers, &id);
+        initiator->loopback->id = 0;
+
+        /* the link takes over the offer table's ref */
+        loopback = _LSTransportLoopbackNew();
+        loopback->peer = initiator;
+
+        _LSTransportClientRef(client);
+        initiator->loopback->peer = client;
+    }
+
+    LOOPBACK_UNLOCK(&loopback_lock);
+
+    return loopback;
+}
+
+/**
+ *******************************************************************************
+ * @brief Break the link of a client in both directions, or withdraw its
+ * offer. Messages sent after this go through the socket.
+ *
+ * @param  client   IN  client
+ *******************************************************************************
+ */
+void
+_LSTransportLoopbackUnpair(_LSTransportClient *client)
+{
+    _LSTransportLoopback *loopback = client->loopback;
+    _LSTransportClient *unref[2] = { NULL, NULL };
+
+    if (!loopback) return;
+
+    LOOPBACK_LOCK(&loopback_lock);
+
+    if (loopback->id)
+    {
+        g_hash_table_remove(offers, &loopback->id);
+        loopback->id = 0;
+        unref[0] = client;
+    }
+
+    _LSTransportClient *peer = loopback->peer;
+
+    if (peer)
+    {
+        loopback->peer = NULL;
+        unref[0] = peer;
+
+        LS_ASSERT(peer->loopback->peer == client);
+        peer->loopback->peer = NULL;
+        unref[1] = client;
+    }
+
+    LOOPBACK_UNLOCK(&loopback_lock);
+
+    /* the last ref may go away here, so not under the lock */
+    if (unref[0]) _LSTransportClientUnref(unref[0]);
+    if (unref[1]) _LSTransportClientUnref(unref[1]);
+}
+
+/**
+ *******************************************************************************
+ * @brief Free the link state of a client.
+ *
+ * @param  loopback     IN  link state of an unpaired client
+ *******************************************************************************
+ */
+void
+_LSTransportLoopbackFree(_LSTransportLoopback *loopback)
+{
+    LS_ASSERT(loopback != NULL);
+    LS_ASSERT(loopback->peer == NULL);
+    LS_ASSERT(loopback->id == 0);
+
+    g_queue_free_full(loopback->held, (GDestroyNotify)_LSTransportMessageUnref);
+    g_slice_free(_LSTransportLoopback, loopback);
+}
+
+/**
+ *******************************************************************************
+ * @brief Hand a message to the far side of a link. The far side gets its own
+ * message that shares the raw bytes, so the message must not change once
+ * it's been sent. Safe to call from any thread.
+ *
+ * @attention the caller holds the client's outgoing lock, which keeps the
+ * messages in order
+ *
+ * @param  client   IN  client with an active link
+ * @param  message  IN  message with its token set
+ *
+ * @retval  true if the message was handed over
+ * @retval  false if the link is gone or the message has to go through the
+ *          socket
+ *******************************************************************************
+ */
+bool
+_LSTransportLoopbackSend(_LSTransportClient *client, _LSTransportMessage *message)
+{
+    /* fds only travel over the socket */
+    if (_LSTransportMessageIsConnectionFdType(message))
+    {
+        return false;
+    }
+
+    _LSTransportMessage *shared = _LSTransportMessageShareNewRef(message);
+    bool ret = false;
+
+    LOOPBACK_LOCK(&loopback_lock);
+
+    _LSTransportClient *peer = client->loopback->peer;
+
+    if (peer)
+    {
+        /* the peer stays linked, and so its transport alive, while we hold
+         * the lock */
+        _LSTransportMessageSetClient(shared, peer);
+        _LSTransportSubmitPush(peer->transport->loopback, peer, shared);
+        ret = true;
+    }
+
+    LOOPBACK_UNLOCK(&loopback_lock);
+
+    if (!ret)
+    {
+        _LSTransportMessageUnref(shared);
+    }
+
+    return ret;
+}
+
+/* @} END OF LunaServiceTransportLoopback */
@@ -0,0 +1,81 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_LOOPBACK_H_
+#define _TRANSPORT_LOOPBACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_message.h"
+
+/**
+ * @addtogroup LunaServiceTransportLoopback
+ *
+ * @{
+ */
+
+/**
+ * Body of a @ref _LSTransportMessageTypeLoopbackOffer message.
+ */
+struct LSTransportLoopbackOffer {
+    uint64_t id;        /**< key of the initiator's client in the offer table */
+};
+
+typedef struct LSTransportLoopbackOffer _LSTransportLoopbackOffer;
+
+/**
+ * Direct link between two clients whose transports live in the same process.
+ *
+ * The connection starts out on the socket that the hub hands over, so that
+ * the hub still decides who may talk to whom. The initiator then offers the
+ * link over the socket with a random id, and the far side takes it if it
+ * finds the id in this process's offer table. Like with the shared memory
+ * rings, each side switches over with a @ref _LSTransportMessageTypeLoopbackReady
+ * message, after which the socket only carries the final shutdown message.
+ *
+ * Messages are handed to the far side's transport as they are, sharing the
+ * raw bytes, and its main loop processes them as if they came from the socket.
+ */
+struct LSTransportLoopback {
+    uint64_t id;                    /**< random key in the offer table until the far side takes the offer; 0 otherwise */
+    _LSTransportClient *peer;       /**< far side's client for this connection (ref); guarded by the loopback lock */
+    bool tx_active;                 /**< messages are handed to @ref peer; set with the outgoing lock held */
+    bool rx_active;                 /**< messages from @ref peer are processed */
+    GQueue *held;                   /**< messages from @ref peer that arrived ahead of its ready message */
+};
+
+typedef struct LSTransportLoopback _LSTransportLoopback;
+
+void _LSTransportLoopbackAddName(const char *unique_name);
+void _LSTransportLoopbackRemoveName(const char *unique_name);
+bool _LSTransportLoopbackHasName(const char *unique_name);
+
+_LSTransportLoopback* _LSTransportLoopbackNewOffer(_LSTransportClient *client);
+_LSTransportLoopback* _LSTransportLoopbackAccept(_LSTransportClient *client, uint64_t id);
+void _LSTransportLoopbackUnpair(_LSTransportClient *client);
+void _LSTransportLoopbackFree(_LSTransportLoopback *loopback);
+
+bool _LSTransportLoopbackSend(_LSTransportClient *client, _LSTransportMessage *message);
+
+/** @} LunaServiceTransportLoopback */
+
+#endif      // _TRANSPORT_LOOPBACK_H_
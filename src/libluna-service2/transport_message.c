@@ -19,9 +19,31 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include "error.h"
 #include "transport.h"
+#include "transport_compress.h"
 #include "transport_message.h"
+#include "transport_message_pool.h"
+
+/* memfd and file sealing; older libc headers don't have these */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS         (1024 + 9)
+#define F_GET_SEALS         (1024 + 10)
+#define F_SEAL_SEAL         0x0001
+#define F_SEAL_SHRINK       0x0002
+#define F_SEAL_GROW         0x0004
+#define F_SEAL_WRITE        0x0008
+#endif
 
 /**
  * Returns true if it is safe to dereference the specificed type with the
@@ -34,6 +56,8 @@ void _LSTransportClientUnref(_LSTransportClient *client);
 const char* _LSTransportClientGetUniqueName(const _LSTransportClient *client);
 const char* _LSTransportClientGetServiceName(const _LSTransportClient *client);
 
+static const _LSTransportMessageFields* _LSTransportMessageGetFields(const _LSTransportMessage *message, _LSTransportMessageFields *scratch);
+
 /**
  * @defgroup LunaServiceTransportMessage
  * @ingroup LunaServiceTransport
@@ -69,7 +93,7 @@ static _LSTransportMessage EMPTY_MESSAGE =
     .ref = 42,
     .client = &EMPTY_CLIENT,
     .connection_fd = -1,
-    .app_id = EMPTY_RAW_MESSAGE.data,
+    .fields = { .parsed = true, .category = -1, .method = -1, .payload = -1, .app_id = -1, .trailer = -1 },
     .raw = &EMPTY_RAW_MESSAGE,
     .connect_state = _LSTransportConnectStateOtherFailure,
 };
@@ -100,13 +124,15 @@ _LSTransportMessageEmpty()
 INLINE _LSTransportMessage*
 _LSTransportMessageNew(unsigned long payload_size)
 {
-    _LSTransportMessage *ret = g_slice_new0(_LSTransportMessage);
+    _LSTransportMessage *ret = _LSTransportMessagePoolAllocMessage();
 
-    ret->raw = g_malloc(sizeof(_LSTransportMessageRaw) + payload_size);
+    ret->raw = _LSTransportMessagePoolAllocRaw(payload_size, &ret->raw_pool_class);
 
     ret->raw->header.len = payload_size;
     ret->raw->header.token = LSMESSAGE_TOKEN_INVALID;
     ret->raw->header.type = _LSTransportMessageTypeUnknown;
+    ret->payload_type = LS_PAYLOAD_TYPE_JSON;
+    ret->payload_len = 0;
     ret->alloc_body_size = payload_size;
     ret->tx_bytes_remaining = payload_size + sizeof(_LSTransportHeader);
     ret->connection_fd = -1;
@@ -128,6 +154,7 @@ _LSTransportMessageReset(_LSTransportMessage *message)
 {
     LS_ASSERT(message);
 
+    message->wire_version = 0;
     message->tx_bytes_remaining = message->raw->header.len + sizeof(_LSTransportHeader);
     message->connection_fd = -1;
 }
@@ -175,15 +202,29 @@ _LSTransportMessageFree(_LSTransportMessage *message)
         close(connection_fd);
     }
 
-    message->app_id = NULL;    /* just for sanity; this points inside the raw message */
+    if (message->payload_map)
+    {
+        munmap((void*)message->payload_map, message->payload_map_size);
+        message->payload_map = NULL;
+    }
 
-    g_free(message->raw);
+    g_free(message->payload_plain);
+    message->payload_plain = NULL;
+
+    if (message->raw_owner)
+    {
+        _LSTransportMessageUnref(message->raw_owner);
+    }
+    else
+    {
+        _LSTransportMessagePoolFreeRaw(message->raw, message->raw_pool_class);
+    }
 
 #ifdef MEMCHECK
     memset(message, 0xFF, sizeof(_LSTransportMessage));
 #endif
 
-    g_slice_free(_LSTransportMessage, message);
+    _LSTransportMessagePoolFreeMessage(message);
 }
 
 /**
@@ -207,20 +248,50 @@ _LSTransportMessageCopyNewRef(_LSTransportMessage *message)
     /* NOTE: tx_bytes_remaining is set when we actually put the message
      * on the queue with _LSTransportSendMessage */
 
-    if (message->app_id)
-    {
-        size_t offset = message->app_id - _LSTransportMessageGetBody(message);
-        ret->app_id = _LSTransportMessageGetBody(ret) + offset;
-    }
-    else
-    {
-        ret->app_id = NULL;
-    }
-
     /* NOTE: does not copy timeout source id */
     _LSTransportMessageSetType(ret, _LSTransportMessageGetType(message));
     _LSTransportMessageSetToken(ret, _LSTransportMessageGetToken(message));
     _LSTransportMessageSetBody(ret, _LSTransportMessageGetBody(message), body_size);
+    ret->payload_type = message->payload_type;
+    ret->payload_len = message->payload_len;
+    ret->payload_compressed = message->payload_compressed;
+
+    /* same body, same offsets */
+    ret->fields = message->fields;
+
+    return ret;
+}
+
+/**
+*******************************************************************************
+* @brief Create a new message with ref count of 1 that shares the raw bytes of
+* the passed in message instead of copying them. The new message is set up
+* like a received one, so it has no client, tx_bytes_remaining, or fds.
+*
+* @note neither message may change the raw bytes afterwards
+*
+* @param  message   IN  message to share
+*
+* @retval new message
+*******************************************************************************
+*/
+_LSTransportMessage*
+_LSTransportMessageShareNewRef(_LSTransportMessage *message)
+{
+    LS_ASSERT(message != NULL);
+
+    _LSTransportMessage *ret = _LSTransportMessagePoolAllocMessage();
+
+    ret->ref = 1;
+    ret->raw = message->raw;
+    ret->raw_owner = _LSTransportMessageRef(message->raw_owner ? message->raw_owner : message);
+    ret->alloc_body_size = message->alloc_body_size;
+    ret->payload_type = message->payload_type;
+    ret->payload_len = message->payload_len;
+    ret->payload_compressed = message->payload_compressed;
+    ret->connection_fd = -1;
+    ret->retries = MAX_SEND_RETRIES;
+    ret->connect_state = _LSTransportConnectStateNoError;
 
     return ret;
 }
@@ -250,19 +321,15 @@ _LSTransportMessageCopy(_LSTransportMessage *dest, const _LSTransportMessage *sr
 
     LS_ASSERT(dest_body_size >= src_body_size);
 
-    if (src->app_id)
-    {
-        size_t offset = src->app_id - _LSTransportMessageGetBody(src);
-        dest->app_id = _LSTransportMessageGetBody(dest) + offset;
-    }
-    else
-    {
-        dest->app_id = NULL;
-    }
-
     _LSTransportMessageSetType(dest, _LSTransportMessageGetType(src));
     _LSTransportMessageSetToken(dest, _LSTransportMessageGetToken(src));
     _LSTransportMessageSetBody(dest, _LSTransportMessageGetBody(src), src_body_size);
+    dest->payload_type = src->payload_type;
+    dest->payload_len = src->payload_len;
+    dest->payload_compressed = src->payload_compressed;
+
+    /* same leading bytes, same offsets */
+    dest->fields = src->fields;
 
     return dest;
 }
@@ -334,6 +401,207 @@ _LSTransportMessageFromVectorNewRef(const struct iovec *iov, int iovcnt, unsigne
     return message;
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the size of the header on the wire.
+ *
+ * @param  version  IN  protocol version spoken with the peer
+ *
+ * @retval size in bytes
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportHeaderSize(int version)
+{
+    return version >= 2 ? sizeof(_LSTransportHeaderV2) : sizeof(_LSTransportHeader);
+}
+
+/**
+ *******************************************************************************
+ * @brief Convert a received version 2 header to the header of the raw
+ * message.
+ *
+ * @param  wire     IN  received header
+ * @param  header   OUT raw message header
+ *
+ * @retval true on success
+ * @retval false if the header has flags we don't know or that contradict it
+ *******************************************************************************
+ */
+bool
+_LSTransportHeaderFromV2(const _LSTransportHeaderV2 *wire, _LSTransportHeader *header)
+{
+    bool binary = (wire->flags & LS_TRANSPORT_HEADER_FLAG_BINARY) != 0;
+
+    if ((wire->flags & ~LS_TRANSPORT_HEADER_FLAGS_KNOWN) ||
+        binary != (wire->payload_type != LS_PAYLOAD_TYPE_JSON))
+    {
+        return false;
+    }
+
+    header->len = wire->len;
+    header->token = wire->token;
+    header->type = wire->type;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Keep the version 2 header that a message was received with, so
+ * that its fields can be found without scanning the body.
+ *
+ * @param  message  IN  message whose header was set from @ref wire
+ * @param  wire     IN  received header
+ *******************************************************************************
+ */
+void
+_LSTransportMessageSetWireHeader(_LSTransportMessage *message, const _LSTransportHeaderV2 *wire)
+{
+    message->wire_header = *wire;
+    message->wire_version = 2;
+    _LSTransportMessageSetPayloadType(message, wire->payload_type, wire->payload_len);
+
+    if (wire->flags & LS_TRANSPORT_HEADER_FLAG_COMPRESSED)
+    {
+        _LSTransportMessageSetPayloadCompressed(message, wire->payload_len);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Prepare a message to be sent to a peer that speaks the given
+ * protocol version.
+ *
+ * For version 2 the header is built here, along with the offsets of the
+ * fields. This also (re)starts the transmission of the message.
+ *
+ * @note the token has to be set before calling this
+ *
+ * @param  message  IN  message
+ * @param  version  IN  protocol version spoken with the peer
+ *******************************************************************************
+ */
+void
+_LSTransportMessageSetTxVersion(_LSTransportMessage *message, int version)
+{
+    const _LSTransportHeader *header = &message->raw->header;
+
+    if (version < 2)
+    {
+        /* the v1 header can't say that the payload is compressed */
+        LS_ASSERT(!message->payload_compressed);
+
+        message->wire_version = 0;
+        message->tx_bytes_remaining = header->len + sizeof(_LSTransportHeader);
+        return;
+    }
+
+    LS_ASSERT(header->len <= G_MAXUINT32);
+
+    /* don't go by a header the message may have been received with, since
+     * it is about to be overwritten */
+    message->wire_version = 0;
+    _LSTransportMessageParseFields(message);
+
+    const _LSTransportMessageFields *fields = &message->fields;
+    _LSTransportHeaderV2 *wire = &message->wire_header;
+
+    memset(wire, 0, sizeof(*wire));
+    wire->len = header->len;
+    wire->type = header->type;
+    wire->token = header->token;
+    wire->payload_type = message->payload_type;
+    wire->payload_len = message->payload_len;
+    wire->category = fields->category == -1 ? LS_TRANSPORT_HEADER_NO_FIELD : fields->category;
+    wire->method = fields->method == -1 ? LS_TRANSPORT_HEADER_NO_FIELD : fields->method;
+    wire->payload = fields->payload == -1 ? LS_TRANSPORT_HEADER_NO_FIELD : fields->payload;
+    wire->app_id = fields->app_id == -1 ? LS_TRANSPORT_HEADER_NO_FIELD : fields->app_id;
+    wire->fields_end = fields->trailer == -1 ? header->len : fields->trailer;
+
+    if (header->type == _LSTransportMessageTypeMethodCallNoReply)
+    {
+        wire->flags |= LS_TRANSPORT_HEADER_FLAG_NO_REPLY;
+    }
+    if (message->payload_type != LS_PAYLOAD_TYPE_JSON)
+    {
+        wire->flags |= LS_TRANSPORT_HEADER_FLAG_BINARY;
+    }
+    if (message->payload_compressed)
+    {
+        wire->flags |= LS_TRANSPORT_HEADER_FLAG_COMPRESSED;
+    }
+    if (_LSTransportMessageIsConnectionFdType(message))
+    {
+        wire->flags |= LS_TRANSPORT_HEADER_FLAG_FD_ATTACHED;
+    }
+
+    message->wire_version = version;
+    message->tx_bytes_remaining = header->len + sizeof(_LSTransportHeaderV2);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the number of bytes that go over the wire for a message.
+ *
+ * @param  message  IN  message prepared with @ref _LSTransportMessageSetTxVersion
+ *
+ * @retval size of the header on the wire plus the body
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportMessageGetTxSize(const _LSTransportMessage *message)
+{
+    return message->raw->header.len + _LSTransportHeaderSize(message->wire_version);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the bytes of a message that haven't been transmitted yet.
+ *
+ * @param  message  IN  message prepared with @ref _LSTransportMessageSetTxVersion
+ * @param  iov      OUT array of (at least) two io vectors
+ *
+ * @retval number of io vectors filled in
+ *******************************************************************************
+ */
+int
+_LSTransportMessageGetTxIov(const _LSTransportMessage *message, struct iovec *iov)
+{
+    unsigned long header_size = _LSTransportHeaderSize(message->wire_version);
+    unsigned long sent = _LSTransportMessageGetTxSize(message) - message->tx_bytes_remaining;
+    int count = 0;
+
+    if (message->tx_bytes_remaining == 0)
+    {
+        return 0;
+    }
+
+    if (message->wire_version < 2)
+    {
+        iov[0].iov_base = (char*)message->raw + sent;
+        iov[0].iov_len = message->tx_bytes_remaining;
+        return 1;
+    }
+
+    if (sent < header_size)
+    {
+        iov[count].iov_base = (char*)&message->wire_header + sent;
+        iov[count].iov_len = header_size - sent;
+        count++;
+        sent = header_size;
+    }
+
+    if (message->raw->header.len > sent - header_size)
+    {
+        iov[count].iov_base = message->raw->data + sent - header_size;
+        iov[count].iov_len = message->raw->header.len - (sent - header_size);
+        count++;
+    }
+
+    return count;
+}
+
 /**
  *******************************************************************************
  * @brief Returns true if the message type is one that we're interested in
@@ -352,6 +620,7 @@ _LSTransportMessageTypeIsMonitorType(_LSTransportMessageType type)
     {
     case _LSTransportMessageTypeReply:
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
     case _LSTransportMessageTypeSignal:
         return true;
@@ -473,6 +742,9 @@ _LSTransportMessageIsConnectionFdType(const _LSTransportMessage *message)
     case _LSTransportMessageTypeQueryNameReply:
     case _LSTransportMessageTypeRequestNameLocalReply:
     case _LSTransportMessageTypeMonitorConnected:
+    case _LSTransportMessageTypePayloadFd:
+    case _LSTransportMessageTypeRingSetup:
+    case _LSTransportMessageTypeTraceRing:
         return true;
 
     default:
@@ -480,6 +752,229 @@ _LSTransportMessageIsConnectionFdType(const _LSTransportMessage *message)
     }
 }
 
+/**
+ *******************************************************************************
+ * @brief Create a sealed memfd holding a payload.
+ *
+ * The terminating NUL is written here, so @ref payload doesn't need to have
+ * one.
+ *
+ * @param  payload  IN  payload
+ * @param  size     IN  size of the payload including the terminating NUL
+ *
+ * @retval fd on success
+ * @retval -1 on failure (e.g., kernel without memfd support)
+ *******************************************************************************
+ */
+int
+_LSTransportMessagePayloadFdNew(const char *payload, unsigned long size)
+{
+#ifdef SYS_memfd_create
+    int fd = syscall(SYS_memfd_create, "ls2-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    unsigned long offset = 0;
+
+    while (offset < size)
+    {
+        /* the last byte is the NUL */
+        ssize_t ret = (offset < size - 1) ?
+                      write(fd, payload + offset, size - 1 - offset) :
+                      write(fd, "", 1);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        offset += ret;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Map the payload passed in a @ref _LSTransportMessageTypePayloadFd
+ * message and attach it to the message that followed it.
+ *
+ * The memfd must be sealed against writes and resizing, so that the sender
+ * can't modify the payload under us, and the payload must be NUL-terminated.
+ * On success @ref _LSTransportMessageGetPayload returns a pointer into the
+ * read-only mapping, which is released with the message.
+ *
+ * @param  message              IN  message received after the payload fd
+ * @param  payload_fd_message   IN  payload fd message
+ *
+ * @retval true on success
+ * @retval false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportMessageAttachPayload(_LSTransportMessage *message, const _LSTransportMessage *payload_fd_message)
+{
+    LS_ASSERT(message != NULL);
+    LS_ASSERT(_LSTransportMessageGetType(payload_fd_message) == _LSTransportMessageTypePayloadFd);
+
+    int fd = _LSTransportMessageGetConnectionFd(payload_fd_message);
+    unsigned long size = 0;
+    struct stat st;
+
+    if (fd == -1 || _LSTransportMessageGetBodySize(payload_fd_message) < sizeof(size))
+    {
+        return false;
+    }
+
+    memcpy(&size, _LSTransportMessageGetBody(payload_fd_message), sizeof(size));
+
+    if (size == 0 || size > MAX_MESSAGE_SIZE_BYTES)
+    {
+        return false;
+    }
+
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK))
+    {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (unsigned long)st.st_size < size)
+    {
+        return false;
+    }
+
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (map[size - 1] != '\0')
+    {
+        munmap((void*)map, size);
+        return false;
+    }
+
+    message->payload_map = map;
+    message->payload_map_size = size;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a copy of a message that was prepared for an out of line
+ * payload, with the payload put back inline.
+ *
+ * @param  message      IN  method call or reply with an empty payload
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_len  IN  size of the payload including the terminating NUL
+ *
+ * @retval new message with ref count of 1 on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportMessageInlinePayloadNewRef(const _LSTransportMessage *message, const char *payload, unsigned long payload_len)
+{
+    const char *body = _LSTransportMessageGetBody(message);
+    const char *empty = _LSTransportMessageGetPayload(message);
+
+    if (!empty || *empty != '\0')
+    {
+        return NULL;
+    }
+
+    unsigned long offset = empty - body;
+    unsigned long body_size = _LSTransportMessageGetBodySize(message);
+    unsigned long grow = payload_len - 1;
+
+    _LSTransportMessage *ret = _LSTransportMessageNewRef(body_size + grow);
+    char *ret_body = _LSTransportMessageGetBody(ret);
+
+    memcpy(ret_body, body, offset);
+    memcpy(ret_body + offset, payload, payload_len - 1);
+    ret_body[offset + payload_len - 1] = '\0';
+    memcpy(ret_body + offset + payload_len, empty + 1, body_size - offset - 1);
+
+    _LSTransportMessageSetType(ret, _LSTransportMessageGetType(message));
+    _LSTransportMessageSetToken(ret, _LSTransportMessageGetToken(message));
+
+    if (_LSTransportMessageGetPayloadType(message) != LS_PAYLOAD_TYPE_JSON)
+    {
+        _LSTransportMessageSetPayloadType(ret, _LSTransportMessageGetPayloadType(message), grow);
+    }
+
+    /* the fields after the payload move along with it */
+    ret->fields = message->fields;
+    if (ret->fields.app_id != -1) ret->fields.app_id += grow;
+    if (ret->fields.trailer != -1) ret->fields.trailer += grow;
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a copy of a message with a compressed payload, with the
+ * payload decompressed.
+ *
+ * This is for the peers that can't take compressed payloads, such as the
+ * monitor.
+ *
+ * @param  message  IN  message with a compressed payload
+ *
+ * @retval new message with ref count of 1 on success
+ * @retval NULL if the payload is corrupt
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportMessageDecompressNewRef(const _LSTransportMessage *message)
+{
+    LS_ASSERT(message->payload_compressed);
+
+    unsigned long plain_len = 0;
+    const char *plain = _LSTransportMessageGetPayloadBinary(message, &plain_len);
+
+    if (!plain)
+    {
+        return NULL;
+    }
+
+    const char *body = _LSTransportMessageGetBody(message);
+    unsigned long body_size = _LSTransportMessageGetBodySize(message);
+    _LSTransportMessageFields scratch;
+    unsigned long offset = _LSTransportMessageGetFields(message, &scratch)->payload;
+    unsigned long rest = offset + message->payload_len + 1;
+
+    _LSTransportMessage *ret = _LSTransportMessageNewRef(offset + plain_len + 1 + body_size - rest);
+    char *ret_body = _LSTransportMessageGetBody(ret);
+
+    memcpy(ret_body, body, offset);
+    memcpy(ret_body + offset, plain, plain_len);
+    ret_body[offset + plain_len] = '\0';
+    memcpy(ret_body + offset + plain_len + 1, body + rest, body_size - rest);
+
+    _LSTransportMessageSetType(ret, _LSTransportMessageGetType(message));
+    _LSTransportMessageSetToken(ret, _LSTransportMessageGetToken(message));
+    _LSTransportMessageSetPayloadType(ret, _LSTransportMessageGetPayloadType(message), plain_len);
+
+    return ret;
+}
+
 /**
  *******************************************************************************
  * @brief Get an error string from an error message
@@ -646,6 +1141,7 @@ _LSTransportMessageSetHeader(_LSTransportMessage *message, _LSTransportHeader *h
     LS_ASSERT(header != NULL);
 
     memcpy(&message->raw->header, header, sizeof(_LSTransportHeader));
+    message->fields.parsed = false;
 }
 
 /**
@@ -675,6 +1171,67 @@ INLINE void
 _LSTransportMessageSetType(_LSTransportMessage *message, _LSTransportMessageType type)
 {
     message->raw->header.type = type;
+    message->fields.parsed = false;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the payload type of a message.
+ *
+ * @param  message  IN  message
+ *
+ * @retval  @ref LS_PAYLOAD_TYPE_JSON or the type of a binary payload
+ *******************************************************************************
+ */
+INLINE LSPayloadType
+_LSTransportMessageGetPayloadType(const _LSTransportMessage *message)
+{
+    return message->payload_type;
+}
+
+/**
+ *******************************************************************************
+ * @brief Set the payload type of a message.
+ *
+ * Binary payloads are found by their length instead of the NUL after them,
+ * since they may contain NULs themselves.
+ *
+ * @param  message      IN  message
+ * @param  payload_type IN  @ref LS_PAYLOAD_TYPE_JSON or the type of a binary payload
+ * @param  payload_len  IN  length of a binary payload in the body, not
+ *                          counting the NUL that follows it
+ *******************************************************************************
+ */
+INLINE void
+_LSTransportMessageSetPayloadType(_LSTransportMessage *message, LSPayloadType payload_type, unsigned long payload_len)
+{
+    message->payload_type = payload_type;
+    message->payload_len = (payload_type == LS_PAYLOAD_TYPE_JSON) ? 0 : payload_len;
+    message->payload_compressed = false;
+    message->fields.parsed = false;
+
+    g_free(message->payload_plain);
+    message->payload_plain = NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Mark the payload of a message as compressed with
+ * @ref _LSTransportCompress.
+ *
+ * @note call this after @ref _LSTransportMessageSetPayloadType
+ *
+ * @param  message          IN  message
+ * @param  compressed_len   IN  length of the compressed payload in the body,
+ *                              not counting the NUL that follows it
+ *******************************************************************************
+ */
+void
+_LSTransportMessageSetPayloadCompressed(_LSTransportMessage *message, unsigned long compressed_len)
+{
+    message->payload_compressed = true;
+    message->payload_len = compressed_len;
+    message->fields.parsed = false;
 }
 
 /**
@@ -781,6 +1338,9 @@ _LSTransportMessageSetBody(_LSTransportMessage *message, const void *body, int b
     LS_ASSERT(message != NULL);
     LS_ASSERT(body != NULL);
 
+    message->fields.parsed = false;
+    message->wire_version = 0;
+
     return memcpy(message->raw->data, body, body_len);
 }
 
@@ -799,85 +1359,317 @@ _LSTransportMessageGetRawMessage(_LSTransportMessage *message)
 {
     LS_ASSERT(message != NULL);
 
-    return message->raw;
+    return message->raw;
+}
+
+/**
+ *******************************************************************************
+ * @brief Set the "raw" message for the message. The raw message is what is
+ * actually sent over the wire.
+ *
+ * @param  message  IN  message
+ * @param  raw      IN  raw message
+ *
+ * @retval  raw message
+ *******************************************************************************
+ */
+INLINE _LSTransportMessageRaw*
+_LSTransportMessageSetRawMessage(_LSTransportMessage *message, _LSTransportMessageRaw *raw)
+{
+    LS_ASSERT(message != NULL);
+    LS_ASSERT(raw != NULL);
+
+    message->raw = raw;
+    message->fields.parsed = false;
+    return raw;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the size of the message body. (More memory may have be allocated behind
+ * for the body behind the scenes. See _LSTransportMessageSetAllocBodySize()).
+ *
+ * @param  message  IN  message
+ *
+ * @retval size in bytes
+ *******************************************************************************
+ */
+INLINE int
+_LSTransportMessageGetBodySize(const _LSTransportMessage *message)
+{
+    LS_ASSERT(message != NULL);
+    return _LSTransportMessageGetHeader(message)->len;
+}
+
+/**
+ *******************************************************************************
+ * @brief Set the currently set size of the message body (do not include the
+ * size of the header).
+ *
+ * @param  message  IN  message
+ * @param  size     IN  size (bytes)
+ *******************************************************************************
+ */
+static INLINE void
+_LSTransportMessageSetBodySize(_LSTransportMessage *message, unsigned long size)
+{
+    LS_ASSERT(message != NULL);
+    _LSTransportMessageGetHeader(message)->len = size;
+    message->fields.parsed = false;
+    message->wire_version = 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Find where a field ends from the offsets in a version 2 header,
+ * which is where the next field starts.
+ *
+ * @param  wire     IN  header the message was received with
+ * @param  start    IN  offset of the field
+ *
+ * @retval offset of the first byte after the field
+ * @retval LS_TRANSPORT_HEADER_NO_FIELD if the header has no such offset
+ *******************************************************************************
+ */
+static INLINE unsigned long
+_LSTransportWireFieldEnd(const _LSTransportHeaderV2 *wire, unsigned long start)
+{
+    const uint32_t bounds[] = { wire->category, wire->method, wire->payload, wire->app_id, wire->fields_end };
+    unsigned long end = LS_TRANSPORT_HEADER_NO_FIELD;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(bounds); i++)
+    {
+        if (bounds[i] > start && bounds[i] < end)
+        {
+            end = bounds[i];
+        }
+    }
+
+    return end;
+}
+
+/**
+ *******************************************************************************
+ * @brief Take the NUL-terminated field at @ref offset in the body.
+ *
+ * For a message that came with a version 2 header, the sender has found the
+ * field already, so only its NUL has to be checked.
+ *
+ * @param  message      IN      message
+ * @param  body         IN      message body
+ * @param  body_size    IN      size of @ref body
+ * @param  wire_field   IN      offset of the field in the version 2 header
+ * @param  offset       IN/OUT  offset of the field; advanced past its NUL
+ * @param  field        OUT     set to the offset of the field
+ *
+ * @retval true if the field ends inside the body
+ * @retval false otherwise
+ *******************************************************************************
+ */
+static INLINE bool
+_LSTransportMessageParseField(const _LSTransportMessage *message, const char *body, int body_size,
+                              uint32_t wire_field, int *offset, int *field)
+{
+    if (*offset >= body_size)
+    {
+        return false;
+    }
+
+    if (message->wire_version >= 2)
+    {
+        unsigned long end = _LSTransportWireFieldEnd(&message->wire_header, *offset);
+
+        if (wire_field != *offset || end > body_size || body[end - 1] != '\0')
+        {
+            return false;
+        }
+
+        *field = *offset;
+        *offset = end;
+        return true;
+    }
+
+    const char *nul = memchr(body + *offset, '\0', body_size - *offset);
+    if (!nul)
+    {
+        return false;
+    }
+
+    *field = *offset;
+    *offset = nul - body + 1;
+    return true;
 }
 
 /**
  *******************************************************************************
- * @brief Set the "raw" message for the message. The raw message is what is
- * actually sent over the wire.
+ * @brief Find the payload field of a message body.
  *
- * @param  message  IN  message
- * @param  raw      IN  raw message
+ * JSON payloads end at their NUL. Binary and compressed payloads may contain
+ * NULs, so their length comes from the header; they are still followed by a
+ * NUL, so that the fields after them stay where a NUL-terminated payload would
+ * have put them.
  *
- * @retval  raw message
+ * @param  message      IN      message
+ * @param  body         IN      message body
+ * @param  body_size    IN      size of @ref body
+ * @param  offset       IN/OUT  offset of the payload; offset of the next field
+ *                              on return
+ * @param  field        OUT     offset of the payload
+ *
+ * @retval true if the payload ends inside the body
+ * @retval false otherwise
  *******************************************************************************
  */
-INLINE _LSTransportMessageRaw*
-_LSTransportMessageSetRawMessage(_LSTransportMessage *message, _LSTransportMessageRaw *raw)
+static INLINE bool
+_LSTransportMessageParsePayloadField(const _LSTransportMessage *message, const char *body, int body_size,
+                                     int *offset, int *field)
 {
-    LS_ASSERT(message != NULL);
-    LS_ASSERT(raw != NULL);
+    uint32_t wire_field = message->wire_header.payload;
 
-    message->raw = raw;
-    return raw;
+    if (message->payload_type == LS_PAYLOAD_TYPE_JSON && !message->payload_compressed)
+    {
+        return _LSTransportMessageParseField(message, body, body_size, wire_field, offset, field);
+    }
+
+    if (*offset >= body_size ||
+        message->payload_len >= (unsigned long)(body_size - *offset) ||
+        body[*offset + message->payload_len] != '\0' ||
+        (message->wire_version >= 2 && wire_field != *offset))
+    {
+        return false;
+    }
+
+    *field = *offset;
+    *offset += message->payload_len + 1;
+    return true;
 }
 
 /**
  *******************************************************************************
- * @brief Get the size of the message body. (More memory may have be allocated behind
- * for the body behind the scenes. See _LSTransportMessageSetAllocBodySize()).
+ * @brief Find the variable length fields of a message and check that they
+ * are inside the body.
  *
- * @param  message  IN  message
+ * Messages that came with a version 2 header take the offsets from there, so
+ * the body isn't scanned.
  *
- * @retval size in bytes
+ * @param  message  IN  message
+ * @param  fields   OUT field offsets
  *******************************************************************************
  */
-INLINE int
-_LSTransportMessageGetBodySize(const _LSTransportMessage *message)
+static void
+_LSTransportMessageFindFields(const _LSTransportMessage *message, _LSTransportMessageFields *fields)
 {
-    LS_ASSERT(message != NULL);
-    return _LSTransportMessageGetHeader(message)->len;
+    const _LSTransportHeaderV2 *wire = &message->wire_header;
+    const char *body = message->raw->data;
+    int body_size = _LSTransportMessageGetBodySize(message);
+    int offset = 0;
+    bool valid = true;
+
+    fields->parsed = true;
+    fields->category = -1;
+    fields->method = -1;
+    fields->payload = -1;
+    fields->app_id = -1;
+    fields->trailer = -1;
+
+    switch (_LSTransportMessageGetType(message))
+    {
+    case _LSTransportMessageTypeReply:
+    case _LSTransportMessageTypeError:
+    case _LSTransportMessageTypeErrorUnknownMethod:
+        /* skip over the reply serial */
+        offset = sizeof(LSMessageToken);
+        valid = _LSTransportMessageParsePayloadField(message, body, body_size, &offset, &fields->payload);
+        break;
+
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
+        valid = _LSTransportMessageParseField(message, body, body_size, wire->category, &offset, &fields->category) &&
+                _LSTransportMessageParseField(message, body, body_size, wire->method, &offset, &fields->method) &&
+                _LSTransportMessageParsePayloadField(message, body, body_size, &offset, &fields->payload) &&
+                _LSTransportMessageParseField(message, body, body_size, wire->app_id, &offset, &fields->app_id);
+        break;
+
+    case _LSTransportMessageTypeCancelMethodCall:
+    case _LSTransportMessageTypeSignal:
+    case _LSTransportMessageTypeServiceUpSignal:
+    case _LSTransportMessageTypeServiceDownSignal:
+        valid = _LSTransportMessageParseField(message, body, body_size, wire->category, &offset, &fields->category) &&
+                _LSTransportMessageParseField(message, body, body_size, wire->method, &offset, &fields->method) &&
+                _LSTransportMessageParsePayloadField(message, body, body_size, &offset, &fields->payload);
+        break;
+
+    case _LSTransportMessageTypeSignalRegister:
+    case _LSTransportMessageTypeSignalUnregister:
+        valid = _LSTransportMessageParseField(message, body, body_size, wire->category, &offset, &fields->category) &&
+                _LSTransportMessageParseField(message, body, body_size, wire->method, &offset, &fields->method);
+        break;
+
+    default:
+        return;
+    }
+
+    /* the sender's offsets have to account for every byte up to the trailer */
+    if (valid && message->wire_version >= 2 && offset != wire->fields_end)
+    {
+        valid = false;
+    }
+
+    if (valid)
+    {
+        fields->trailer = offset;
+    }
+    else
+    {
+        LOG_LS_WARNING(MSGID_LS_ACCESS_ERR, 0,
+                       "Malformed message body: type: %d, size: %d",
+                       (int)_LSTransportMessageGetType(message), body_size);
+    }
 }
 
 /**
  *******************************************************************************
- * @brief Set the currently set size of the message body (do not include the
- * size of the header).
+ * @brief Find the variable length fields of a message and keep their
+ * offsets in it.
+ *
+ * This is done when a message has been received completely, before it is
+ * handed to a handler or worker thread, and when a message is prepared for
+ * sending. Setting the type, header or body drops the offsets again.
  *
  * @param  message  IN  message
- * @param  size     IN  size (bytes)
  *******************************************************************************
  */
-static INLINE void
-_LSTransportMessageSetBodySize(const _LSTransportMessage *message, unsigned long size)
+void
+_LSTransportMessageParseFields(_LSTransportMessage *message)
 {
-    LS_ASSERT(message != NULL);
-    _LSTransportMessageGetHeader(message)->len = size;
+    _LSTransportMessageFindFields(message, &message->fields);
 }
 
 /**
  *******************************************************************************
- * @brief Checks to see if the specified pointer falls within the message body.
+ * @brief Get the field offsets of a message.
+ *
+ * Messages may be read by several threads at once, so the offsets of a
+ * message that hasn't been parsed yet are computed into @p scratch rather
+ * than kept in the message.
  *
  * @param  message  IN  message
- * @param  ptr      IN  pointer to check
+ * @param  scratch  IN  space for the offsets of an unparsed message
  *
- * @retval true if pointer points inside message body
- * @retval false otherwise
+ * @retval field offsets
  *******************************************************************************
  */
-static INLINE bool
-_LSTransportMessageIsValidMessageBodyPtr(const _LSTransportMessage *message, const char *ptr)
+static INLINE const _LSTransportMessageFields*
+_LSTransportMessageGetFields(const _LSTransportMessage *message, _LSTransportMessageFields *scratch)
 {
-    if (ptr < message->raw->data + _LSTransportMessageGetBodySize(message))
+    if (message->fields.parsed)
     {
-        return true;
+        return &message->fields;
     }
-    LOG_LS_WARNING(MSGID_LS_ACCESS_ERR, 0,
-                   "Message access out of bounds: requested: %p, end: %p",
-                   ptr, message->raw->data + _LSTransportMessageGetBodySize(message));
-    return false;
+
+    _LSTransportMessageFindFields(message, scratch);
+    return scratch;
 }
 
 /**
@@ -919,6 +1711,8 @@ _LSTransportMessageSetAllocBodySize(_LSTransportMessage *message, unsigned long
  * moved in memory, but its contents will not change. The additional bytes are
  * not initialized.
  *
+ * Pooled raw messages grow into the next size class that fits.
+ *
  * @param  message          IN  message
  * @param  bytes_needed     IN  number of bytes to add to message
  *
@@ -929,46 +1723,98 @@ _LSTransportMessageSetAllocBodySize(_LSTransportMessage *message, unsigned long
 _LSTransportMessage*
 _LSTransportMessageBodyExpand(_LSTransportMessage *message, unsigned long bytes_needed)
 {
-    bool need_realloc = false;
     unsigned long alloc_body_size = _LSTransportMessageGetAllocBodySize(message);
     unsigned long body_size = _LSTransportMessageGetBodySize(message);
 
+    /* shared raw bytes are read-only */
+    LS_ASSERT(message->raw_owner == NULL);
+
     _LSTransportMessageRaw *raw = _LSTransportMessageGetRawMessage(message);
 
     LS_ASSERT(alloc_body_size >= body_size);
 
     unsigned long new_body_size = body_size + bytes_needed;
 
-    while (alloc_body_size < new_body_size)
-    {
-        alloc_body_size *= 2;
-        need_realloc = true;
-    }
+    /* the raw buffer may be bigger than asked for when it came from the pool */
+    alloc_body_size = MAX(alloc_body_size, _LSTransportMessagePoolGetClassBodySize(message->raw_pool_class));
 
-    if (need_realloc)
+    if (alloc_body_size < new_body_size)
     {
-        raw = g_try_realloc(raw, sizeof(_LSTransportMessageRaw) + alloc_body_size);
+        alloc_body_size = MAX(alloc_body_size, 1);
+        while (alloc_body_size < new_body_size)
+        {
+            alloc_body_size *= 2;
+        }
+
+        raw = _LSTransportMessagePoolReallocRaw(raw, body_size, alloc_body_size, &message->raw_pool_class);
 
         if (!raw)
         {
-            new_body_size = 0;
-            alloc_body_size = 0;
+            /* the message is left as it was */
             LOG_LS_CRITICAL(MSGID_LS_OOM_ERR, 0, "Unable to re-allocate message body, OOM");
+            return NULL;
         }
 
+        alloc_body_size = MAX(alloc_body_size, _LSTransportMessagePoolGetClassBodySize(message->raw_pool_class));
         _LSTransportMessageSetRawMessage(message, raw);
-        _LSTransportMessageSetAllocBodySize(message, alloc_body_size);
     }
 
+    _LSTransportMessageSetAllocBodySize(message, alloc_body_size);
     _LSTransportMessageSetBodySize(message, new_body_size);
 
     return message;
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the decompressed payload of a message, decompressing it on the
+ * first call.
+ *
+ * Messages that are only passed along never pay for the decompression.
+ *
+ * @param  message  IN  message with a compressed payload
+ * @param  fields   IN  field offsets of the message
+ *
+ * @retval  payload followed by a NUL
+ * @retval  NULL if the compressed payload is corrupt
+ *******************************************************************************
+ */
+static const char*
+_LSTransportMessageGetPayloadPlain(const _LSTransportMessage *message, const _LSTransportMessageFields *fields)
+{
+    char *plain = g_atomic_pointer_get(&message->payload_plain);
+
+    if (plain)
+    {
+        return plain;
+    }
+
+    plain = _LSTransportDecompress(message->raw->data + fields->payload, message->payload_len);
+
+    if (!plain)
+    {
+        LOG_LS_WARNING(MSGID_LS_COMPRESS_ERR, 0,
+                       "Could not decompress payload: type: %d, size: %lu",
+                       (int)_LSTransportMessageGetType(message), message->payload_len);
+        return NULL;
+    }
+
+    /* another thread may have beaten us to it */
+    if (!g_atomic_pointer_compare_and_exchange(&((_LSTransportMessage*)message)->payload_plain, NULL, plain))
+    {
+        g_free(plain);
+        plain = g_atomic_pointer_get(&message->payload_plain);
+    }
+
+    return plain;
+}
+
 /**
  *******************************************************************************
  * @brief Get the payload for a message.
  *
+ * A compressed payload is decompressed on the first call.
+ *
  * @param  message  IN  message
  *
  * @retval  payload
@@ -978,45 +1824,18 @@ const char*
 _LSTransportMessageGetPayload(const _LSTransportMessage *message)
 {
     //LS_ASSERT(message->raw->header.type == _LSTransportMessageTypeReply);
-    const char *ret = NULL;
 
-    /* TODO: make this less expensive */
-    switch (_LSTransportMessageGetType(message))
+    /* payload was passed out of line in a memfd */
+    if (message->payload_map)
     {
-    case _LSTransportMessageTypeReply:
-    case _LSTransportMessageTypeError:
-    case _LSTransportMessageTypeErrorUnknownMethod:
-        /* skip over the reply serial */
-        ret = _LSTransportMessageGetBody(message) + sizeof(LSMessageToken);
-        if (!_LSTransportMessageIsValidMessageBodyPtr(message, ret))
-        {
-            return NULL;
-        }
-        return ret;
-
-    case _LSTransportMessageTypeMethodCall:
-    case _LSTransportMessageTypeCancelMethodCall:
-    case _LSTransportMessageTypeSignal:
-    case _LSTransportMessageTypeServiceUpSignal:
-    case _LSTransportMessageTypeServiceDownSignal:
-        /* skip over category */
-        ret = _LSTransportMessageGetBody(message) + strlen(_LSTransportMessageGetBody(message)) + 1;
-
-        if (!_LSTransportMessageIsValidMessageBodyPtr(message, ret))
-        {
-            return NULL;
-        }
-
-        /* skip over method */
-        ret = ret + strlen(ret) + 1;
+        return message->payload_map;
+    }
 
-        if (!_LSTransportMessageIsValidMessageBodyPtr(message, ret))
-        {
-            return NULL;
-        }
-        return ret;
+    _LSTransportMessageFields scratch;
+    const _LSTransportMessageFields *fields = _LSTransportMessageGetFields(message, &scratch);
 
-    default:
+    if (fields->payload == -1)
+    {
         /* When DEBUG_VERBOSE is enabled we expect to call this function on
          * all types of messages; otherwise we don't */
         if (!DEBUG_VERBOSE)
@@ -1026,23 +1845,57 @@ _LSTransportMessageGetPayload(const _LSTransportMessage *message)
         return NULL;
     }
 
-    return NULL;
+    if (message->payload_compressed)
+    {
+        return _LSTransportMessageGetPayloadPlain(message, fields);
+    }
+
+    return message->raw->data + fields->payload;
 }
 
 /**
  *******************************************************************************
- * @brief Save a reference to the appId. This will *NOT* copy an memory; the
- * appId should point inside the message.
+ * @brief Get the payload for a message along with its length.
+ *
+ * Works for both JSON and binary payloads; either way the payload is
+ * followed by a NUL that isn't counted in @ref len.
  *
  * @param  message  IN  message
- * @param  app_id   IN  application id
+ * @param  len      OUT length of the payload
+ *
+ * @retval  payload
+ * @retval  NULL if the message has no payload
  *******************************************************************************
  */
-INLINE void
-_LSTransportMessageSetAppId(_LSTransportMessage *message, const char *app_id)
+const char*
+_LSTransportMessageGetPayloadBinary(const _LSTransportMessage *message, unsigned long *len)
 {
-    LS_ASSERT(message != NULL);
-    message->app_id = app_id;
+    const char *payload = _LSTransportMessageGetPayload(message);
+
+    if (!payload)
+    {
+        *len = 0;
+    }
+    else if (message->payload_map)
+    {
+        *len = message->payload_map_size - 1;
+    }
+    else if (message->payload_compressed)
+    {
+        _LSTransportMessageFields scratch;
+        const _LSTransportMessageFields *fields = _LSTransportMessageGetFields(message, &scratch);
+        *len = _LSTransportCompressGetPlainSize(message->raw->data + fields->payload, message->payload_len);
+    }
+    else if (_LSTransportMessageGetPayloadType(message) != LS_PAYLOAD_TYPE_JSON)
+    {
+        *len = message->payload_len;
+    }
+    else
+    {
+        *len = strlen(payload);
+    }
+
+    return payload;
 }
 
 /**
@@ -1057,32 +1910,16 @@ _LSTransportMessageSetAppId(_LSTransportMessage *message, const char *app_id)
 static const char*
 _LSTransportMessageGetAppIdPtr(_LSTransportMessage *message)
 {
-    _LSTransportMessageType msg_type = _LSTransportMessageGetType(message);
+    _LSTransportMessageFields scratch;
+    const _LSTransportMessageFields *fields = _LSTransportMessageGetFields(message, &scratch);
 
-    /* Check if value is cached */
-    if (!message->app_id)
+    if (fields->app_id == -1)
     {
-        if (msg_type == _LSTransportMessageTypeMethodCall)
-        {
-            /* TODO: very inefficient */
-
-            const char *payload = _LSTransportMessageGetPayload(message);
-
-            /* skip over payload */
-            const char *ret = (payload + strlen(payload) + 1);
-            LS_ASSERT(ret);
-
-            /* cache the value */
-            message->app_id = ret;
-        }
-        else
-        {
-            LOG_LS_DEBUG("AppId msg type: %d", msg_type);
-            return NULL;
-        }
+        LOG_LS_DEBUG("AppId msg type: %d", _LSTransportMessageGetType(message));
+        return NULL;
     }
 
-    return message->app_id;
+    return message->raw->data + fields->app_id;
 }
 
 /**
@@ -1121,29 +1958,16 @@ _LSTransportMessageGetAppId(_LSTransportMessage *message)
 const char*
 _LSTransportMessageGetMethod(const _LSTransportMessage *message)
 {
-    /* TODO: make this less expensive */
-    /* skip over category and the method is after the NUL */
-    switch (_LSTransportMessageGetType(message))
-    {
-    case _LSTransportMessageTypeMethodCall:
-    case _LSTransportMessageTypeCancelMethodCall:
-    case _LSTransportMessageTypeSignal:
-    case _LSTransportMessageTypeSignalRegister:
-    case _LSTransportMessageTypeSignalUnregister:
-    case _LSTransportMessageTypeServiceUpSignal:
-    case _LSTransportMessageTypeServiceDownSignal:
+    _LSTransportMessageFields scratch;
+    const _LSTransportMessageFields *fields = _LSTransportMessageGetFields(message, &scratch);
+
+    if (fields->method == -1)
     {
-        const char *ret = message->raw->data + strlen(message->raw->data) + 1;
-        if (!_LSTransportMessageIsValidMessageBodyPtr(message, ret))
-        {
-            return NULL;
-        }
-        return ret;
-    }
-    default:
         LOG_LS_DEBUG("Unrecognized type (%d) to call %s on", (int)_LSTransportMessageGetType(message), __func__);
         return NULL;
     }
+
+    return message->raw->data + fields->method;
 }
 
 /**
@@ -1158,20 +1982,16 @@ _LSTransportMessageGetMethod(const _LSTransportMessage *message)
 const char*
 _LSTransportMessageGetCategory(const _LSTransportMessage *message)
 {
-    switch (_LSTransportMessageGetType(message))
+    _LSTransportMessageFields scratch;
+    const _LSTransportMessageFields *fields = _LSTransportMessageGetFields(message, &scratch);
+
+    if (fields->category == -1)
     {
-    case _LSTransportMessageTypeMethodCall:
-    case _LSTransportMessageTypeCancelMethodCall:
-    case _LSTransportMessageTypeSignal:
-    case _LSTransportMessageTypeSignalRegister:
-    case _LSTransportMessageTypeSignalUnregister:
-    case _LSTransportMessageTypeServiceUpSignal:
-    case _LSTransportMessageTypeServiceDownSignal:
-        return message->raw->data;
-    default:
         LOG_LS_DEBUG("Unrecognized type (%d) to call %s on", (int)_LSTransportMessageGetType(message), __func__);
         return NULL;
     }
+
+    return message->raw->data + fields->category;
 }
 
 /**
@@ -1225,36 +2045,21 @@ _LSTransportMessageGetDestServiceName(_LSTransportMessage *message)
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeMethodCall:
-    {
-        /* move past the appid to get the destination service name */
-        const char *app_id = _LSTransportMessageGetAppIdPtr(message);
-
-        /*
-            In theory app_id can't be NULL as we are in the case for _LSTransportMessageTypeMethodCall and
-            _LSTransportMessageGetAppIdPtr will only return a NULL when passed a message whose type is *not*
-            _LSTransportMessageTypeMethodCall.
-        */
-        LS_ASSERT(app_id);
-
-        const char *ret = app_id + strlen(app_id) + 1;
-
-        /* make sure we're not trying to access data outside of the message */
-        LS_ASSERT((ret - _LSTransportMessageGetBody(message) + 1) < _LSTransportMessageGetBodySize(message));
-
-        return ret;
-    }
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
     case _LSTransportMessageTypeSignal:
     case _LSTransportMessageTypeReply:
     {
-        /* move past the payload to get the destination service name */
-        const char *payload = _LSTransportMessageGetPayload(message);
-        const char *ret = payload + strlen(payload) + 1;
+        /* the destination service name follows the app id (method calls)
+         * or the payload */
+        _LSTransportMessageFields scratch;
+        int trailer = _LSTransportMessageGetFields(message, &scratch)->trailer;
 
         /* make sure we're not trying to access data outside of the message */
-        LS_ASSERT((ret - _LSTransportMessageGetBody(message) + 1) < _LSTransportMessageGetBodySize(message));
+        LS_ASSERT(trailer != -1);
+        LS_ASSERT(trailer + 1 < _LSTransportMessageGetBodySize(message));
 
-        return ret;
+        return message->raw->data + trailer;
     }
     default:
         LOG_LS_DEBUG("Unrecognized type (%d) to call %s on", (int)_LSTransportMessageGetType(message), __func__);
@@ -1279,6 +2084,7 @@ _LSTransportMessageGetDestUniqueName(_LSTransportMessage *message)
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
     case _LSTransportMessageTypeSignal:
     case _LSTransportMessageTypeReply:
@@ -1314,6 +2120,7 @@ _LSTransportMessageGetMonitorMessageData(_LSTransportMessage *message)
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
     case _LSTransportMessageTypeCancelMethodCall:
     case _LSTransportMessageTypeSignal:
     case _LSTransportMessageTypeReply:
@@ -1386,6 +2193,42 @@ _LSTransportMessagePrintFilterMatch(_LSTransportMessage *message, const char *fi
     return false;
 }
 
+/**
+ *******************************************************************************
+ * @brief Print a binary payload as its type followed by hex bytes, e.g.,
+ * "0x100:3:0a0b0c".
+ *
+ * @param  message  IN  message
+ * @param  file     OUT file to print payload to
+ * @param  width    IN  max number of characters to print; -1 for no limit
+ *
+ * @retval number of characters printed
+ *******************************************************************************
+ */
+static int
+_LSTransportMessagePrintPayloadHex(const _LSTransportMessage *message, FILE *file, int width)
+{
+    unsigned long len = 0;
+    const unsigned char *payload = (const unsigned char*)_LSTransportMessageGetPayloadBinary(message, &len);
+    char prefix[32];
+    unsigned long i;
+
+    int printed = snprintf(prefix, sizeof(prefix), "%#x:%lu:", _LSTransportMessageGetPayloadType(message), len);
+
+    if (width >= 0 && printed > width)
+    {
+        printed = width;
+    }
+    fprintf(file, "%.*s", printed, prefix);
+
+    for (i = 0; i < len && (width < 0 || printed + 2 <= width); i++)
+    {
+        printed += fprintf(file, "%02x", payload[i]);
+    }
+
+    return printed;
+}
+
 /**
  *******************************************************************************
  * @brief Print out a message payload.
@@ -1399,7 +2242,14 @@ _LSTransportMessagePrintPayload(const _LSTransportMessage *message, FILE *file)
 {
     /* Raw UTF-8 encoding for 'Left-Pointing double angle quotation mark */
     fprintf(file, "\xc2\xab");
-    fprintf(file, "%s", _LSTransportMessageGetPayload(message));
+    if (_LSTransportMessageGetPayloadType(message) != LS_PAYLOAD_TYPE_JSON)
+    {
+        _LSTransportMessagePrintPayloadHex(message, file, -1);
+    }
+    else
+    {
+        fprintf(file, "%s", _LSTransportMessageGetPayload(message));
+    }
     /* Raw UTF-8 encoding for 'Right-Pointing double angle quotation mark' */
     fprintf(file, "\xc2\xbb");
 }
@@ -1467,9 +2317,11 @@ _LSTransportMessagePrintCancelMethodCall(_LSTransportMessage *message, FILE *fil
 static void
 _LSTransportMessagePrintMethodCall(_LSTransportMessage *message, FILE *file)
 {
-    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageType type = _LSTransportMessageGetType(message);
 
-    fprintf(file, "call\t");
+    LS_ASSERT(type == _LSTransportMessageTypeMethodCall || type == _LSTransportMessageTypeMethodCallNoReply);
+
+    fprintf(file, type == _LSTransportMessageTypeMethodCall ? "call\t" : "noreply\t");
     fprintf(file, "%d\t", (int)_LSTransportMessageGetToken(message));
     fprintf(file, "\t");
     fprintf(file, "%s ", _LSTransportMessageGetSenderServiceName(message));
@@ -1532,6 +2384,7 @@ LSTransportMessageFilterMatch(_LSTransportMessage *message, const char *filter)
         return _LSTransportMessagePrintFilterMatch(message, filter, true, true);
 
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
         return _LSTransportMessagePrintFilterMatch(message, filter, true, true);
 
     case _LSTransportMessageTypeReply:
@@ -1566,6 +2419,7 @@ LSTransportMessagePrint(_LSTransportMessage *message, FILE *file)
         break;
 
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
         _LSTransportMessagePrintMethodCall(message, file);
         break;
 
@@ -1740,6 +2594,7 @@ LSTransportMessagePrintCompactHeader(_LSTransportMessage *message, FILE *file)
         break;
 
     case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
         directions = " >";
         caller_service_name = _LSTransportMessageGetSenderServiceName(message);
         callee_service_name = _LSTransportMessageGetDestServiceName(message);
@@ -1788,6 +2643,11 @@ LSTransportMessagePrintCompactHeader(_LSTransportMessage *message, FILE *file)
 int
 LSTransportMessagePrintCompactPayload(_LSTransportMessage *message, FILE *file, int width)
 {
+    if (_LSTransportMessageGetPayloadType(message) != LS_PAYLOAD_TYPE_JSON)
+    {
+        return _LSTransportMessagePrintPayloadHex(message, file, width);
+    }
+
     return fprintf(file, "%.*s", width, _LSTransportMessageGetPayload(message));
 }
 
@@ -20,6 +20,7 @@
 #ifndef _TRANSPORT_MESSAGE_H_
 #define _TRANSPORT_MESSAGE_H_
 
+#include <stdint.h>
 #include <sys/uio.h>
 #include <luna-service2/lunaservice.h>
 //#include "transport_client.h"
@@ -46,6 +47,10 @@
                                                              size when creating
                                                              variable-length messages */
 
+#define LS_TRANSPORT_PAYLOAD_FD_THRESHOLD   (64 * 1024) /**< default size from which method call
+                                                             and reply payloads are passed in a
+                                                             memfd instead of the socket */
+
 typedef struct LSTransportClient _LSTransportClient;
 
 typedef enum LSTransportMessageType
@@ -82,6 +87,13 @@ typedef enum LSTransportMessageType
     _LSTransportMessageTypeAppendCategory,           /**< message to the hub to update category tables */
     _LSTransportMessageTypeQueryServiceCategory,     /**< message from client to hub to get list of registered categories */
     _LSTransportMessageTypeQueryServiceCategoryReply,/**< reply from hub to client with list of registered categories */
+    _LSTransportMessageTypePayloadFd,                /**< sealed memfd holding the payload of the message that follows */
+    _LSTransportMessageTypeRingSetup,                /**< one of the fds of the shared memory rings offered by the initiator */
+    _LSTransportMessageTypeRingReady,                /**< the sender switches to the shared memory rings after this message */
+    _LSTransportMessageTypeMethodCallNoReply,        /**< method call the sender doesn't expect a reply to */
+    _LSTransportMessageTypeLoopbackOffer,            /**< offer of a direct link from a client in the same process */
+    _LSTransportMessageTypeLoopbackReady,            /**< the sender hands messages over the direct link after this message */
+    _LSTransportMessageTypeTraceRing,                /**< memfd of the sender's trace ring, for a monitor in trace mode */
 } _LSTransportMessageType;
 
 /**
@@ -139,7 +151,8 @@ typedef enum LSTransportConnectState {
 } _LSTransportConnectState;
 
 /**
- * Header for the raw message.
+ * Header for the raw message. This is also the header on the wire for
+ * protocol version 1 peers.
  */
 struct LSTransportHeader {
     unsigned long len;            /**< len of the data portion of the message (doesn't include size of header itself) */
@@ -149,6 +162,53 @@ struct LSTransportHeader {
 
 typedef struct LSTransportHeader _LSTransportHeader;
 
+/**
+ * @defgroup LSTransportHeaderFlags LSTransportHeaderFlags
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_HEADER_FLAG_NO_REPLY       (1 << 0)  /**< method call the sender doesn't expect a reply to */
+#define LS_TRANSPORT_HEADER_FLAG_BINARY         (1 << 1)  /**< the payload is framed by @ref payload_len */
+#define LS_TRANSPORT_HEADER_FLAG_COMPRESSED     (1 << 2)  /**< the payload is compressed, see
+                                                               @ref _LSTransportCompress */
+#define LS_TRANSPORT_HEADER_FLAG_FD_ATTACHED    (1 << 3)  /**< an fd is passed right after the message */
+
+#define LS_TRANSPORT_HEADER_FLAGS_KNOWN         (LS_TRANSPORT_HEADER_FLAG_NO_REPLY | \
+                                                 LS_TRANSPORT_HEADER_FLAG_BINARY | \
+                                                 LS_TRANSPORT_HEADER_FLAG_COMPRESSED | \
+                                                 LS_TRANSPORT_HEADER_FLAG_FD_ATTACHED)
+
+/** @} LSTransportHeaderFlags */
+
+#define LS_TRANSPORT_HEADER_NO_FIELD    0xFFFFFFFF  /**< field offset of a field the message doesn't have */
+
+/**
+ * Header on the wire for protocol version 2 peers.
+ *
+ * All members have a fixed width, so the layout doesn't depend on the
+ * architecture. The offsets of the body fields are found once by the sender,
+ * so that the receiver only has to check that each field is terminated
+ * instead of scanning the body for them.
+ */
+struct LSTransportHeaderV2 {
+    uint32_t len;                   /**< len of the data portion of the message */
+    uint16_t type;                  /**< @ref _LSTransportMessageType */
+    uint16_t flags;                 /**< @ref LSTransportHeaderFlags */
+    uint64_t token;                 /**< serial associated with message */
+    uint32_t payload_type;          /**< @ref LS_PAYLOAD_TYPE_JSON or the type of a binary payload */
+    uint32_t payload_len;           /**< length of a binary payload, not counting the NUL that
+                                         follows it; 0 for JSON payloads */
+    uint32_t category;              /**< offsets of the fields in the body, or */
+    uint32_t method;                /**< @ref LS_TRANSPORT_HEADER_NO_FIELD */
+    uint32_t payload;
+    uint32_t app_id;
+    uint32_t fields_end;            /**< first byte after the fields above */
+    uint32_t reserved;              /**< always 0 */
+};
+
+typedef struct LSTransportHeaderV2 _LSTransportHeaderV2;
+
 /**
  * Underlying message that is sent across the wire. You shouldn't use this
  * directly, but instead use the @LSTransportMessage that wraps this.
@@ -160,6 +220,24 @@ struct LSTransportMessageRaw {
 
 typedef struct LSTransportMessageRaw _LSTransportMessageRaw;
 
+/**
+ * Offsets of the variable length fields in the body of a message. They are
+ * found and bounds checked once, so that the getters don't have to scan the
+ * body. -1 means that the message type has no such field or that it is
+ * malformed.
+ */
+struct LSTransportMessageFields {
+    bool parsed;        /**< false until the offsets have been computed */
+    int category;
+    int method;
+    int payload;
+    int app_id;
+    int trailer;        /**< first byte after the fields above; monitor
+                             copies carry the destination names there */
+};
+
+typedef struct LSTransportMessageFields _LSTransportMessageFields;
+
 /**
  * Encapsulates the raw message with ref counting and state tracking.
  */
@@ -176,9 +254,30 @@ struct LSTransportMessage {
     int connection_fd;                  /**< fd passed from the hub that is already
                                              connected to the far side. This is only
                                              set for certain messages (-1 otherwise) */
-    const char *app_id;                 /**< cached app id -- points inside the raw message */
+    _LSTransportMessageFields fields;   /**< cached field offsets -- see
+                                             @ref _LSTransportMessageParseFields */
     _LSTransportMessageRaw *raw;        /**< raw bytes sent over the wire */
+    int raw_pool_class;                 /**< size class of @ref raw in the message
+                                             pool (see transport_message_pool.h) */
+    struct LSTransportMessage *raw_owner;   /**< message whose @ref raw this one shares
+                                                 (ref); NULL if it owns @ref raw */
+    const char *payload_map;            /**< read-only mapping of a payload received
+                                             out of line; NULL if the payload is inline */
+    unsigned long payload_map_size;     /**< size of @ref payload_map */
+    LSPayloadType payload_type;         /**< @ref LS_PAYLOAD_TYPE_JSON or the type of a binary payload */
+    unsigned long payload_len;          /**< length of a binary or compressed payload in the body,
+                                             not counting the NUL that follows it; 0 for JSON payloads */
+    bool payload_compressed;            /**< the payload in the body is compressed, and
+                                             @ref payload_len is its compressed length */
+    char *payload_plain;                /**< decompressed payload, filled in on first use */
+    int wire_version;                   /**< protocol version of @ref wire_header; 0 when the
+                                             message goes (or came) over the wire as is */
+    _LSTransportHeaderV2 wire_header;   /**< header the message was received with or is sent
+                                             with for protocol version 2 peers */
     int retries;                        /**< remaining send retries */
+    int replies_sent;                   /**< replies sent to this received message */
+    bool is_update;                     /**< reply that follows an earlier reply to the
+                                             same call (e.g., a subscription update) */
     _LSTransportConnectState connect_state;   /**< state of connect() -- e.g., if we fail to connect()
                                                    due to non-blocking sockets we save the state here */
 };
@@ -214,10 +313,18 @@ INLINE void _LSTransportMessageFree(_LSTransportMessage *message);
 INLINE _LSTransportMessage* _LSTransportMessageRef(_LSTransportMessage *message);
 INLINE void _LSTransportMessageUnref(_LSTransportMessage *message);
 INLINE _LSTransportMessage* _LSTransportMessageCopyNewRef(_LSTransportMessage *message);
+_LSTransportMessage* _LSTransportMessageShareNewRef(_LSTransportMessage *message);
 INLINE _LSTransportMessage* _LSTransportMessageCopy(_LSTransportMessage *dest, const _LSTransportMessage *src);
 
 _LSTransportMessage* _LSTransportMessageFromVectorNewRef(const struct iovec *iov, int iovcnt, unsigned long total_len);
 
+unsigned long _LSTransportHeaderSize(int version);
+bool _LSTransportHeaderFromV2(const _LSTransportHeaderV2 *wire, _LSTransportHeader *header);
+void _LSTransportMessageSetWireHeader(_LSTransportMessage *message, const _LSTransportHeaderV2 *wire);
+void _LSTransportMessageSetTxVersion(_LSTransportMessage *message, int version);
+unsigned long _LSTransportMessageGetTxSize(const _LSTransportMessage *message);
+int _LSTransportMessageGetTxIov(const _LSTransportMessage *message, struct iovec *iov);
+
 INLINE guint _LSTransportMessageGetTimeoutId(const _LSTransportMessage *message);
 INLINE void _LSTransportMessageSetTimeoutId(_LSTransportMessage *message, guint timeout_id);
 INLINE _LSTransportConnectState _LSTransportMessageGetConnectState(const _LSTransportMessage * message);
@@ -230,6 +337,9 @@ INLINE _LSTransportHeader* _LSTransportMessageGetHeader(const _LSTransportMessag
 INLINE void _LSTransportMessageSetHeader(_LSTransportMessage *message, _LSTransportHeader *header);
 INLINE _LSTransportMessageType _LSTransportMessageGetType(const _LSTransportMessage *message);
 INLINE void _LSTransportMessageSetType(_LSTransportMessage *message, _LSTransportMessageType type);
+INLINE LSPayloadType _LSTransportMessageGetPayloadType(const _LSTransportMessage *message);
+INLINE void _LSTransportMessageSetPayloadType(_LSTransportMessage *message, LSPayloadType payload_type, unsigned long payload_len);
+void _LSTransportMessageSetPayloadCompressed(_LSTransportMessage *message, unsigned long compressed_len);
 INLINE void _LSTransportMessageSetToken(_LSTransportMessage *message, LSMessageToken token);
 INLINE LSMessageToken _LSTransportMessageGetToken(const _LSTransportMessage *message);
 INLINE LSMessageToken _LSTransportMessageGetReplyToken(const _LSTransportMessage *message);
@@ -244,11 +354,16 @@ INLINE bool _LSTransportMessageTypeIsMonitorType(_LSTransportMessageType type);
 INLINE bool _LSTransportMessageTypeIsErrorType(_LSTransportMessageType type);
 INLINE bool _LSTransportMessageTypeIsReplyType(_LSTransportMessageType type);
 bool _LSTransportMessageIsConnectionFdType(const _LSTransportMessage *message);
+int _LSTransportMessagePayloadFdNew(const char *payload, unsigned long size);
+bool _LSTransportMessageAttachPayload(_LSTransportMessage *message, const _LSTransportMessage *payload_fd_message);
+_LSTransportMessage* _LSTransportMessageInlinePayloadNewRef(const _LSTransportMessage *message, const char *payload, unsigned long payload_len);
+_LSTransportMessage* _LSTransportMessageDecompressNewRef(const _LSTransportMessage *message);
 
 const char* _LSTransportMessageGetMethod(const _LSTransportMessage *message);
 const char* _LSTransportMessageGetCategory(const _LSTransportMessage *message);
 const char* _LSTransportMessageGetPayload(const _LSTransportMessage *message);
-INLINE void _LSTransportMessageSetAppId(_LSTransportMessage *message, const char *app_id);
+const char* _LSTransportMessageGetPayloadBinary(const _LSTransportMessage *message, unsigned long *len);
+void _LSTransportMessageParseFields(_LSTransportMessage *message);
 const char* _LSTransportMessageGetAppId(_LSTransportMessage *message);
 const char* _LSTransportMessageGetSenderServiceName(const _LSTransportMessage *message);
 const char* _LSTransportMessageGetSenderUniqueName(const _LSTransportMessage *message);
@@ -0,0 +1,435 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <pthread.h>
+#include <string.h>
+
+#include "error.h"
+#include "transport_message_pool.h"
+
+/**
+ * @defgroup LunaServiceTransportMessagePool
+ * @ingroup LunaServiceTransport
+ * @brief Per-thread cache of message structs and size-classed raw buffers
+ */
+
+/**
+ * @addtogroup LunaServiceTransportMessagePool
+ * @{
+ */
+
+#define LS_TRANSPORT_POOL_MAX_MESSAGES  256     /**< max cached message structs per thread */
+
+/** Size of the raw buffers (header included) in each class */
+static const unsigned long pool_class_size[LS_TRANSPORT_POOL_NUM_CLASSES] =
+{
+    64, 256, 1024, 4 * 1024, 16 * 1024
+};
+
+/** Max cached raw buffers per thread in each class */
+static const unsigned int pool_class_max[LS_TRANSPORT_POOL_NUM_CLASSES] =
+{
+    128, 64, 32, 16, 8
+};
+
+/** Free list link; stored in the first bytes of a cached item */
+typedef struct LSTransportPoolItem {
+    struct LSTransportPoolItem *next;
+} _LSTransportPoolItem;
+
+typedef struct LSTransportMessagePool {
+    _LSTransportPoolItem *messages;                             /**< cached message structs */
+    unsigned int num_messages;
+    _LSTransportPoolItem *raw[LS_TRANSPORT_POOL_NUM_CLASSES];   /**< cached raw buffers per class */
+    unsigned int num_raw[LS_TRANSPORT_POOL_NUM_CLASSES];
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long bytes_retained;
+    struct LSTransportMessagePool *next;                        /**< list of all pools, for statistics */
+} _LSTransportMessagePool;
+
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+
+/* protects the following */
+static pthread_mutex_t pool_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static _LSTransportMessagePool *pool_list = NULL;
+static unsigned long pool_retired_hits = 0;     /**< hits of pools of threads that have exited */
+static unsigned long pool_retired_misses = 0;   /**< misses of pools of threads that have exited */
+
+/**
+ *******************************************************************************
+ * @brief Release a thread's pool and everything cached in it. Called when the
+ * thread exits.
+ *
+ * @param  data     IN  pool
+ *******************************************************************************
+ */
+static void
+_LSTransportMessagePoolDestroy(void *data)
+{
+    _LSTransportMessagePool *pool = data;
+    _LSTransportMessagePool **iter;
+    int i;
+
+    pthread_mutex_lock(&pool_list_lock);
+    for (iter = &pool_list; *iter; iter = &(*iter)->next)
+    {
+        if (*iter == pool)
+        {
+            *iter = pool->next;
+            break;
+        }
+    }
+    pool_retired_hits += pool->hits;
+    pool_retired_misses += pool->misses;
+    pthread_mutex_unlock(&pool_list_lock);
+
+    while (pool->messages)
+    {
+        _LSTransportPoolItem *item = pool->messages;
+        pool->messages = item->next;
+        g_slice_free1(sizeof(_LSTransportMessage), item);
+    }
+
+    for (i = 0; i < LS_TRANSPORT_POOL_NUM_CLASSES; i++)
+    {
+        while (pool->raw[i])
+        {
+            _LSTransportPoolItem *item = pool->raw[i];
+            pool->raw[i] = item->next;
+            g_free(item);
+        }
+    }
+
+    g_free(pool);
+}
+
+static void
+_LSTransportMessagePoolKeyCreate(void)
+{
+    if (pthread_key_create(&pool_key, _LSTransportMessagePoolDestroy))
+    {
+        LOG_LS_CRITICAL(MSGID_LS_OOM_ERR, 0, "Could not create message pool key");
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the calling thread's pool, creating it on first use.
+ *
+ * @retval  pool
+ *******************************************************************************
+ */
+static _LSTransportMessagePool*
+_LSTransportMessagePoolGet(void)
+{
+    pthread_once(&pool_key_once, _LSTransportMessagePoolKeyCreate);
+
+    _LSTransportMessagePool *pool = pthread_getspecific(pool_key);
+
+    if (G_UNLIKELY(!pool))
+    {
+        pool = g_new0(_LSTransportMessagePool, 1);
+        pthread_setspecific(pool_key, pool);
+
+        pthread_mutex_lock(&pool_list_lock);
+        pool->next = pool_list;
+        pool_list = pool;
+        pthread_mutex_unlock(&pool_list_lock);
+    }
+
+    return pool;
+}
+
+/**
+ *******************************************************************************
+ * @brief Find the smallest class that fits a raw message.
+ *
+ * @param  body_size    IN  size of the message body
+ *
+ * @retval  class (1-based)
+ * @retval  LS_TRANSPORT_POOL_CLASS_NONE if it's too big for the pool
+ *******************************************************************************
+ */
+static int
+_LSTransportMessagePoolFindClass(unsigned long body_size)
+{
+    unsigned long size = sizeof(_LSTransportMessageRaw) + body_size;
+    int i;
+
+    for (i = 0; i < LS_TRANSPORT_POOL_NUM_CLASSES; i++)
+    {
+        if (size <= pool_class_size[i])
+        {
+            return i + 1;
+        }
+    }
+
+    return LS_TRANSPORT_POOL_CLASS_NONE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the size of the raw buffers in a class.
+ *
+ * @param  pool_class   IN  class
+ *
+ * @retval  size in bytes (header included)
+ * @retval  0 for LS_TRANSPORT_POOL_CLASS_NONE
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportMessagePoolGetClassSize(int pool_class)
+{
+    if (pool_class == LS_TRANSPORT_POOL_CLASS_NONE)
+    {
+        return 0;
+    }
+
+    LS_ASSERT(pool_class > 0 && pool_class <= LS_TRANSPORT_POOL_NUM_CLASSES);
+
+    return pool_class_size[pool_class - 1];
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the largest message body that fits in the raw buffers of a class.
+ *
+ * @param  pool_class   IN  class
+ *
+ * @retval  size in bytes
+ * @retval  0 for LS_TRANSPORT_POOL_CLASS_NONE
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportMessagePoolGetClassBodySize(int pool_class)
+{
+    if (pool_class == LS_TRANSPORT_POOL_CLASS_NONE)
+    {
+        return 0;
+    }
+
+    return _LSTransportMessagePoolGetClassSize(pool_class) - sizeof(_LSTransportMessageRaw);
+}
+
+/**
+ *******************************************************************************
+ * @brief Allocate a zeroed message struct.
+ *
+ * @retval  message
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportMessagePoolAllocMessage(void)
+{
+    _LSTransportMessagePool *pool = _LSTransportMessagePoolGet();
+
+    if (pool->messages)
+    {
+        _LSTransportPoolItem *item = pool->messages;
+        pool->messages = item->next;
+        pool->num_messages--;
+        pool->bytes_retained -= sizeof(_LSTransportMessage);
+        pool->hits++;
+
+        memset(item, 0, sizeof(_LSTransportMessage));
+        return (_LSTransportMessage*)item;
+    }
+
+    pool->misses++;
+    return g_slice_new0(_LSTransportMessage);
+}
+
+/**
+ *******************************************************************************
+ * @brief Return a message struct to the pool.
+ *
+ * @param  message  IN  message (raw message already released)
+ *******************************************************************************
+ */
+void
+_LSTransportMessagePoolFreeMessage(_LSTransportMessage *message)
+{
+#ifndef LS_NO_MESSAGE_POOL
+    _LSTransportMessagePool *pool = _LSTransportMessagePoolGet();
+
+    if (pool->num_messages < LS_TRANSPORT_POOL_MAX_MESSAGES)
+    {
+        _LSTransportPoolItem *item = (_LSTransportPoolItem*)message;
+        item->next = pool->messages;
+        pool->messages = item;
+        pool->num_messages++;
+        pool->bytes_retained += sizeof(_LSTransportMessage);
+        return;
+    }
+#endif
+
+    g_slice_free(_LSTransportMessage, message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Allocate a raw message with room for at least @ref body_size bytes
+ * of body.
+ *
+ * @param  body_size    IN   size of the body
+ * @param  pool_class   OUT  class of the buffer; pass it back to
+ *                           _LSTransportMessagePoolFreeRaw()
+ *
+ * @retval  raw message (uninitialized)
+ *******************************************************************************
+ */
+_LSTransportMessageRaw*
+_LSTransportMessagePoolAllocRaw(unsigned long body_size, int *pool_class)
+{
+    _LSTransportMessagePool *pool = _LSTransportMessagePoolGet();
+
+    *pool_class = _LSTransportMessagePoolFindClass(body_size);
+
+    if (*pool_class == LS_TRANSPORT_POOL_CLASS_NONE)
+    {
+        pool->misses++;
+        return g_malloc(sizeof(_LSTransportMessageRaw) + body_size);
+    }
+
+    int i = *pool_class - 1;
+
+    if (pool->raw[i])
+    {
+        _LSTransportPoolItem *item = pool->raw[i];
+        pool->raw[i] = item->next;
+        pool->num_raw[i]--;
+        pool->bytes_retained -= pool_class_size[i];
+        pool->hits++;
+        return (_LSTransportMessageRaw*)item;
+    }
+
+    pool->misses++;
+    return g_malloc(pool_class_size[i]);
+}
+
+/**
+ *******************************************************************************
+ * @brief Move a raw message into a buffer with room for at least
+ * @ref new_body_size bytes of body. The header and the first @ref body_size
+ * bytes of the body are preserved.
+ *
+ * @param  raw              IN      raw message
+ * @param  body_size        IN      bytes of body in use
+ * @param  new_body_size    IN      size needed
+ * @param  pool_class       IN/OUT  class of @ref raw; set to the class of the
+ *                                  returned buffer
+ *
+ * @retval  raw message on success (may have been moved)
+ * @retval  NULL on failure (@ref raw is left untouched)
+ *******************************************************************************
+ */
+_LSTransportMessageRaw*
+_LSTransportMessagePoolReallocRaw(_LSTransportMessageRaw *raw, unsigned long body_size,
+                                  unsigned long new_body_size, int *pool_class)
+{
+    if (new_body_size <= _LSTransportMessagePoolGetClassBodySize(*pool_class))
+    {
+        return raw;
+    }
+
+    int new_class = _LSTransportMessagePoolFindClass(new_body_size);
+
+    if (*pool_class == LS_TRANSPORT_POOL_CLASS_NONE && new_class == LS_TRANSPORT_POOL_CLASS_NONE)
+    {
+        return g_try_realloc(raw, sizeof(_LSTransportMessageRaw) + new_body_size);
+    }
+
+    _LSTransportMessageRaw *new_raw = _LSTransportMessagePoolAllocRaw(new_body_size, &new_class);
+
+    memcpy(new_raw, raw, sizeof(_LSTransportMessageRaw) + body_size);
+    _LSTransportMessagePoolFreeRaw(raw, *pool_class);
+    *pool_class = new_class;
+
+    return new_raw;
+}
+
+/**
+ *******************************************************************************
+ * @brief Release a raw message.
+ *
+ * @param  raw          IN  raw message
+ * @param  pool_class   IN  class it was allocated with
+ *******************************************************************************
+ */
+void
+_LSTransportMessagePoolFreeRaw(_LSTransportMessageRaw *raw, int pool_class)
+{
+#ifndef LS_NO_MESSAGE_POOL
+    if (pool_class != LS_TRANSPORT_POOL_CLASS_NONE)
+    {
+        _LSTransportMessagePool *pool = _LSTransportMessagePoolGet();
+        int i = pool_class - 1;
+
+        if (pool->num_raw[i] < pool_class_max[i])
+        {
+            _LSTransportPoolItem *item = (_LSTransportPoolItem*)raw;
+            item->next = pool->raw[i];
+            pool->raw[i] = item;
+            pool->num_raw[i]++;
+            pool->bytes_retained += pool_class_size[i];
+            return;
+        }
+    }
+#endif
+
+    g_free(raw);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the statistics of the pools of all threads.
+ *
+ * @param  stats    OUT statistics
+ *******************************************************************************
+ */
+void
+_LSTransportMessagePoolGetStats(_LSTransportMessagePoolStats *stats)
+{
+    _LSTransportMessagePool *pool;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    /* The counters of other threads' pools are read without their owners
+     * stopping, so the result is only approximate */
+    pthread_mutex_lock(&pool_list_lock);
+    stats->hits = pool_retired_hits;
+    stats->misses = pool_retired_misses;
+    for (pool = pool_list; pool; pool = pool->next)
+    {
+        stats->hits += pool->hits;
+        stats->misses += pool->misses;
+        stats->bytes_retained += pool->bytes_retained;
+        stats->messages_retained += pool->num_messages;
+        for (i = 0; i < LS_TRANSPORT_POOL_NUM_CLASSES; i++)
+        {
+            stats->raw_retained[i] += pool->num_raw[i];
+        }
+    }
+    pthread_mutex_unlock(&pool_list_lock);
+}
+
+/* @} END OF LunaServiceTransportMessagePool */
@@ -0,0 +1,59 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_MESSAGE_POOL_H_
+#define _TRANSPORT_MESSAGE_POOL_H_
+
+#include "transport_message.h"
+
+/**
+ * @addtogroup LunaServiceTransportMessagePool
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_POOL_CLASS_NONE    0   /**< raw buffer isn't from the pool */
+#define LS_TRANSPORT_POOL_NUM_CLASSES   5   /**< 64B, 256B, 1KB, 4KB and 16KB raw buffers */
+
+/**
+ * Pool statistics summed over all threads.
+ */
+typedef struct LSTransportMessagePoolStats {
+    unsigned long hits;                 /**< allocations served from the pool */
+    unsigned long misses;               /**< allocations that went to the allocator */
+    unsigned long bytes_retained;       /**< memory currently held by the pool */
+    unsigned long messages_retained;    /**< message structs currently held by the pool */
+    unsigned long raw_retained[LS_TRANSPORT_POOL_NUM_CLASSES];  /**< raw buffers held per size class */
+} _LSTransportMessagePoolStats;
+
+_LSTransportMessage* _LSTransportMessagePoolAllocMessage(void);
+void _LSTransportMessagePoolFreeMessage(_LSTransportMessage *message);
+
+_LSTransportMessageRaw* _LSTransportMessagePoolAllocRaw(unsigned long body_size, int *pool_class);
+_LSTransportMessageRaw* _LSTransportMessagePoolReallocRaw(_LSTransportMessageRaw *raw, unsigned long body_size,
+                                                          unsigned long new_body_size, int *pool_class);
+void _LSTransportMessagePoolFreeRaw(_LSTransportMessageRaw *raw, int pool_class);
+unsigned long _LSTransportMessagePoolGetClassBodySize(int pool_class);
+unsigned long _LSTransportMessagePoolGetClassSize(int pool_class);
+
+void _LSTransportMessagePoolGetStats(_LSTransportMessagePoolStats *stats);
+
+/** @} LunaServiceTransportMessagePool */
+
+#endif      // _TRANSPORT_MESSAGE_POOL_H_
@@ -0,0 +1,236 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <string.h>
+
+#include "error.h"
+#include "transport_monitor_filter.h"
+
+/**
+ * @defgroup LunaServiceTransportMonitorFilter
+ * @ingroup LunaServiceTransport
+ * @brief Filtering of monitor copies in the clients that make them
+ */
+
+/**
+ * @addtogroup LunaServiceTransportMonitorFilter
+ * @{
+ */
+
+/**
+ *******************************************************************************
+ * @brief Create a monitor filter.
+ *
+ * @param  name             IN  part of a service or unique name, or NULL
+ * @param  method           IN  glob for "category/method", or NULL
+ * @param  types            IN  mask of LS_TRANSPORT_MONITOR_FILTER_* values; 0 for all
+ * @param  min_payload_size IN  smallest payload to copy
+ *
+ * @retval filter
+ *******************************************************************************
+ */
+_LSTransportMonitorFilter*
+_LSTransportMonitorFilterNew(const char *name, const char *method, int32_t types, int32_t min_payload_size)
+{
+    _LSTransportMonitorFilter *filter = g_slice_new0(_LSTransportMonitorFilter);
+
+    /* empty strings come from monitors that have no such filter */
+    if (name && name[0])
+    {
+        filter->name = g_strdup(name);
+    }
+
+    if (method && method[0])
+    {
+        filter->method = g_strdup(method);
+        filter->method_pattern = g_pattern_spec_new(method);
+    }
+
+    filter->types = types;
+    filter->min_payload_size = min_payload_size;
+
+    return filter;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a monitor filter.
+ *
+ * @param  filter   IN  filter
+ *******************************************************************************
+ */
+void
+_LSTransportMonitorFilterFree(_LSTransportMonitorFilter *filter)
+{
+    LS_ASSERT(filter != NULL);
+
+    if (filter->method_pattern)
+    {
+        g_pattern_spec_free(filter->method_pattern);
+    }
+    g_free(filter->name);
+    g_free(filter->method);
+
+    g_slice_free(_LSTransportMonitorFilter, filter);
+}
+
+/**
+ *******************************************************************************
+ * @brief Append the arguments of a filter to a message.
+ *
+ * @param  filter   IN  filter, or NULL to match everything
+ * @param  iter     IN  iterator at the end of the message
+ *
+ * @retval true on success
+ * @retval false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportMonitorFilterAppend(const _LSTransportMonitorFilter *filter, _LSTransportMessageIter *iter)
+{
+    if (!_LSTransportMessageAppendString(iter, filter ? filter->name : NULL)) return false;
+    if (!_LSTransportMessageAppendString(iter, filter ? filter->method : NULL)) return false;
+    if (!_LSTransportMessageAppendInt32(iter, filter ? filter->types : 0)) return false;
+    if (!_LSTransportMessageAppendInt32(iter, filter ? filter->min_payload_size : 0)) return false;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Read the arguments of a filter from a message.
+ *
+ * Older monitors and hubs end the message before the filter, which matches
+ * everything.
+ *
+ * @param  iter     IN  iterator at the first argument of the filter
+ *
+ * @retval filter
+ * @retval NULL if the filter matches everything
+ *******************************************************************************
+ */
+_LSTransportMonitorFilter*
+_LSTransportMonitorFilterRead(_LSTransportMessageIter *iter)
+{
+    const char *name = NULL;
+    const char *method = NULL;
+    int32_t types = 0;
+    int32_t min_payload_size = 0;
+
+    _LSTransportMessageGetString(iter, &name);
+    _LSTransportMessageIterNext(iter);
+    _LSTransportMessageGetString(iter, &method);
+    _LSTransportMessageIterNext(iter);
+    _LSTransportMessageGetInt32(iter, &types);
+    _LSTransportMessageIterNext(iter);
+    _LSTransportMessageGetInt32(iter, &min_payload_size);
+
+    if (!(name && name[0]) && !(method && method[0]) && types == 0 && min_payload_size <= 0)
+    {
+        return NULL;
+    }
+
+    return _LSTransportMonitorFilterNew(name, method, types, min_payload_size);
+}
+
+static int32_t
+_LSTransportMonitorFilterGetType(_LSTransportMessageType type)
+{
+    switch (type)
+    {
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
+        return LS_TRANSPORT_MONITOR_FILTER_CALL;
+    case _LSTransportMessageTypeSignal:
+        return LS_TRANSPORT_MONITOR_FILTER_SIGNAL;
+    case _LSTransportMessageTypeCancelMethodCall:
+        return LS_TRANSPORT_MONITOR_FILTER_CANCEL;
+    default:
+        return LS_TRANSPORT_MONITOR_FILTER_REPLY;
+    }
+}
+
+static bool
+_LSTransportMonitorFilterMatchName(const char *filter_name, const char *name)
+{
+    return name && strstr(name, filter_name);
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether the monitor wants to see a message.
+ *
+ * The method glob only applies to messages that carry a category and
+ * method, so replies get through it.
+ *
+ * @param  filter               IN  filter, or NULL to match everything
+ * @param  type                 IN  message type
+ * @param  category             IN  category, or NULL if the message has none
+ * @param  method               IN  method, or NULL if the message has none
+ * @param  service_name         IN  service name of one side of the message
+ * @param  unique_name          IN  unique name of that side
+ * @param  peer_service_name    IN  service name of the other side
+ * @param  peer_unique_name     IN  unique name of the other side
+ * @param  payload_len          IN  size of the plain payload
+ *
+ * @retval true if the message matches
+ * @retval false otherwise
+ *******************************************************************************
+ */
+bool
+_LSTransportMonitorFilterMatch(const _LSTransportMonitorFilter *filter, _LSTransportMessageType type,
+                               const char *category, const char *method,
+                               const char *service_name, const char *unique_name,
+                               const char *peer_service_name, const char *peer_unique_name,
+                               unsigned long payload_len)
+{
+    if (!filter) return true;
+
+    if (filter->types && !(filter->types & _LSTransportMonitorFilterGetType(type)))
+    {
+        return false;
+    }
+
+    if (filter->min_payload_size > 0 && payload_len < (unsigned long)filter->min_payload_size)
+    {
+        return false;
+    }
+
+    if (filter->name &&
+        !_LSTransportMonitorFilterMatchName(filter->name, service_name) &&
+        !_LSTransportMonitorFilterMatchName(filter->name, unique_name) &&
+        !_LSTransportMonitorFilterMatchName(filter->name, peer_service_name) &&
+        !_LSTransportMonitorFilterMatchName(filter->name, peer_unique_name))
+    {
+        return false;
+    }
+
+    if (filter->method_pattern && category && method)
+    {
+        char *category_method = g_strconcat(category, "/", method, NULL);
+        bool match = g_pattern_match_string(filter->method_pattern, category_method);
+        g_free(category_method);
+
+        if (!match) return false;
+    }
+
+    return true;
+}
+
+/** @} LunaServiceTransportMonitorFilter */
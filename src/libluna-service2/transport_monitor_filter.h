@@ -0,0 +1,72 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_MONITOR_FILTER_H_
+#define _TRANSPORT_MONITOR_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+#include "transport_message.h"
+
+/**
+ * @addtogroup LunaServiceTransportMonitorFilter
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_MONITOR_FILTER_CALL        (1 << 0)    /**< method calls, with or without a reply */
+#define LS_TRANSPORT_MONITOR_FILTER_SIGNAL      (1 << 1)
+#define LS_TRANSPORT_MONITOR_FILTER_REPLY       (1 << 2)
+#define LS_TRANSPORT_MONITOR_FILTER_CANCEL      (1 << 3)
+
+/**
+ * Filter of the monitor, which the hub hands to every client in the
+ * "MonitorConnected" message so that clients only copy the messages the
+ * monitor is going to show.
+ *
+ * Unset fields match everything.
+ */
+struct LSTransportMonitorFilter {
+    char *name;                     /**< part of a service or unique name on either side of the message */
+    char *method;                   /**< glob for "category/method" of messages that have one */
+    GPatternSpec *method_pattern;   /**< @ref method, compiled */
+    int32_t types;                  /**< mask of LS_TRANSPORT_MONITOR_FILTER_* values; 0 for all */
+    int32_t min_payload_size;       /**< smallest payload to copy */
+};
+
+typedef struct LSTransportMonitorFilter _LSTransportMonitorFilter;
+
+_LSTransportMonitorFilter* _LSTransportMonitorFilterNew(const char *name, const char *method,
+                                                        int32_t types, int32_t min_payload_size);
+void _LSTransportMonitorFilterFree(_LSTransportMonitorFilter *filter);
+
+bool _LSTransportMonitorFilterAppend(const _LSTransportMonitorFilter *filter, _LSTransportMessageIter *iter);
+_LSTransportMonitorFilter* _LSTransportMonitorFilterRead(_LSTransportMessageIter *iter);
+
+bool _LSTransportMonitorFilterMatch(const _LSTransportMonitorFilter *filter, _LSTransportMessageType type,
+                                    const char *category, const char *method,
+                                    const char *service_name, const char *unique_name,
+                                    const char *peer_service_name, const char *peer_unique_name,
+                                    unsigned long payload_len);
+
+/** @} LunaServiceTransportMonitorFilter */
+
+#endif      // _TRANSPORT_MONITOR_FILTER_H_
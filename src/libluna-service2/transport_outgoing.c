@@ -101,4 +101,207 @@ _LSTransportOutgoingFree(_LSTransportOutgoing *outgoing)
     g_slice_free(_LSTransportOutgoing, outgoing);
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the number of bytes a queued message accounts for.
+ *
+ * This doesn't depend on the header the message goes out with, so that it
+ * stays the same when the protocol version changes while it is queued.
+ *
+ * @param  message  IN  message
+ *
+ * @retval size of the message including its header
+ *******************************************************************************
+ */
+static inline unsigned long
+_LSTransportOutgoingMessageSize(const _LSTransportMessage *message)
+{
+    return message ? message->raw->header.len + sizeof(_LSTransportHeader) : 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Put a message on the queue. The queue takes over the caller's ref.
+ *
+ * @attention the caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  message      IN  message
+ * @param  prepend      IN  true to put the message at the head of the queue,
+ *                          behind the messages that are being sent
+ *******************************************************************************
+ */
+void
+_LSTransportOutgoingPush(_LSTransportOutgoing *outgoing, _LSTransportMessage *message, bool prepend)
+{
+    if (prepend)
+    {
+        g_queue_push_nth(outgoing->queue, message, outgoing->tx_in_flight);
+    }
+    else
+    {
+        g_queue_push_tail(outgoing->queue, message);
+    }
+
+    outgoing->queue_bytes += _LSTransportOutgoingMessageSize(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Take the message at the head of the queue. The caller gets the
+ * queue's ref.
+ *
+ * @attention the caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ *
+ * @retval message on success
+ * @retval NULL if the queue is empty
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportOutgoingPop(_LSTransportOutgoing *outgoing)
+{
+    _LSTransportMessage *message = g_queue_pop_head(outgoing->queue);
+
+    outgoing->queue_bytes -= _LSTransportOutgoingMessageSize(message);
+
+    if (outgoing->tx_in_flight > 0)
+    {
+        outgoing->tx_in_flight--;
+    }
+
+    return message;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether the queue is at or above either high watermark.
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  limits       IN  watermarks
+ *
+ * @retval true if at or above a high watermark
+ * @retval false otherwise
+ *******************************************************************************
+ */
+bool
+_LSTransportOutgoingIsAboveHigh(const _LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits)
+{
+    return (limits->high_bytes && outgoing->queue_bytes >= limits->high_bytes) ||
+           (limits->high_messages && g_queue_get_length(outgoing->queue) >= limits->high_messages);
+}
+
+/**
+ *******************************************************************************
+ * @brief Update the watermark state of the queue.
+ *
+ * The queue stays above the high watermark until it has drained to the low
+ * watermarks of all enabled limits.
+ *
+ * @attention the caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  limits       IN  watermarks
+ *
+ * @retval watermark that was crossed, if any
+ *******************************************************************************
+ */
+_LSTransportOutgoingWatermark
+_LSTransportOutgoingCheckWatermarks(_LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits)
+{
+    if (!outgoing->above_high_watermark)
+    {
+        if (_LSTransportOutgoingIsAboveHigh(outgoing, limits))
+        {
+            outgoing->above_high_watermark = true;
+            return _LSTransportOutgoingWatermarkHigh;
+        }
+    }
+    else
+    {
+        bool bytes_drained = !limits->high_bytes ||
+                             outgoing->queue_bytes <= limits->low_bytes;
+        bool messages_drained = !limits->high_messages ||
+                                g_queue_get_length(outgoing->queue) <= limits->low_messages;
+
+        if (bytes_drained && messages_drained)
+        {
+            outgoing->above_high_watermark = false;
+            return _LSTransportOutgoingWatermarkLow;
+        }
+    }
+
+    return _LSTransportOutgoingWatermarkNone;
+}
+
+/**
+ *******************************************************************************
+ * @brief Drop the oldest queued subscription update.
+ *
+ * Only replies that follow an earlier reply to the same call are dropped, so
+ * a subscriber always gets the initial reply and, once it catches up, the
+ * latest state. A message that is partially sent, or being sent by the I/O
+ * engine, is never dropped.
+ *
+ * @attention the caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ *
+ * @retval true if a message was dropped
+ * @retval false if there was nothing to drop
+ *******************************************************************************
+ */
+bool
+_LSTransportOutgoingDropOldestUpdate(_LSTransportOutgoing *outgoing)
+{
+    GList *iter;
+    unsigned int pos = 0;
+
+    for (iter = outgoing->queue->head; iter != NULL; iter = iter->next, pos++)
+    {
+        _LSTransportMessage *message = iter->data;
+
+        if (pos < outgoing->tx_in_flight)
+        {
+            continue;
+        }
+
+        if (!message || !message->is_update ||
+            message->tx_bytes_remaining != _LSTransportMessageGetTxSize(message))
+        {
+            continue;
+        }
+
+        /* a payload that was moved out of line goes together with its fd */
+        _LSTransportMessage *fd_message = iter->prev ? iter->prev->data : NULL;
+
+        if (fd_message && _LSTransportMessageGetType(fd_message) != _LSTransportMessageTypePayloadFd)
+        {
+            fd_message = NULL;
+        }
+
+        if (fd_message && (pos - 1 < outgoing->tx_in_flight ||
+                           fd_message->tx_bytes_remaining != _LSTransportMessageGetTxSize(fd_message)))
+        {
+            continue;
+        }
+
+        if (fd_message)
+        {
+            g_queue_delete_link(outgoing->queue, iter->prev);
+            outgoing->queue_bytes -= _LSTransportOutgoingMessageSize(fd_message);
+            _LSTransportMessageUnref(fd_message);
+        }
+
+        g_queue_delete_link(outgoing->queue, iter);
+        outgoing->queue_bytes -= _LSTransportOutgoingMessageSize(message);
+        outgoing->dropped++;
+        _LSTransportMessageUnref(message);
+        return true;
+    }
+
+    return false;
+}
+
 /* @} END OF LunaServiceTransportOutgoing */
@@ -21,13 +21,50 @@
 #define _TRANSPORT_OUTGOING_H_
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <glib.h>
+#include <luna-service2/lunaservice.h>
 #include "transport_serial.h"
 
+#define LS_TRANSPORT_OUTGOING_BLOCK_POLL_MS  100   /**< poll interval while a sender is blocked by LSOutgoingPolicyBlock */
+#define LS_TRANSPORT_OUTGOING_BLOCK_TIMEOUT_MS  5000  /**< longest a sender is blocked by LSOutgoingPolicyBlock */
+
+/**
+ * Watermarks for the outgoing queue of each client. A zero high watermark
+ * disables that limit.
+ */
+typedef struct LSTransportOutgoingLimits {
+    unsigned long high_bytes;       /**< bytes queued to cross the high watermark */
+    unsigned long low_bytes;        /**< bytes queued to drop back below it */
+    unsigned int high_messages;     /**< messages queued to cross the high watermark */
+    unsigned int low_messages;      /**< messages queued to drop back below it */
+    LSOutgoingPolicy policy;        /**< what to do above the high watermark */
+} _LSTransportOutgoingLimits;
+
+typedef enum {
+    _LSTransportOutgoingWatermarkNone,  /**< no change */
+    _LSTransportOutgoingWatermarkHigh,  /**< queue crossed the high watermark */
+    _LSTransportOutgoingWatermarkLow,   /**< queue drained to the low watermark */
+} _LSTransportOutgoingWatermark;
+
+/**
+ * Snapshot of the state of an outgoing queue.
+ */
+typedef struct LSTransportOutgoingStats {
+    unsigned int messages;          /**< messages queued */
+    unsigned long bytes;            /**< bytes queued */
+    bool above_high_watermark;      /**< crossed the high watermark and hasn't drained yet */
+    unsigned long dropped;          /**< updates dropped so far */
+} _LSTransportOutgoingStats;
+
 struct LSTransportOutgoing {
     pthread_mutex_t lock;           /**< protects queue */
     GQueue *queue;                  /**< queue of LSTransportMessages that need to be sent */
     _LSTransportSerial *serial;     /**< keeps track of clean shutdown state */
+    unsigned long queue_bytes;      /**< size of the messages in @ref queue */
+    bool above_high_watermark;      /**< crossed the high watermark and hasn't drained to the low one yet */
+    unsigned long dropped;          /**< updates dropped by @ref LSOutgoingPolicyDropOldestUpdate */
+    unsigned int tx_in_flight;      /**< messages at the head of @ref queue that the I/O engine is sending */
 };
 
 typedef struct LSTransportOutgoing _LSTransportOutgoing;
@@ -35,4 +72,10 @@ typedef struct LSTransportOutgoing _LSTransportOutgoing;
 _LSTransportOutgoing* _LSTransportOutgoingNew(void);
 void _LSTransportOutgoingFree(_LSTransportOutgoing *outgoing);
 
+void _LSTransportOutgoingPush(_LSTransportOutgoing *outgoing, _LSTransportMessage *message, bool prepend);
+_LSTransportMessage* _LSTransportOutgoingPop(_LSTransportOutgoing *outgoing);
+bool _LSTransportOutgoingIsAboveHigh(const _LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits);
+_LSTransportOutgoingWatermark _LSTransportOutgoingCheckWatermarks(_LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits);
+bool _LSTransportOutgoingDropOldestUpdate(_LSTransportOutgoing *outgoing);
+
 #endif      // _TRANSPORT_OUTGOING_H_
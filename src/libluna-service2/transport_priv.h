@@ -30,8 +30,13 @@
 #include "transport_outgoing.h"
 #include "transport_incoming.h"
 #include "transport_channel.h"
+#include "transport_epoll.h"
+#include "transport_uring.h"
+#include "transport_submit.h"
 #include "transport_signal.h"
 #include "transport_shm.h"
+#include "transport_compress.h"
+#include "transport_trace.h"
 
 /**
  * "Global" in this case means that the token is unique for this transport to
@@ -47,8 +52,7 @@
  * Example serial numbers used for com.palm.bar2: 3, 4
  */
 typedef struct LSTransportGlobalToken {
-    pthread_mutex_t lock;
-    LSMessageToken value;
+    LSMessageToken value;       /**< last token handed out; only changed atomically */
 } _LSTransportGlobalToken;
 
 struct LSTransport {
@@ -56,11 +60,21 @@ struct LSTransport {
     char                *service_name;        /*<< pretty name (e.g., com.palm.foo), NULL if there is no service name (e.g., anonymous client */
     char                *unique_name;         /*<< unique name (e.g., local socket address) */
     GMainContext        *mainloop_context;   /*<< glib mainloop context -- ref'd when added, so make sure to deref when done */
+    pthread_t           loop_thread;        /*<< thread that attached @ref mainloop_context and runs it */
 
     int                  source_priority;    /*<< io watch priority (for glib mainloop) */
 
     _LSTransportChannel  listen_channel;     /*<< accept incoming connections */
 
+    bool                 use_epoll;          /*<< watch channels with @ref epoll once attached to a main context */
+    _LSTransportEpoll    *epoll;             /*<< epoll event engine; NULL when channels have GIOChannel watches */
+
+    bool                 use_uring;          /*<< do the socket I/O through @ref uring once attached to a main context */
+    _LSTransportUring    *uring;             /*<< io_uring I/O engine; NULL when sockets are read and written directly */
+
+    _LSTransportSubmit   *submit;            /*<< messages sent from other threads than the main loop thread */
+    _LSTransportSubmit   *loopback;          /*<< messages from clients linked to ours in the same process */
+
     _LSTransportShm      *shm;               /*<< shared memory for ordering of monitor messages */
 
     /* TODO: just copy the vtable passed in, instead of individual ones */
@@ -74,17 +88,38 @@ struct LSTransport {
     LSTransportMessageHandler msg_handler;          /**< callback to handle incoming messages */
     void *msg_context;                              /**< private context passed to message handling callback */
 
+    LSTransportOutgoingWatermarkHandler outgoing_watermark_handler; /**< callback to handle when an outgoing queue crosses a watermark */
+    void *outgoing_watermark_context;
+
     _LSTransportClient      *hub;           /*<< client info for hub; should always be valid after connecting */
     _LSTransportClient      *monitor;       /*<< client info for monitor; NULL when there is no monitor */
+    bool                    monitor_trace;  /*<< the monitor reads our trace ring instead of getting message copies */
+    _LSTransportTrace       *trace;         /*<< trace ring; created for the first monitor in trace mode, NULL until then */
+    _LSTransportMonitorFilter *monitor_filter;  /*<< messages the monitor wants to see; NULL for all.
+                                                     Read without a lock by any thread */
+    GSList                  *monitor_filters_retired;   /*<< filters replaced on the main loop; kept until
+                                                             the transport goes away since readers may still hold them */
+
+    struct timespec         flush_deadline; /*<< when the shutdown flush stops waiting for room in rings */
 
     _LSTransportGlobalToken *global_token;  /*<< global token that provides unique identity for messages sent by this transport */
 
     pthread_mutex_t         lock;               /*<< lock for clients, all_connections, pending */
     GHashTable              *clients;           /*<< hash of _LSTransportClients by *service* name */
+    pthread_rwlock_t        clients_lock;       /*<< lets senders look up clients without taking the transport lock;
+                                                     write locked (in addition to the transport lock) to change clients */
     GHashTable              *all_connections;   /*<< hash of fd to _LSTransportClient */
     GHashTable              *pending;           /*<< hash of _LSTransportOutgoing by service name */
 
     bool                    privileged;         /*<< true if we are a privileged service */
+
+    unsigned long           payload_fd_threshold;   /*<< payloads of at least this size are sent in a memfd; 0 disables */
+    unsigned long           ring_size;              /*<< size of the shared memory rings offered to peers; 0 disables */
+    unsigned long           compress_threshold;     /*<< payloads of at least this size are compressed for peers that
+                                                         support it; set by the hub, 0 disables */
+
+    _LSTransportOutgoingLimits outgoing_limits;     /*<< watermarks for the outgoing queue of each client */
+    _LSTransportIncomingBudget incoming_budget;     /*<< how much is read from a client per wakeup */
 };
 
 #endif      // _TRANSPORT_PRIV_H_
@@ -0,0 +1,644 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "clock.h"
+#include "error.h"
+#include "transport_ring.h"
+
+/**
+ * @defgroup LunaServiceTransportRing
+ * @ingroup LunaServiceTransport
+ * @brief Shared memory rings between two connected peers
+ */
+
+/**
+ * @addtogroup LunaServiceTransportRing
+ * @{
+ */
+
+/* memfd and file sealing; older libc headers don't have these */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS         (1024 + 9)
+#define F_GET_SEALS         (1024 + 10)
+#define F_SEAL_SEAL         0x0001
+#define F_SEAL_SHRINK       0x0002
+#define F_SEAL_GROW         0x0004
+#endif
+
+/* The far side maps the rings for as long as the connection lasts, so their
+ * size must not change under it */
+#define LS_TRANSPORT_RING_SEALS     (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+#define LS_TRANSPORT_RING_CACHELINE     64
+
+/**
+ * Ring state in shared memory; the ring data follows it. Positions are free
+ * running and wrap around, so the fill level is always (tail - head).
+ */
+struct LSTransportRingHeader {
+    gint tail;                  /**< producer position; only written by the producer */
+    char pad0[LS_TRANSPORT_RING_CACHELINE - sizeof(gint)];
+    gint head;                  /**< consumer position; only written by the consumer */
+    gint writer_waiting;        /**< set by a producer that ran out of space */
+    char pad1[LS_TRANSPORT_RING_CACHELINE - 2 * sizeof(gint)];
+};
+
+static inline size_t
+_LSTransportRingRegionSize(unsigned long capacity)
+{
+    return sizeof(_LSTransportRingHeader) + capacity;
+}
+
+static inline void
+_LSTransportRingSignal(int event_fd)
+{
+    eventfd_write(event_fd, 1);
+}
+
+/**
+ *******************************************************************************
+ * @brief Turn a requested ring size into a valid one.
+ *
+ * @param  size     IN  requested size per direction in bytes
+ *
+ * @retval power of 2 between @ref LS_TRANSPORT_RING_MIN_SIZE and
+ * @ref LS_TRANSPORT_RING_MAX_SIZE
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportRingRoundCapacity(unsigned long size)
+{
+    unsigned long capacity = LS_TRANSPORT_RING_MIN_SIZE;
+
+    while (capacity < size && capacity < LS_TRANSPORT_RING_MAX_SIZE)
+    {
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
+
+/**
+ *******************************************************************************
+ * @brief Allocate a ring without any shared memory yet. This is what the far
+ * side starts with before it receives the fds with
+ * @ref _LSTransportRingSetFd.
+ *
+ * @retval ring
+ *******************************************************************************
+ */
+_LSTransportRing*
+_LSTransportRingNewEmpty(void)
+{
+    _LSTransportRing *ring = g_slice_new0(_LSTransportRing);
+    int i;
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        ring->fds[i] = -1;
+    }
+
+    ring->tx_event_fd = -1;
+    ring->rx_event_fd = -1;
+    ring->incoming = _LSTransportIncomingNew();
+
+    return ring;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a new pair of rings to offer to the far side.
+ *
+ * @param  capacity     IN  size of each ring (see @ref _LSTransportRingRoundCapacity)
+ *
+ * @retval ring on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+_LSTransportRing*
+_LSTransportRingNew(unsigned long capacity)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    LS_ASSERT(capacity == _LSTransportRingRoundCapacity(capacity));
+
+    _LSTransportRing *ring = _LSTransportRingNewEmpty();
+
+    ring->initiator = true;
+    ring->capacity = capacity;
+
+#ifdef SYS_memfd_create
+    ring->fds[_LSTransportRingFdShm] = syscall(SYS_memfd_create, "ls2-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+    if (ring->fds[_LSTransportRingFdShm] == -1 ||
+        ftruncate(ring->fds[_LSTransportRingFdShm], 2 * _LSTransportRingRegionSize(capacity)) != 0 ||
+        fcntl(ring->fds[_LSTransportRingFdShm], F_ADD_SEALS, LS_TRANSPORT_RING_SEALS) != 0)
+    {
+        _LSErrorSetFromErrno(&lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        goto error;
+    }
+
+    ring->fds[_LSTransportRingFdInitiatorEvent] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ring->fds[_LSTransportRingFdAcceptorEvent] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (ring->fds[_LSTransportRingFdInitiatorEvent] == -1 ||
+        ring->fds[_LSTransportRingFdAcceptorEvent] == -1)
+    {
+        _LSErrorSetFromErrno(&lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        goto error;
+    }
+
+    if (!_LSTransportRingMap(ring, &lserror))
+    {
+        goto error;
+    }
+
+    return ring;
+
+error:
+    LOG_LSERROR(MSGID_LS_SHARED_MEMORY_ERR, &lserror);
+    LSErrorFree(&lserror);
+    _LSTransportRingFree(ring);
+    return NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Store an fd received in a @ref _LSTransportMessageTypeRingSetup
+ * message.
+ *
+ * @param  ring     IN  ring created with @ref _LSTransportRingNewEmpty
+ * @param  setup    IN  setup message body
+ * @param  fd       IN  fd; the ring takes ownership even on failure
+ *
+ * @retval true on success
+ * @retval false if the setup is inconsistent
+ *******************************************************************************
+ */
+bool
+_LSTransportRingSetFd(_LSTransportRing *ring, const _LSTransportRingSetup *setup, int fd)
+{
+    LS_ASSERT(ring != NULL);
+    LS_ASSERT(!ring->initiator);
+
+    if (fd == -1 || setup->which < 0 || setup->which >= _LSTransportRingFdCount ||
+        ring->fds[setup->which] != -1 ||
+        setup->capacity != _LSTransportRingRoundCapacity(setup->capacity) ||
+        (ring->capacity && ring->capacity != setup->capacity))
+    {
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    ring->capacity = setup->capacity;
+    ring->fds[setup->which] = fd;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if all fds needed to map the rings are there.
+ *
+ * @param  ring     IN  ring
+ *
+ * @retval true if @ref _LSTransportRingMap can be called
+ *******************************************************************************
+ */
+bool
+_LSTransportRingIsComplete(const _LSTransportRing *ring)
+{
+    int i;
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        if (ring->fds[i] == -1) return false;
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Map the shared memory and pick the rings and eventfds for our side.
+ *
+ * @param  ring     IN  ring with all fds set
+ * @param  lserror  OUT set on error
+ *
+ * @retval true on success
+ * @retval false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportRingMap(_LSTransportRing *ring, LSError *lserror)
+{
+    LS_ASSERT(_LSTransportRingIsComplete(ring));
+    LS_ASSERT(ring->map == NULL);
+
+    size_t region_size = _LSTransportRingRegionSize(ring->capacity);
+    size_t map_size = 2 * region_size;
+    struct stat st;
+
+    int seals = fcntl(ring->fds[_LSTransportRingFdShm], F_GET_SEALS);
+    if (seals < 0 || (seals & LS_TRANSPORT_RING_SEALS) != LS_TRANSPORT_RING_SEALS)
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -1, "Ring shared memory is not sealed");
+        return false;
+    }
+
+    if (fstat(ring->fds[_LSTransportRingFdShm], &st) != 0)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        return false;
+    }
+
+    if ((size_t)st.st_size < map_size)
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -1, "Ring shared memory is too small: %ld bytes", (long)st.st_size);
+        return false;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fds[_LSTransportRingFdShm], 0);
+
+    if (map == MAP_FAILED)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        return false;
+    }
+
+    ring->map = map;
+    ring->map_size = map_size;
+
+    /* the first ring carries initiator -> acceptor data */
+    _LSTransportRingHeader *first = map;
+    _LSTransportRingHeader *second = (_LSTransportRingHeader*)((char*)map + region_size);
+
+    if (ring->initiator)
+    {
+        ring->tx = first;
+        ring->rx = second;
+        ring->tx_event_fd = ring->fds[_LSTransportRingFdAcceptorEvent];
+        ring->rx_event_fd = ring->fds[_LSTransportRingFdInitiatorEvent];
+    }
+    else
+    {
+        ring->tx = second;
+        ring->rx = first;
+        ring->tx_event_fd = ring->fds[_LSTransportRingFdInitiatorEvent];
+        ring->rx_event_fd = ring->fds[_LSTransportRingFdAcceptorEvent];
+    }
+
+    ring->tx_data = (char*)(ring->tx + 1);
+    ring->rx_data = (char*)(ring->rx + 1);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a ring.
+ *
+ * The main loop channel must not have any watches left at this point.
+ *
+ * @param  ring     IN  ring
+ *******************************************************************************
+ */
+void
+_LSTransportRingFree(_LSTransportRing *ring)
+{
+    LS_ASSERT(ring != NULL);
+
+    int i;
+
+    if (ring->channel.channel)
+    {
+        _LSTransportChannelDeinit(&ring->channel);
+    }
+
+    if (ring->map)
+    {
+        munmap(ring->map, ring->map_size);
+    }
+
+    for (i = 0; i < _LSTransportRingFdCount; i++)
+    {
+        if (ring->fds[i] != -1) close(ring->fds[i]);
+    }
+
+    /* the far side may have gone away in the middle of a message */
+    if (ring->incoming->tmp_msg)
+    {
+        _LSTransportMessageUnref(ring->incoming->tmp_msg);
+        ring->incoming->tmp_msg = NULL;
+    }
+    _LSTransportIncomingFree(ring->incoming);
+
+#ifdef MEMCHECK
+    memset(ring, 0xFF, sizeof(_LSTransportRing));
+#endif
+
+    g_slice_free(_LSTransportRing, ring);
+}
+
+/**
+ *******************************************************************************
+ * @brief Make data written up to @ref tail visible to the consumer and wake
+ * it up if it may have gone to sleep on an empty ring.
+ *******************************************************************************
+ */
+static void
+_LSTransportRingPublish(_LSTransportRing *ring, guint old_tail, guint tail)
+{
+    g_atomic_int_set(&ring->tx->tail, (gint)tail);
+
+    /* The consumer only sleeps after it has read everything; if it hasn't
+     * caught up with old_tail yet, it will see the new data on its own */
+    if ((guint)g_atomic_int_get(&ring->tx->head) == old_tail)
+    {
+        _LSTransportRingSignal(ring->tx_event_fd);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Write as much of an io vector to the ring as fits, without blocking.
+ *
+ * When the ring fills up the far side is asked to wake us up once it has
+ * made room.
+ *
+ * @param  ring     IN  ring
+ * @param  iov      IN  array of io vectors
+ * @param  iovcnt   IN  size of @ref iov array
+ *
+ * @retval number of bytes written
+ * @retval -1 with errno set to EAGAIN if the ring is full, or EPROTO if the
+ * far side corrupted the ring state
+ *******************************************************************************
+ */
+int
+_LSTransportRingWrite(_LSTransportRing *ring, const struct iovec *iov, int iovcnt)
+{
+    LS_ASSERT(ring->map != NULL);
+
+    _LSTransportRingHeader *hdr = ring->tx;
+    guint mask = ring->capacity - 1;
+    guint tail = (guint)g_atomic_int_get(&hdr->tail);
+    guint published = tail;
+    unsigned long iov_offset = 0;
+    int written = 0;
+    bool waiting = false;
+    int i = 0;
+
+    while (i < iovcnt)
+    {
+        if (iov_offset == iov[i].iov_len)
+        {
+            i++;
+            iov_offset = 0;
+            continue;
+        }
+
+        guint used = tail - (guint)g_atomic_int_get(&hdr->head);
+
+        if (used > ring->capacity)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+
+        unsigned long space = ring->capacity - used;
+
+        if (space == 0)
+        {
+            if (tail != published)
+            {
+                _LSTransportRingPublish(ring, published, tail);
+                published = tail;
+            }
+
+            if (waiting)
+            {
+                break;
+            }
+
+            /* check for space once more after setting the flag, since the
+             * consumer may have made room before it could see the flag */
+            g_atomic_int_set(&hdr->writer_waiting, 1);
+            waiting = true;
+            continue;
+        }
+
+        const char *src = (const char*)iov[i].iov_base + iov_offset;
+        unsigned long chunk = MIN(space, iov[i].iov_len - iov_offset);
+        unsigned long pos = tail & mask;
+        unsigned long first = MIN(chunk, ring->capacity - pos);
+
+        memcpy(ring->tx_data + pos, src, first);
+        memcpy(ring->tx_data, src + first, chunk - first);
+
+        tail += chunk;
+        iov_offset += chunk;
+        written += chunk;
+    }
+
+    if (tail != published)
+    {
+        _LSTransportRingPublish(ring, published, tail);
+    }
+
+    if (written == 0 && i < iovcnt)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return written;
+}
+
+/**
+ *******************************************************************************
+ * @brief Write a buffer to the ring, waiting for the far side to make room
+ * when needed. Only meant for flushing during shutdown.
+ *
+ * @param  ring         IN  ring
+ * @param  buf          IN  data
+ * @param  len          IN  size of @ref buf
+ * @param  deadline     IN  monotonic time after which we stop waiting for room
+ * @param  lserror      OUT set on error
+ *
+ * @retval true on success
+ * @retval false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportRingWriteBlocking(_LSTransportRing *ring, const char *buf, unsigned long len,
+                              const struct timespec *deadline, LSError *lserror)
+{
+    unsigned long offset = 0;
+    bool cleared = false;
+    bool ret = true;
+
+    while (offset < len)
+    {
+        struct iovec iov = { .iov_base = (char*)buf + offset, .iov_len = len - offset };
+        int written = _LSTransportRingWrite(ring, &iov, 1);
+
+        if (written > 0)
+        {
+            offset += written;
+            continue;
+        }
+
+        if (errno != EAGAIN)
+        {
+            _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+            ret = false;
+            break;
+        }
+
+        struct timespec now, left;
+        ClockGetTime(&now);
+        int timeout_ms = ClockDiff(&left, deadline, &now) ? 0 : ClockGetMs(&left);
+
+        struct pollfd pfd = { .fd = ring->rx_event_fd, .events = POLLIN };
+        int poll_ret = poll(&pfd, 1, timeout_ms);
+
+        if (poll_ret == 0)
+        {
+            _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -1, "Timed out waiting for room in ring");
+            ret = false;
+            break;
+        }
+        else if (poll_ret < 0 && errno != EINTR)
+        {
+            _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+            ret = false;
+            break;
+        }
+
+        _LSTransportRingClearWakeup(ring);
+        cleared = true;
+    }
+
+    /* we may have swallowed a "data available" wakeup meant for the main loop */
+    if (cleared)
+    {
+        _LSTransportRingKick(ring);
+    }
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Read up to @ref len bytes from the ring, without blocking.
+ *
+ * @param  ring     IN  ring
+ * @param  buf      IN  buffer to read into
+ * @param  len      IN  size of @ref buf
+ *
+ * @retval number of bytes read
+ * @retval -1 with errno set to EAGAIN if the ring is empty, or EPROTO if the
+ * far side corrupted the ring state
+ *******************************************************************************
+ */
+int
+_LSTransportRingRead(_LSTransportRing *ring, char *buf, unsigned long len)
+{
+    LS_ASSERT(ring->map != NULL);
+
+    _LSTransportRingHeader *hdr = ring->rx;
+    guint head = (guint)g_atomic_int_get(&hdr->head);
+    guint avail = (guint)g_atomic_int_get(&hdr->tail) - head;
+
+    if (avail > ring->capacity)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    if (avail == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    unsigned long chunk = MIN(avail, len);
+    unsigned long pos = head & (ring->capacity - 1);
+    unsigned long first = MIN(chunk, ring->capacity - pos);
+
+    memcpy(buf, ring->rx_data + pos, first);
+    memcpy(buf + first, ring->rx_data, chunk - first);
+
+    g_atomic_int_set(&hdr->head, (gint)(head + chunk));
+
+    /* wake up a producer waiting for room */
+    if (g_atomic_int_compare_and_exchange(&hdr->writer_waiting, 1, 0))
+    {
+        _LSTransportRingSignal(ring->tx_event_fd);
+    }
+
+    return chunk;
+}
+
+/**
+ *******************************************************************************
+ * @brief Wake up our own side, e.g. to send queued messages through the ring.
+ *
+ * @param  ring     IN  ring
+ *******************************************************************************
+ */
+void
+_LSTransportRingKick(_LSTransportRing *ring)
+{
+    _LSTransportRingSignal(ring->rx_event_fd);
+}
+
+/**
+ *******************************************************************************
+ * @brief Reset our eventfd after a wakeup.
+ *
+ * @param  ring     IN  ring
+ *******************************************************************************
+ */
+void
+_LSTransportRingClearWakeup(_LSTransportRing *ring)
+{
+    eventfd_t value;
+
+    (void)eventfd_read(ring->rx_event_fd, &value);
+}
+
+/* @} END OF LunaServiceTransportRing */
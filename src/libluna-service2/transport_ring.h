@@ -0,0 +1,117 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_RING_H_
+#define _TRANSPORT_RING_H_
+
+#include <stdbool.h>
+#include <sys/uio.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_channel.h"
+#include "transport_incoming.h"
+
+/**
+ * @addtogroup LunaServiceTransportRing
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_RING_MIN_SIZE  (4 * 1024)          /**< smallest ring per direction */
+#define LS_TRANSPORT_RING_MAX_SIZE  (16 * 1024 * 1024)  /**< largest ring per direction */
+
+#define LS_TRANSPORT_RING_FLUSH_TIMEOUT_MS  1000    /**< max wait for room in all rings together when flushing */
+
+/**
+ * Feature announced by clients that map the rings offered to them, next to
+ * the LS_TRANSPORT_FEATURE_* values of transport_compress.h.
+ */
+#define LS_TRANSPORT_FEATURE_RING           (1 << 1)
+
+/**
+ * File descriptors that are passed to the far side in
+ * @ref _LSTransportMessageTypeRingSetup messages, one per message.
+ */
+typedef enum LSTransportRingFd {
+    _LSTransportRingFdShm,              /**< shared memory holding both rings */
+    _LSTransportRingFdInitiatorEvent,   /**< eventfd the initiator waits on */
+    _LSTransportRingFdAcceptorEvent,    /**< eventfd the far side waits on */
+    _LSTransportRingFdCount,
+} _LSTransportRingFd;
+
+/**
+ * Body of a @ref _LSTransportMessageTypeRingSetup message.
+ */
+struct LSTransportRingSetup {
+    unsigned long capacity;     /**< size of each ring in bytes */
+    _LSTransportRingFd which;   /**< which fd comes with the message */
+};
+
+typedef struct LSTransportRingSetup _LSTransportRingSetup;
+
+typedef struct LSTransportRingHeader _LSTransportRingHeader;
+
+/**
+ * A pair of single-producer/single-consumer byte rings shared with a peer.
+ *
+ * Each side writes to one ring and reads from the other, and waits on its
+ * own eventfd for "data available" and "space available" wakeups. The socket
+ * to the peer is switched over to the rings in each direction with a
+ * @ref _LSTransportMessageTypeRingReady message, after which it only carries
+ * the final shutdown message and the disconnect.
+ */
+struct LSTransportRing {
+    bool initiator;                 /**< true on the side that created the rings */
+    unsigned long capacity;         /**< size of each ring in bytes (power of 2) */
+    int fds[_LSTransportRingFdCount];
+    void *map;                      /**< mapping of the shared memory */
+    size_t map_size;
+    _LSTransportRingHeader *tx;     /**< ring we write to */
+    char *tx_data;
+    _LSTransportRingHeader *rx;     /**< ring we read from */
+    char *rx_data;
+    int tx_event_fd;                /**< eventfd the far side waits on */
+    int rx_event_fd;                /**< eventfd we wait on */
+    bool tx_active;                 /**< messages are sent through the ring */
+    bool rx_active;                 /**< messages are received from the ring */
+    _LSTransportChannel channel;    /**< main loop channel for @ref rx_event_fd */
+    _LSTransportIncoming *incoming; /**< partially received data from the ring */
+};
+
+typedef struct LSTransportRing _LSTransportRing;
+
+unsigned long _LSTransportRingRoundCapacity(unsigned long size);
+_LSTransportRing* _LSTransportRingNew(unsigned long capacity);
+_LSTransportRing* _LSTransportRingNewEmpty(void);
+bool _LSTransportRingSetFd(_LSTransportRing *ring, const _LSTransportRingSetup *setup, int fd);
+bool _LSTransportRingIsComplete(const _LSTransportRing *ring);
+bool _LSTransportRingMap(_LSTransportRing *ring, LSError *lserror);
+void _LSTransportRingFree(_LSTransportRing *ring);
+
+int _LSTransportRingWrite(_LSTransportRing *ring, const struct iovec *iov, int iovcnt);
+bool _LSTransportRingWriteBlocking(_LSTransportRing *ring, const char *buf, unsigned long len,
+                                   const struct timespec *deadline, LSError *lserror);
+int _LSTransportRingRead(_LSTransportRing *ring, char *buf, unsigned long len);
+void _LSTransportRingKick(_LSTransportRing *ring);
+void _LSTransportRingClearWakeup(_LSTransportRing *ring);
+
+/** @} LunaServiceTransportRing */
+
+#endif      // _TRANSPORT_RING_H_
@@ -36,88 +36,176 @@
  * @{
  */
 
+static inline _LSTransportSerialEntry*
+_LSTransportSerialEntryAt(const _LSTransportSerial *serial_info, unsigned int i)
+{
+    return &serial_info->entries[(serial_info->head + i) & (serial_info->capacity - 1)];
+}
+
 /**
  *******************************************************************************
- * @brief Allocate a new serial map entry.
+ * @brief Drop removed entries from both ends of the ring.
  *
- * @param  serial       IN  serial
- * @param  list_item    IN  pointer to item in list
+ * @param  serial_info  IN  serial info
+ *******************************************************************************
+ */
+static void
+_LSTransportSerialTrim(_LSTransportSerial *serial_info)
+{
+    while (serial_info->length > 0 && !_LSTransportSerialEntryAt(serial_info, 0)->message)
+    {
+        serial_info->head = (serial_info->head + 1) & (serial_info->capacity - 1);
+        serial_info->length--;
+    }
+
+    while (serial_info->length > 0 && !_LSTransportSerialEntryAt(serial_info, serial_info->length - 1)->message)
+    {
+        serial_info->length--;
+    }
+
+    if (serial_info->length == 0)
+    {
+        serial_info->head = 0;
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Move the entries that haven't been removed together at the start of
+ * the ring.
  *
- * @retval  entry on success
- * @retval  NULL on failure
+ * @param  serial_info  IN  serial info
  *******************************************************************************
  */
-_LSTransportSerialMapEntry*
-_LSTransportSerialMapEntryNew(LSMessageToken serial, GList *list_item)
+static void
+_LSTransportSerialCompact(_LSTransportSerial *serial_info)
 {
-    _LSTransportSerialMapEntry* entry = g_slice_new0(_LSTransportSerialMapEntry);
+    unsigned int i, live = 0;
 
-    entry->serial = serial;
-    entry->serial_list_item = list_item;
+    for (i = 0; i < serial_info->length; i++)
+    {
+        _LSTransportSerialEntry *entry = _LSTransportSerialEntryAt(serial_info, i);
+
+        if (entry->message)
+        {
+            *_LSTransportSerialEntryAt(serial_info, live++) = *entry;
+        }
+    }
 
-    return entry;
+    LS_ASSERT(live == serial_info->count);
+    serial_info->length = live;
 }
 
 /**
  *******************************************************************************
- * @brief Free a serial map entry.
+ * @brief Make room for one more entry at the tail of the ring.
  *
- * @param  entry    IN  entry
+ * @param  serial_info  IN  serial info
  *******************************************************************************
  */
-void
-_LSTransportSerialMapEntryFree(_LSTransportSerialMapEntry *entry)
+static void
+_LSTransportSerialReserve(_LSTransportSerial *serial_info)
 {
-    LS_ASSERT(entry != NULL);
+    if (serial_info->length < serial_info->capacity)
+    {
+        return;
+    }
 
-#ifdef MEMCHECK
-    memset(entry, 0xFF, sizeof(_LSTransportSerialMapEntry));
-#endif
+    /* reuse the room of removed entries before growing */
+    if (serial_info->count < serial_info->length)
+    {
+        _LSTransportSerialCompact(serial_info);
+        return;
+    }
+
+    unsigned int new_capacity = serial_info->capacity * 2;
+    _LSTransportSerialEntry *entries = g_new(_LSTransportSerialEntry, new_capacity);
+    unsigned int i;
 
-    g_slice_free(_LSTransportSerialMapEntry, entry);
+    for (i = 0; i < serial_info->length; i++)
+    {
+        entries[i] = *_LSTransportSerialEntryAt(serial_info, i);
+    }
+
+    g_free(serial_info->entries);
+    serial_info->entries = entries;
+    serial_info->capacity = new_capacity;
+    serial_info->head = 0;
 }
 
 /**
  *******************************************************************************
- * @brief Allocate a new serial list item.
+ * @brief Find the position in the ring of the first entry with a serial that
+ * is not less than the given one.
  *
- * @param  serial   IN  serial (token)
+ * @param  serial_info  IN  serial info
+ * @param  serial       IN  serial (token)
  *
- * @retval  item on success
- * @retval  NULL on failure
+ * @retval position between 0 and the length of the ring
  *******************************************************************************
  */
-_LSTransportSerialListItem*
-_LSTransportSerialListItemNew(LSMessageToken serial, _LSTransportMessage *message)
+static unsigned int
+_LSTransportSerialLowerBound(const _LSTransportSerial *serial_info, LSMessageToken serial)
 {
-    _LSTransportSerialListItem *item = g_slice_new0(_LSTransportSerialListItem);
+    unsigned int low = 0, high = serial_info->length;
 
-    item->serial = serial;
-    _LSTransportMessageRef(message);
-    item->message = message;
+    while (low < high)
+    {
+        unsigned int mid = low + (high - low) / 2;
+
+        if (_LSTransportSerialEntryAt(serial_info, mid)->serial < serial)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
 
-    return item;
+    return low;
 }
 
 /**
  *******************************************************************************
- * @brief Free a serial list item.
+ * @brief Look up the entry of a method call that hasn't been removed.
+ *
+ * @param  serial_info  IN  serial info
+ * @param  serial       IN  serial (token)
  *
- * @param  list_item    IN serial list item to free
+ * @retval entry on success
+ * @retval NULL if not found
  *******************************************************************************
  */
-void
-_LSTransportSerialListItemFree(_LSTransportSerialListItem *list_item)
+static _LSTransportSerialEntry*
+_LSTransportSerialLookup(const _LSTransportSerial *serial_info, LSMessageToken serial)
 {
-    LS_ASSERT(list_item != NULL);
+    _LSTransportSerialEntry *entry;
 
-    _LSTransportMessageUnref(list_item->message);
+    if (serial_info->length == 0)
+    {
+        return NULL;
+    }
 
-#ifdef MEMCHECK
-    memset(list_item, 0xFF, sizeof(_LSTransportSerialListItem));
-#endif
+    /* replies mostly come in the order of the calls */
+    entry = _LSTransportSerialEntryAt(serial_info, 0);
+    if (entry->serial != serial)
+    {
+        entry = _LSTransportSerialEntryAt(serial_info, serial_info->length - 1);
+    }
 
-    g_slice_free(_LSTransportSerialListItem, list_item);
+    if (entry->serial != serial)
+    {
+        unsigned int i = _LSTransportSerialLowerBound(serial_info, serial);
+
+        if (i == serial_info->length)
+        {
+            return NULL;
+        }
+        entry = _LSTransportSerialEntryAt(serial_info, i);
+    }
+
+    return (entry->serial == serial && entry->message) ? entry : NULL;
 }
 
 /**
@@ -139,11 +227,8 @@ _LSTransportSerialNew(void)
         goto error;
     }
 
-    serial_info->queue = g_queue_new();
-
-    /* TODO: make custom 64-bit int hash function since we may need to
-     * increase the size of LSMessageToken */
-    serial_info->map = g_hash_table_new_full(g_int_hash, g_int_equal, NULL, (GDestroyNotify)_LSTransportSerialMapEntryFree);
+    serial_info->capacity = LS_TRANSPORT_SERIAL_INITIAL_SIZE;
+    serial_info->entries = g_new(_LSTransportSerialEntry, serial_info->capacity);
 
     return serial_info;
 
@@ -166,14 +251,18 @@ _LSTransportSerialFree(_LSTransportSerial *serial_info)
 
     SERIAL_INFO_LOCK(&serial_info->lock);
 
-    while (!g_queue_is_empty(serial_info->queue))
+    unsigned int i;
+    for (i = 0; i < serial_info->length; i++)
     {
-         _LSTransportSerialListItem *item = g_queue_pop_head(serial_info->queue);
-        _LSTransportSerialListItemFree(item);
+        _LSTransportSerialEntry *entry = _LSTransportSerialEntryAt(serial_info, i);
+
+        if (entry->message)
+        {
+            _LSTransportMessageUnref(entry->message);
+        }
     }
 
-    g_queue_free(serial_info->queue);
-    g_hash_table_destroy(serial_info->map); /* key and value destroy functions clean this up */
+    g_free(serial_info->entries);
 
     SERIAL_INFO_UNLOCK(&serial_info->lock);
 
@@ -186,12 +275,12 @@ _LSTransportSerialFree(_LSTransportSerial *serial_info)
 
 /**
  *******************************************************************************
- * @brief Save a serial (token) in the queue and map.
+ * @brief Save a serial (token) in the ring. The ring refs the message.
  *
  * @attention locks the serial lock
  *
  * @param  serial_info  IN  serial info
- * @param  serial       IN  message serial (token) to save
+ * @param  message      IN  method call with the serial (token) to save
  * @param  lserror      OUT set on error
  *
  * @retval  true on success
@@ -202,20 +291,35 @@ bool
 _LSTransportSerialSave(_LSTransportSerial *serial_info, _LSTransportMessage *message, LSError *lserror)
 {
     LSMessageToken serial = _LSTransportMessageGetToken(message);
-    _LSTransportSerialListItem *item = _LSTransportSerialListItemNew(serial, message);
+
+    _LSTransportMessageRef(message);
 
     SERIAL_INFO_LOCK(&serial_info->lock);
 
-    g_queue_push_tail(serial_info->queue, item);
-    GList *list = g_queue_peek_tail_link(serial_info->queue);
+    LS_ASSERT(NULL == _LSTransportSerialLookup(serial_info, serial));
+
+    _LSTransportSerialReserve(serial_info);
+
+    unsigned int i = serial_info->length;
 
-    LS_ASSERT(list != NULL);
+    /* Tokens are taken before the lock, so a thread that took a later token
+     * may have beaten us here; keep the ring sorted */
+    if (i > 0 && _LSTransportSerialEntryAt(serial_info, i - 1)->serial > serial)
+    {
+        unsigned int pos = _LSTransportSerialLowerBound(serial_info, serial);
 
-    _LSTransportSerialMapEntry *map_entry = _LSTransportSerialMapEntryNew(serial, list);
+        for (; i > pos; i--)
+        {
+            *_LSTransportSerialEntryAt(serial_info, i) = *_LSTransportSerialEntryAt(serial_info, i - 1);
+        }
+    }
 
-    LS_ASSERT(NULL == g_hash_table_lookup(serial_info->map, &map_entry->serial));
+    _LSTransportSerialEntry *entry = _LSTransportSerialEntryAt(serial_info, i);
+    entry->serial = serial;
+    entry->message = message;
 
-    g_hash_table_insert(serial_info->map, &map_entry->serial, map_entry);
+    serial_info->length++;
+    serial_info->count++;
 
     SERIAL_INFO_UNLOCK(&serial_info->lock);
 
@@ -224,7 +328,7 @@ _LSTransportSerialSave(_LSTransportSerial *serial_info, _LSTransportMessage *mes
 
 /**
  *******************************************************************************
- * @brief Remove a serial (token) from the queue and map.
+ * @brief Remove a serial (token) from the ring.
  *
  * @attention locks the serial info lock
  *
@@ -235,31 +339,100 @@ _LSTransportSerialSave(_LSTransportSerial *serial_info, _LSTransportMessage *mes
 void
 _LSTransportSerialRemove(_LSTransportSerial *serial_info, LSMessageToken serial)
 {
+    _LSTransportMessage *message = NULL;
+
     SERIAL_INFO_LOCK(&serial_info->lock);
 
-    _LSTransportSerialMapEntry *map_entry = g_hash_table_lookup(serial_info->map, &serial);
+    _LSTransportSerialEntry *entry = _LSTransportSerialLookup(serial_info, serial);
 
-    if (map_entry)
+    if (entry)
     {
-        _LSTransportSerialListItem *item = (_LSTransportSerialListItem*)map_entry->serial_list_item->data;
-        g_queue_delete_link(serial_info->queue, map_entry->serial_list_item);
-        _LSTransportSerialListItemFree(item);
-        g_hash_table_remove(serial_info->map, &serial);
+        message = entry->message;
+        entry->message = NULL;
+        serial_info->count--;
+
+        _LSTransportSerialTrim(serial_info);
+
+        /* don't let removed entries pile up behind a call that never gets
+         * a reply */
+        if (serial_info->length > LS_TRANSPORT_SERIAL_INITIAL_SIZE &&
+            serial_info->count < serial_info->length / 2)
+        {
+            _LSTransportSerialCompact(serial_info);
+        }
     }
 
     SERIAL_INFO_UNLOCK(&serial_info->lock);
+
+    if (message)
+    {
+        _LSTransportMessageUnref(message);
+    }
 }
 
 /**
  *******************************************************************************
- * @brief Pops a message from the serial queue and removes it from the serial map.
+ * @brief Check whether a serial (token) is in the ring.
+ *
+ * @attention locks the serial info lock
+ *
+ * @param  serial_info  IN  serial info
+ * @param  serial       IN  serial (token)
+ *
+ * @retval  true if found
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+bool
+_LSTransportSerialContains(_LSTransportSerial *serial_info, LSMessageToken serial)
+{
+    SERIAL_INFO_LOCK(&serial_info->lock);
+    bool ret = _LSTransportSerialLookup(serial_info, serial) != NULL;
+    SERIAL_INFO_UNLOCK(&serial_info->lock);
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the serial (token) of the oldest method call in the ring.
+ *
+ * @attention locks the serial info lock
+ *
+ * @param  serial_info  IN  serial info
+ *
+ * @retval serial on success
+ * @retval LSMESSAGE_TOKEN_INVALID on empty ring
+ *******************************************************************************
+ */
+LSMessageToken
+_LSTransportSerialGetHeadSerial(_LSTransportSerial *serial_info)
+{
+    LSMessageToken serial = LSMESSAGE_TOKEN_INVALID;
+
+    SERIAL_INFO_LOCK(&serial_info->lock);
+
+    /* the ring never starts with a removed entry */
+    if (serial_info->length > 0)
+    {
+        serial = _LSTransportSerialEntryAt(serial_info, 0)->serial;
+    }
+
+    SERIAL_INFO_UNLOCK(&serial_info->lock);
+
+    return serial;
+}
+
+/**
+ *******************************************************************************
+ * @brief Pops the oldest message from the serial ring.
  *
  * @attention locks the serial info lock
  *
  * @param  serial_info  IN  serial info
  *
  * @retval message on success
- * @retval NULL on empty serial queue
+ * @retval NULL on empty serial ring
  *******************************************************************************
  */
 _LSTransportMessage*
@@ -268,13 +441,16 @@ _LSTransportSerialPopHead(_LSTransportSerial *serial_info)
     _LSTransportMessage *message = NULL;
     SERIAL_INFO_LOCK(&serial_info->lock);
 
-    _LSTransportSerialListItem *item = g_queue_pop_head(serial_info->queue);
-    if (item)
+    if (serial_info->length > 0)
     {
-        message = item->message;
-        _LSTransportMessageRef(message);
-        g_hash_table_remove(serial_info->map, &item->serial);
-        _LSTransportSerialListItemFree(item);
+        _LSTransportSerialEntry *entry = _LSTransportSerialEntryAt(serial_info, 0);
+
+        /* the ring's ref goes to the caller */
+        message = entry->message;
+        entry->message = NULL;
+        serial_info->count--;
+
+        _LSTransportSerialTrim(serial_info);
     }
 
     SERIAL_INFO_UNLOCK(&serial_info->lock);
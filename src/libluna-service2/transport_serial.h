@@ -24,32 +24,32 @@
 #include <glib.h>
 #include <luna-service2/lunaservice.h>
 
-typedef struct LSTransportSerialMapEntry {
-    LSMessageToken serial;  /**< global serial */
-    GList *serial_list_item;
-} _LSTransportSerialMapEntry;
+#define LS_TRANSPORT_SERIAL_INITIAL_SIZE    16  /**< initial number of entries in the ring (power of 2) */
 
-typedef struct LSTransportSerialListItem {
-    LSMessageToken serial;  /**< global */
-    _LSTransportMessage *message;
-} _LSTransportSerialListItem;
+typedef struct LSTransportSerialEntry {
+    LSMessageToken serial;          /**< global serial (token) of the method call */
+    _LSTransportMessage *message;   /**< method call; NULL once it has been removed */
+} _LSTransportSerialEntry;
 
 /**
  * In order to handle clean shutdown (i.e., making sure that we know which
  * method calls have been received and/or processed on the far end), we keep
- * a queue of @LSTransportSerialListItem that saves the serial number for
- * each method call that we make. In additon, we save a pointer to the
- * actual item on the queue as a @LSTransportSerialMapEntry in the @map,
- * which allows us to do a fast lookup and remove from the list when
- * receive a method call reply.
+ * the serial number of each method call that we make, along with the
+ * message itself, in a ring of @ref _LSTransportSerialEntry.
+ *
+ * Tokens only go up, so the ring is kept sorted by serial by appending at
+ * the tail. A call is looked up by checking the head and the tail, where
+ * replies usually land, and otherwise by a binary search. Removing a call
+ * from the middle only clears its message; cleared entries are dropped when
+ * they reach either end of the ring, or all at once when they make up most
+ * of it. Entries live in the ring's array, so saving and removing a call
+ * doesn't allocate.
  *
  * When a client shuts down cleanly, it will send the serial number of the
- * last method call that it has processed. We then look up that serial
- * number in the map and get the pointer to the item on the queue that
- * represents that message. We know that every serial in the list beyond
- * this one has not been processed and can iterate over that list and call
- * a failure callback with the serial number of each message that didn't
- * get processed.
+ * last method call that it has processed. We know that every serial in the
+ * ring beyond this one has not been processed and can iterate over the ring
+ * and call a failure callback with the serial number of each message that
+ * didn't get processed.
  *
  * Example:
  * 3 Method calls on com.palm.foo:
@@ -63,24 +63,25 @@ typedef struct LSTransportSerialListItem {
  *
  * We then call the failure handler on serial 6.
  *
- * Note that we also remove serial numbers from the queue when we receive
+ * Note that we also remove serial numbers from the ring when we receive
  * a reply, since that indicates that the far side has processed the
  * message as well.
  */
 typedef struct LSTransportSerial {
-    pthread_mutex_t lock;           /**< protects the queue and map */
-    GQueue *queue;                  /**< ordered linked list of serial #s */
-    GHashTable *map;                /**< map of serial number to ll item */
+    pthread_mutex_t lock;               /**< protects the ring */
+    _LSTransportSerialEntry *entries;   /**< ring of entries sorted by serial */
+    unsigned int capacity;              /**< size of @ref entries (power of 2) */
+    unsigned int head;                  /**< index of the oldest entry */
+    unsigned int length;                /**< entries in the ring, including removed ones */
+    unsigned int count;                 /**< entries that haven't been removed */
 } _LSTransportSerial;
 
-_LSTransportSerialMapEntry* _LSTransportSerialMapEntryNew(LSMessageToken serial, GList *list_item);
-void _LSTransportSerialMapEntryFree(_LSTransportSerialMapEntry *entry);
-_LSTransportSerialListItem* _LSTransportSerialListItemNew(LSMessageToken serial, _LSTransportMessage *message);
-void _LSTransportSerialListItemFree(_LSTransportSerialListItem *list_item);
 _LSTransportSerial* _LSTransportSerialNew(void);
 void _LSTransportSerialFree(_LSTransportSerial *serial_info);
 bool _LSTransportSerialSave(_LSTransportSerial *serial_info, _LSTransportMessage *message, LSError *lserror);
 void _LSTransportSerialRemove(_LSTransportSerial *serial_info, LSMessageToken serial);
+bool _LSTransportSerialContains(_LSTransportSerial *serial_info, LSMessageToken serial);
+LSMessageToken _LSTransportSerialGetHeadSerial(_LSTransportSerial *serial_info);
 _LSTransportMessage *_LSTransportSerialPopHead(_LSTransportSerial *serial_info);
 
 #endif      // _TRANSPORT_SERIAL_H_
@@ -26,6 +26,8 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 
 #include "transport_shm.h"
@@ -37,19 +39,37 @@
 
 #define FENCE_VAL       0xdeadbeef
 
+#define MONITOR_SERIAL_BLOCK_SIZE   1024    /**< serials a process reserves at a time with LS_MONITOR_SERIAL_BLOCKS=1 */
+
 struct _LSTransportShmData
 {
     uint32_t front_fence;
-    pthread_mutex_t lock;
-    _LSTransportMonitorSerial serial;
+    _LSTransportMonitorSerial serial;   /**< last serial handed out; only changed with atomic adds */
     uint32_t back_fence;
 };
 
 typedef struct _LSTransportShmData _LSTransportShmData;
 
+/**
+ * Serials reserved by this process, handed out without touching the shared
+ * memory until they run out.
+ *
+ * Serials then only order the messages of each process; messages of
+ * different processes can come out of order by up to a block.
+ */
+struct _LSTransportShmBlock
+{
+    pthread_mutex_t lock;               /**< process local, so nobody else contends on it */
+    _LSTransportMonitorSerial next;     /**< next serial to hand out */
+    _LSTransportMonitorSerial end;      /**< first serial past the block */
+};
+
+typedef struct _LSTransportShmBlock _LSTransportShmBlock;
+
 struct _LSTransportShm
 {
     _LSTransportShmData* data;
+    _LSTransportShmBlock* block;        /**< NULL when every serial comes from the shared memory */
 };
 
 /** protects singleton mapping initialization from multiple threads */
@@ -63,6 +83,11 @@ static _LSTransportShmData *shm_map_addr_prv = NULL;   /**< singleton mapping of
                                                          shared memory region for
                                                          process */
 
+static _LSTransportShmBlock shm_block_pub = { PTHREAD_MUTEX_INITIALIZER, 0, 0 };   /**< serials reserved
+                                                                                      on the public bus */
+static _LSTransportShmBlock shm_block_prv = { PTHREAD_MUTEX_INITIALIZER, 0, 0 };   /**< serials reserved
+                                                                                      on the private bus */
+
 static _LSTransportShmData*
 _LSTransportShmInitOnce(bool public_bus, LSError *lserror)
 {
@@ -158,17 +183,6 @@ _LSTransportShmInitOnce(bool public_bus, LSError *lserror)
 
     if (shm_needs_init)
     {
-        pthread_mutexattr_t attr;
-
-        /* mark mutex as being shared by multiple processes */
-        pthread_mutexattr_init(&attr);
-        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-
-        if (pthread_mutex_init(&map->lock, &attr))
-        {
-            LOG_LS_ERROR(MSGID_LS_MUTEX_ERR, 0, "Could not initialize mutex.");
-            goto error;
-        }
         map->serial = MONITOR_SERIAL_INVALID;
         map->front_fence = FENCE_VAL;
         map->back_fence = FENCE_VAL;
@@ -210,6 +224,15 @@ _LSTransportShmInit(_LSTransportShm** shm, bool public_bus, LSError* lserror)
         goto error;
     }
 
+    /* LS_MONITOR_SERIAL_BLOCKS=1 trades the ordering between processes for
+     * touching the shared memory only once every MONITOR_SERIAL_BLOCK_SIZE
+     * messages */
+    const char *blocks = getenv("LS_MONITOR_SERIAL_BLOCKS");
+    if (blocks && strcmp(blocks, "1") == 0)
+    {
+        ret_shm->block = public_bus ? &shm_block_pub : &shm_block_prv;
+    }
+
     *shm = ret_shm;
 
     return true;
@@ -219,27 +242,90 @@ error:
     return false;
 }
 
+/**
+ *******************************************************************************
+ * @brief Reserve serials in the shared memory.
+ *
+ * Lock-free, so processes only contend on the cache line holding the counter.
+ *
+ * @param  data     IN  shared memory
+ * @param  count    IN  number of serials to reserve
+ * @param  first    OUT first reserved serial
+ *
+ * @retval true on success
+ * @retval false if the shared memory was corrupted
+ *******************************************************************************
+ */
+static bool
+_LSTransportShmReserveSerials(_LSTransportShmData *data, unsigned int count, _LSTransportMonitorSerial *first)
+{
+    /* Make sure a rogue process didn't mess with the shared mem */
+    if (data->front_fence != FENCE_VAL ||
+        data->back_fence != FENCE_VAL)
+    {
+        return false;
+    }
+
+    *first = __sync_fetch_and_add(&data->serial, count) + 1;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the next serial for ordering monitor messages.
+ *
+ * @param  shm  IN  shared memory
+ *
+ * @retval serial
+ * @retval MONITOR_SERIAL_INVALID if the shared memory was corrupted
+ *******************************************************************************
+ */
 _LSTransportMonitorSerial
 _LSTransportShmGetSerial(_LSTransportShm* shm)
 {
     LS_ASSERT(shm != NULL);
 
     _LSTransportMonitorSerial ret = MONITOR_SERIAL_INVALID;
+    _LSTransportShmBlock *block = shm->block;
 
-    /* Make sure a rogue process didn't mess with the shared mem */
-    if (shm->data->front_fence == FENCE_VAL &&
-        shm->data->back_fence == FENCE_VAL)
+    if (!block)
+    {
+        if (_LSTransportShmReserveSerials(shm->data, 1, &ret) &&
+            unlikely(ret == MONITOR_SERIAL_INVALID))
+        {
+            _LSTransportShmReserveSerials(shm->data, 1, &ret);
+        }
+        return ret;
+    }
+
+    pthread_mutex_lock(&block->lock);
+
+    /* the block starts out empty at 0 */
+    if (block->next >= block->end || block->next == MONITOR_SERIAL_INVALID)
     {
-        pthread_mutex_lock(&shm->data->lock);
-        ret = ++shm->data->serial;
+        _LSTransportMonitorSerial start = MONITOR_SERIAL_INVALID;
 
-        if (unlikely(ret == MONITOR_SERIAL_INVALID))
+        if (_LSTransportShmReserveSerials(shm->data, MONITOR_SERIAL_BLOCK_SIZE, &start))
         {
-            ret++;
+            block->next = start;
+            block->end = start + MONITOR_SERIAL_BLOCK_SIZE;
         }
-        pthread_mutex_unlock(&shm->data->lock);
     }
 
+    /* the counter wrapped inside the block */
+    if (unlikely(block->next == MONITOR_SERIAL_INVALID) && block->next < block->end)
+    {
+        block->next++;
+    }
+
+    if (block->next < block->end)
+    {
+        ret = block->next++;
+    }
+
+    pthread_mutex_unlock(&block->lock);
+
     return ret;
 }
 
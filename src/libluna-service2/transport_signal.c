@@ -202,15 +202,35 @@ LSTransportUnregisterSignalServiceStatus(_LSTransport *transport, const char *se
  */
 _LSTransportMessage*
 LSTransportMessageSignalNewRef(const char *category, const char *method, const char *payload)
+{
+    return LSTransportMessageSignalNewRefLen(category, method, payload, strlen(payload));
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a new signal message with a payload of known length and ref
+ * count of 1.
+ *
+ * @param  category     IN  category
+ * @param  method       IN  method (optional, NULL means none)
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_len  IN  length of @ref payload without a terminating NUL
+ *
+ * @retval  message on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportMessage*
+LSTransportMessageSignalNewRefLen(const char *category, const char *method,
+                                  const char *payload, unsigned long payload_len)
 {
     int category_len = strlen(category) + 1;
     int method_len = strlen(method) + 1;
-    int payload_len = strlen(payload) + 1;
 
     LS_ASSERT(category_len > 1);
     LS_ASSERT(method_len > 1);
 
-    _LSTransportMessage *message = _LSTransportMessageNewRef(category_len + method_len + payload_len);
+    _LSTransportMessage *message = _LSTransportMessageNewRef(category_len + method_len + payload_len + 1);
 
     _LSTransportMessageSetType(message, _LSTransportMessageTypeSignal);
 
@@ -221,6 +241,7 @@ LSTransportMessageSignalNewRef(const char *category, const char *method, const c
     memcpy(message_body, method, method_len);
     message_body += method_len;
     memcpy(message_body, payload, payload_len);
+    message_body[payload_len] = '\0';
 
     /* TODO: original code also appended the service_name of the sender (or "")
      * if there was no name (sh->name) */
@@ -244,10 +265,32 @@ LSTransportMessageSignalNewRef(const char *category, const char *method, const c
  */
 bool
 LSTransportSendSignal(_LSTransport *transport, const char *category, const char *method, const char *payload, LSError *lserror)
+{
+    return LSTransportSendSignalLen(transport, category, method, payload, strlen(payload), lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a signal with a payload of known length.
+ *
+ * @param  transport    IN  transport
+ * @param  category     IN  category
+ * @param  method       IN  method (optional, NULL means none)
+ * @param  payload      IN  payload (need not be NUL-terminated)
+ * @param  payload_len  IN  length of @ref payload without a terminating NUL
+ * @param  lserror      OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+LSTransportSendSignalLen(_LSTransport *transport, const char *category, const char *method,
+                         const char *payload, unsigned long payload_len, LSError *lserror)
 {
     bool ret = true;
 
-    _LSTransportMessage *message = LSTransportMessageSignalNewRef(category, method, payload);
+    _LSTransportMessage *message = LSTransportMessageSignalNewRefLen(category, method, payload, payload_len);
 
     LS_ASSERT(transport->hub != NULL);
 
@@ -32,11 +32,13 @@
 bool LSTransportRegisterSignal(_LSTransport *transport, const char *category, const char *method, LSMessageToken *token, LSError *lserror);
 bool LSTransportUnregisterSignal(_LSTransport *transport, const char *category, const char *method, LSMessageToken *token, LSError *lserror);
 bool LSTransportSendSignal(_LSTransport *transport, const char *category, const char *method, const char *payload, LSError *lserror);
+bool LSTransportSendSignalLen(_LSTransport *transport, const char *category, const char *method, const char *payload, unsigned long payload_len, LSError *lserror);
 
 bool LSTransportRegisterSignalServiceStatus(_LSTransport *transport, const char *service_name,  LSMessageToken *token, LSError *lserror);
 bool LSTransportUnregisterSignalServiceStatus(_LSTransport *transport, const char *service_name,  LSMessageToken *token, LSError *lserror);
 
 char* LSTransportServiceStatusSignalGetServiceName(_LSTransportMessage *message);
 _LSTransportMessage* LSTransportMessageSignalNewRef(const char *category, const char *method, const char *payload);
+_LSTransportMessage* LSTransportMessageSignalNewRefLen(const char *category, const char *method, const char *payload, unsigned long payload_len);
 
 #endif      // _TRANSPORT_SIGNAL_H_
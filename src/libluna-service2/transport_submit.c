@@ -0,0 +1,207 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "transport.h"
+#include "transport_submit.h"
+
+/**
+ * @defgroup LunaServiceTransportSubmit
+ * @ingroup LunaServiceTransport
+ * @brief Lock-free handover of messages to the main loop thread
+ */
+
+/**
+ * @addtogroup LunaServiceTransportSubmit
+ * @{
+ */
+
+/**
+ *******************************************************************************
+ * @brief Create a submission queue.
+ *
+ * @param  lserror  OUT set on error
+ *
+ * @retval  queue on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportSubmit*
+_LSTransportSubmitNew(LSError *lserror)
+{
+    int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (event_fd == -1)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_SUBMIT_ERR, errno);
+        return NULL;
+    }
+
+    _LSTransportSubmit *submit = g_new0(_LSTransportSubmit, 1);
+    submit->event_fd = event_fd;
+    pthread_mutex_init(&submit->lock, NULL);
+
+    return submit;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a submission queue along with the messages still in it.
+ *
+ * @param  submit   IN  queue
+ *******************************************************************************
+ */
+void
+_LSTransportSubmitFree(_LSTransportSubmit *submit)
+{
+    LS_ASSERT(submit != NULL);
+
+    _LSTransportSubmitNode *node = _LSTransportSubmitTakeAll(submit);
+
+    while (node)
+    {
+        _LSTransportSubmitNode *next = node->next;
+        _LSTransportSubmitNodeFree(node);
+        node = next;
+    }
+
+    if (submit->channel.channel)
+    {
+        _LSTransportChannelDeinit(&submit->channel);
+    }
+    else
+    {
+        close(submit->event_fd);
+    }
+
+    pthread_mutex_destroy(&submit->lock);
+
+    g_free(submit);
+}
+
+/**
+ *******************************************************************************
+ * @brief Hand a message over to the main loop thread. Safe to call from any
+ * thread.
+ *
+ * @param  submit   IN  queue
+ * @param  client   IN  client to send the message to; a ref is taken
+ * @param  message  IN  message with its token set; the queue takes over the
+ *                      caller's ref
+ *******************************************************************************
+ */
+void
+_LSTransportSubmitPush(_LSTransportSubmit *submit, _LSTransportClient *client, _LSTransportMessage *message)
+{
+    LS_ASSERT(submit != NULL);
+    LS_ASSERT(message != NULL);
+
+    _LSTransportSubmitNode *node = g_slice_new(_LSTransportSubmitNode);
+    _LSTransportSubmitNode *head;
+
+    node->client = client;
+    node->message = message;
+
+    if (client)
+    {
+        _LSTransportClientRef(client);
+    }
+
+    do
+    {
+        head = submit->head;
+        node->next = head;
+    }
+    while (!__sync_bool_compare_and_swap(&submit->head, head, node));
+
+    /* the main loop thread takes all nodes at once, so it only needs to be
+     * woken up for the first one */
+    if (!head)
+    {
+        eventfd_write(submit->event_fd, 1);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Take all messages that have been handed over.
+ *
+ * @attention the caller is expected to hold @ref _LSTransportSubmit::lock
+ * until the messages are queued
+ *
+ * @param  submit   IN  queue
+ *
+ * @retval  list of nodes linked by @ref _LSTransportSubmitNode::next in the
+ *          order they were pushed
+ * @retval  NULL if there are none
+ *******************************************************************************
+ */
+_LSTransportSubmitNode*
+_LSTransportSubmitTakeAll(_LSTransportSubmit *submit)
+{
+    LS_ASSERT(submit != NULL);
+
+    eventfd_t value;
+
+    /* clear the wakeup first; whoever pushes after the exchange below
+     * finds the stack empty and signals again */
+    (void)eventfd_read(submit->event_fd, &value);
+
+    _LSTransportSubmitNode *node = __sync_lock_test_and_set(&submit->head, NULL);
+    _LSTransportSubmitNode *list = NULL;
+
+    /* the stack has the most recent node on top */
+    while (node)
+    {
+        _LSTransportSubmitNode *next = node->next;
+        node->next = list;
+        list = node;
+        node = next;
+    }
+
+    return list;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a node along with the refs it holds.
+ *
+ * @param  node     IN  node
+ *******************************************************************************
+ */
+void
+_LSTransportSubmitNodeFree(_LSTransportSubmitNode *node)
+{
+    if (node->message)
+    {
+        _LSTransportMessageUnref(node->message);
+    }
+
+    if (node->client)
+    {
+        _LSTransportClientUnref(node->client);
+    }
+
+    g_slice_free(_LSTransportSubmitNode, node);
+}
+
+/* @} END OF LunaServiceTransportSubmit */
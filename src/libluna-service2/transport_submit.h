@@ -0,0 +1,78 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_SUBMIT_H_
+#define _TRANSPORT_SUBMIT_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_channel.h"
+#include "transport_message.h"
+
+/**
+ * @addtogroup LunaServiceTransportSubmit
+ *
+ * @{
+ */
+
+/**
+ * A message handed over to the main loop thread.
+ */
+typedef struct LSTransportSubmitNode {
+    struct LSTransportSubmitNode *next;
+    _LSTransportClient *client;     /**< client the message goes to (ref) */
+    _LSTransportMessage *message;   /**< message to queue (ref) */
+} _LSTransportSubmitNode;
+
+/**
+ * Queue of messages that threads other than the main loop thread send.
+ *
+ * Any number of threads push fully serialized messages without taking a
+ * lock, and the main loop thread takes them all at once and queues them to
+ * their clients, so the senders never contend with it on the outgoing lock
+ * or write to a socket that it's writing to. The nodes form a stack that is
+ * pushed with compare-and-swap and taken whole with an atomic exchange,
+ * which is then reversed to get the messages in the order they were pushed.
+ * The thread that pushes onto an empty stack signals @ref event_fd.
+ *
+ * A sender that can't hand a message over has to move the earlier ones to
+ * the outgoing queues first to keep its messages in order, so taking the
+ * nodes and queueing them happens under @ref lock.
+ */
+struct LSTransportSubmit {
+    _LSTransportSubmitNode *head;   /**< most recently pushed node */
+    pthread_mutex_t lock;           /**< serializes the threads that take and queue the nodes */
+    int event_fd;                   /**< readable while there are nodes */
+    _LSTransportChannel channel;    /**< main loop channel for @ref event_fd */
+};
+
+typedef struct LSTransportSubmit _LSTransportSubmit;
+
+_LSTransportSubmit* _LSTransportSubmitNew(LSError *lserror);
+void _LSTransportSubmitFree(_LSTransportSubmit *submit);
+void _LSTransportSubmitPush(_LSTransportSubmit *submit, _LSTransportClient *client, _LSTransportMessage *message);
+_LSTransportSubmitNode* _LSTransportSubmitTakeAll(_LSTransportSubmit *submit);
+void _LSTransportSubmitNodeFree(_LSTransportSubmitNode *node);
+
+/** @} LunaServiceTransportSubmit */
+
+#endif      // _TRANSPORT_SUBMIT_H_
@@ -0,0 +1,419 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "error.h"
+#include "transport_trace.h"
+
+/**
+ * @defgroup LunaServiceTransportTrace
+ * @ingroup LunaServiceTransport
+ * @brief Lossy shared memory trace of the messages of a process for the monitor
+ */
+
+/**
+ * @addtogroup LunaServiceTransportTrace
+ * @{
+ */
+
+/* memfd and file sealing; older libc headers don't have these */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS         (1024 + 9)
+#define F_GET_SEALS         (1024 + 10)
+#define F_SEAL_SHRINK       0x0002
+#define F_SEAL_GROW         0x0004
+#endif
+
+/* the monitor maps the ring for as long as it traces us, so its size must not
+ * change under it */
+#define LS_TRANSPORT_TRACE_SEALS    (F_SEAL_SHRINK | F_SEAL_GROW)
+
+#define LS_TRANSPORT_TRACE_CACHELINE    64
+#define LS_TRANSPORT_TRACE_MAGIC        0x4c535452      /* "LSTR" */
+
+#define LS_TRANSPORT_TRACE_SEQ_BUSY     UINT64_MAX      /**< record is being written */
+
+/**
+ * Ring state in shared memory; the records follow it. The position is free
+ * running, so record i lives in slot (i & (capacity - 1)).
+ */
+struct LSTransportTraceHeader {
+    uint32_t magic;
+    uint32_t record_size;       /**< sizeof(_LSTransportTraceRecord) of the writer */
+    uint32_t capacity;          /**< number of records (power of 2) */
+    int32_t pid;                /**< writing process */
+    char pad0[LS_TRANSPORT_TRACE_CACHELINE - 4 * sizeof(uint32_t)];
+    uint64_t head;              /**< next record to be reserved by a writer */
+    char pad1[LS_TRANSPORT_TRACE_CACHELINE - sizeof(uint64_t)];
+};
+
+static inline size_t
+_LSTransportTraceRegionSize(unsigned int capacity)
+{
+    return sizeof(_LSTransportTraceHeader) + (size_t)capacity * sizeof(_LSTransportTraceRecord);
+}
+
+/* the monitor's mapping is read-only, so it can't use atomic read-modify-write
+ * operations to read the head */
+static inline uint64_t
+_LSTransportTraceGetHead(const _LSTransportTraceHeader *header)
+{
+    uint64_t head = *(volatile const uint64_t*)&header->head;
+    __sync_synchronize();
+    return head;
+}
+
+static void
+_LSTransportTraceCopyString(char *dest, size_t dest_size, const char *src)
+{
+    g_strlcpy(dest, src ? src : "", dest_size);
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a trace ring.
+ *
+ * @param  capacity     IN  number of records (power of 2)
+ *
+ * @retval trace ring on success
+ * @retval NULL on failure (e.g., kernel without memfd support)
+ *******************************************************************************
+ */
+_LSTransportTrace*
+_LSTransportTraceNew(unsigned int capacity)
+{
+    LS_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    _LSTransportTrace *trace = g_slice_new0(_LSTransportTrace);
+    trace->fd = -1;
+    trace->map_size = _LSTransportTraceRegionSize(capacity);
+
+#ifdef SYS_memfd_create
+    trace->fd = syscall(SYS_memfd_create, "ls2-trace", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+    if (trace->fd == -1 || ftruncate(trace->fd, trace->map_size) != 0 ||
+        fcntl(trace->fd, F_ADD_SEALS, LS_TRANSPORT_TRACE_SEALS) != 0)
+    {
+        goto error;
+    }
+
+    void *map = mmap(NULL, trace->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        goto error;
+    }
+
+    /* the memfd starts out zeroed, so no record looks complete */
+    trace->header = map;
+    trace->records = (_LSTransportTraceRecord*)((char*)map + sizeof(_LSTransportTraceHeader));
+
+    trace->header->record_size = sizeof(_LSTransportTraceRecord);
+    trace->header->capacity = capacity;
+    trace->header->pid = getpid();
+    __sync_synchronize();
+    trace->header->magic = LS_TRANSPORT_TRACE_MAGIC;
+
+    return trace;
+
+error:
+    LOG_LS_WARNING(MSGID_LS_SHARED_MEMORY_ERR, 2,
+                   PMLOGKFV("ERROR_CODE", "%d", errno),
+                   PMLOGKS("ERROR", g_strerror(errno)),
+                   "Could not create trace ring");
+    if (trace->fd != -1) close(trace->fd);
+    g_slice_free(_LSTransportTrace, trace);
+    return NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a trace ring. The monitor keeps its own mapping.
+ *
+ * @param  trace    IN  trace ring
+ *******************************************************************************
+ */
+void
+_LSTransportTraceFree(_LSTransportTrace *trace)
+{
+    if (!trace) return;
+
+    munmap(trace->header, trace->map_size);
+    close(trace->fd);
+    g_slice_free(_LSTransportTrace, trace);
+}
+
+/**
+ *******************************************************************************
+ * @brief Write a record of a message to the trace ring.
+ *
+ * Lock-free and never waits; safe to call from any thread.
+ *
+ * @param  trace        IN  trace ring
+ * @param  data         IN  serial, timestamp and direction of the message
+ * @param  message      IN  message
+ * @param  peer         IN  name of the far side
+ * @param  payload      IN  payload (need not be NUL-terminated) or NULL
+ * @param  payload_len  IN  length of @ref payload
+ *******************************************************************************
+ */
+void
+_LSTransportTraceWrite(_LSTransportTrace *trace, const _LSMonitorMessageData *data,
+                       const _LSTransportMessage *message, const char *peer,
+                       const char *payload, unsigned long payload_len)
+{
+    uint64_t pos = __sync_fetch_and_add(&trace->header->head, 1);
+    _LSTransportTraceRecord *record = &trace->records[pos & (trace->header->capacity - 1)];
+
+    record->seq = LS_TRANSPORT_TRACE_SEQ_BUSY;
+    __sync_synchronize();
+
+    record->serial = data->serial;
+    record->timestamp = data->timestamp;
+    record->monitor_type = data->type;
+    record->message_type = _LSTransportMessageGetType(message);
+    record->token = _LSTransportMessageGetToken(message);
+    record->reply_token = _LSTransportMessageIsReplyType(message)
+                          ? _LSTransportMessageGetReplyToken(message)
+                          : LSMESSAGE_TOKEN_INVALID;
+
+    _LSTransportTraceCopyString(record->peer, sizeof(record->peer), peer);
+
+    const char *category = _LSTransportMessageGetCategory(message);
+    const char *method = _LSTransportMessageGetMethod(message);
+    if (category && method)
+    {
+        g_snprintf(record->method, sizeof(record->method), "%s/%s", category, method);
+    }
+    else
+    {
+        _LSTransportTraceCopyString(record->method, sizeof(record->method), category);
+    }
+
+    if (!payload)
+    {
+        payload = "";
+        payload_len = 0;
+    }
+
+    unsigned long copy_len = MIN(payload_len, sizeof(record->payload) - 1);
+    memcpy(record->payload, payload, copy_len);
+    record->payload[copy_len] = '\0';
+    record->payload_len = payload_len;
+
+    __sync_synchronize();
+    record->seq = pos + 1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Map a trace ring passed by a client, read-only.
+ *
+ * Reading starts at the oldest record still in the ring.
+ *
+ * @param  fd       IN  memfd of the ring; closed by this function
+ * @param  lserror  OUT set on error
+ *
+ * @retval reader on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+_LSTransportTraceReader*
+_LSTransportTraceReaderNew(int fd, LSError *lserror)
+{
+    struct stat st;
+    void *map = MAP_FAILED;
+
+    if (fd == -1)
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -EINVAL, "No trace ring fd");
+        return NULL;
+    }
+
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & LS_TRANSPORT_TRACE_SEALS) != LS_TRANSPORT_TRACE_SEALS)
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -EINVAL, "Trace ring is not sealed");
+        goto error;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        goto error;
+    }
+
+    if (st.st_size < sizeof(_LSTransportTraceHeader))
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -EINVAL, "Trace ring too small");
+        goto error;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_SHARED_MEMORY_ERR, errno);
+        goto error;
+    }
+
+    const _LSTransportTraceHeader *header = map;
+    unsigned int capacity = header->capacity;
+
+    /* the writer must agree with us on the layout */
+    if (header->magic != LS_TRANSPORT_TRACE_MAGIC ||
+        header->record_size != sizeof(_LSTransportTraceRecord) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        _LSTransportTraceRegionSize(capacity) > st.st_size)
+    {
+        _LSErrorSet(lserror, MSGID_LS_SHARED_MEMORY_ERR, -EINVAL, "Invalid trace ring");
+        goto error;
+    }
+
+    close(fd);
+
+    _LSTransportTraceReader *reader = g_slice_new0(_LSTransportTraceReader);
+    reader->header = header;
+    reader->records = (const _LSTransportTraceRecord*)((const char*)map + sizeof(_LSTransportTraceHeader));
+    reader->map_size = st.st_size;
+    reader->capacity = capacity;
+
+    uint64_t head = _LSTransportTraceGetHead(header);
+    reader->pos = head > capacity ? head - capacity : 0;
+
+    return reader;
+
+error:
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    close(fd);
+    return NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Unmap a trace ring.
+ *
+ * @param  reader   IN  reader
+ *******************************************************************************
+ */
+void
+_LSTransportTraceReaderFree(_LSTransportTraceReader *reader)
+{
+    if (!reader) return;
+
+    munmap((void*)reader->header, reader->map_size);
+    g_slice_free(_LSTransportTraceReader, reader);
+}
+
+/**
+ *******************************************************************************
+ * @brief Read the next complete record from a trace ring.
+ *
+ * Records that were overwritten before we got to them are counted in
+ * @ref LSTransportTraceReader::dropped. A record that a writer reserved but
+ * still hasn't finished on the next call is given up on too, so a writer that
+ * died half way can't stall the reader.
+ *
+ * @param  reader   IN  reader
+ * @param  record   OUT copy of the record
+ *
+ * @retval true if a record was read
+ * @retval false if there are no more complete records for now
+ *******************************************************************************
+ */
+bool
+_LSTransportTraceReaderNext(_LSTransportTraceReader *reader, _LSTransportTraceRecord *record)
+{
+    /* the writer can still change the header, so only the checked copy is used */
+    uint64_t capacity = reader->capacity;
+
+    for (;;)
+    {
+        uint64_t head = _LSTransportTraceGetHead(reader->header);
+
+        if (reader->pos >= head)
+        {
+            return false;
+        }
+
+        /* the writers lapped us */
+        if (head - reader->pos > capacity)
+        {
+            reader->dropped += head - capacity - reader->pos;
+            reader->pos = head - capacity;
+        }
+
+        const _LSTransportTraceRecord *slot = &reader->records[reader->pos & (capacity - 1)];
+
+        uint64_t seq = *(volatile const uint64_t*)&slot->seq;
+        __sync_synchronize();
+
+        if (seq != reader->pos + 1)
+        {
+            if (seq != LS_TRANSPORT_TRACE_SEQ_BUSY && seq > reader->pos + 1)
+            {
+                /* overwritten since we looked at the head */
+                reader->dropped++;
+                reader->pos++;
+                continue;
+            }
+
+            /* not written yet; wait for it once */
+            if (reader->stalled != reader->pos + 1)
+            {
+                reader->stalled = reader->pos + 1;
+                return false;
+            }
+
+            reader->dropped++;
+            reader->pos++;
+            continue;
+        }
+
+        memcpy(record, slot, sizeof(*record));
+        __sync_synchronize();
+
+        /* make sure a writer didn't overwrite it while we were copying */
+        if (*(volatile const uint64_t*)&slot->seq != seq)
+        {
+            reader->dropped++;
+            reader->pos++;
+            continue;
+        }
+
+        record->method[sizeof(record->method) - 1] = '\0';
+        record->peer[sizeof(record->peer) - 1] = '\0';
+        record->payload[sizeof(record->payload) - 1] = '\0';
+
+        reader->pos++;
+        return true;
+    }
+}
+
+/** @} LunaServiceTransportTrace */
@@ -0,0 +1,114 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_TRACE_H_
+#define _TRANSPORT_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_shm.h"
+#include "transport_message.h"
+
+/**
+ * @addtogroup LunaServiceTransportTrace
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_TRACE_RECORDS          1024    /**< records per trace ring (power of 2) */
+
+#define LS_TRANSPORT_TRACE_PEER_SIZE        64      /**< room for the name of the far side */
+#define LS_TRANSPORT_TRACE_METHOD_SIZE      96      /**< room for "category/method" */
+#define LS_TRANSPORT_TRACE_PAYLOAD_SIZE     192     /**< room for the start of the payload */
+
+#define LS_TRANSPORT_TRACE_POLL_MS          100     /**< how often the monitor reads the trace rings */
+
+/**
+ * Compact record of a message sent or received by a process, written in
+ * place of a copy of the message while a monitor in trace mode is attached.
+ *
+ * Strings are NUL-terminated and cut to fit.
+ */
+struct LSTransportTraceRecord {
+    uint64_t seq;                       /**< position of the record in the ring plus 1 once it is
+                                             complete; only meaningful to the ring */
+    _LSTransportMonitorSerial serial;   /**< monitor serial, for merging the rings of all processes */
+    struct timespec timestamp;
+    int32_t monitor_type;               /**< @ref _LSMonitorMessageType */
+    int32_t message_type;               /**< @ref _LSTransportMessageType */
+    LSMessageToken token;
+    LSMessageToken reply_token;         /**< token of the call for replies; LSMESSAGE_TOKEN_INVALID otherwise */
+    uint32_t payload_len;               /**< length of the whole payload */
+    char peer[LS_TRANSPORT_TRACE_PEER_SIZE];        /**< service name (or unique name) of the far side */
+    char method[LS_TRANSPORT_TRACE_METHOD_SIZE];
+    char payload[LS_TRANSPORT_TRACE_PAYLOAD_SIZE];
+};
+
+typedef struct LSTransportTraceRecord _LSTransportTraceRecord;
+
+typedef struct LSTransportTraceHeader _LSTransportTraceHeader;
+
+/**
+ * Trace ring written by all the threads of a transport. It lives in a memfd
+ * that is passed to the monitor, which maps it read-only.
+ *
+ * Writers never wait: when the monitor falls behind, the oldest records are
+ * overwritten and the monitor counts them as dropped.
+ */
+struct LSTransportTrace {
+    int fd;                             /**< memfd holding the ring */
+    _LSTransportTraceHeader *header;
+    _LSTransportTraceRecord *records;
+    size_t map_size;
+};
+
+typedef struct LSTransportTrace _LSTransportTrace;
+
+/**
+ * Monitor side of a trace ring.
+ */
+struct LSTransportTraceReader {
+    const _LSTransportTraceHeader *header;
+    const _LSTransportTraceRecord *records;
+    size_t map_size;
+    unsigned int capacity;              /**< number of records, as checked when the ring was mapped */
+    uint64_t pos;                       /**< next record to read */
+    uint64_t stalled;                   /**< record that wasn't complete on the last try, plus 1 */
+    unsigned long dropped;              /**< records overwritten before we got to them */
+};
+
+typedef struct LSTransportTraceReader _LSTransportTraceReader;
+
+_LSTransportTrace* _LSTransportTraceNew(unsigned int capacity);
+void _LSTransportTraceFree(_LSTransportTrace *trace);
+void _LSTransportTraceWrite(_LSTransportTrace *trace, const _LSMonitorMessageData *data,
+                            const _LSTransportMessage *message, const char *peer,
+                            const char *payload, unsigned long payload_len);
+
+_LSTransportTraceReader* _LSTransportTraceReaderNew(int fd, LSError *lserror);
+void _LSTransportTraceReaderFree(_LSTransportTraceReader *reader);
+bool _LSTransportTraceReaderNext(_LSTransportTraceReader *reader, _LSTransportTraceRecord *record);
+
+/** @} LunaServiceTransportTrace */
+
+#endif      // _TRANSPORT_TRACE_H_
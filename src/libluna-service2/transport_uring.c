@@ -0,0 +1,1611 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <liburing.h>
+
+#include "error.h"
+#include "transport_utils.h"
+#include "transport_uring.h"
+
+/**
+ * @defgroup LunaServiceTransportUring
+ * @ingroup LunaServiceTransport
+ * @brief io_uring based I/O engine for transport sockets
+ */
+
+/**
+ * @addtogroup LunaServiceTransportUring
+ * @{
+ */
+
+/**
+ * Operations, which are kept in the low bits of the user data of their
+ * submissions next to the entry they're for.
+ */
+typedef enum LSTransportUringOp {
+    _LSTransportUringOpIn,          /**< multishot accept or receive */
+    _LSTransportUringOpSend,        /**< send of a batch of messages */
+    _LSTransportUringOpSendFd,      /**< fd that is linked to the send */
+    _LSTransportUringOpIgnore,      /**< cancellation or probe; nothing to do when it completes */
+} _LSTransportUringOp;
+
+#define LS_TRANSPORT_URING_OP_MASK  3
+
+/**
+ * Data that has been received, or a connection that has been accepted, and
+ * hasn't been picked up by the callback yet.
+ */
+typedef struct LSTransportUringChunk {
+    int bid;                /**< provided buffer holding the data; -1 for an accepted connection */
+    char *data;             /**< unread data */
+    unsigned int len;       /**< bytes of unread data */
+    int fd;                 /**< fd that came with the data, or the accepted connection; -1 if none */
+} _LSTransportUringChunk;
+
+/**
+ * A callback waiting for completions on a channel.
+ */
+typedef struct LSTransportUringWatch {
+    GIOFunc func;               /**< NULL if the watch isn't set */
+    void *user_data;
+    GDestroyNotify destroy;     /**< called for @ref user_data when the watch goes away */
+    unsigned int serial;        /**< bumped every time the watch is set */
+    unsigned int generation;    /**< dispatch in which the callback was last called */
+} _LSTransportUringWatch;
+
+/**
+ * State of a channel's socket in the engine. It lives apart from the channel,
+ * since the kernel may still complete operations for it after the channel is
+ * gone.
+ */
+typedef struct LSTransportUringEntry {
+    _LSTransportUring *uring;       /**< engine (holds a ref to its source) */
+    int fd;                         /**< -1 once the channel is closed */
+    GIOChannel *io;                 /**< passed to the callbacks */
+    int ref;                        /**< the channel's ref, one per operation in flight and one per queue it's in */
+    bool listening;                 /**< fd is a listening socket */
+    bool queued;                    /**< in the engine's ready queue */
+    bool starved;                   /**< in the engine's starved queue */
+
+    _LSTransportUringWatch in;      /**< receive or accept watch */
+    bool in_armed;                  /**< multishot accept or receive is in flight */
+    bool in_cancelled;              /**< and its cancellation was requested */
+    GQueue chunks;                  /**< @ref _LSTransportUringChunk not picked up yet */
+    int in_error;                   /**< errno that ended receiving; 0 if none */
+    bool eof;                       /**< the far side has closed the connection */
+    struct msghdr recv_msg;         /**< layout of the buffers the receive fills */
+
+    _LSTransportUringWatch out;     /**< send watch */
+    int send_ops;                   /**< send operations in flight */
+    bool send_done;                 /**< @ref send_result hasn't been picked up yet */
+    int send_result;                /**< bytes sent or -errno */
+    bool fd_sent;                   /**< the fd linked to the send went out */
+    struct iovec *send_iov;         /**< copy of the batch in flight */
+    struct msghdr send_msg;
+    GPtrArray *send_holds;          /**< keep the batch in flight alive */
+    struct msghdr fd_msg;
+    struct iovec fd_iov;
+    char fd_marker;
+    char fd_cmsg[CMSG_SPACE(sizeof(int))];
+} _LSTransportUringEntry;
+
+/**
+ * Destroy notification that has to wait until the callbacks are done.
+ */
+typedef struct LSTransportUringDeferred {
+    GDestroyNotify destroy;
+    void *user_data;
+} _LSTransportUringDeferred;
+
+struct LSTransportUring {
+    GSource source;
+    GPollFD poll_fd;                /**< the ring's fd, readable when there are completions */
+    struct io_uring ring;
+    bool exited;                    /**< the ring is gone; nothing completes anymore */
+    struct io_uring_buf_ring *buf_ring;
+    char *bufs;                     /**< memory of the provided buffers */
+    int buf_mask;
+    bool bufs_returned;             /**< buffers went back to the kernel since the last dispatch */
+    GQueue ready;                   /**< entries with callbacks to run */
+    GQueue starved;                 /**< entries whose receive ran out of buffers */
+    GHashTable *entries;            /**< all entries, to drop their operations when the ring goes away */
+    unsigned int generation;        /**< bumped for every dispatch */
+    bool dispatching;               /**< callbacks are running */
+    GArray *deferred;               /**< @ref _LSTransportUringDeferred to run after dispatching */
+};
+
+static gboolean _LSTransportUringPrepare(GSource *source, gint *timeout_ms);
+static gboolean _LSTransportUringCheck(GSource *source);
+static gboolean _LSTransportUringDispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+static void _LSTransportUringFinalize(GSource *source);
+
+static GSourceFuncs _LSTransportUringFuncs = {
+    .prepare  = _LSTransportUringPrepare,
+    .check    = _LSTransportUringCheck,
+    .dispatch = _LSTransportUringDispatch,
+    .finalize = _LSTransportUringFinalize,
+};
+
+static inline char*
+_LSTransportUringBuf(_LSTransportUring *uring, int bid)
+{
+    return uring->bufs + (size_t)bid * LS_TRANSPORT_URING_BUF_SIZE;
+}
+
+static inline void
+_LSTransportUringSetData(struct io_uring_sqe *sqe, _LSTransportUringEntry *entry, _LSTransportUringOp op)
+{
+    io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)entry | op);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get a free submission queue entry, handing what is queued to the
+ * kernel if the queue is full.
+ *
+ * @param  uring    IN  engine
+ * @param  count    IN  number of consecutive entries the caller needs
+ *
+ * @retval  entry on success
+ * @retval  NULL if the submission queue can't be drained
+ *******************************************************************************
+ */
+static struct io_uring_sqe*
+_LSTransportUringGetSqe(_LSTransportUring *uring, unsigned int count)
+{
+    if (io_uring_sq_space_left(&uring->ring) < count)
+    {
+        int ret = io_uring_submit(&uring->ring);
+
+        if (ret < 0)
+        {
+            LOG_LS_ERROR(MSGID_LS_URING_ERR, 1,
+                         PMLOGKFV("ERROR_CODE", "%d", -ret),
+                         "%s: io_uring_submit failed: %s", __func__, g_strerror(-ret));
+            return NULL;
+        }
+    }
+
+    return io_uring_get_sqe(&uring->ring);
+}
+
+/**
+ *******************************************************************************
+ * @brief Give a provided buffer back to the kernel.
+ *
+ * @param  uring    IN  engine
+ * @param  bid      IN  buffer id
+ *******************************************************************************
+ */
+static void
+_LSTransportUringRecycle(_LSTransportUring *uring, int bid)
+{
+    if (uring->exited)
+    {
+        return;
+    }
+
+    io_uring_buf_ring_add(uring->buf_ring, _LSTransportUringBuf(uring, bid), LS_TRANSPORT_URING_BUF_SIZE,
+                          bid, uring->buf_mask, 0);
+    io_uring_buf_ring_advance(uring->buf_ring, 1);
+    uring->bufs_returned = true;
+}
+
+static void
+_LSTransportUringChunkFree(_LSTransportUring *uring, _LSTransportUringChunk *chunk)
+{
+    if (chunk->bid >= 0)
+    {
+        _LSTransportUringRecycle(uring, chunk->bid);
+    }
+
+    if (chunk->fd != -1)
+    {
+        close(chunk->fd);
+    }
+
+    g_slice_free(_LSTransportUringChunk, chunk);
+}
+
+static void
+_LSTransportUringSendFinish(_LSTransportUringEntry *entry)
+{
+    g_free(entry->send_iov);
+    entry->send_iov = NULL;
+
+    if (entry->send_holds)
+    {
+        g_ptr_array_unref(entry->send_holds);
+        entry->send_holds = NULL;
+    }
+}
+
+static void
+_LSTransportUringEntryFree(_LSTransportUringEntry *entry)
+{
+    _LSTransportUring *uring = entry->uring;
+    _LSTransportUringChunk *chunk;
+
+    while ((chunk = g_queue_pop_head(&entry->chunks)))
+    {
+        _LSTransportUringChunkFree(uring, chunk);
+    }
+
+    _LSTransportUringSendFinish(entry);
+
+    g_hash_table_remove(uring->entries, entry);
+    g_io_channel_unref(entry->io);
+    g_slice_free(_LSTransportUringEntry, entry);
+
+    g_source_unref(&uring->source);
+}
+
+static inline void
+_LSTransportUringEntryUnref(_LSTransportUringEntry *entry)
+{
+    LS_ASSERT(entry->ref > 0);
+
+    if (--entry->ref == 0)
+    {
+        _LSTransportUringEntryFree(entry);
+    }
+}
+
+static inline bool
+_LSTransportUringInReady(const _LSTransportUringEntry *entry)
+{
+    return entry->in.func && (!g_queue_is_empty((GQueue*)&entry->chunks) || entry->in_error || entry->eof);
+}
+
+static inline bool
+_LSTransportUringOutReady(const _LSTransportUringEntry *entry)
+{
+    /* the callback is called again once the batch in flight is done */
+    return entry->out.func && entry->send_ops == 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Put an entry in the ready queue if one of its callbacks has to run.
+ *
+ * @param  entry    IN  entry
+ *******************************************************************************
+ */
+static void
+_LSTransportUringQueue(_LSTransportUringEntry *entry)
+{
+    if (!entry->queued && (_LSTransportUringInReady(entry) || _LSTransportUringOutReady(entry)))
+    {
+        entry->queued = true;
+        entry->ref++;
+        g_queue_push_tail(&entry->uring->ready, entry);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Start the multishot accept or receive of an entry, unless it's
+ * running or there's nothing to do it for.
+ *
+ * @param  entry    IN  entry
+ *******************************************************************************
+ */
+static void
+_LSTransportUringArm(_LSTransportUringEntry *entry)
+{
+    _LSTransportUring *uring = entry->uring;
+
+    if (uring->exited || entry->fd == -1 || !entry->in.func ||
+        entry->in_armed || entry->starved || entry->in_error || entry->eof)
+    {
+        return;
+    }
+
+    struct io_uring_sqe *sqe = _LSTransportUringGetSqe(uring, 1);
+
+    if (!sqe)
+    {
+        return;
+    }
+
+    if (entry->listening)
+    {
+        io_uring_prep_multishot_accept(sqe, entry->fd, NULL, NULL, 0);
+    }
+    else
+    {
+        /* the kernel picks a buffer from the pool for every completion */
+        io_uring_prep_recvmsg_multishot(sqe, entry->fd, &entry->recv_msg, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = LS_TRANSPORT_URING_BUF_GROUP;
+    }
+
+    _LSTransportUringSetData(sqe, entry, _LSTransportUringOpIn);
+
+    entry->in_armed = true;
+    entry->in_cancelled = false;
+    entry->ref++;
+}
+
+/**
+ *******************************************************************************
+ * @brief Request cancellation of the multishot accept or receive of an
+ * entry. It's still in flight until its last completion comes in.
+ *
+ * @param  entry    IN  entry
+ *******************************************************************************
+ */
+static void
+_LSTransportUringCancelIn(_LSTransportUringEntry *entry)
+{
+    _LSTransportUring *uring = entry->uring;
+
+    if (uring->exited || !entry->in_armed || entry->in_cancelled)
+    {
+        return;
+    }
+
+    struct io_uring_sqe *sqe = _LSTransportUringGetSqe(uring, 1);
+
+    if (!sqe)
+    {
+        return;
+    }
+
+    io_uring_prep_cancel64(sqe, (uint64_t)(uintptr_t)entry | _LSTransportUringOpIn, 0);
+    _LSTransportUringSetData(sqe, NULL, _LSTransportUringOpIgnore);
+
+    entry->in_cancelled = true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Queue the data of a receive completion for the callback.
+ *
+ * @param  uring    IN  engine
+ * @param  entry    IN  entry
+ * @param  bid      IN  buffer the kernel filled
+ * @param  res      IN  result of the completion
+ *******************************************************************************
+ */
+static void
+_LSTransportUringAddReceived(_LSTransportUring *uring, _LSTransportUringEntry *entry, int bid, int res)
+{
+    struct io_uring_recvmsg_out *out = io_uring_recvmsg_validate(_LSTransportUringBuf(uring, bid), res, &entry->recv_msg);
+
+    if (!out)
+    {
+        LOG_LS_ERROR(MSGID_LS_URING_ERR, 1,
+                     PMLOGKFV("FD", "%d", entry->fd),
+                     "%s: malformed receive completion of %d bytes", __func__, res);
+        _LSTransportUringRecycle(uring, bid);
+        entry->in_error = EPROTO;
+        return;
+    }
+
+    struct cmsghdr *cmsg;
+    int fd = -1;
+
+    for (cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &entry->recv_msg);
+         cmsg != NULL;
+         cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &entry->recv_msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    unsigned int len = io_uring_recvmsg_payload_length(out, res, &entry->recv_msg);
+
+    if (len == 0)
+    {
+        /* orderly shutdown */
+        _LSTransportUringRecycle(uring, bid);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        entry->eof = true;
+        return;
+    }
+
+    _LSTransportUringChunk *chunk = g_slice_new(_LSTransportUringChunk);
+
+    chunk->bid = bid;
+    chunk->data = io_uring_recvmsg_payload(out, &entry->recv_msg);
+    chunk->len = len;
+    chunk->fd = fd;
+
+    g_queue_push_tail(&entry->chunks, chunk);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle a completion of the multishot accept or receive of an entry.
+ *
+ * @param  uring    IN  engine
+ * @param  entry    IN  entry
+ * @param  cqe      IN  completion
+ *******************************************************************************
+ */
+static void
+_LSTransportUringCompleteIn(_LSTransportUring *uring, _LSTransportUringEntry *entry, const struct io_uring_cqe *cqe)
+{
+    int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    if (cqe->res >= 0 && entry->listening)
+    {
+        _LSTransportUringChunk *chunk = g_slice_new0(_LSTransportUringChunk);
+
+        chunk->bid = -1;
+        chunk->fd = cqe->res;
+
+        g_queue_push_tail(&entry->chunks, chunk);
+    }
+    else if (cqe->res >= 0 && bid >= 0)
+    {
+        _LSTransportUringAddReceived(uring, entry, bid, cqe->res);
+    }
+    else if (cqe->res == -ENOBUFS)
+    {
+        /* the pool ran dry; started again once buffers come back */
+        if (!entry->starved)
+        {
+            entry->starved = true;
+            entry->ref++;
+            g_queue_push_tail(&uring->starved, entry);
+        }
+    }
+    else if (cqe->res < 0 && cqe->res != -ECANCELED)
+    {
+        if (entry->listening)
+        {
+            /* accept is started again below, like the listening socket
+             * stays readable */
+            LOG_LS_CRITICAL(MSGID_LS_SOCK_ERROR, 2,
+                            PMLOGKFV("ERROR_CODE", "%d", -cqe->res),
+                            PMLOGKS("ERROR", g_strerror(-cqe->res)),
+                            "Accept error");
+        }
+        else
+        {
+            entry->in_error = -cqe->res;
+        }
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        entry->in_armed = false;
+        _LSTransportUringArm(entry);
+        _LSTransportUringQueue(entry);
+        _LSTransportUringEntryUnref(entry);
+        return;
+    }
+
+    _LSTransportUringQueue(entry);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle the completion of a send, or of the fd linked to it.
+ *
+ * @param  entry    IN  entry
+ * @param  op       IN  which of the two completed
+ * @param  res      IN  result of the completion
+ *******************************************************************************
+ */
+static void
+_LSTransportUringCompleteSend(_LSTransportUringEntry *entry, _LSTransportUringOp op, int res)
+{
+    if (op == _LSTransportUringOpSend)
+    {
+        entry->send_result = res;
+    }
+    else
+    {
+        /* -ECANCELED if the send was cut short */
+        entry->fd_sent = (res == 1);
+    }
+
+    LS_ASSERT(entry->send_ops > 0);
+
+    if (--entry->send_ops == 0)
+    {
+        entry->send_done = true;
+        _LSTransportUringSendFinish(entry);
+        _LSTransportUringQueue(entry);
+    }
+
+    _LSTransportUringEntryUnref(entry);
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle all completions the kernel has posted.
+ *
+ * @param  uring    IN  engine
+ *******************************************************************************
+ */
+static void
+_LSTransportUringReap(_LSTransportUring *uring)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    unsigned int count = 0;
+
+    io_uring_for_each_cqe(&uring->ring, head, cqe)
+    {
+        uint64_t data = io_uring_cqe_get_data64(cqe);
+        _LSTransportUringOp op = data & LS_TRANSPORT_URING_OP_MASK;
+        _LSTransportUringEntry *entry = (_LSTransportUringEntry*)(uintptr_t)(data & ~(uint64_t)LS_TRANSPORT_URING_OP_MASK);
+
+        switch (op)
+        {
+        case _LSTransportUringOpIn:
+            _LSTransportUringCompleteIn(uring, entry, cqe);
+            break;
+
+        case _LSTransportUringOpSend:
+        case _LSTransportUringOpSendFd:
+            _LSTransportUringCompleteSend(entry, op, cqe->res);
+            break;
+
+        case _LSTransportUringOpIgnore:
+            break;
+        }
+
+        count++;
+    }
+
+    io_uring_cq_advance(&uring->ring, count);
+}
+
+/**
+ *******************************************************************************
+ * @brief Unset a watch.
+ *
+ * @param  entry    IN  entry
+ * @param  watch    IN  watch of @ref entry to unset
+ * @param  deferred OUT destroy notification to run
+ *******************************************************************************
+ */
+static void
+_LSTransportUringClearWatch(_LSTransportUringEntry *entry, _LSTransportUringWatch *watch,
+                            _LSTransportUringDeferred *deferred)
+{
+    deferred->destroy = watch->destroy;
+    deferred->user_data = watch->user_data;
+
+    watch->func = NULL;
+    watch->user_data = NULL;
+    watch->destroy = NULL;
+
+    if (watch == &entry->in)
+    {
+        /* don't keep filling buffers nobody reads */
+        _LSTransportUringCancelIn(entry);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Hold on to a destroy notification while callbacks are running, since
+ * they may still use the data.
+ *
+ * @param  uring        IN  engine
+ * @param  deferred     IN/OUT  notification; cleared if it was queued
+ *******************************************************************************
+ */
+static void
+_LSTransportUringDefer(_LSTransportUring *uring, _LSTransportUringDeferred *deferred)
+{
+    if (deferred->destroy && uring->dispatching)
+    {
+        g_array_append_val(uring->deferred, *deferred);
+        deferred->destroy = NULL;
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Call a watch's callback, and unset the watch if the callback returns
+ * false.
+ *
+ * @param  uring        IN  engine
+ * @param  entry        IN  entry
+ * @param  watch        IN  watch of @ref entry
+ * @param  condition    IN  condition to pass to the callback
+ *******************************************************************************
+ */
+static void
+_LSTransportUringCall(_LSTransportUring *uring, _LSTransportUringEntry *entry,
+                      _LSTransportUringWatch *watch, GIOCondition condition)
+{
+    GIOFunc func = watch->func;
+    unsigned int serial = watch->serial;
+
+    watch->generation = uring->generation;
+
+    if (!func(entry->io, condition, watch->user_data))
+    {
+        /* unless the callback has already replaced the watch */
+        if (watch->func && watch->serial == serial)
+        {
+            _LSTransportUringDeferred deferred;
+            _LSTransportUringClearWatch(entry, watch, &deferred);
+            _LSTransportUringDefer(uring, &deferred);
+        }
+    }
+}
+
+static gboolean
+_LSTransportUringPrepare(GSource *source, gint *timeout_ms)
+{
+    _LSTransportUring *uring = (_LSTransportUring*)source;
+
+    /* hand over what was queued outside of dispatch, e.g. by timeouts */
+    if (io_uring_sq_ready(&uring->ring) > 0)
+    {
+        (void)io_uring_submit(&uring->ring);
+    }
+
+    *timeout_ms = -1;
+
+    return !g_queue_is_empty(&uring->ready) ||
+           io_uring_cq_ready(&uring->ring) > 0 ||
+           (uring->bufs_returned && !g_queue_is_empty(&uring->starved));
+}
+
+static gboolean
+_LSTransportUringCheck(GSource *source)
+{
+    _LSTransportUring *uring = (_LSTransportUring*)source;
+
+    return (uring->poll_fd.revents & G_IO_IN) ||
+           !g_queue_is_empty(&uring->ready) ||
+           io_uring_cq_ready(&uring->ring) > 0 ||
+           (uring->bufs_returned && !g_queue_is_empty(&uring->starved));
+}
+
+/**
+ *******************************************************************************
+ * @brief Handle the completions and run the callbacks of the ready entries.
+ *
+ * Callbacks make more entries ready as they go, e.g. by replying to other
+ * clients, and those are handled in the same pass, so that all of the sends
+ * go to the kernel together at the end. Each callback runs at most once per
+ * pass, and entries that are still ready after that wait for the next main
+ * loop iteration.
+ *******************************************************************************
+ */
+static gboolean
+_LSTransportUringDispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    _LSTransportUring *uring = (_LSTransportUring*)source;
+    _LSTransportUringEntry *entry;
+    GQueue later = G_QUEUE_INIT;
+
+    _LSTransportUringReap(uring);
+
+    uring->dispatching = true;
+    uring->generation++;
+
+    while ((entry = g_queue_pop_head(&uring->ready)))
+    {
+        entry->queued = false;
+
+        if (_LSTransportUringInReady(entry) && entry->in.generation != uring->generation)
+        {
+            GIOCondition condition = G_IO_IN;
+
+            if (entry->eof) condition |= G_IO_HUP;
+            if (entry->in_error) condition |= G_IO_ERR;
+
+            _LSTransportUringCall(uring, entry, &entry->in, condition);
+        }
+
+        if (_LSTransportUringOutReady(entry) && entry->out.generation != uring->generation)
+        {
+            _LSTransportUringCall(uring, entry, &entry->out, G_IO_OUT);
+        }
+
+        if (_LSTransportUringInReady(entry) || _LSTransportUringOutReady(entry))
+        {
+            /* keeps the ref of the ready queue */
+            g_queue_push_tail(&later, entry);
+        }
+        else
+        {
+            _LSTransportUringEntryUnref(entry);
+        }
+    }
+
+    uring->dispatching = false;
+
+    while ((entry = g_queue_pop_head(&later)))
+    {
+        if (entry->queued)
+        {
+            /* queued again while we were still in this pass */
+            _LSTransportUringEntryUnref(entry);
+        }
+        else
+        {
+            entry->queued = true;
+            g_queue_push_tail(&uring->ready, entry);
+        }
+    }
+
+    if (uring->bufs_returned)
+    {
+        uring->bufs_returned = false;
+
+        while ((entry = g_queue_pop_head(&uring->starved)))
+        {
+            entry->starved = false;
+            _LSTransportUringArm(entry);
+            _LSTransportUringEntryUnref(entry);
+        }
+    }
+
+    if (io_uring_sq_ready(&uring->ring) > 0)
+    {
+        int ret = io_uring_submit(&uring->ring);
+
+        if (ret < 0)
+        {
+            LOG_LS_ERROR(MSGID_LS_URING_ERR, 1,
+                         PMLOGKFV("ERROR_CODE", "%d", -ret),
+                         "%s: io_uring_submit failed: %s", __func__, g_strerror(-ret));
+        }
+    }
+
+    GArray *deferred = uring->deferred;
+    uring->deferred = g_array_new(FALSE, FALSE, sizeof(_LSTransportUringDeferred));
+
+    int i;
+    for (i = 0; i < deferred->len; i++)
+    {
+        _LSTransportUringDeferred *item = &g_array_index(deferred, _LSTransportUringDeferred, i);
+        item->destroy(item->user_data);
+    }
+    g_array_free(deferred, TRUE);
+
+    return TRUE;
+}
+
+static void
+_LSTransportUringFinalize(GSource *source)
+{
+    _LSTransportUring *uring = (_LSTransportUring*)source;
+
+    LS_ASSERT(uring->deferred->len == 0);
+    LS_ASSERT(g_hash_table_size(uring->entries) == 0);
+
+    if (!uring->exited)
+    {
+        io_uring_free_buf_ring(&uring->ring, uring->buf_ring, LS_TRANSPORT_URING_BUF_COUNT, LS_TRANSPORT_URING_BUF_GROUP);
+        io_uring_queue_exit(&uring->ring);
+    }
+
+    g_free(uring->bufs);
+    g_hash_table_destroy(uring->entries);
+    g_array_free(uring->deferred, TRUE);
+}
+
+/**
+ *******************************************************************************
+ * @brief Check that the kernel does multishot receives into provided
+ * buffers, which came last of the features the engine relies on (5.19 for
+ * buffer rings and multishot accept, 6.0 for multishot receives).
+ *
+ * @param  uring    IN  engine with its buffers set up and no operations yet
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true if the kernel has the features
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+static bool
+_LSTransportUringProbe(_LSTransportUring *uring, LSError *lserror)
+{
+    int fds[2];
+    struct msghdr msg;
+    struct io_uring_cqe *cqe;
+    bool supported = false;
+    int ret;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_URING_ERR, errno);
+        return false;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+    io_uring_prep_recvmsg_multishot(sqe, fds[0], &msg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = LS_TRANSPORT_URING_BUF_GROUP;
+    _LSTransportUringSetData(sqe, NULL, _LSTransportUringOpIgnore);
+
+    ret = io_uring_submit(&uring->ring);
+    if (ret < 0 || write(fds[1], "", 1) != 1)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_URING_ERR, ret < 0 ? -ret : errno);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    /* closing the far side ends the receive, so everything is back in the
+     * pool when we're done */
+    close(fds[1]);
+
+    while ((ret = io_uring_wait_cqe(&uring->ring, &cqe)) == 0)
+    {
+        bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+        if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            supported = supported || more;
+            _LSTransportUringRecycle(uring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        else if (cqe->res < 0)
+        {
+            ret = cqe->res;
+        }
+
+        io_uring_cqe_seen(&uring->ring, cqe);
+
+        if (!more)
+        {
+            break;
+        }
+    }
+
+    close(fds[0]);
+    uring->bufs_returned = false;
+
+    if (!supported)
+    {
+        _LSErrorSet(lserror, MSGID_LS_URING_ERR, ret < 0 ? ret : -ENOTSUP,
+                    "Kernel doesn't support multishot receives into provided buffers");
+    }
+
+    return supported;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create an engine and attach its source to a main context.
+ *
+ * Fails if the kernel is missing any of the io_uring features the engine
+ * needs, in which case the transport keeps using GIOChannel watches.
+ *
+ * @param  context      IN  main loop context
+ * @param  priority     IN  priority of the source
+ * @param  lserror      OUT set on error
+ *
+ * @retval  engine on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportUring*
+_LSTransportUringNew(GMainContext *context, int priority, LSError *lserror)
+{
+    LS_ASSERT(context != NULL);
+
+    GSource *source = g_source_new(&_LSTransportUringFuncs, sizeof(_LSTransportUring));
+    _LSTransportUring *uring = (_LSTransportUring*)source;
+    int ret;
+    int i;
+
+    uring->deferred = g_array_new(FALSE, FALSE, sizeof(_LSTransportUringDeferred));
+    uring->entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&uring->ready);
+    g_queue_init(&uring->starved);
+
+    /* nothing to tear down in finalize until the ring and its buffers exist */
+    uring->exited = true;
+
+    ret = io_uring_queue_init(LS_TRANSPORT_URING_ENTRIES, &uring->ring, 0);
+    if (ret < 0)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_URING_ERR, -ret);
+        g_source_unref(source);
+        return NULL;
+    }
+
+    uring->buf_ring = io_uring_setup_buf_ring(&uring->ring, LS_TRANSPORT_URING_BUF_COUNT,
+                                              LS_TRANSPORT_URING_BUF_GROUP, 0, &ret);
+    if (!uring->buf_ring)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_URING_ERR, -ret);
+        io_uring_queue_exit(&uring->ring);
+        g_source_unref(source);
+        return NULL;
+    }
+
+    uring->exited = false;
+    uring->buf_mask = io_uring_buf_ring_mask(LS_TRANSPORT_URING_BUF_COUNT);
+    uring->bufs = g_malloc((size_t)LS_TRANSPORT_URING_BUF_COUNT * LS_TRANSPORT_URING_BUF_SIZE);
+
+    for (i = 0; i < LS_TRANSPORT_URING_BUF_COUNT; i++)
+    {
+        io_uring_buf_ring_add(uring->buf_ring, _LSTransportUringBuf(uring, i), LS_TRANSPORT_URING_BUF_SIZE,
+                              i, uring->buf_mask, i);
+    }
+    io_uring_buf_ring_advance(uring->buf_ring, LS_TRANSPORT_URING_BUF_COUNT);
+
+    if (!_LSTransportUringProbe(uring, lserror))
+    {
+        g_source_unref(source);
+        return NULL;
+    }
+
+    uring->poll_fd.fd = uring->ring.ring_fd;
+    uring->poll_fd.events = G_IO_IN;
+    g_source_add_poll(source, &uring->poll_fd);
+
+    if (priority != G_PRIORITY_DEFAULT)
+    {
+        g_source_set_priority(source, priority);
+    }
+
+    g_source_attach(source, context);
+
+    return uring;
+}
+
+/**
+ *******************************************************************************
+ * @brief Detach an engine from its main context, tear down the ring and drop
+ * the caller's ref.
+ *
+ * Channels that are still registered keep the engine alive until they're
+ * released, but their callbacks aren't called anymore.
+ *
+ * @param  uring    IN  engine
+ *******************************************************************************
+ */
+void
+_LSTransportUringFree(_LSTransportUring *uring)
+{
+    LS_ASSERT(uring != NULL);
+
+    g_source_destroy(&uring->source);
+
+    GList *entries = g_hash_table_get_keys(uring->entries);
+    GList *iter;
+
+    for (iter = entries; iter != NULL; iter = iter->next)
+    {
+        ((_LSTransportUringEntry*)iter->data)->ref++;
+    }
+
+    io_uring_free_buf_ring(&uring->ring, uring->buf_ring, LS_TRANSPORT_URING_BUF_COUNT, LS_TRANSPORT_URING_BUF_GROUP);
+    io_uring_queue_exit(&uring->ring);
+    uring->exited = true;
+
+    /* nothing completes anymore, so drop the refs of the operations in
+     * flight and of the queues */
+    for (iter = entries; iter != NULL; iter = iter->next)
+    {
+        _LSTransportUringEntry *entry = iter->data;
+
+        if (entry->in_armed)
+        {
+            entry->in_armed = false;
+            entry->ref--;
+        }
+
+        if (entry->send_ops > 0)
+        {
+            entry->ref -= entry->send_ops;
+            entry->send_ops = 0;
+            _LSTransportUringSendFinish(entry);
+        }
+
+        if (entry->queued)
+        {
+            entry->queued = false;
+            entry->ref--;
+        }
+
+        if (entry->starved)
+        {
+            entry->starved = false;
+            entry->ref--;
+        }
+    }
+
+    g_queue_clear(&uring->ready);
+    g_queue_clear(&uring->starved);
+
+    g_list_free_full(entries, (GDestroyNotify)_LSTransportUringEntryUnref);
+
+    g_source_unref(&uring->source);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the engine's GSource (not ref counted).
+ *
+ * @param  uring    IN  engine
+ *
+ * @retval  source
+ *******************************************************************************
+ */
+GSource*
+_LSTransportUringGetSource(_LSTransportUring *uring)
+{
+    return &uring->source;
+}
+
+/**
+ *******************************************************************************
+ * @brief Start serving a watch on a channel.
+ *
+ * A watch on a listening socket accepts connections, a watch that includes
+ * G_IO_OUT sends and any other watch receives. Only sockets are served.
+ *
+ * @param  uring        IN  engine
+ * @param  channel      IN  channel
+ * @param  condition    IN  conditions of the watch
+ * @param  func         IN  callback; returning false unsets the watch
+ * @param  user_data    IN  passed to @ref func
+ * @param  destroy      IN  called for @ref user_data when the watch is unset
+ *
+ * @retval  true on success
+ * @retval  false if the channel can't be served; @ref destroy isn't called then
+ *******************************************************************************
+ */
+bool
+_LSTransportUringAddWatch(_LSTransportUring *uring, _LSTransportChannel *channel, GIOCondition condition,
+                          GIOFunc func, void *user_data, GDestroyNotify destroy)
+{
+    LS_ASSERT(uring != NULL);
+    LS_ASSERT(channel != NULL);
+    LS_ASSERT(func != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry)
+    {
+        int listening = 0;
+        socklen_t len = sizeof(listening);
+
+        /* e.g. the eventfd of a peer ring keeps its GIOChannel watch */
+        if (getsockopt(channel->fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == -1)
+        {
+            return false;
+        }
+
+        entry = g_slice_new0(_LSTransportUringEntry);
+        entry->uring = uring;
+        g_source_ref(&uring->source);
+        entry->fd = channel->fd;
+        entry->io = g_io_channel_ref(channel->channel);
+        entry->ref = 1;
+        entry->listening = (listening != 0);
+        g_queue_init(&entry->chunks);
+        entry->recv_msg.msg_controllen = CMSG_SPACE(sizeof(int));
+        g_hash_table_add(uring->entries, entry);
+        channel->uring_entry = entry;
+    }
+
+    LS_ASSERT(entry->uring == uring);
+
+    if (entry->fd == -1 || uring->exited)
+    {
+        return false;
+    }
+
+    _LSTransportUringWatch *watch = (condition & G_IO_OUT) ? &entry->out : &entry->in;
+
+    LS_ASSERT(watch->func == NULL);
+
+    watch->func = func;
+    watch->user_data = user_data;
+    watch->destroy = destroy;
+    watch->serial++;
+
+    if (watch == &entry->in)
+    {
+        _LSTransportUringArm(entry);
+    }
+
+    _LSTransportUringQueue(entry);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Stop serving a watch on a channel. Does nothing if the watch isn't
+ * set (e.g., its callback returned false).
+ *
+ * Data that was received already is kept for when the watch is set again.
+ *
+ * @param  channel      IN  channel
+ * @param  condition    IN  conditions the watch was added with
+ *******************************************************************************
+ */
+void
+_LSTransportUringRemoveWatch(_LSTransportChannel *channel, GIOCondition condition)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportUringWatch *watch = (condition & G_IO_OUT) ? &entry->out : &entry->in;
+    _LSTransportUringDeferred deferred = { NULL, NULL };
+
+    if (watch->func)
+    {
+        _LSTransportUringClearWatch(entry, watch, &deferred);
+        _LSTransportUringDefer(entry->uring, &deferred);
+    }
+
+    if (deferred.destroy)
+    {
+        deferred.destroy(deferred.user_data);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether a channel's watch is served by the engine.
+ *
+ * @param  channel      IN  channel
+ * @param  watch        IN  watch source stored in the channel
+ *
+ * @retval  true if @ref watch is the source of the channel's engine
+ *******************************************************************************
+ */
+bool
+_LSTransportUringOwnsWatch(const _LSTransportChannel *channel, const GSource *watch)
+{
+    LS_ASSERT(channel != NULL);
+
+    return channel->uring_entry && watch == &channel->uring_entry->uring->source;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether the I/O of a channel has to go through the engine.
+ *
+ * @param  channel      IN  channel
+ *
+ * @retval  true if the channel is registered with the engine
+ *******************************************************************************
+ */
+bool
+_LSTransportUringOwnsChannel(const _LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    return channel->uring_entry != NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Stop the operations on a channel's socket before it's closed. The
+ * multishot receive holds on to the socket, so the far side wouldn't see it
+ * closed otherwise.
+ *
+ * The watches stay set until they're removed.
+ *
+ * @param  channel      IN  channel
+ *******************************************************************************
+ */
+void
+_LSTransportUringDetach(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportUringCancelIn(entry);
+    entry->fd = -1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Drop a channel's registration. Its watches must have been removed.
+ *
+ * @param  channel      IN  channel
+ *******************************************************************************
+ */
+void
+_LSTransportUringRelease(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry)
+    {
+        return;
+    }
+
+    _LSTransportUringDetach(channel);
+
+    LS_ASSERT(entry->in.func == NULL && entry->out.func == NULL);
+
+    channel->uring_entry = NULL;
+    _LSTransportUringEntryUnref(entry);
+}
+
+/**
+ *******************************************************************************
+ * @brief Take a connection that was accepted on a listening channel.
+ *
+ * @param  channel      IN  listening channel
+ *
+ * @retval  fd of the connection
+ * @retval  -1 with errno set to EAGAIN if there is none
+ *******************************************************************************
+ */
+int
+_LSTransportUringAccept(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+    LS_ASSERT(channel->uring_entry != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+    _LSTransportUringChunk *chunk = g_queue_pop_head(&entry->chunks);
+
+    if (!chunk)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    int fd = chunk->fd;
+
+    chunk->fd = -1;
+    _LSTransportUringChunkFree(entry->uring, chunk);
+
+    return fd;
+}
+
+/**
+ *******************************************************************************
+ * @brief Take data that was received on a channel.
+ *
+ * Works like a non-blocking recvmsg() on the socket: the data of a received
+ * fd starts a new read, and a read that doesn't ask for fds closes it.
+ *
+ * @param  channel      IN      channel
+ * @param  buf          IN      buffer to copy the data to
+ * @param  len          IN      size of @ref buf
+ * @param  fd_recvd     IN/OUT  set to the received file descriptor, if any;
+ *                              NULL to not take fds
+ *
+ * @retval  bytes copied
+ * @retval  0 once the far side has closed the connection
+ * @retval  -1 with errno set on error, or to EAGAIN if there is no data
+ *******************************************************************************
+ */
+int
+_LSTransportUringRecv(_LSTransportChannel *channel, char *buf, size_t len, int *fd_recvd)
+{
+    LS_ASSERT(channel != NULL);
+    LS_ASSERT(channel->uring_entry != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+    _LSTransportUringChunk *chunk;
+    size_t copied = 0;
+
+    while (copied < len && (chunk = g_queue_peek_head(&entry->chunks)))
+    {
+        if (chunk->fd != -1)
+        {
+            if (copied > 0)
+            {
+                break;
+            }
+
+            if (fd_recvd && *fd_recvd != -1)
+            {
+                /* the previous one was never claimed by a message */
+                LOG_LS_WARNING(MSGID_LS_SOCK_ERROR, 0, "Dropping unexpected fd: %d", *fd_recvd);
+                close(*fd_recvd);
+            }
+
+            if (fd_recvd)
+            {
+                *fd_recvd = chunk->fd;
+            }
+            else
+            {
+                close(chunk->fd);
+            }
+            chunk->fd = -1;
+        }
+
+        size_t n = MIN(len - copied, chunk->len);
+
+        memcpy(buf + copied, chunk->data, n);
+        copied += n;
+        chunk->data += n;
+        chunk->len -= n;
+
+        if (chunk->len == 0)
+        {
+            g_queue_pop_head(&entry->chunks);
+            _LSTransportUringChunkFree(entry->uring, chunk);
+        }
+    }
+
+    if (copied > 0)
+    {
+        return copied;
+    }
+
+    if (entry->in_error)
+    {
+        errno = entry->in_error;
+        return -1;
+    }
+
+    if (entry->eof)
+    {
+        return 0;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Queue a send on a channel. The result is picked up with
+ * _LSTransportUringTakeSendResult() when the send watch is called again.
+ *
+ * The fd that follows a message is sent with a one byte marker, as
+ * _LSTransportSendFd() does. Its send is linked to the batch, so that it
+ * goes out right after the batch, and only if all of the batch did.
+ *
+ * @param  channel      IN  channel; there must be no send in flight
+ * @param  iov          IN  data to send (copied)
+ * @param  iovcnt       IN  number of items in @ref iov
+ * @param  holds        IN  keeps the data alive until the send is done; the
+ *                          engine takes ownership
+ * @param  link_fd      IN  send @ref fd_to_send after the data
+ * @param  fd_to_send   IN  fd, or -1 to tell the far side there is none
+ *******************************************************************************
+ */
+void
+_LSTransportUringSend(_LSTransportChannel *channel, const struct iovec *iov, int iovcnt,
+                      GPtrArray *holds, bool link_fd, int fd_to_send)
+{
+    LS_ASSERT(channel != NULL);
+    LS_ASSERT(channel->uring_entry != NULL);
+    LS_ASSERT(iovcnt > 0);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+    _LSTransportUring *uring = entry->uring;
+
+    LS_ASSERT(entry->send_ops == 0 && !entry->send_done);
+
+    entry->send_iov = g_new(struct iovec, iovcnt);
+    memcpy(entry->send_iov, iov, sizeof(struct iovec) * iovcnt);
+    entry->send_holds = holds;
+    entry->fd_sent = false;
+
+    memset(&entry->send_msg, 0, sizeof(entry->send_msg));
+    entry->send_msg.msg_iov = entry->send_iov;
+    entry->send_msg.msg_iovlen = iovcnt;
+
+    struct io_uring_sqe *sqe = NULL;
+
+    if (!uring->exited && entry->fd != -1)
+    {
+        sqe = _LSTransportUringGetSqe(uring, link_fd ? 2 : 1);
+    }
+
+    if (!sqe)
+    {
+        entry->send_result = (entry->fd == -1) ? -EPIPE : -EAGAIN;
+        entry->send_done = true;
+        _LSTransportUringSendFinish(entry);
+        _LSTransportUringQueue(entry);
+        return;
+    }
+
+    /* a short send breaks the link, so the fd can't go out too early */
+    io_uring_prep_sendmsg(sqe, entry->fd, &entry->send_msg, link_fd ? MSG_WAITALL : 0);
+    _LSTransportUringSetData(sqe, entry, _LSTransportUringOpSend);
+    entry->send_ops++;
+    entry->ref++;
+
+    if (!link_fd)
+    {
+        return;
+    }
+
+    sqe->flags |= IOSQE_IO_LINK;
+
+    memset(&entry->fd_msg, 0, sizeof(entry->fd_msg));
+    entry->fd_iov.iov_base = &entry->fd_marker;
+    entry->fd_iov.iov_len = sizeof(entry->fd_marker);
+    entry->fd_msg.msg_iov = &entry->fd_iov;
+    entry->fd_msg.msg_iovlen = 1;
+
+    if (fd_to_send < 0)
+    {
+        /* non-zero means invalid fd */
+        entry->fd_marker = 1;
+    }
+    else
+    {
+        entry->fd_marker = 0;
+        entry->fd_msg.msg_control = entry->fd_cmsg;
+        entry->fd_msg.msg_controllen = sizeof(entry->fd_cmsg);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&entry->fd_msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd_to_send, sizeof(int));
+    }
+
+    /* space for both was reserved above */
+    sqe = io_uring_get_sqe(&uring->ring);
+    io_uring_prep_sendmsg(sqe, entry->fd, &entry->fd_msg, 0);
+    _LSTransportUringSetData(sqe, entry, _LSTransportUringOpSendFd);
+    entry->send_ops++;
+    entry->ref++;
+}
+
+/**
+ *******************************************************************************
+ * @brief Pick up the result of the last send on a channel once it's done.
+ *
+ * @param  channel      IN  channel
+ * @param  ret          OUT same as sendmsg()
+ *
+ * @retval  true if the send is done; @ref ret is set then
+ * @retval  false if there is no result
+ *******************************************************************************
+ */
+bool
+_LSTransportUringTakeSendResult(_LSTransportChannel *channel, int *ret)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry || !entry->send_done)
+    {
+        return false;
+    }
+
+    entry->send_done = false;
+
+    if (entry->send_result < 0)
+    {
+        errno = -entry->send_result;
+        *ret = -1;
+    }
+    else
+    {
+        *ret = entry->send_result;
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether the fd linked to the last send on a channel went out.
+ *
+ * @param  channel      IN  channel
+ *
+ * @retval  true if it did; only reported once
+ * @retval  false otherwise, and the caller has to send it
+ *******************************************************************************
+ */
+bool
+_LSTransportUringTakeFdSent(_LSTransportChannel *channel)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry || !entry->fd_sent)
+    {
+        return false;
+    }
+
+    entry->fd_sent = false;
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Block until the send in flight on a channel is done and pick up its
+ * result. Used when the rest of the queue is sent directly on shutdown.
+ *
+ * Other completions that come in meanwhile are handled as usual, and their
+ * callbacks run in the next dispatch.
+ *
+ * @param  channel      IN  channel
+ * @param  ret          OUT same as sendmsg()
+ *
+ * @retval  true if there was a send; @ref ret is set then
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+bool
+_LSTransportUringWaitSend(_LSTransportChannel *channel, int *ret)
+{
+    LS_ASSERT(channel != NULL);
+
+    _LSTransportUringEntry *entry = channel->uring_entry;
+
+    if (!entry)
+    {
+        return false;
+    }
+
+    _LSTransportUring *uring = entry->uring;
+
+    while (entry->send_ops > 0 && !uring->exited)
+    {
+        int wait_ret = io_uring_submit_and_wait(&uring->ring, 1);
+
+        if (wait_ret < 0 && wait_ret != -EINTR)
+        {
+            LOG_LS_ERROR(MSGID_LS_URING_ERR, 1,
+                         PMLOGKFV("ERROR_CODE", "%d", -wait_ret),
+                         "%s: io_uring_submit_and_wait failed: %s", __func__, g_strerror(-wait_ret));
+            return false;
+        }
+
+        _LSTransportUringReap(uring);
+    }
+
+    return _LSTransportUringTakeSendResult(channel, ret);
+}
+
+/* @} END OF LunaServiceTransportUring */
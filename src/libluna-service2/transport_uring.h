@@ -0,0 +1,182 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_URING_H_
+#define _TRANSPORT_URING_H_
+
+#include <stdbool.h>
+#include <sys/uio.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+#include "transport_channel.h"
+
+/**
+ * @addtogroup LunaServiceTransportUring
+ *
+ * @{
+ */
+
+#define LS_TRANSPORT_URING_ENTRIES      256     /**< size of the submission queue */
+#define LS_TRANSPORT_URING_BUF_COUNT    256     /**< buffers the kernel picks from for receives (power of 2) */
+#define LS_TRANSPORT_URING_BUF_SIZE     2048    /**< size of each of those buffers */
+#define LS_TRANSPORT_URING_BUF_GROUP    0       /**< id of the buffer group */
+
+/**
+ * I/O engine that does the socket I/O of a transport through io_uring.
+ *
+ * The listening socket has a multishot accept and every client socket a
+ * multishot receive that fills buffers which the kernel picks from a pool
+ * registered up front. Sends are queued as submissions, with the fd that
+ * follows a message linked to its send. Everything that was queued while
+ * handling completions goes to the kernel with a single io_uring_enter()
+ * per main loop iteration.
+ *
+ * The watch callbacks of the channels are called as usual, and get their
+ * data from the engine with _LSTransportUringAccept(),
+ * _LSTransportUringRecv() and _LSTransportUringSend() in place of the
+ * system calls.
+ *
+ * The engine isn't thread safe: it's only used by the hub, which runs its
+ * transport from a single thread.
+ */
+typedef struct LSTransportUring _LSTransportUring;
+
+#ifdef HAS_IO_URING
+
+_LSTransportUring* _LSTransportUringNew(GMainContext *context, int priority, LSError *lserror);
+void _LSTransportUringFree(_LSTransportUring *uring);
+GSource* _LSTransportUringGetSource(_LSTransportUring *uring);
+
+bool _LSTransportUringAddWatch(_LSTransportUring *uring, _LSTransportChannel *channel, GIOCondition condition,
+                               GIOFunc func, void *user_data, GDestroyNotify destroy);
+void _LSTransportUringRemoveWatch(_LSTransportChannel *channel, GIOCondition condition);
+bool _LSTransportUringOwnsWatch(const _LSTransportChannel *channel, const GSource *watch);
+bool _LSTransportUringOwnsChannel(const _LSTransportChannel *channel);
+void _LSTransportUringDetach(_LSTransportChannel *channel);
+void _LSTransportUringRelease(_LSTransportChannel *channel);
+
+int _LSTransportUringAccept(_LSTransportChannel *channel);
+int _LSTransportUringRecv(_LSTransportChannel *channel, char *buf, size_t len, int *fd_recvd);
+void _LSTransportUringSend(_LSTransportChannel *channel, const struct iovec *iov, int iovcnt,
+                           GPtrArray *holds, bool link_fd, int fd_to_send);
+bool _LSTransportUringTakeSendResult(_LSTransportChannel *channel, int *ret);
+bool _LSTransportUringTakeFdSent(_LSTransportChannel *channel);
+bool _LSTransportUringWaitSend(_LSTransportChannel *channel, int *ret);
+
+#else
+
+#include "error.h"
+
+/* Built without io_uring: channels never belong to the engine, so the I/O
+ * functions are never reached */
+
+static inline _LSTransportUring*
+_LSTransportUringNew(GMainContext *context, int priority, LSError *lserror)
+{
+    _LSErrorSet(lserror, MSGID_LS_URING_ERR, -ENOTSUP, "Built without io_uring support");
+    return NULL;
+}
+
+static inline GSource*
+_LSTransportUringGetSource(_LSTransportUring *uring)
+{
+    return NULL;
+}
+
+static inline void
+_LSTransportUringFree(_LSTransportUring *uring)
+{
+}
+
+static inline bool
+_LSTransportUringAddWatch(_LSTransportUring *uring, _LSTransportChannel *channel, GIOCondition condition,
+                          GIOFunc func, void *user_data, GDestroyNotify destroy)
+{
+    return false;
+}
+
+static inline void
+_LSTransportUringRemoveWatch(_LSTransportChannel *channel, GIOCondition condition)
+{
+}
+
+static inline bool
+_LSTransportUringOwnsWatch(const _LSTransportChannel *channel, const GSource *watch)
+{
+    return false;
+}
+
+static inline bool
+_LSTransportUringOwnsChannel(const _LSTransportChannel *channel)
+{
+    return false;
+}
+
+static inline void
+_LSTransportUringDetach(_LSTransportChannel *channel)
+{
+}
+
+static inline void
+_LSTransportUringRelease(_LSTransportChannel *channel)
+{
+}
+
+static inline int
+_LSTransportUringAccept(_LSTransportChannel *channel)
+{
+    return -1;
+}
+
+static inline int
+_LSTransportUringRecv(_LSTransportChannel *channel, char *buf, size_t len, int *fd_recvd)
+{
+    return -1;
+}
+
+static inline void
+_LSTransportUringSend(_LSTransportChannel *channel, const struct iovec *iov, int iovcnt,
+                      GPtrArray *holds, bool link_fd, int fd_to_send)
+{
+}
+
+static inline bool
+_LSTransportUringTakeSendResult(_LSTransportChannel *channel, int *ret)
+{
+    return false;
+}
+
+static inline bool
+_LSTransportUringTakeFdSent(_LSTransportChannel *channel)
+{
+    return false;
+}
+
+static inline bool
+_LSTransportUringWaitSend(_LSTransportChannel *channel, int *ret)
+{
+    return false;
+}
+
+#endif      // HAS_IO_URING
+
+/** @} LunaServiceTransportUring */
+
+#endif      // _TRANSPORT_URING_H_
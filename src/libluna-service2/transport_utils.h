@@ -84,14 +84,22 @@ do {                                                        \
     UNLOCK("Serial Info", mutex);                           \
 } while (0)
 
-#define GLOBAL_TOKEN_LOCK(mutex)                            \
+#define CLIENTS_READ_LOCK(rwlock)                           \
 do {                                                        \
-    LOCK("Global Token", mutex);                            \
+    LOG_LS_TRACE("%s: READ LOCK Clients\n", __func__);      \
+    pthread_rwlock_rdlock(rwlock);                          \
 } while (0)
 
-#define GLOBAL_TOKEN_UNLOCK(mutex)                          \
+#define CLIENTS_WRITE_LOCK(rwlock)                          \
 do {                                                        \
-    UNLOCK("Global Token", mutex);                          \
+    LOG_LS_TRACE("%s: WRITE LOCK Clients\n", __func__);     \
+    pthread_rwlock_wrlock(rwlock);                          \
+} while (0)
+
+#define CLIENTS_UNLOCK(rwlock)                              \
+do {                                                        \
+    LOG_LS_TRACE("%s: UNLOCK Clients\n", __func__);         \
+    pthread_rwlock_unlock(rwlock);                          \
 } while (0)
 
 #define OUTGOING_LOCK(mutex)                                \
@@ -124,5 +132,45 @@ do {                                                        \
     UNLOCK("Incoming", mutex);                              \
 } while (0)
 
+#define EPOLL_LOCK(mutex)                                   \
+do {                                                        \
+    LOCK("Epoll", mutex);                                   \
+} while (0)
+
+#define EPOLL_UNLOCK(mutex)                                 \
+do {                                                        \
+    UNLOCK("Epoll", mutex);                                 \
+} while (0)
+
+#define WORKERS_LOCK(mutex)                                 \
+do {                                                        \
+    LOCK("Workers", mutex);                                 \
+} while (0)
+
+#define WORKERS_UNLOCK(mutex)                               \
+do {                                                        \
+    UNLOCK("Workers", mutex);                               \
+} while (0)
+
+#define SUBMIT_LOCK(mutex)                                  \
+do {                                                        \
+    LOCK("Submit", mutex);                                  \
+} while (0)
+
+#define SUBMIT_UNLOCK(mutex)                                \
+do {                                                        \
+    UNLOCK("Submit", mutex);                                \
+} while (0)
+
+#define LOOPBACK_LOCK(mutex)                                \
+do {                                                        \
+    LOCK("Loopback", mutex);                                \
+} while (0)
+
+#define LOOPBACK_UNLOCK(mutex)                              \
+do {                                                        \
+    UNLOCK("Loopback", mutex);                              \
+} while (0)
+
 
 #endif  // _TRANSPORT_UTILS_H_
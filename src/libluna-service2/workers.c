@@ -0,0 +1,366 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <pthread.h>
+
+#include "error.h"
+#include "log.h"
+#include "transport_utils.h"
+#include "workers.h"
+
+/**
+ * @addtogroup LunaServiceWorkers
+ *
+ * @{
+ */
+
+typedef struct LSWorkersQueue _LSWorkersQueue;
+
+typedef struct LSWorkersJob {
+    _LSWorkersFunc func;
+    void *data;
+    GDestroyNotify destroy;     /**< called for @ref data after @ref func, or instead of it */
+    _LSWorkersQueue *queue;     /**< queue of the job's key; NULL for a job without a key */
+} _LSWorkersJob;
+
+struct LSWorkersQueue {
+    const void *key;
+    GQueue waiting;             /**< jobs behind the one that is running */
+};
+
+struct LSWorkers {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;        /**< signalled when @ref running drops to 0 */
+    GThreadPool *pool;
+    GHashTable *queues;         /**< key -> @ref _LSWorkersQueue with a running job */
+    unsigned int running;       /**< jobs handed to @ref pool that haven't finished */
+    bool closing;               /**< no more jobs are started */
+    GMainContext *context;      /**< woken up when @ref running drops to 0; see @ref _LSWorkersClose */
+};
+
+static void
+_LSWorkersJobFree(_LSWorkersJob *job)
+{
+    if (job->destroy)
+    {
+        job->destroy(job->data);
+    }
+
+    g_slice_free(_LSWorkersJob, job);
+}
+
+static void
+_LSWorkersQueueFree(_LSWorkersQueue *queue)
+{
+    LS_ASSERT(g_queue_is_empty(&queue->waiting));
+
+    g_slice_free(_LSWorkersQueue, queue);
+}
+
+/**
+ *******************************************************************************
+ * @brief Run a job on a pool thread, then start the next job with the same
+ * key, if any.
+ *
+ * @param  data         IN  job
+ * @param  user_data    IN  workers
+ *******************************************************************************
+ */
+static void
+_LSWorkersRun(gpointer data, gpointer user_data)
+{
+    _LSWorkers *workers = user_data;
+    _LSWorkersJob *job = data;
+    _LSWorkersQueue *queue = job->queue;
+
+    job->func(job->data);
+    _LSWorkersJobFree(job);
+
+    WORKERS_LOCK(&workers->lock);
+
+    _LSWorkersJob *next = queue ? g_queue_pop_head(&queue->waiting) : NULL;
+
+    if (next)
+    {
+        /* the key stays busy, so the count of running jobs doesn't change */
+        g_thread_pool_push(workers->pool, next, NULL);
+    }
+    else
+    {
+        if (queue)
+        {
+            g_hash_table_remove(workers->queues, queue->key);
+        }
+
+        if (--workers->running == 0)
+        {
+            pthread_cond_broadcast(&workers->idle);
+
+            if (workers->context)
+            {
+                g_main_context_wakeup(workers->context);
+            }
+        }
+    }
+
+    WORKERS_UNLOCK(&workers->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a worker pool. Threads are only started when there are jobs.
+ *
+ * @param  max_threads  IN  maximum number of threads running jobs at once
+ * @param  lserror      OUT set on error
+ *
+ * @retval  workers on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSWorkers*
+_LSWorkersNew(unsigned int max_threads, LSError *lserror)
+{
+    LS_ASSERT(max_threads > 0);
+
+    GError *error = NULL;
+    _LSWorkers *workers = g_new0(_LSWorkers, 1);
+
+    workers->pool = g_thread_pool_new(_LSWorkersRun, workers, max_threads, FALSE, &error);
+    if (!workers->pool)
+    {
+        _LSErrorSet(lserror, MSGID_LS_WORKERS_ERR, -1, "Couldn't create thread pool: %s", error->message);
+        g_error_free(error);
+        g_free(workers);
+        return NULL;
+    }
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->idle, NULL);
+    workers->queues = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                            (GDestroyNotify)_LSWorkersQueueFree);
+
+    return workers;
+}
+
+/**
+ *******************************************************************************
+ * @brief Stop a worker pool. The jobs that haven't started are dropped, and
+ * the running ones are waited for.
+ *
+ * Running jobs may wait on the main loop themselves, e.g. for a reply or for
+ * their messages to be sent, so if the calling thread can own @ref context,
+ * it keeps dispatching it while it waits.
+ *
+ * @attention must not be called from a job
+ *
+ * @param  workers  IN  workers
+ * @param  context  IN  main context the jobs may wait on, or NULL
+ *******************************************************************************
+ */
+void
+_LSWorkersClose(_LSWorkers *workers, GMainContext *context)
+{
+    LS_ASSERT(workers != NULL);
+
+    GQueue dropped = G_QUEUE_INIT;
+    GHashTableIter iter;
+    gpointer value;
+
+    WORKERS_LOCK(&workers->lock);
+
+    workers->closing = true;
+
+    g_hash_table_iter_init(&iter, workers->queues);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        _LSWorkersQueue *queue = value;
+        _LSWorkersJob *job;
+
+        while ((job = g_queue_pop_head(&queue->waiting)))
+        {
+            g_queue_push_tail(&dropped, job);
+        }
+    }
+
+    WORKERS_UNLOCK(&workers->lock);
+
+    /* outside of the lock, since the destroy notifications may take others */
+    _LSWorkersJob *job;
+    while ((job = g_queue_pop_head(&dropped)))
+    {
+        _LSWorkersJobFree(job);
+    }
+
+    if (context && g_main_context_acquire(context))
+    {
+        WORKERS_LOCK(&workers->lock);
+        workers->context = context;
+        while (workers->running > 0)
+        {
+            /* the last job to finish wakes the context up */
+            WORKERS_UNLOCK(&workers->lock);
+            g_main_context_iteration(context, TRUE);
+            WORKERS_LOCK(&workers->lock);
+        }
+        workers->context = NULL;
+        WORKERS_UNLOCK(&workers->lock);
+
+        g_main_context_release(context);
+    }
+    else
+    {
+        /* the loop, if any, runs in another thread */
+        WORKERS_LOCK(&workers->lock);
+        while (workers->running > 0)
+        {
+            pthread_cond_wait(&workers->idle, &workers->lock);
+        }
+        WORKERS_UNLOCK(&workers->lock);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Free a worker pool, closing it first if @ref _LSWorkersClose hasn't
+ * been called.
+ *
+ * @attention must not be called from a job
+ *
+ * @param  workers  IN  workers
+ *******************************************************************************
+ */
+void
+_LSWorkersFree(_LSWorkers *workers)
+{
+    LS_ASSERT(workers != NULL);
+
+    _LSWorkersClose(workers, NULL);
+
+    g_thread_pool_free(workers->pool, FALSE, TRUE);
+
+    LS_ASSERT(g_hash_table_size(workers->queues) == 0);
+    g_hash_table_unref(workers->queues);
+
+    pthread_cond_destroy(&workers->idle);
+    pthread_mutex_destroy(&workers->lock);
+    g_free(workers);
+}
+
+/**
+ *******************************************************************************
+ * @brief Change the maximum number of threads running jobs at once.
+ *
+ * @param  workers      IN  workers
+ * @param  max_threads  IN  maximum number of threads
+ *******************************************************************************
+ */
+void
+_LSWorkersSetMaxThreads(_LSWorkers *workers, unsigned int max_threads)
+{
+    LS_ASSERT(workers != NULL);
+    LS_ASSERT(max_threads > 0);
+
+    g_thread_pool_set_max_threads(workers->pool, max_threads, NULL);
+}
+
+/**
+ *******************************************************************************
+ * @brief Run a job on the pool.
+ *
+ * @param  workers  IN  workers
+ * @param  key      IN  jobs with the same key run one at a time, in order;
+ *                      NULL if the job can run alongside any other
+ * @param  func     IN  job
+ * @param  data     IN  passed to @ref func
+ * @param  destroy  IN  called for @ref data once the job is done, or if it's
+ *                      dropped; not called if this fails
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSWorkersPush(_LSWorkers *workers, const void *key, _LSWorkersFunc func,
+               void *data, GDestroyNotify destroy, LSError *lserror)
+{
+    LS_ASSERT(workers != NULL);
+    LS_ASSERT(func != NULL);
+
+    bool ret = true;
+    GError *error = NULL;
+    _LSWorkersJob *job = g_slice_new0(_LSWorkersJob);
+
+    job->func = func;
+    job->data = data;
+    job->destroy = destroy;
+
+    WORKERS_LOCK(&workers->lock);
+
+    if (workers->closing)
+    {
+        _LSErrorSet(lserror, MSGID_LS_WORKERS_ERR, -1, "Worker pool is shutting down");
+        ret = false;
+        goto exit;
+    }
+
+    if (key)
+    {
+        _LSWorkersQueue *queue = g_hash_table_lookup(workers->queues, key);
+
+        if (queue)
+        {
+            /* started when the jobs ahead of it are done */
+            job->queue = queue;
+            g_queue_push_tail(&queue->waiting, job);
+            job = NULL;
+            goto exit;
+        }
+
+        queue = g_slice_new0(_LSWorkersQueue);
+        queue->key = key;
+        g_queue_init(&queue->waiting);
+        g_hash_table_insert(workers->queues, (gpointer)key, queue);
+        job->queue = queue;
+    }
+
+    if (!g_thread_pool_push(workers->pool, job, &error))
+    {
+        /* the job is queued anyway and runs once a thread is free */
+        LOG_LS_WARNING(MSGID_LS_WORKERS_ERR, 1,
+                       PMLOGKS("ERROR", error->message),
+                       "Couldn't start a worker thread");
+        g_error_free(error);
+    }
+
+    workers->running++;
+    job = NULL;
+
+exit:
+    WORKERS_UNLOCK(&workers->lock);
+
+    if (job)
+    {
+        g_slice_free(_LSWorkersJob, job);
+    }
+
+    return ret;
+}
+
+/* @} END OF LunaServiceWorkers */
@@ -0,0 +1,54 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include <luna-service2/lunaservice.h>
+
+/**
+ * @addtogroup LunaServiceWorkers
+ *
+ * @{
+ */
+
+/**
+ * A bounded pool of threads that run jobs off the main loop.
+ *
+ * Jobs pushed with the same key run one at a time, in the order in which
+ * they were pushed; each key has a queue of the jobs waiting behind the one
+ * that is running, and only the job at its head is handed to the thread
+ * pool. Jobs without a key run as soon as a thread is free.
+ */
+typedef struct LSWorkers _LSWorkers;
+
+typedef void (*_LSWorkersFunc)(void *data);
+
+_LSWorkers* _LSWorkersNew(unsigned int max_threads, LSError *lserror);
+void _LSWorkersClose(_LSWorkers *workers, GMainContext *context);
+void _LSWorkersFree(_LSWorkers *workers);
+void _LSWorkersSetMaxThreads(_LSWorkers *workers, unsigned int max_threads);
+bool _LSWorkersPush(_LSWorkers *workers, const void *key, _LSWorkersFunc func,
+                    void *data, GDestroyNotify destroy, LSError *lserror);
+
+/** @} LunaServiceWorkers */
+
+#endif      // _WORKERS_H_
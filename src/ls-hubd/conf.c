@@ -107,6 +107,8 @@ _ConfigKeyProcessDynamicServiceExecPrefix(char *value, const char **conf_var, LS
 static bool
 _ConfigKeyProcessWatchdogFailureMode(char *mode_str, LSHubWatchdogFailureMode *conf_var, LSError *lserror);
 static bool
+_ConfigKeyProcessOutgoingPolicy(char *policy_str, LSOutgoingPolicy *conf_var, LSError *lserror);
+static bool
 _ConfigParseFile(const char *path, const _ConfigDOM *dom, LSError *lserror);
 
 void _ConfigFreeSettings(void);
@@ -119,6 +121,10 @@ void _ConfigFreeSettings(void);
  * PidDirectory=/path/to/some/dir
  * LogServiceStatus=false
  * ConnectTimeout=time_ms
+ * OutgoingHighWatermark=bytes
+ * OutgoingLowWatermark=bytes
+ * OutgoingPolicy=none (or drop or disconnect)
+ * CompressThreshold=bytes
  *
  * [Watchdog]
  * Timeout=time_sec
@@ -169,6 +175,30 @@ static _ConfigDOM conf_file_dom = {
                     .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
                     .user_ctxt = &g_conf_connect_timeout_ms,
                 },
+                {
+                    .key = "OutgoingHighWatermark",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_outgoing_high_watermark,
+                },
+                {
+                    .key = "OutgoingLowWatermark",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_outgoing_low_watermark,
+                },
+                {
+                    .key = "OutgoingPolicy",
+                    .get_value = _ConfigKeyGetString,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeyProcessOutgoingPolicy,
+                    .user_ctxt = &g_conf_outgoing_policy,
+                },
+                {
+                    .key = "CompressThreshold",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_compress_threshold,
+                },
                 { NULL }
             }
         },
@@ -315,6 +345,10 @@ bool g_conf_log_service_status = false;         /**< enable service status loggi
 char *g_conf_dynamic_service_exec_prefix = NULL; /**< prefix added to Exec in service file
                                                       when launching dynamic service */
 int g_conf_connect_timeout_ms = 20000;          /**< timeout in ms for connect() to complete */
+int g_conf_outgoing_high_watermark = 0;         /**< bytes queued to a client before the outgoing policy applies (0 = unlimited) */
+int g_conf_outgoing_low_watermark = 0;          /**< bytes a client queue has to drain to after crossing the high watermark */
+LSOutgoingPolicy g_conf_outgoing_policy = LSOutgoingPolicyNone;   /**< what to do with clients above the high watermark */
+int g_conf_compress_threshold = 0;              /**< payloads from this size up are compressed between clients that support it (0 = never) */
 char *g_conf_monitor_exe_path = NULL;           /**< path to ls-monitor */
 char *g_conf_monitor_pub_exe_path = NULL;       /**< path to ls-monitor-pub */
 char *g_conf_sysmgr_exe_path = NULL;            /**< path to LunaSysMgr */
@@ -881,6 +915,51 @@ _ConfigKeyProcessWatchdogFailureMode(char *mode_str, LSHubWatchdogFailureMode *c
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Set the policy for client queues above the high watermark.
+ *
+ * "block" isn't accepted since it would stall the hub on a single client.
+ *
+ * @param  policy_str   IN  policy string
+ * @param  conf_var     OUT policy
+ * @param  lserror      OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+static bool
+_ConfigKeyProcessOutgoingPolicy(char *policy_str, LSOutgoingPolicy *conf_var, LSError *lserror)
+{
+    LS_ASSERT(policy_str != NULL);
+    LS_ASSERT(conf_var != NULL);
+
+    if (strcmp(policy_str, "none") == 0)
+    {
+        *conf_var = LSOutgoingPolicyNone;
+    }
+    else if (strcmp(policy_str, "drop") == 0)
+    {
+        *conf_var = LSOutgoingPolicyDropOldestUpdate;
+    }
+    else if (strcmp(policy_str, "disconnect") == 0)
+    {
+        *conf_var = LSOutgoingPolicyDisconnect;
+    }
+    else
+    {
+        LOG_LS_WARNING(MSGID_LSHUB_CONF_FILE_ERROR, 1,
+                       PMLOGKS("POLICY", policy_str),
+                       "Ignoring unsupported outgoing queue policy");
+    }
+
+    /* we don't need to save the string */
+    g_free(policy_str);
+
+    return true;
+}
+
 /**
  *******************************************************************************
  * @brief Parse dynamic services from steady directories and load dynamic service map.
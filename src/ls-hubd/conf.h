@@ -23,6 +23,7 @@
 #endif
 
 #include <stdbool.h>
+#include <luna-service2/lunaservice.h>
 #include "error.h"
 #include "watchdog.h"
 
@@ -39,6 +40,10 @@ extern char* g_conf_dynamic_service_exec_prefix;
 extern bool g_conf_security_enabled;
 extern bool g_conf_log_service_status;
 extern int g_conf_connect_timeout_ms;
+extern int g_conf_outgoing_high_watermark;
+extern int g_conf_outgoing_low_watermark;
+extern LSOutgoingPolicy g_conf_outgoing_policy;
+extern int g_conf_compress_threshold;
 extern char* g_conf_monitor_exe_path;
 extern char* g_conf_monitor_pub_exe_path;
 extern char* g_conf_sysmgr_exe_path;
@@ -237,6 +237,8 @@ typedef struct _SignalMap {
 static _SignalMap *signal_map = NULL;    /**< keeps track of signals */
 
 static _ClientId *monitor = NULL;        /**< non-NULL when a monitor is connected */
+static bool monitor_trace = false;       /**< true if the monitor reads trace rings instead of message copies */
+static _LSTransportMonitorFilter *monitor_filter = NULL;  /**< messages the monitor wants to see; NULL for all */
 
 typedef struct _LSTransportClientList {
     GList *list;
@@ -1536,6 +1538,13 @@ _LSHubHandleDisconnect(_LSTransportClient *client, _LSTransportDisconnectType ty
         id->is_monitor = false;
         _LSHubClientIdLocalUnref(monitor);
         monitor = NULL;
+        monitor_trace = false;
+
+        if (monitor_filter)
+        {
+            _LSTransportMonitorFilterFree(monitor_filter);
+            monitor_filter = NULL;
+        }
     }
 
     /* remove the socket file; we do this in the hub so that we clean up
@@ -1713,6 +1722,8 @@ _LSHubConstructRequestNameReply(_LSTransportMessage *message,
     if (!_LSTransportMessageAppendInt32(&iter, err_code)) goto error;
     if (!_LSTransportMessageAppendBool(&iter, privileged)) goto error;
     if (!_LSTransportMessageAppendString(&iter, ret_str)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, LS_TRANSPORT_PROTOCOL_VERSION)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, g_conf_compress_threshold)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     return reply_message;
@@ -1730,6 +1741,8 @@ error:
  * @param  message      IN  request name message
  * @param  err_code     IN  numeric error code (0 means success)
  * @param  ret_str      IN  return string
+ * @param  protocol_version IN  highest protocol version the client speaks
+ *                              (only used on success)
  * @param  lserror      OUT set on error
  *
  * @retval  true on success
@@ -1738,7 +1751,7 @@ error:
  */
 static bool
 _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transport_type,
-                           long err_code, char* ret_str, LSError *lserror)
+                           long err_code, char* ret_str, int32_t protocol_version, LSError *lserror)
 {
     int fd = -1;
 
@@ -1789,6 +1802,13 @@ _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transp
         return false;
     }
 
+    /* the reply itself goes out in the old format, everything after it in
+     * the version both sides speak */
+    if (err_code == LS_TRANSPORT_REQUEST_NAME_SUCCESS)
+    {
+        _LSTransportClientSwitchVersion(client, reply_message, _LSTransportNegotiateVersion(protocol_version));
+    }
+
     _LSTransportMessageUnref(reply_message);
 
     return true;
@@ -1847,13 +1867,13 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
     int32_t protocol_version = 0;
     _LSTransportMessageGetInt32(&iter, &protocol_version);
 
-    if (protocol_version != LS_TRANSPORT_PROTOCOL_VERSION)
+    if (protocol_version < LS_TRANSPORT_PROTOCOL_VERSION_MIN)
     {
         LOG_LS_ERROR(MSGID_LSHUB_WRONG_PROTOCOL, 0,
                      "Transport protocol mismatch. Client version: %d. Hub version: %d",
                      protocol_version, LS_TRANSPORT_PROTOCOL_VERSION);
 
-        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION, NULL, &lserror))
+        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION, NULL, 0, &lserror))
         {
             LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
             LSErrorFree(&lserror);
@@ -1871,7 +1891,7 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
     /* Check security permissions */
     if (!LSHubIsClientAllowedToRequestName(client, service_name))
     {
-        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_PERMISSION_DENIED, NULL, &lserror))
+        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_PERMISSION_DENIED, NULL, 0, &lserror))
         {
             LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
             LSErrorFree(&lserror);
@@ -1885,7 +1905,7 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
         if (g_hash_table_lookup(pending, service_name) || g_hash_table_lookup(available_services, service_name))
         {
             /* construct and send error reply */
-            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_NAME_ALREADY_REGISTERED, NULL, &lserror))
+            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_NAME_ALREADY_REGISTERED, NULL, 0, &lserror))
             {
                 LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
                 LSErrorFree(&lserror);
@@ -1937,6 +1957,12 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
         char inet_buf[INET_ADDRSTRLEN];
         unique_name = g_strdup_printf("%s:%"PRId32, inet_ntop(AF_INET, &addr.sin_addr, inet_buf, sizeof(inet_buf)), port);
     }
+
+    /* clients that predate payload compression don't announce any features */
+    int32_t features = 0;
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMessageGetInt32(&iter, &features);
+    client->features = features;
     LOG_LS_DEBUG("%s: unique_name: \"%s\"\n", __func__, unique_name);
 
     /* add client id to client lookup (refs client) */
@@ -1960,7 +1986,7 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
     _LSHubClientIdLocalUnref(id);
 
     /* send reply with name */
-    if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_SUCCESS, unique_name, &lserror))
+    if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_SUCCESS, unique_name, protocol_version, &lserror))
     {
         LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
         LSErrorFree(&lserror);
@@ -2121,6 +2147,54 @@ _LSHubHandleConnectReady(GIOChannel *channel, GIOCondition cond, _LSTransportMes
     return FALSE;
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the protocol version spoken with a connected client, so that
+ * clients connecting to it directly can speak it too.
+ *
+ * @param  unique_name  IN  unique name of the client (may be NULL)
+ *
+ * @retval  protocol version
+ * @retval  0 if there is no such client
+ *******************************************************************************
+ */
+static int32_t
+_LSHubGetClientVersion(const char *unique_name)
+{
+    if (!unique_name)
+    {
+        return 0;
+    }
+
+    _ClientId *id = g_hash_table_lookup(connected_clients.by_unique_name, unique_name);
+
+    return (id && id->client) ? _LSTransportClientGetVersion(id->client) : 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the features a connected client announced when it requested
+ * its name, so that clients connecting to it directly know what it takes.
+ *
+ * @param  unique_name  IN  unique name of the client (may be NULL)
+ *
+ * @retval  LS_TRANSPORT_FEATURE_* values
+ * @retval  0 if there is no such client
+ *******************************************************************************
+ */
+static int32_t
+_LSHubGetClientFeatures(const char *unique_name)
+{
+    if (!unique_name)
+    {
+        return 0;
+    }
+
+    _ClientId *id = g_hash_table_lookup(connected_clients.by_unique_name, unique_name);
+
+    return (id && id->client) ? id->client->features : 0;
+}
+
 /**
  *******************************************************************************
  * @brief Send a reply to a "QueryName" message.
@@ -2164,6 +2238,8 @@ _LSHubSendQueryNameReply(const _LSTransportMessage *message, long err_code,
     if (!_LSTransportMessageAppendString(&iter, service_name)) goto error;
     if (!_LSTransportMessageAppendString(&iter, unique_name)) goto error;
     if (!_LSTransportMessageAppendInt32(&iter, is_dynamic)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, _LSHubGetClientVersion(unique_name))) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, _LSHubGetClientFeatures(unique_name))) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     int fd = -1;
@@ -3501,6 +3577,9 @@ _LSHubSendMonitorMessage(int ignored_fd, _ClientId *id, const char *unique_name)
 
     _LSTransportMessageIterInit(monitor_message, &iter);
     if (!_LSTransportMessageAppendString(&iter, unique_name)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, _LSHubGetClientVersion(unique_name))) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, monitor_trace)) goto error;
+    if (!_LSTransportMonitorFilterAppend(monitor_filter, &iter)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     /* set up the connection to the monitor if it exists and we're local */
@@ -3590,10 +3669,25 @@ _LSHubHandleMonitorRequest(_LSTransportMessage *message)
         return;
     }
 
+    /* older monitors send an empty request */
+    int32_t trace = 0;
+    _LSTransportMessageIter iter;
+    _LSTransportMessageIterInit(message, &iter);
+    _LSTransportMessageGetInt32(&iter, &trace);
+    _LSTransportMessageIterNext(&iter);
+    _LSTransportMonitorFilter *filter = _LSTransportMonitorFilterRead(&iter);
+
     /* mark this client as the monitor */
     id->is_monitor = true;
     _LSHubClientIdLocalRef(id);
     monitor = id;
+    monitor_trace = trace;
+
+    if (monitor_filter)
+    {
+        _LSTransportMonitorFilterFree(monitor_filter);
+    }
+    monitor_filter = filter;
 
     if (monitor_client->unique_name)
     {
@@ -4419,6 +4513,26 @@ int main(int argc, char *argv[])
         LSErrorFree(&lserror);
     }
 
+    /* keep clients that don't read their messages from holding on to the
+     * hub's memory */
+    if (hub_transport && g_conf_outgoing_high_watermark > 0)
+    {
+        _LSTransportOutgoingLimits limits = {
+            .high_bytes = g_conf_outgoing_high_watermark,
+            .low_bytes = MIN(g_conf_outgoing_low_watermark, g_conf_outgoing_high_watermark),
+            .policy = g_conf_outgoing_policy,
+        };
+
+        _LSTransportSetOutgoingLimits(hub_transport, &limits);
+    }
+
+    /* the hub's socket I/O goes through io_uring where available, which cuts
+     * down on syscalls when lots of services register at boot */
+    if (hub_transport)
+    {
+        _LSTransportSetUseUring(hub_transport, true);
+    }
+
     if (enable_inet)
     {
         uint16_t hub_inet_port = 0;
@@ -29,6 +29,8 @@
 #include "transport.h"
 #include "clock.h"
 #include "monitor_queue.h"
+#include "monitor_trace.h"
+#include "monitor_capture.h"
 #include "debug_methods.h"
 
 #define DYNAMIC_SERVICE_STR         "dynamic"
@@ -70,6 +72,10 @@ static GHashTable *dup_hash_table;
 
 static const char *list_servicename_methods = NULL;
 static const char *message_filter_str = NULL;
+static const char *message_filter_method = NULL;
+static const char *message_filter_types = NULL;
+static gint message_filter_min_size = 0;
+static _LSTransportMonitorFilter *message_filter = NULL;
 static gboolean list_clients = false;
 static gboolean list_subscriptions = false;
 static gboolean list_malloc = false;
@@ -77,6 +83,10 @@ static gboolean debug_output = false;
 static gboolean compact_output = false;
 static gboolean two_line_output = false;
 static gboolean sort_by_timestamps = false;
+static gboolean trace_mode = false;
+static const char *capture_path = NULL;
+static _LSMonitorCapture *capture = NULL;
+static bool capture_failed = false;
 static GMainLoop *mainloop = NULL;
 
 static uint32_t terminal_width = TERMINAL_WIDTH_DEFAULT;
@@ -86,6 +96,7 @@ static _LSTransport *transport_pub = NULL;
 static GSList *public_sub_replies = NULL;
 static bool transport_pub_local = false;
 static _LSMonitorQueue *public_queue = NULL;
+static _LSMonitorTrace *public_trace = NULL;
 
 #ifndef PUBLIC_ONLY
 static int hubs_answers_count = 2;
@@ -99,6 +110,7 @@ static _LSTransport *transport_priv = NULL;
 static GSList *private_sub_replies = NULL;
 static bool transport_priv_local = false;
 static _LSMonitorQueue *private_queue = NULL;
+static _LSMonitorTrace *private_trace = NULL;
 #endif
 
 /* time1 - time2 */
@@ -166,10 +178,118 @@ _LSMonitorIdleHandlerPublic(gpointer data)
     return TRUE;
 }
 
+/* Stop capturing after a failed write (e.g., the disk is full) */
+static void
+_LSMonitorCaptureFailed(void)
+{
+    g_critical("Error writing capture to %s", capture_path);
+    _LSMonitorCaptureClose(capture);
+    capture = NULL;
+    capture_failed = true;
+    g_main_loop_quit(mainloop);
+}
+
+static gboolean
+_LSMonitorCaptureHandler(gpointer data)
+{
+    if (capture && !_LSMonitorCaptureFlush(capture))
+    {
+        _LSMonitorCaptureFailed();
+    }
+    return capture != NULL;
+}
+
+static gboolean
+_LSMonitorTraceHandler(gpointer data)
+{
+    _LSMonitorTrace *trace = data;
+    _LSMonitorTracePrint(trace, sort_by_timestamps);
+    fflush(stdout);
+    return TRUE;
+}
+
+/**
+ * Print a record read from the trace ring of a client, in the same columns
+ * as a full message
+ */
+void
+_LSMonitorTraceRecordPrint(const _LSTransportTraceRecord *record, const char *owner, bool public_bus)
+{
+    /* the ring belongs to the sender for TX records and to the receiver for RX */
+    const char *sender = record->monitor_type == _LSMonitorMessageTypeTx ? owner : record->peer;
+    const char *dest = record->monitor_type == _LSMonitorMessageTypeTx ? record->peer : owner;
+
+    if (message_filter_str && !strstr(sender, message_filter_str) && !strstr(dest, message_filter_str))
+    {
+        return;
+    }
+
+    const char *type_str = "unknown";
+    LSMessageToken token = record->token;
+
+    switch (record->message_type)
+    {
+    case _LSTransportMessageTypeSignal:
+        type_str = "signal";
+        break;
+    case _LSTransportMessageTypeMethodCall:
+        type_str = "call";
+        break;
+    case _LSTransportMessageTypeMethodCallNoReply:
+        type_str = "noreply";
+        break;
+    case _LSTransportMessageTypeCancelMethodCall:
+        type_str = "cancel";
+        break;
+    case _LSTransportMessageTypeReply:
+        type_str = "return";
+        token = record->reply_token;
+        break;
+    }
+
+    _LSMonitorPrintTime(&record->timestamp);
+    _LSMonitorPrintType(record->monitor_type);
+    fprintf(stdout, public_bus?"\t[PUB]\t":"\t[PRV]\t");
+    fprintf(stdout, "%s\t%lu\t\t%s\t\t%s\t\t%s\t\xc2\xab%s%s\xc2\xbb\n",
+            type_str, (unsigned long)token, sender, dest, record->method, record->payload,
+            record->payload_len >= LS_TRANSPORT_TRACE_PAYLOAD_SIZE ? "..." : "");
+}
+
+/**
+ * Check the method, type and size filters on a copy; clients that know about
+ * the filter don't send us what doesn't match, but older ones send everything
+ */
+static bool
+_LSMonitorMessageFilterMatch(_LSTransportMessage *message)
+{
+    if (!message_filter) return true;
+
+    _LSTransportMessageType type = _LSTransportMessageGetType(message);
+    unsigned long payload_len = 0;
+
+    _LSTransportMessageGetPayloadBinary(message, &payload_len);
+
+    const char *category = NULL;
+    const char *method = NULL;
+
+    if (type != _LSTransportMessageTypeReply)
+    {
+        category = _LSTransportMessageGetCategory(message);
+        method = _LSTransportMessageGetMethod(message);
+    }
+
+    return _LSTransportMonitorFilterMatch(message_filter, type, category, method,
+                                          _LSTransportMessageGetSenderServiceName(message),
+                                          _LSTransportMessageGetSenderUniqueName(message),
+                                          _LSTransportMessageGetDestServiceName(message),
+                                          _LSTransportMessageGetDestUniqueName(message),
+                                          payload_len);
+}
+
 void
 _LSMonitorMessagePrint(_LSTransportMessage *message, bool public_bus)
 {
-    if (LSTransportMessageFilterMatch(message, message_filter_str))
+    if (LSTransportMessageFilterMatch(message, message_filter_str) && _LSMonitorMessageFilterMatch(message))
     {
         const _LSMonitorMessageData *message_data = _LSTransportMessageGetMonitorMessageData(message);
 
@@ -216,11 +336,40 @@ _LSMonitorMessagePrint(_LSTransportMessage *message, bool public_bus)
     }
 }
 
+/**
+ * Write a copy to the capture file instead of printing it; the handlers call
+ * this for every copy, so it does no formatting
+ */
+static void
+_LSMonitorMessageCapture(_LSTransportMessage *message, bool public_bus)
+{
+    if (!capture)
+    {
+        return;
+    }
+
+    if (LSTransportMessageFilterMatch(message, message_filter_str) && _LSMonitorMessageFilterMatch(message))
+    {
+        if (!_LSMonitorCaptureWrite(capture, message, public_bus))
+        {
+            _LSMonitorCaptureFailed();
+        }
+    }
+}
+
 #ifndef PUBLIC_ONLY
 static LSMessageHandlerResult
 _LSMonitorMessageHandlerPrivate(_LSTransportMessage *message, void *context)
 {
-    if (!transport_priv_local || sort_by_timestamps)
+    if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeTraceRing)
+    {
+        if (private_trace) _LSMonitorTraceAddRing(private_trace, message);
+    }
+    else if (capture_path)
+    {
+        _LSMonitorMessageCapture(message, false);
+    }
+    else if (!transport_priv_local || sort_by_timestamps)
     {
         _LSMonitorMessagePrint(message, false);
     }
@@ -237,7 +386,15 @@ _LSMonitorMessageHandlerPrivate(_LSTransportMessage *message, void *context)
 static LSMessageHandlerResult
 _LSMonitorMessageHandlerPublic(_LSTransportMessage *message, void *context)
 {
-    if (!transport_pub_local || sort_by_timestamps)
+    if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeTraceRing)
+    {
+        if (public_trace) _LSMonitorTraceAddRing(public_trace, message);
+    }
+    else if (capture_path)
+    {
+        _LSMonitorMessageCapture(message, true);
+    }
+    else if (!transport_pub_local || sort_by_timestamps)
     {
         _LSMonitorMessagePrint(message, true);
     }
@@ -250,6 +407,20 @@ _LSMonitorMessageHandlerPublic(_LSTransportMessage *message, void *context)
     return LSMessageHandlerResultHandled;
 }
 
+#ifndef PUBLIC_ONLY
+static void
+_LSMonitorDisconnectHandlerPrivate(_LSTransportClient *client, _LSTransportDisconnectType type, void *context)
+{
+    if (private_trace) _LSMonitorTraceRemoveRing(private_trace, client);
+}
+#endif
+
+static void
+_LSMonitorDisconnectHandlerPublic(_LSTransportClient *client, _LSTransportDisconnectType type, void *context)
+{
+    if (public_trace) _LSMonitorTraceRemoveRing(public_trace, client);
+}
+
 static void
 _PrintMonitorListInfo(const GSList *info_list)
 {
@@ -647,6 +818,9 @@ _HandleCommandline(int argc, char *argv[])
     static GOptionEntry opt_entries[] =
     {
         {"filter", 'f', 0, G_OPTION_ARG_STRING, &message_filter_str, "Filter by service name (or unique name)", "com.palm.foo"},
+        {"method", 'M', 0, G_OPTION_ARG_STRING, &message_filter_method, "Filter by category/method glob", "/com/palm/foo/*"},
+        {"type", 'y', 0, G_OPTION_ARG_STRING, &message_filter_types, "Filter by message type", "call,signal,return,cancel"},
+        {"min-size", 'z', 0, G_OPTION_ARG_INT, &message_filter_min_size, "Filter out payloads smaller than this many bytes", "bytes"},
         {"list", 'l', 0, G_OPTION_ARG_NONE, &list_clients, "List all entities connected to the hub", NULL},
         {"subscriptions", 's', 0, G_OPTION_ARG_NONE, &list_subscriptions, "List all subscriptions in the system", NULL},
         {"introspection", 'i', 0, G_OPTION_ARG_STRING, &list_servicename_methods, "List service methods and signals", "com.palm.foo"},
@@ -654,6 +828,8 @@ _HandleCommandline(int argc, char *argv[])
         {"debug", 'd', 0, G_OPTION_ARG_NONE, &debug_output, "Print extra output for debugging monitor but with UNBOUNDED MEMORY GROWTH", NULL},
         {"compact", 'c', 0, G_OPTION_ARG_NONE, &compact_output, "Print compact output to fit terminal. Take precedence over debug", NULL},
         {"sort-by-timestamps", 't', 0, G_OPTION_ARG_NONE, &sort_by_timestamps, "Sort output by timestamps instead of serials", NULL},
+        {"trace", 'r', 0, G_OPTION_ARG_NONE, &trace_mode, "Read compact records from shared memory rings in each process instead of message copies (lossy)", NULL},
+        {"capture", 'w', 0, G_OPTION_ARG_FILENAME, &capture_path, "Write message copies to a binary capture file instead of printing them (see ls-monitor-analyze)", "FILE"},
         { NULL }
     };
 
@@ -683,11 +859,52 @@ _HandleCommandline(int argc, char *argv[])
     }
 #endif
 
+    /* the capture holds whole copies, which trace mode doesn't get */
+    if (capture_path && trace_mode)
+    {
+        g_critical("Capture needs message copies and can't be used with trace mode");
+        exit(EXIT_FAILURE);
+    }
+
+    /* trace records have the columns of the full output */
+    if (trace_mode)
+    {
+        compact_output = false;
+    }
+
     if (compact_output)
     {
         debug_output = false;
     }
 
+    /* the filter goes to the clients, so they only copy what we print */
+    int32_t types = 0;
+    if (message_filter_types)
+    {
+        char **type_names = g_strsplit(message_filter_types, ",", -1);
+        char **type_name;
+
+        for (type_name = type_names; *type_name; type_name++)
+        {
+            if (strcmp(*type_name, "call") == 0) types |= LS_TRANSPORT_MONITOR_FILTER_CALL;
+            else if (strcmp(*type_name, "signal") == 0) types |= LS_TRANSPORT_MONITOR_FILTER_SIGNAL;
+            else if (strcmp(*type_name, "return") == 0) types |= LS_TRANSPORT_MONITOR_FILTER_REPLY;
+            else if (strcmp(*type_name, "cancel") == 0) types |= LS_TRANSPORT_MONITOR_FILTER_CANCEL;
+            else
+            {
+                g_critical("Unknown message type: %s", *type_name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        g_strfreev(type_names);
+    }
+
+    if (message_filter_str || message_filter_method || types || message_filter_min_size > 0)
+    {
+        message_filter = _LSTransportMonitorFilterNew(message_filter_str, message_filter_method,
+                                                      types, message_filter_min_size);
+    }
+
     if (debug_output)
     {
         g_warning("extra output for debugging monitor enabled, causes UNBOUNDED MEMORY GROWTH");
@@ -744,7 +961,7 @@ main(int argc, char *argv[])
     {
         .msg_handler = _LSMonitorMessageHandlerPrivate,
         .msg_context = &private,
-        .disconnect_handler = NULL,
+        .disconnect_handler = _LSMonitorDisconnectHandlerPrivate,
         .disconnect_context = NULL,
         .message_failure_handler = NULL,
         .message_failure_context = NULL
@@ -755,7 +972,7 @@ main(int argc, char *argv[])
     {
         .msg_handler = _LSMonitorMessageHandlerPublic,
         .msg_context = &public,
-        .disconnect_handler = NULL,
+        .disconnect_handler = _LSMonitorDisconnectHandlerPublic,
         .disconnect_context = NULL,
         .message_failure_handler = NULL,
         .message_failure_context = NULL
@@ -840,6 +1057,28 @@ main(int argc, char *argv[])
         g_timeout_add(500, _LSMonitorIdleHandlerPublic, public_queue);
     }
 
+    /* clients hand their trace rings over the monitor connection, and we
+     * poll them instead of getting copies */
+    if (trace_mode && !(list_clients || list_subscriptions || list_malloc || list_servicename_methods))
+    {
+#ifndef PUBLIC_ONLY
+        private_trace = _LSMonitorTraceNew(false);
+        g_timeout_add(LS_TRANSPORT_TRACE_POLL_MS, _LSMonitorTraceHandler, private_trace);
+#endif
+        public_trace = _LSMonitorTraceNew(true);
+        g_timeout_add(LS_TRANSPORT_TRACE_POLL_MS, _LSMonitorTraceHandler, public_trace);
+    }
+
+    if (capture_path && !(list_clients || list_subscriptions || list_malloc || list_servicename_methods))
+    {
+        capture = _LSMonitorCaptureOpen(capture_path, &lserror);
+        if (!capture)
+        {
+            goto error;
+        }
+        g_timeout_add(500, _LSMonitorCaptureHandler, NULL);
+    }
+
     if (list_clients || list_subscriptions || list_malloc)
     {
 #ifndef PUBLIC_ONLY
@@ -872,18 +1111,22 @@ main(int argc, char *argv[])
     {
         /* send the message to the hub to tell clients to connect to us */
 #ifndef PUBLIC_ONLY
-        if (!LSTransportSendMessageMonitorRequest(transport_priv, &lserror))
+        if (!LSTransportSendMessageMonitorRequest(transport_priv, trace_mode, message_filter, &lserror))
         {
             goto error;
         }
 #endif
 
-        if (!LSTransportSendMessageMonitorRequest(transport_pub, &lserror))
+        if (!LSTransportSendMessageMonitorRequest(transport_pub, trace_mode, message_filter, &lserror))
         {
             goto error;
         }
 
-        if (debug_output)
+        if (capture)
+        {
+            fprintf(stdout, "Capturing to %s\n", capture_path);
+        }
+        else if (debug_output)
         {
             fprintf(stdout, "Debug\t\tTime\tStatus\tProt\tType\tSerial\t\tSender\t\tDestination\t\tMethod                            \tPayload\n");
         }
@@ -905,9 +1148,20 @@ main(int argc, char *argv[])
 
     _DisconnectCustomTransport();
 
+    int ret = EXIT_SUCCESS;
+    if (capture_failed)
+    {
+        ret = EXIT_FAILURE;
+    }
+    else if (capture && !_LSMonitorCaptureClose(capture))
+    {
+        g_critical("Error writing capture to %s", capture_path);
+        ret = EXIT_FAILURE;
+    }
+
     g_hash_table_destroy(dup_hash_table);
 
-    exit(EXIT_SUCCESS);
+    exit(ret);
 
 error:
     LSErrorPrint(&lserror, stderr);
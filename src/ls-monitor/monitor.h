@@ -24,9 +24,11 @@
 #include <stdbool.h>
 
 #include "transport.h"
+#include "transport_trace.h"
 
 void _LSMonitorGetTime(struct timespec *time);
 void _LSMonitorMessagePrint(_LSTransportMessage *message, bool public_bus);
+void _LSMonitorTraceRecordPrint(const _LSTransportTraceRecord *record, const char *owner, bool public_bus);
 double _LSMonitorTimeDiff(struct timespec const *time1, struct timespec const *time2);
 
 #endif  /* _MONITOR_H */
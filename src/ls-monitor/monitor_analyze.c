@@ -0,0 +1,397 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "transport.h"
+#include "monitor_capture.h"
+#include "monitor_stats.h"
+
+/* Offline analysis of a capture written by "ls-monitor --capture": call rates,
+ * call to reply latency and payload sizes of each method.
+ *
+ * Only TX copies are counted, so that a message is seen once even when both
+ * sides send us a copy. The latency is from the caller sending the call to
+ * the service sending its first reply; later replies to the same call (e.g.,
+ * subscription updates) aren't counted. */
+
+#define LS_ANALYZE_SIZE_BUCKETS     33      /* payloads of 0 bytes, then up to 2^n bytes */
+
+typedef struct LSAnalyzeMethod
+{
+    _LSMonitorMethodStats stats;                /* name, counts and latencies; has to come first */
+    bool excluded;                              /* doesn't match the method glob */
+    uint64_t call_sizes[LS_ANALYZE_SIZE_BUCKETS];
+    uint64_t reply_sizes[LS_ANALYZE_SIZE_BUCKETS];
+} _LSAnalyzeMethod;
+
+/* Call waiting for its reply; the caller points into the capture mapping */
+typedef struct LSAnalyzeCall
+{
+    const char *caller;
+    LSMessageToken token;
+} _LSAnalyzeCall;
+
+typedef struct LSAnalyzePending
+{
+    _LSAnalyzeMethod *method;
+    struct timespec timestamp;
+} _LSAnalyzePending;
+
+static const char *method_glob = NULL;
+static gdouble from_sec = 0;
+static gdouble to_sec = 0;
+static gboolean print_histograms = false;
+
+static GPatternSpec *method_pattern = NULL;
+static GHashTable *methods = NULL;      /* name -> _LSAnalyzeMethod */
+static GHashTable *pending = NULL;      /* _LSAnalyzeCall -> _LSAnalyzePending */
+
+static guint
+_LSAnalyzeCallHash(gconstpointer key)
+{
+    const _LSAnalyzeCall *call = key;
+    return g_str_hash(call->caller) ^ (guint)call->token;
+}
+
+static gboolean
+_LSAnalyzeCallEqual(gconstpointer a, gconstpointer b)
+{
+    const _LSAnalyzeCall *call_a = a;
+    const _LSAnalyzeCall *call_b = b;
+    return call_a->token == call_b->token && strcmp(call_a->caller, call_b->caller) == 0;
+}
+
+static void
+_LSAnalyzeCallFree(gpointer data)
+{
+    g_slice_free(_LSAnalyzeCall, data);
+}
+
+static void
+_LSAnalyzePendingFree(gpointer data)
+{
+    g_slice_free(_LSAnalyzePending, data);
+}
+
+static void
+_LSAnalyzeMethodFree(gpointer data)
+{
+    _LSAnalyzeMethod *method = data;
+    _LSMonitorMethodStatsClear(&method->stats);
+    g_slice_free(_LSAnalyzeMethod, method);
+}
+
+static _LSAnalyzeMethod*
+_LSAnalyzeMethodGet(const char *category, const char *method_name)
+{
+    char *name = g_strconcat(category, "/", method_name, NULL);
+    _LSAnalyzeMethod *method = g_hash_table_lookup(methods, name);
+
+    if (method)
+    {
+        g_free(name);
+        return method;
+    }
+
+    method = g_slice_new0(_LSAnalyzeMethod);
+    _LSMonitorMethodStatsInit(&method->stats, name);
+    method->excluded = method_pattern && !g_pattern_match_string(method_pattern, name);
+    g_hash_table_insert(methods, name, method);
+
+    return method;
+}
+
+static int
+_LSAnalyzeSizeBucket(unsigned long size)
+{
+    if (size <= 1) return size;
+
+    /* bucket n holds sizes up to 2^(n-1) */
+    int bucket = g_bit_storage(size - 1) + 1;
+    return MIN(bucket, LS_ANALYZE_SIZE_BUCKETS - 1);
+}
+
+static double
+_LSAnalyzeTimeDiff(const struct timespec *a, const struct timespec *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) + (double)(a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static void
+_LSAnalyzeMessage(const _LSMonitorCaptureEntry *entry, _LSTransportMessage *message,
+                  const _LSMonitorMessageData *message_data)
+{
+    unsigned long payload_len = 0;
+    _LSTransportMessageGetPayloadBinary(message, &payload_len);
+
+    switch (_LSTransportMessageGetType(message))
+    {
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeMethodCallNoReply:
+    {
+        const char *category = _LSTransportMessageGetCategory(message);
+        const char *method_name = _LSTransportMessageGetMethod(message);
+
+        if (!category || !method_name) break;
+
+        _LSAnalyzeMethod *method = _LSAnalyzeMethodGet(category, method_name);
+
+        if (method->excluded) break;
+
+        method->stats.calls++;
+        method->call_sizes[_LSAnalyzeSizeBucket(payload_len)]++;
+
+        if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCall)
+        {
+            /* the copy of a call comes from the caller */
+            _LSAnalyzeCall *call = g_slice_new(_LSAnalyzeCall);
+            call->caller = entry->sender_unique_name;
+            call->token = _LSTransportMessageGetToken(message);
+
+            _LSAnalyzePending *call_pending = g_slice_new(_LSAnalyzePending);
+            call_pending->method = method;
+            call_pending->timestamp = message_data->timestamp;
+
+            g_hash_table_replace(pending, call, call_pending);
+        }
+        break;
+    }
+    case _LSTransportMessageTypeReply:
+    {
+        /* the copy of a reply comes from the service, and goes to the caller */
+        _LSAnalyzeCall call;
+        call.caller = _LSTransportMessageGetDestUniqueName(message);
+        call.token = _LSTransportMessageGetReplyToken(message);
+
+        if (!call.caller) break;
+
+        _LSAnalyzePending *call_pending = g_hash_table_lookup(pending, &call);
+        if (!call_pending) break;
+
+        _LSAnalyzeMethod *method = call_pending->method;
+        double latency = _LSAnalyzeTimeDiff(&message_data->timestamp, &call_pending->timestamp) * 1000;
+
+        method->stats.replies++;
+        method->reply_sizes[_LSAnalyzeSizeBucket(payload_len)]++;
+        g_array_append_val(method->stats.latencies, latency);
+
+        g_hash_table_remove(pending, &call);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void
+_LSAnalyzePrintHistogram(const char *title, const uint64_t *sizes)
+{
+    int bucket;
+
+    fprintf(stdout, "    %s\n", title);
+
+    for (bucket = 0; bucket < LS_ANALYZE_SIZE_BUCKETS; bucket++)
+    {
+        if (!sizes[bucket]) continue;
+
+        if (bucket == 0)
+        {
+            fprintf(stdout, "      %10s  %" PRIu64 "\n", "0", sizes[bucket]);
+        }
+        else
+        {
+            fprintf(stdout, "      <= %7lu  %" PRIu64 "\n", 1UL << (bucket - 1), sizes[bucket]);
+        }
+    }
+}
+
+static void
+_LSAnalyzePrint(double duration)
+{
+    GPtrArray *sorted = _LSMonitorMethodStatsSort(methods);
+
+    fprintf(stdout, "%10s %10s %10s %10s %10s %10s %10s  %s\n",
+            "Calls", "Calls/s", "Replied", "p50 ms", "p90 ms", "p99 ms", "max ms", "Method");
+
+    guint i;
+    for (i = 0; i < sorted->len; i++)
+    {
+        _LSAnalyzeMethod *method = g_ptr_array_index(sorted, i);
+        _LSMonitorMethodStats *stats = &method->stats;
+
+        fprintf(stdout, "%10" PRIu64 " %10.2f %10" PRIu64 " ",
+                stats->calls, duration > 0 ? stats->calls / duration : 0.0, stats->replies);
+        _LSMonitorMethodStatsPrintLatencies(stats);
+        fprintf(stdout, "  %s\n", stats->name);
+
+        if (print_histograms)
+        {
+            _LSAnalyzePrintHistogram("call payload bytes", method->call_sizes);
+            if (stats->replies)
+            {
+                _LSAnalyzePrintHistogram("reply payload bytes", method->reply_sizes);
+            }
+        }
+    }
+
+    g_ptr_array_free(sorted, TRUE);
+}
+
+static void
+_HandleCommandline(int *argc, char ***argv)
+{
+    GError *gerror = NULL;
+    GOptionContext *opt_context = NULL;
+
+    static GOptionEntry opt_entries[] =
+    {
+        {"method", 'M', 0, G_OPTION_ARG_STRING, &method_glob, "Only count methods matching a category/method glob", "/com/palm/foo/*"},
+        {"from", 'f', 0, G_OPTION_ARG_DOUBLE, &from_sec, "Skip this many seconds from the start of the capture", "seconds"},
+        {"to", 't', 0, G_OPTION_ARG_DOUBLE, &to_sec, "Stop this many seconds from the start of the capture", "seconds"},
+        {"histograms", 'g', 0, G_OPTION_ARG_NONE, &print_histograms, "Print payload size histograms of each method", NULL},
+        { NULL }
+    };
+
+    opt_context = g_option_context_new("FILE - Luna Service monitor capture analyzer");
+    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
+
+    if (!g_option_context_parse(opt_context, argc, argv, &gerror))
+    {
+        g_critical("Error processing commandline args: %s", gerror->message);
+        g_error_free(gerror);
+        exit(EXIT_FAILURE);
+    }
+
+    if (*argc != 2)
+    {
+        char *help = g_option_context_get_help(opt_context, TRUE, NULL);
+        fprintf(stderr, "%s", help);
+        g_free(help);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(opt_context);
+
+    if (method_glob)
+    {
+        method_pattern = g_pattern_spec_new(method_glob);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _HandleCommandline(&argc, &argv);
+
+    _LSMonitorCaptureReader *reader = _LSMonitorCaptureReaderOpen(argv[1], &lserror);
+    if (!reader)
+    {
+        LSErrorPrint(&lserror, stderr);
+        LSErrorFree(&lserror);
+        exit(EXIT_FAILURE);
+    }
+
+    methods = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _LSAnalyzeMethodFree);
+    pending = g_hash_table_new_full(_LSAnalyzeCallHash, _LSAnalyzeCallEqual, _LSAnalyzeCallFree, _LSAnalyzePendingFree);
+
+    _LSMonitorCaptureEntry entry;
+    struct timespec start = { 0, 0 };
+    struct timespec first = { 0, 0 };
+    struct timespec last = { 0, 0 };
+    bool have_start = false;
+    bool have_first = false;
+
+    while (_LSMonitorCaptureReaderNext(reader, &entry))
+    {
+        _LSTransportMessage *message = _LSMonitorCaptureEntryMessageNewRef(&entry);
+        const _LSMonitorMessageData *message_data = _LSTransportMessageGetMonitorMessageData(message);
+
+        if (!have_start)
+        {
+            /* the window is relative to the first message, so find it and
+             * then jump to the start of the window */
+            start = message_data->timestamp;
+            have_start = true;
+
+            if (from_sec > 0)
+            {
+                struct timespec from = start;
+                from.tv_sec += (time_t)from_sec;
+                from.tv_nsec += (long)((from_sec - (time_t)from_sec) * 1e9);
+                if (from.tv_nsec >= 1000000000)
+                {
+                    from.tv_sec++;
+                    from.tv_nsec -= 1000000000;
+                }
+
+                _LSTransportMessageUnref(message);
+                if (!_LSMonitorCaptureReaderSeek(reader, &from)) break;
+                continue;
+            }
+        }
+
+        double offset = _LSAnalyzeTimeDiff(&message_data->timestamp, &start);
+
+        if (message_data->type == _LSMonitorMessageTypeTx && offset >= from_sec)
+        {
+            if (to_sec > 0 && offset > to_sec)
+            {
+                /* copies are only roughly in order, so give late ones a second */
+                if (offset > to_sec + 1)
+                {
+                    _LSTransportMessageUnref(message);
+                    break;
+                }
+            }
+            else
+            {
+                if (!have_first || _LSAnalyzeTimeDiff(&message_data->timestamp, &first) < 0)
+                {
+                    first = message_data->timestamp;
+                }
+                if (!have_first || _LSAnalyzeTimeDiff(&message_data->timestamp, &last) > 0)
+                {
+                    last = message_data->timestamp;
+                }
+                have_first = true;
+
+                _LSAnalyzeMessage(&entry, message, message_data);
+            }
+        }
+
+        _LSTransportMessageUnref(message);
+    }
+
+    _LSAnalyzePrint(_LSAnalyzeTimeDiff(&last, &first));
+
+    g_hash_table_destroy(pending);
+    g_hash_table_destroy(methods);
+    if (method_pattern) g_pattern_spec_free(method_pattern);
+    _LSMonitorCaptureReaderClose(reader);
+
+    exit(EXIT_SUCCESS);
+}
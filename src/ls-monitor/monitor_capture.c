@@ -0,0 +1,653 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "monitor_capture.h"
+
+/* The writer is fed straight from the message handlers, so it only copies the
+ * raw messages into a large stdio buffer and leaves all parsing to whoever
+ * reads the capture. */
+
+#define LS_MONITOR_CAPTURE_BUFFER_SIZE  (1024 * 1024)
+
+#define LS_MONITOR_CAPTURE_ALIGN(size)  (((size) + 7) & ~(uint64_t)7)
+
+struct _LSMonitorCapture
+{
+    FILE *file;
+    char *buffer;
+    uint64_t offset;                /* where the next record goes */
+    uint64_t last_index;            /* offset of the last index written; 0 if none */
+    GArray *index;                  /* _LSMonitorCaptureIndexEntry of messages since then */
+};
+
+struct _LSMonitorCaptureReader
+{
+    const char *map;
+    size_t map_size;
+    uint64_t pos;                   /* offset of the next record */
+    uint64_t last_index;            /* from the trailer; 0 if there is none */
+};
+
+static const char _LSMonitorCapturePadding[8];
+
+static bool
+_LSMonitorCaptureWriteBytes(_LSMonitorCapture *capture, const void *data, size_t size)
+{
+    if (size && fwrite(data, size, 1, capture->file) != 1)
+    {
+        return false;
+    }
+    capture->offset += size;
+    return true;
+}
+
+static bool
+_LSMonitorCaptureWritePadding(_LSMonitorCapture *capture)
+{
+    return _LSMonitorCaptureWriteBytes(capture, _LSMonitorCapturePadding,
+                                       LS_MONITOR_CAPTURE_ALIGN(capture->offset) - capture->offset);
+}
+
+static bool
+_LSMonitorCaptureWriteIndex(_LSMonitorCapture *capture)
+{
+    _LSMonitorCaptureIndex index;
+    uint64_t offset = capture->offset;
+
+    index.record.kind = LS_MONITOR_CAPTURE_RECORD_INDEX;
+    index.record.size = sizeof(index) + capture->index->len * sizeof(_LSMonitorCaptureIndexEntry);
+    index.count = capture->index->len;
+    index.reserved = 0;
+    index.prev = capture->last_index;
+
+    if (!_LSMonitorCaptureWriteBytes(capture, &index, sizeof(index)) ||
+        !_LSMonitorCaptureWriteBytes(capture, capture->index->data,
+                                     capture->index->len * sizeof(_LSMonitorCaptureIndexEntry)))
+    {
+        return false;
+    }
+
+    capture->last_index = offset;
+    g_array_set_size(capture->index, 0);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a capture file.
+ *
+ * @param  path     IN  file to create; an existing file is overwritten
+ * @param  lserror  OUT set on error
+ *
+ * @retval capture on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+_LSMonitorCapture*
+_LSMonitorCaptureOpen(const char *path, LSError *lserror)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (!file)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_CAPTURE_ERR, errno);
+        return NULL;
+    }
+
+    _LSMonitorCapture *capture = g_slice_new0(_LSMonitorCapture);
+    capture->file = file;
+    capture->buffer = g_malloc(LS_MONITOR_CAPTURE_BUFFER_SIZE);
+    capture->index = g_array_sized_new(FALSE, FALSE, sizeof(_LSMonitorCaptureIndexEntry),
+                                       LS_MONITOR_CAPTURE_INDEX_INTERVAL);
+
+    setvbuf(file, capture->buffer, _IOFBF, LS_MONITOR_CAPTURE_BUFFER_SIZE);
+
+    _LSMonitorCaptureFileHeader header;
+    struct timespec now;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LS_MONITOR_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = LS_MONITOR_CAPTURE_VERSION;
+    header.header_size = sizeof(_LSTransportHeader);
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.start_sec = now.tv_sec;
+    header.start_nsec = now.tv_nsec;
+
+    if (!_LSMonitorCaptureWriteBytes(capture, &header, sizeof(header)))
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_CAPTURE_ERR, errno);
+        fclose(file);
+        g_array_free(capture->index, TRUE);
+        g_free(capture->buffer);
+        g_slice_free(_LSMonitorCapture, capture);
+        return NULL;
+    }
+
+    return capture;
+}
+
+/**
+ *******************************************************************************
+ * @brief Append a monitor copy to a capture.
+ *
+ * @param  capture      IN  capture
+ * @param  message      IN  monitor copy received from a client
+ * @param  public_bus   IN  true if the copy came over the public bus
+ *
+ * @retval true on success
+ * @retval false if the file could not be written
+ *******************************************************************************
+ */
+bool
+_LSMonitorCaptureWrite(_LSMonitorCapture *capture, _LSTransportMessage *message, bool public_bus)
+{
+    LS_ASSERT(capture != NULL);
+    LS_ASSERT(message != NULL);
+
+    const char *service_name = _LSTransportMessageGetSenderServiceName(message);
+    const char *unique_name = _LSTransportMessageGetSenderUniqueName(message);
+    const _LSMonitorMessageData *message_data = _LSTransportMessageGetMonitorMessageData(message);
+
+    uint16_t service_len = service_name ? strlen(service_name) + 1 : 0;
+    uint16_t unique_len = unique_name ? strlen(unique_name) + 1 : 0;
+    uint32_t raw_len = sizeof(_LSTransportHeader) + message->raw->header.len;
+
+    _LSMonitorCaptureMessage record;
+    _LSMonitorCaptureIndexEntry entry;
+
+    record.record.kind = LS_MONITOR_CAPTURE_RECORD_MESSAGE;
+    record.record.size = LS_MONITOR_CAPTURE_ALIGN(sizeof(record) + service_len + unique_len) +
+                         LS_MONITOR_CAPTURE_ALIGN(raw_len);
+    record.flags = public_bus ? LS_MONITOR_CAPTURE_FLAG_PUBLIC : 0;
+    record.payload_type = _LSTransportMessageGetPayloadType(message);
+    record.payload_len = message->payload_len;
+    record.sender_service_len = service_len;
+    record.sender_unique_len = unique_len;
+    record.raw_len = raw_len;
+
+    entry.offset = capture->offset;
+    entry.sec = message_data->timestamp.tv_sec;
+    entry.nsec = message_data->timestamp.tv_nsec;
+
+    if (!_LSMonitorCaptureWriteBytes(capture, &record, sizeof(record)) ||
+        !_LSMonitorCaptureWriteBytes(capture, service_name, service_len) ||
+        !_LSMonitorCaptureWriteBytes(capture, unique_name, unique_len) ||
+        !_LSMonitorCaptureWritePadding(capture) ||
+        !_LSMonitorCaptureWriteBytes(capture, message->raw, raw_len) ||
+        !_LSMonitorCaptureWritePadding(capture))
+    {
+        return false;
+    }
+
+    g_array_append_val(capture->index, entry);
+
+    if (capture->index->len == LS_MONITOR_CAPTURE_INDEX_INTERVAL)
+    {
+        return _LSMonitorCaptureWriteIndex(capture);
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Push buffered records out to the file.
+ *
+ * @param  capture  IN  capture
+ *
+ * @retval true on success
+ * @retval false if the file could not be written
+ *******************************************************************************
+ */
+bool
+_LSMonitorCaptureFlush(_LSMonitorCapture *capture)
+{
+    LS_ASSERT(capture != NULL);
+
+    return fflush(capture->file) == 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Index the last messages, write the trailer and close a capture.
+ *
+ * @param  capture  IN  capture
+ *
+ * @retval true on success
+ * @retval false if the file could not be written
+ *******************************************************************************
+ */
+bool
+_LSMonitorCaptureClose(_LSMonitorCapture *capture)
+{
+    LS_ASSERT(capture != NULL);
+
+    bool ret = true;
+
+    if (capture->index->len > 0)
+    {
+        ret = _LSMonitorCaptureWriteIndex(capture);
+    }
+
+    if (ret)
+    {
+        _LSMonitorCaptureTrailer trailer;
+
+        trailer.record.kind = LS_MONITOR_CAPTURE_RECORD_TRAILER;
+        trailer.record.size = sizeof(trailer);
+        trailer.last_index = capture->last_index;
+
+        ret = _LSMonitorCaptureWriteBytes(capture, &trailer, sizeof(trailer));
+    }
+
+    if (fclose(capture->file) != 0)
+    {
+        ret = false;
+    }
+
+    g_array_free(capture->index, TRUE);
+    g_free(capture->buffer);
+    g_slice_free(_LSMonitorCapture, capture);
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Map a capture file for reading.
+ *
+ * @param  path     IN  capture file
+ * @param  lserror  OUT set on error
+ *
+ * @retval reader on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+_LSMonitorCaptureReader*
+_LSMonitorCaptureReaderOpen(const char *path, LSError *lserror)
+{
+    struct stat st;
+    void *map = MAP_FAILED;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_CAPTURE_ERR, errno);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_CAPTURE_ERR, errno);
+        goto error;
+    }
+
+    if (st.st_size < sizeof(_LSMonitorCaptureFileHeader))
+    {
+        _LSErrorSet(lserror, MSGID_LS_CAPTURE_ERR, -EINVAL, "Capture file too small");
+        goto error;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LS_CAPTURE_ERR, errno);
+        goto error;
+    }
+
+    const _LSMonitorCaptureFileHeader *header = map;
+
+    /* the raw messages are in the layout of the writer */
+    if (memcmp(header->magic, LS_MONITOR_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != LS_MONITOR_CAPTURE_VERSION ||
+        header->header_size != sizeof(_LSTransportHeader))
+    {
+        _LSErrorSet(lserror, MSGID_LS_CAPTURE_ERR, -EINVAL, "Invalid capture file");
+        goto error;
+    }
+
+    close(fd);
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    _LSMonitorCaptureReader *reader = g_slice_new0(_LSMonitorCaptureReader);
+    reader->map = map;
+    reader->map_size = st.st_size;
+    reader->pos = sizeof(_LSMonitorCaptureFileHeader);
+
+    /* a capture that was cut short has no trailer */
+    if (reader->map_size >= reader->pos + sizeof(_LSMonitorCaptureTrailer))
+    {
+        const _LSMonitorCaptureTrailer *trailer =
+            (const _LSMonitorCaptureTrailer*)(reader->map + reader->map_size - sizeof(_LSMonitorCaptureTrailer));
+
+        if (trailer->record.kind == LS_MONITOR_CAPTURE_RECORD_TRAILER &&
+            trailer->record.size == sizeof(_LSMonitorCaptureTrailer) &&
+            trailer->last_index < reader->map_size)
+        {
+            reader->last_index = trailer->last_index;
+        }
+    }
+
+    return reader;
+
+error:
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    close(fd);
+    return NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Unmap a capture file.
+ *
+ * @param  reader   IN  reader
+ *******************************************************************************
+ */
+void
+_LSMonitorCaptureReaderClose(_LSMonitorCaptureReader *reader)
+{
+    LS_ASSERT(reader != NULL);
+
+    munmap((void*)reader->map, reader->map_size);
+    g_slice_free(_LSMonitorCaptureReader, reader);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the file header of a capture.
+ *
+ * @param  reader   IN  reader
+ *
+ * @retval header
+ *******************************************************************************
+ */
+const _LSMonitorCaptureFileHeader*
+_LSMonitorCaptureReaderGetHeader(const _LSMonitorCaptureReader *reader)
+{
+    LS_ASSERT(reader != NULL);
+
+    return (const _LSMonitorCaptureFileHeader*)reader->map;
+}
+
+/* Get the record at an offset, or NULL if it runs past the end of the file,
+ * as the last one does in a capture that was cut short */
+static const _LSMonitorCaptureRecord*
+_LSMonitorCaptureReaderGetRecord(const _LSMonitorCaptureReader *reader, uint64_t offset)
+{
+    if (offset % 8 || offset + sizeof(_LSMonitorCaptureRecord) > reader->map_size)
+    {
+        return NULL;
+    }
+
+    const _LSMonitorCaptureRecord *record = (const _LSMonitorCaptureRecord*)(reader->map + offset);
+
+    if (record->size < sizeof(_LSMonitorCaptureRecord) || record->size % 8 ||
+        offset + record->size > reader->map_size)
+    {
+        return NULL;
+    }
+
+    return record;
+}
+
+static const _LSMonitorCaptureIndex*
+_LSMonitorCaptureReaderGetIndex(const _LSMonitorCaptureReader *reader, uint64_t offset)
+{
+    const _LSMonitorCaptureRecord *record = _LSMonitorCaptureReaderGetRecord(reader, offset);
+
+    if (!record || record->kind != LS_MONITOR_CAPTURE_RECORD_INDEX || record->size < sizeof(_LSMonitorCaptureIndex))
+    {
+        return NULL;
+    }
+
+    const _LSMonitorCaptureIndex *index = (const _LSMonitorCaptureIndex*)record;
+
+    if (index->count == 0 ||
+        sizeof(_LSMonitorCaptureIndex) + index->count * sizeof(_LSMonitorCaptureIndexEntry) > record->size)
+    {
+        return NULL;
+    }
+
+    return index;
+}
+
+static int
+_LSMonitorCaptureTimeCompare(const _LSMonitorCaptureIndexEntry *entry, const struct timespec *time)
+{
+    if (entry->sec != time->tv_sec) return entry->sec < time->tv_sec ? -1 : 1;
+    if (entry->nsec != time->tv_nsec) return entry->nsec < time->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/* Find the first entry of an index at or after a time, or NULL if they are
+ * all before it */
+static const _LSMonitorCaptureIndexEntry*
+_LSMonitorCaptureIndexFind(const _LSMonitorCaptureIndex *index, const struct timespec *time)
+{
+    const _LSMonitorCaptureIndexEntry *entries = (const _LSMonitorCaptureIndexEntry*)(index + 1);
+    uint32_t low = 0;
+    uint32_t high = index->count;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (_LSMonitorCaptureTimeCompare(&entries[mid], time) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low < index->count ? &entries[low] : NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Move to the first message recorded at or after a time.
+ *
+ * Copies arrive from many clients, so their times are only roughly in order;
+ * callers that need an exact window still check the time of each message.
+ *
+ * With a trailer the indexes are walked back from the last one; otherwise the
+ * records are skipped from the start of the file, which only reads their
+ * headers.
+ *
+ * @param  reader   IN  reader
+ * @param  time     IN  time of the monitor clock
+ *
+ * @retval true if the reader is at a message
+ * @retval false if there are no messages at or after @ref time
+ *******************************************************************************
+ */
+bool
+_LSMonitorCaptureReaderSeek(_LSMonitorCaptureReader *reader, const struct timespec *time)
+{
+    LS_ASSERT(reader != NULL);
+    LS_ASSERT(time != NULL);
+
+    const _LSMonitorCaptureIndexEntry *entry = NULL;
+
+    if (reader->last_index)
+    {
+        uint64_t index_offset = reader->last_index;
+        const _LSMonitorCaptureIndex *index = _LSMonitorCaptureReaderGetIndex(reader, index_offset);
+
+        /* messages after the last index, if any */
+        reader->pos = reader->last_index + (index ? index->record.size : 0);
+
+        while (index)
+        {
+            const _LSMonitorCaptureIndexEntry *first = (const _LSMonitorCaptureIndexEntry*)(index + 1);
+
+            if (_LSMonitorCaptureTimeCompare(first, time) <= 0)
+            {
+                /* if they are all before the time, the first entry of the
+                 * next index (or the messages after the last one) will do */
+                const _LSMonitorCaptureIndexEntry *found = _LSMonitorCaptureIndexFind(index, time);
+                if (found) entry = found;
+                break;
+            }
+
+            entry = first;
+
+            /* indexes only point back, so a damaged capture can't loop us */
+            if (!index->prev || index->prev >= index_offset) break;
+
+            index_offset = index->prev;
+            index = _LSMonitorCaptureReaderGetIndex(reader, index_offset);
+        }
+    }
+    else
+    {
+        uint64_t offset = sizeof(_LSMonitorCaptureFileHeader);
+        const _LSMonitorCaptureRecord *record;
+
+        reader->pos = offset;
+
+        while ((record = _LSMonitorCaptureReaderGetRecord(reader, offset)))
+        {
+            offset += record->size;
+
+            if (record->kind != LS_MONITOR_CAPTURE_RECORD_INDEX) continue;
+
+            const _LSMonitorCaptureIndex *index = _LSMonitorCaptureReaderGetIndex(reader, offset - record->size);
+            if (!index) continue;
+
+            entry = _LSMonitorCaptureIndexFind(index, time);
+            if (entry) break;
+
+            reader->pos = offset;
+        }
+    }
+
+    if (entry)
+    {
+        reader->pos = entry->offset;
+    }
+
+    /* after the last index there may only be the trailer */
+    const _LSMonitorCaptureRecord *record = _LSMonitorCaptureReaderGetRecord(reader, reader->pos);
+
+    return record && record->kind == LS_MONITOR_CAPTURE_RECORD_MESSAGE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Read the next message of a capture.
+ *
+ * @param  reader   IN  reader
+ * @param  entry    OUT message, valid until the reader is closed
+ *
+ * @retval true if a message was read
+ * @retval false at the end of the capture
+ *******************************************************************************
+ */
+bool
+_LSMonitorCaptureReaderNext(_LSMonitorCaptureReader *reader, _LSMonitorCaptureEntry *entry)
+{
+    LS_ASSERT(reader != NULL);
+    LS_ASSERT(entry != NULL);
+
+    const _LSMonitorCaptureRecord *record;
+
+    while ((record = _LSMonitorCaptureReaderGetRecord(reader, reader->pos)))
+    {
+        reader->pos += record->size;
+
+        if (record->kind != LS_MONITOR_CAPTURE_RECORD_MESSAGE ||
+            record->size < sizeof(_LSMonitorCaptureMessage))
+        {
+            continue;
+        }
+
+        const _LSMonitorCaptureMessage *message = (const _LSMonitorCaptureMessage*)record;
+        const char *names = (const char*)(message + 1);
+        uint64_t names_size = LS_MONITOR_CAPTURE_ALIGN(sizeof(*message) + message->sender_service_len +
+                                                       message->sender_unique_len);
+
+        if (names_size + LS_MONITOR_CAPTURE_ALIGN(message->raw_len) > record->size ||
+            message->raw_len < sizeof(_LSTransportHeader) ||
+            message->sender_unique_len == 0 ||
+            (message->sender_service_len && names[message->sender_service_len - 1] != '\0') ||
+            names[message->sender_service_len + message->sender_unique_len - 1] != '\0')
+        {
+            LOG_LS_ERROR(MSGID_LS_CAPTURE_ERR, 1, PMLOGKFV("OFFSET", "%lu", (unsigned long)(reader->pos - record->size)),
+                         "Skipping invalid capture record");
+            continue;
+        }
+
+        entry->record = message;
+        entry->sender_service_name = message->sender_service_len ? names : NULL;
+        entry->sender_unique_name = names + message->sender_service_len;
+        entry->raw = (const _LSTransportMessageRaw*)((const char*)message + names_size);
+        entry->public_bus = message->flags & LS_MONITOR_CAPTURE_FLAG_PUBLIC;
+
+        if (entry->raw->header.len != message->raw_len - sizeof(_LSTransportHeader))
+        {
+            LOG_LS_ERROR(MSGID_LS_CAPTURE_ERR, 1, PMLOGKFV("OFFSET", "%lu", (unsigned long)(reader->pos - record->size)),
+                         "Skipping invalid capture record");
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ *******************************************************************************
+ * @brief Make a message out of a captured copy.
+ *
+ * The message has no client, so the sender names come from @ref entry.
+ *
+ * @param  entry    IN  message read from a capture
+ *
+ * @retval message with ref count of 1
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSMonitorCaptureEntryMessageNewRef(const _LSMonitorCaptureEntry *entry)
+{
+    LS_ASSERT(entry != NULL);
+
+    const _LSTransportHeader *header = &entry->raw->header;
+    _LSTransportMessage *message = _LSTransportMessageNewRef(header->len);
+
+    _LSTransportMessageSetType(message, header->type);
+    _LSTransportMessageSetToken(message, header->token);
+    _LSTransportMessageSetBody(message, entry->raw->data, header->len);
+    _LSTransportMessageSetPayloadType(message, entry->record->payload_type, entry->record->payload_len);
+
+    return message;
+}
@@ -0,0 +1,133 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _MONITOR_CAPTURE_H
+#define _MONITOR_CAPTURE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "transport.h"
+
+/*
+ * Capture file
+ *
+ * A file header is followed by records, each starting with a record header
+ * and padded to 8 bytes, so that the file can be mapped and walked in place.
+ *
+ * Message records hold the monitor copy of a message as it arrived: the raw
+ * header and body, which ends with the destination names and the
+ * _LSMonitorMessageData. The names of the client that sent us the copy come
+ * before it, since they aren't in the copy itself.
+ *
+ * Every LS_MONITOR_CAPTURE_INDEX_INTERVAL messages an index record lists the
+ * offset and time of each of them and points back at the previous index. A
+ * trailer written on close points at the last index; a capture that was cut
+ * short has no trailer and is read from the start.
+ */
+
+#define LS_MONITOR_CAPTURE_MAGIC            "LS2CAPT"       /**< 8 bytes with the NUL */
+#define LS_MONITOR_CAPTURE_VERSION          1
+
+#define LS_MONITOR_CAPTURE_INDEX_INTERVAL   1024
+
+#define LS_MONITOR_CAPTURE_RECORD_MESSAGE   1
+#define LS_MONITOR_CAPTURE_RECORD_INDEX     2
+#define LS_MONITOR_CAPTURE_RECORD_TRAILER   3
+
+#define LS_MONITOR_CAPTURE_FLAG_PUBLIC      (1 << 0)        /**< the copy came over the public bus */
+
+struct LSMonitorCaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;               /**< sizeof(_LSTransportHeader) of the writer, which
+                                             has to match ours to read the raw messages */
+    int64_t start_sec;                  /**< wall clock time the capture started */
+    int64_t start_nsec;
+};
+
+struct LSMonitorCaptureRecord {
+    uint32_t kind;                      /**< LS_MONITOR_CAPTURE_RECORD_* */
+    uint32_t size;                      /**< whole record with padding */
+};
+
+struct LSMonitorCaptureMessage {
+    struct LSMonitorCaptureRecord record;
+    uint32_t flags;                     /**< LS_MONITOR_CAPTURE_FLAG_* */
+    uint32_t payload_type;              /**< LS_PAYLOAD_TYPE_JSON or the type of a binary payload */
+    uint64_t payload_len;               /**< length of a binary payload */
+    uint16_t sender_service_len;        /**< with the NUL; 0 if the sender has no service name */
+    uint16_t sender_unique_len;         /**< with the NUL */
+    uint32_t raw_len;                   /**< header and body of the copy */
+    /* sender service name, sender unique name, padding, raw copy, padding */
+};
+
+struct LSMonitorCaptureIndexEntry {
+    uint64_t offset;                    /**< of the message record */
+    int64_t sec;                        /**< time of the message */
+    int64_t nsec;
+};
+
+struct LSMonitorCaptureIndex {
+    struct LSMonitorCaptureRecord record;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t prev;                      /**< offset of the previous index; 0 for the first */
+    /* count entries */
+};
+
+struct LSMonitorCaptureTrailer {
+    struct LSMonitorCaptureRecord record;
+    uint64_t last_index;                /**< offset of the last index; 0 if there is none */
+};
+
+typedef struct LSMonitorCaptureFileHeader _LSMonitorCaptureFileHeader;
+typedef struct LSMonitorCaptureRecord _LSMonitorCaptureRecord;
+typedef struct LSMonitorCaptureMessage _LSMonitorCaptureMessage;
+typedef struct LSMonitorCaptureIndexEntry _LSMonitorCaptureIndexEntry;
+typedef struct LSMonitorCaptureIndex _LSMonitorCaptureIndex;
+typedef struct LSMonitorCaptureTrailer _LSMonitorCaptureTrailer;
+
+/* A message read back from a capture; the pointers point into the mapping */
+struct LSMonitorCaptureEntry {
+    const _LSMonitorCaptureMessage *record;
+    const char *sender_service_name;    /**< NULL if the sender has no service name */
+    const char *sender_unique_name;
+    const _LSTransportMessageRaw *raw;
+    bool public_bus;
+};
+
+typedef struct LSMonitorCaptureEntry _LSMonitorCaptureEntry;
+
+typedef struct _LSMonitorCapture _LSMonitorCapture;
+typedef struct _LSMonitorCaptureReader _LSMonitorCaptureReader;
+
+_LSMonitorCapture* _LSMonitorCaptureOpen(const char *path, LSError *lserror);
+bool _LSMonitorCaptureWrite(_LSMonitorCapture *capture, _LSTransportMessage *message, bool public_bus);
+bool _LSMonitorCaptureFlush(_LSMonitorCapture *capture);
+bool _LSMonitorCaptureClose(_LSMonitorCapture *capture);
+
+_LSMonitorCaptureReader* _LSMonitorCaptureReaderOpen(const char *path, LSError *lserror);
+void _LSMonitorCaptureReaderClose(_LSMonitorCaptureReader *reader);
+const _LSMonitorCaptureFileHeader* _LSMonitorCaptureReaderGetHeader(const _LSMonitorCaptureReader *reader);
+bool _LSMonitorCaptureReaderSeek(_LSMonitorCaptureReader *reader, const struct timespec *time);
+bool _LSMonitorCaptureReaderNext(_LSMonitorCaptureReader *reader, _LSMonitorCaptureEntry *entry);
+_LSTransportMessage* _LSMonitorCaptureEntryMessageNewRef(const _LSMonitorCaptureEntry *entry);
+
+#endif  /* _MONITOR_CAPTURE_H */
@@ -0,0 +1,106 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "monitor_stats.h"
+
+/* Busiest first, then by name */
+static int
+_LSMonitorMethodStatsCompare(gconstpointer a, gconstpointer b)
+{
+    const _LSMonitorMethodStats *method_a = *(_LSMonitorMethodStats* const*)a;
+    const _LSMonitorMethodStats *method_b = *(_LSMonitorMethodStats* const*)b;
+
+    if (method_a->calls != method_b->calls) return method_a->calls < method_b->calls ? 1 : -1;
+    return strcmp(method_a->name, method_b->name);
+}
+
+static int
+_LSMonitorDoubleCompare(gconstpointer a, gconstpointer b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return da < db ? -1 : da > db;
+}
+
+/* Takes ownership of the name */
+void
+_LSMonitorMethodStatsInit(_LSMonitorMethodStats *stats, char *name)
+{
+    stats->name = name;
+    stats->calls = 0;
+    stats->replies = 0;
+    stats->latencies = g_array_new(FALSE, FALSE, sizeof(double));
+}
+
+void
+_LSMonitorMethodStatsClear(_LSMonitorMethodStats *stats)
+{
+    g_free(stats->name);
+    stats->name = NULL;
+    g_array_free(stats->latencies, TRUE);
+    stats->latencies = NULL;
+}
+
+/* The values of the table that have been called, busiest first */
+GPtrArray*
+_LSMonitorMethodStatsSort(GHashTable *methods)
+{
+    GPtrArray *sorted = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, methods);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        _LSMonitorMethodStats *stats = value;
+        if (stats->calls) g_ptr_array_add(sorted, stats);
+    }
+    g_ptr_array_sort(sorted, _LSMonitorMethodStatsCompare);
+
+    return sorted;
+}
+
+/* Nearest rank percentile; the latencies have to be sorted and not empty */
+double
+_LSMonitorMethodStatsPercentile(const _LSMonitorMethodStats *stats, double percentile)
+{
+    const GArray *latencies = stats->latencies;
+    guint rank = (guint)(percentile / 100 * (latencies->len - 1) + 0.5);
+    return g_array_index(latencies, double, rank);
+}
+
+/* Print the p50, p90, p99 and max columns; sorts the latencies */
+void
+_LSMonitorMethodStatsPrintLatencies(_LSMonitorMethodStats *stats)
+{
+    GArray *latencies = stats->latencies;
+
+    if (!latencies->len)
+    {
+        fprintf(stdout, "%10s %10s %10s %10s", "-", "-", "-", "-");
+        return;
+    }
+
+    g_array_sort(latencies, _LSMonitorDoubleCompare);
+    fprintf(stdout, "%10.3f %10.3f %10.3f %10.3f",
+            _LSMonitorMethodStatsPercentile(stats, 50), _LSMonitorMethodStatsPercentile(stats, 90),
+            _LSMonitorMethodStatsPercentile(stats, 99), g_array_index(latencies, double, latencies->len - 1));
+}
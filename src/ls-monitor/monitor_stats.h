@@ -0,0 +1,46 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _MONITOR_STATS_H
+#define _MONITOR_STATS_H
+
+#include <stdint.h>
+#include <glib.h>
+
+/*
+ * Per method counters shared by ls-monitor-analyze and ls-replay. Their method
+ * structs start with a _LSMonitorMethodStats, so that a pointer to one of them
+ * can be used as a pointer to its stats.
+ */
+
+typedef struct LSMonitorMethodStats
+{
+    char *name;                         /* name of the method, e.g., "category/method" */
+    uint64_t calls;
+    uint64_t replies;
+    GArray *latencies;                  /* double, call to first reply in ms */
+} _LSMonitorMethodStats;
+
+void _LSMonitorMethodStatsInit(_LSMonitorMethodStats *stats, char *name);
+void _LSMonitorMethodStatsClear(_LSMonitorMethodStats *stats);
+GPtrArray* _LSMonitorMethodStatsSort(GHashTable *methods);
+double _LSMonitorMethodStatsPercentile(const _LSMonitorMethodStats *stats, double percentile);
+void _LSMonitorMethodStatsPrintLatencies(_LSMonitorMethodStats *stats);
+
+#endif  /* _MONITOR_STATS_H */
@@ -0,0 +1,192 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdio.h>
+
+#include "monitor.h"
+#include "monitor_trace.h"
+
+/* Trace rings of the clients on one bus. Each client writes its own ring, so
+ * the records are gathered from all of them and put back in order by serial
+ * before printing. */
+
+struct _LSMonitorTraceRing
+{
+    _LSTransportTraceReader *reader;
+    char *owner;                    /* name of the client that writes the ring */
+    unsigned long dropped;          /* drops we have reported so far */
+};
+
+struct _LSMonitorTraceItem
+{
+    _LSTransportTraceRecord record;
+    char owner[LS_TRANSPORT_TRACE_PEER_SIZE];
+};
+
+struct _LSMonitorTrace
+{
+    bool public;
+    GHashTable *rings;              /* _LSTransportClient* to _LSMonitorTraceRing */
+    GArray *items;                  /* records read but not printed yet */
+};
+
+typedef struct _LSMonitorTraceRing _LSMonitorTraceRing;
+typedef struct _LSMonitorTraceItem _LSMonitorTraceItem;
+
+static void
+_LSMonitorTraceRingFree(_LSMonitorTraceRing *ring)
+{
+    _LSTransportTraceReaderFree(ring->reader);
+    g_free(ring->owner);
+    g_slice_free(_LSMonitorTraceRing, ring);
+}
+
+_LSMonitorTrace*
+_LSMonitorTraceNew(bool public_bus)
+{
+    _LSMonitorTrace *trace = g_new0(_LSMonitorTrace, 1);
+
+    trace->public = public_bus;
+    trace->rings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_LSMonitorTraceRingFree);
+    trace->items = g_array_new(FALSE, FALSE, sizeof(_LSMonitorTraceItem));
+
+    return trace;
+}
+
+void
+_LSMonitorTraceFree(_LSMonitorTrace *trace)
+{
+    LS_ASSERT(trace != NULL);
+    g_hash_table_destroy(trace->rings);
+    g_array_free(trace->items, TRUE);
+    g_free(trace);
+}
+
+/* Take the fd out of a "TraceRing" message and map the ring */
+void
+_LSMonitorTraceAddRing(_LSMonitorTrace *trace, _LSTransportMessage *message)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSTransportClient *client = _LSTransportMessageGetClient(message);
+
+    int fd = _LSTransportMessageGetConnectionFd(message);
+    _LSTransportMessageSetConnectionFd(message, -1);
+
+    _LSTransportTraceReader *reader = _LSTransportTraceReaderNew(fd, &lserror);
+    if (!reader)
+    {
+        LSErrorPrint(&lserror, stderr);
+        LSErrorFree(&lserror);
+        return;
+    }
+
+    /* the client told us who it is before handing over the ring */
+    const char *owner = _LSTransportClientGetServiceName(client);
+    if (!owner)
+    {
+        owner = _LSTransportClientGetUniqueName(client);
+    }
+
+    _LSMonitorTraceRing *ring = g_slice_new0(_LSMonitorTraceRing);
+    ring->reader = reader;
+    ring->owner = g_strdup(owner ? owner : "");
+
+    g_hash_table_replace(trace->rings, client, ring);
+}
+
+static void
+_LSMonitorTraceRingCollect(_LSMonitorTrace *trace, _LSMonitorTraceRing *ring)
+{
+    _LSMonitorTraceItem item;
+
+    g_strlcpy(item.owner, ring->owner, sizeof(item.owner));
+
+    while (_LSTransportTraceReaderNext(ring->reader, &item.record))
+    {
+        g_array_append_val(trace->items, item);
+    }
+
+    if (ring->reader->dropped != ring->dropped)
+    {
+        fprintf(stdout, "%s: %lu records dropped\n", ring->owner, ring->reader->dropped - ring->dropped);
+        ring->dropped = ring->reader->dropped;
+    }
+}
+
+/* The client went away: keep what is left in its ring for the next print */
+void
+_LSMonitorTraceRemoveRing(_LSMonitorTrace *trace, _LSTransportClient *client)
+{
+    _LSMonitorTraceRing *ring = g_hash_table_lookup(trace->rings, client);
+
+    if (ring)
+    {
+        _LSMonitorTraceRingCollect(trace, ring);
+        g_hash_table_remove(trace->rings, client);
+    }
+}
+
+static gint
+_LSMonitorTraceItemCompareSerial(gconstpointer a, gconstpointer b)
+{
+    const _LSMonitorTraceItem *item_a = a;
+    const _LSMonitorTraceItem *item_b = b;
+
+    if (item_a->record.serial < item_b->record.serial) return -1;
+    if (item_a->record.serial > item_b->record.serial) return 1;
+    return 0;
+}
+
+static gint
+_LSMonitorTraceItemCompareTime(gconstpointer a, gconstpointer b)
+{
+    const _LSMonitorTraceItem *item_a = a;
+    const _LSMonitorTraceItem *item_b = b;
+
+    double diff = _LSMonitorTimeDiff(&item_a->record.timestamp, &item_b->record.timestamp);
+
+    if (diff < 0) return -1;
+    if (diff > 0) return 1;
+    return _LSMonitorTraceItemCompareSerial(a, b);
+}
+
+void
+_LSMonitorTracePrint(_LSMonitorTrace *trace, bool sort_by_timestamps)
+{
+    GHashTableIter iter;
+    _LSMonitorTraceRing *ring = NULL;
+    guint i;
+
+    g_hash_table_iter_init(&iter, trace->rings);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&ring))
+    {
+        _LSMonitorTraceRingCollect(trace, ring);
+    }
+
+    g_array_sort(trace->items, sort_by_timestamps ? _LSMonitorTraceItemCompareTime : _LSMonitorTraceItemCompareSerial);
+
+    for (i = 0; i < trace->items->len; i++)
+    {
+        const _LSMonitorTraceItem *item = &g_array_index(trace->items, _LSMonitorTraceItem, i);
+        _LSMonitorTraceRecordPrint(&item->record, item->owner, trace->public);
+    }
+
+    g_array_set_size(trace->items, 0);
+}
@@ -0,0 +1,34 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _MONITOR_TRACE_H
+#define _MONITOR_TRACE_H
+
+#include "transport.h"
+#include "transport_trace.h"
+
+typedef struct _LSMonitorTrace _LSMonitorTrace;
+
+_LSMonitorTrace* _LSMonitorTraceNew(bool public_bus);
+void _LSMonitorTraceFree(_LSMonitorTrace *trace);
+void _LSMonitorTraceAddRing(_LSMonitorTrace *trace, _LSTransportMessage *message);
+void _LSMonitorTraceRemoveRing(_LSMonitorTrace *trace, _LSTransportClient *client);
+void _LSMonitorTracePrint(_LSMonitorTrace *trace, bool sort_by_timestamps);
+
+#endif  /* _MONITOR_TRACE_H */
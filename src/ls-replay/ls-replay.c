@@ -0,0 +1,651 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <pbnjson.h>
+#include <luna-service2/lunaservice.h>
+
+#include "error.h"
+#include "transport.h"
+#include "monitor_capture.h"
+#include "monitor_stats.h"
+
+/* Replay of recorded method calls against a running hub, for load testing.
+ *
+ * The calls come from a capture written by "ls-monitor --capture" or from a
+ * JSONL file with one call per line:
+ *
+ *   {"time": 1.25, "sender": "com.palm.foo", "uri": "palm://com.palm.bar/get",
+ *    "payload": {...}, "appId": "com.palm.app", "public": true}
+ *
+ * Only "uri" is required. Each call is made from a handle registered with
+ * the name of its recorded sender, if the role files let us have it, and
+ * from an anonymous handle otherwise. Calls keep their app id. The latency
+ * is from sending a call to its first reply; calls stay open after it, so
+ * subscriptions cost what they did when they were recorded. */
+
+#define LS_REPLAY_BATCH         64      /* calls sent per idle callback with --fast */
+
+typedef struct LSReplayMethod
+{
+    _LSMonitorMethodStats stats;        /* named by the uri without the scheme; has to come first */
+    uint64_t errors;                    /* hub errors, e.g., the service is not there */
+} _LSReplayMethod;
+
+typedef struct LSReplayCall
+{
+    double time;                        /* seconds from the first call */
+    char *sender;                       /* service name of the caller; NULL if it had none */
+    bool public_bus;
+    char *uri;
+    char *payload;
+    size_t payload_len;
+    LSPayloadType payload_type;
+    char *app_id;
+    bool no_reply;
+    LSHandle *sh;
+    _LSReplayMethod *method;
+    struct timespec sent;
+    bool replied;
+} _LSReplayCall;
+
+static gdouble speed = 1.0;
+static gboolean fast = false;
+static gint reply_timeout = 10;
+static gboolean anonymous = false;
+static const char *method_glob = NULL;
+
+static GMainLoop *mainloop = NULL;
+static GPatternSpec *method_pattern = NULL;
+static GPtrArray *calls = NULL;         /* _LSReplayCall, by time */
+static GHashTable *methods = NULL;      /* name -> _LSReplayMethod */
+static GHashTable *handles = NULL;      /* "public/sender" -> LSHandle */
+static guint next_call = 0;
+static guint pending_replies = 0;
+static struct timespec start;
+static double max_lag = 0;
+
+static double
+_LSReplayElapsed(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) + (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void
+_LSReplayMethodFree(gpointer data)
+{
+    _LSReplayMethod *method = data;
+    _LSMonitorMethodStatsClear(&method->stats);
+    g_slice_free(_LSReplayMethod, method);
+}
+
+static void
+_LSReplayCallFree(gpointer data)
+{
+    _LSReplayCall *call = data;
+    g_free(call->sender);
+    g_free(call->uri);
+    g_free(call->payload);
+    g_free(call->app_id);
+    g_slice_free(_LSReplayCall, call);
+}
+
+static _LSReplayMethod*
+_LSReplayMethodGet(const char *uri)
+{
+    const char *name = strstr(uri, "://");
+    name = name ? name + 3 : uri;
+
+    _LSReplayMethod *method = g_hash_table_lookup(methods, name);
+
+    if (!method)
+    {
+        method = g_slice_new0(_LSReplayMethod);
+        _LSMonitorMethodStatsInit(&method->stats, g_strdup(name));
+        g_hash_table_insert(methods, method->stats.name, method);
+    }
+
+    return method;
+}
+
+/* Take ownership of a call, unless the method glob leaves it out */
+static void
+_LSReplayCallAdd(_LSReplayCall *call)
+{
+    call->method = _LSReplayMethodGet(call->uri);
+
+    if (method_pattern && !g_pattern_match_string(method_pattern, call->method->stats.name))
+    {
+        _LSReplayCallFree(call);
+        return;
+    }
+
+    g_ptr_array_add(calls, call);
+}
+
+/* Read the calls of a capture; each call is taken from the copy its caller sent */
+static bool
+_LSReplayLoadCapture(const char *path, LSError *lserror)
+{
+    _LSMonitorCaptureReader *reader = _LSMonitorCaptureReaderOpen(path, lserror);
+    if (!reader)
+    {
+        return false;
+    }
+
+    _LSMonitorCaptureEntry entry;
+
+    while (_LSMonitorCaptureReaderNext(reader, &entry))
+    {
+        _LSTransportMessageType type = entry.raw->header.type;
+
+        if (type != _LSTransportMessageTypeMethodCall && type != _LSTransportMessageTypeMethodCallNoReply)
+        {
+            continue;
+        }
+
+        _LSTransportMessage *message = _LSMonitorCaptureEntryMessageNewRef(&entry);
+        const _LSMonitorMessageData *message_data = _LSTransportMessageGetMonitorMessageData(message);
+        const char *service_name = _LSTransportMessageGetDestServiceName(message);
+        const char *category = _LSTransportMessageGetCategory(message);
+        const char *method_name = _LSTransportMessageGetMethod(message);
+        unsigned long payload_len = 0;
+        const char *payload = _LSTransportMessageGetPayloadBinary(message, &payload_len);
+
+        if (message_data->type == _LSMonitorMessageTypeTx && service_name && category && method_name && payload)
+        {
+            _LSReplayCall *call = g_slice_new0(_LSReplayCall);
+
+            call->time = message_data->timestamp.tv_sec + message_data->timestamp.tv_nsec / 1e9;
+            call->sender = g_strdup(entry.sender_service_name);
+            call->public_bus = entry.public_bus;
+            call->uri = g_strdup_printf("palm://%s%s%s%s", service_name, category,
+                                        g_str_has_suffix(category, "/") ? "" : "/", method_name);
+            call->payload = g_memdup(payload, payload_len + 1);
+            call->payload_len = payload_len;
+            call->payload_type = _LSTransportMessageGetPayloadType(message);
+            call->app_id = g_strdup(_LSTransportMessageGetAppId(message));
+            call->no_reply = type == _LSTransportMessageTypeMethodCallNoReply;
+
+            _LSReplayCallAdd(call);
+        }
+
+        _LSTransportMessageUnref(message);
+    }
+
+    _LSMonitorCaptureReaderClose(reader);
+
+    return true;
+}
+
+static char*
+_LSReplayGetString(jvalue_ref object, const char *key)
+{
+    jvalue_ref value = jobject_get(object, j_cstr_to_buffer(key));
+
+    if (!jis_string(value))
+    {
+        return NULL;
+    }
+
+    raw_buffer buf = jstring_get_fast(value);
+    return g_strndup(buf.m_str, buf.m_len);
+}
+
+/* Read the calls of a JSONL file */
+static bool
+_LSReplayLoadJson(const char *path, LSError *lserror)
+{
+    char *contents = NULL;
+    GError *gerror = NULL;
+
+    if (!g_file_get_contents(path, &contents, NULL, &gerror))
+    {
+        _LSErrorSet(lserror, MSGID_LS_CAPTURE_ERR, -1, "%s", gerror->message);
+        g_error_free(gerror);
+        return false;
+    }
+
+    JSchemaInfo schemaInfo;
+    jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+    char **lines = g_strsplit(contents, "\n", -1);
+    char **line;
+    int line_number = 0;
+
+    for (line = lines; *line; line++)
+    {
+        line_number++;
+
+        if (!g_strstrip(*line)[0]) continue;
+
+        jvalue_ref object = jdom_parse(j_cstr_to_buffer(*line), DOMOPT_NOOPT, &schemaInfo);
+        char *uri = jis_object(object) ? _LSReplayGetString(object, "uri") : NULL;
+
+        if (!uri)
+        {
+            g_warning("%s:%d: not a call, skipping", path, line_number);
+            j_release(&object);
+            continue;
+        }
+
+        _LSReplayCall *call = g_slice_new0(_LSReplayCall);
+        call->uri = uri;
+        call->sender = _LSReplayGetString(object, "sender");
+        call->app_id = _LSReplayGetString(object, "appId");
+        call->payload_type = LS_PAYLOAD_TYPE_JSON;
+
+        jvalue_ref time = jobject_get(object, J_CSTR_TO_BUF("time"));
+        if (jis_number(time))
+        {
+            (void)jnumber_get_f64(time, &call->time);
+        }
+
+        jvalue_ref public_bus = jobject_get(object, J_CSTR_TO_BUF("public"));
+        if (jis_boolean(public_bus))
+        {
+            (void)jboolean_get(public_bus, &call->public_bus);
+        }
+
+        /* the payload is either the JSON itself or a string holding it */
+        jvalue_ref payload = jobject_get(object, J_CSTR_TO_BUF("payload"));
+        if (jis_string(payload))
+        {
+            call->payload = _LSReplayGetString(object, "payload");
+        }
+        else if (jis_valid(payload) && !jis_null(payload))
+        {
+            call->payload = g_strdup(jvalue_tostring(payload, jschema_all()));
+        }
+        else
+        {
+            call->payload = g_strdup("{}");
+        }
+        call->payload_len = strlen(call->payload);
+
+        _LSReplayCallAdd(call);
+        j_release(&object);
+    }
+
+    g_strfreev(lines);
+    g_free(contents);
+
+    return true;
+}
+
+static bool
+_LSReplayIsCapture(const char *path)
+{
+    char magic[8] = { 0 };
+    FILE *file = fopen(path, "rb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    bool ret = fread(magic, sizeof(magic), 1, file) == 1 &&
+               memcmp(magic, LS_MONITOR_CAPTURE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+
+    return ret;
+}
+
+static gint
+_LSReplayCallCompare(gconstpointer a, gconstpointer b)
+{
+    const _LSReplayCall *call_a = *(_LSReplayCall* const*)a;
+    const _LSReplayCall *call_b = *(_LSReplayCall* const*)b;
+    return call_a->time < call_b->time ? -1 : call_a->time > call_b->time;
+}
+
+/* Get a handle for the sender of a call, falling back to an anonymous one
+ * if we may not register the name (or it is taken) */
+static LSHandle*
+_LSReplayGetHandle(const char *sender, bool public_bus)
+{
+    if (anonymous)
+    {
+        sender = NULL;
+    }
+
+    char *key = g_strdup_printf("%s/%s", public_bus ? "pub" : "prv", sender ? sender : "");
+    LSHandle *sh = g_hash_table_lookup(handles, key);
+
+    if (sh)
+    {
+        g_free(key);
+        return sh;
+    }
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    if (!LSRegisterPubPriv(sender, &sh, public_bus, &lserror) ||
+        !LSGmainAttach(sh, mainloop, &lserror))
+    {
+        if (!sender)
+        {
+            LSErrorPrint(&lserror, stderr);
+            LSErrorFree(&lserror);
+            g_free(key);
+            return NULL;
+        }
+
+        g_warning("Can't register as %s, calling anonymously", sender);
+        LSErrorFree(&lserror);
+
+        if (sh) LSUnregister(sh, NULL);
+        sh = _LSReplayGetHandle(NULL, public_bus);
+        if (!sh)
+        {
+            g_free(key);
+            return NULL;
+        }
+    }
+
+    g_hash_table_insert(handles, key, sh);
+
+    return sh;
+}
+
+static gboolean
+_LSReplayQuit(gpointer data)
+{
+    g_main_loop_quit(mainloop);
+    return FALSE;
+}
+
+static bool
+_LSReplayResponse(LSHandle *sh, LSMessage *reply, void *ctx)
+{
+    _LSReplayCall *call = ctx;
+
+    if (!call->replied)
+    {
+        double latency = _LSReplayElapsed(&call->sent) * 1000;
+
+        call->replied = true;
+        call->method->stats.replies++;
+        if (LSMessageIsHubErrorMessage(reply)) call->method->errors++;
+        g_array_append_val(call->method->stats.latencies, latency);
+
+        pending_replies--;
+        if (pending_replies == 0 && next_call == calls->len)
+        {
+            g_main_loop_quit(mainloop);
+        }
+    }
+
+    return true;
+}
+
+static void
+_LSReplaySend(_LSReplayCall *call)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    bool ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &call->sent);
+    call->method->stats.calls++;
+
+    if (call->no_reply)
+    {
+        ret = LSCallNoReplyWithLen(call->sh, call->uri, call->payload, call->payload_len, &lserror);
+    }
+    else if (call->payload_type != LS_PAYLOAD_TYPE_JSON)
+    {
+        /* binary calls carry no app id */
+        ret = LSCallBinary(call->sh, call->uri, call->payload_type, call->payload, call->payload_len,
+                           _LSReplayResponse, call, NULL, &lserror);
+    }
+    else
+    {
+        ret = LSCallFromApplication(call->sh, call->uri, call->payload, call->app_id,
+                                    _LSReplayResponse, call, NULL, &lserror);
+    }
+
+    if (!ret)
+    {
+        call->method->errors++;
+        LSErrorPrint(&lserror, stderr);
+        LSErrorFree(&lserror);
+    }
+    else if (!call->no_reply)
+    {
+        pending_replies++;
+    }
+}
+
+static gboolean
+_LSReplaySendDue(gpointer data)
+{
+    double elapsed = _LSReplayElapsed(&start);
+    guint sent = 0;
+
+    while (next_call < calls->len)
+    {
+        _LSReplayCall *call = g_ptr_array_index(calls, next_call);
+
+        if (fast)
+        {
+            if (sent == LS_REPLAY_BATCH) return TRUE;
+        }
+        else
+        {
+            double due = call->time / speed;
+            if (due > elapsed)
+            {
+                g_timeout_add((guint)((due - elapsed) * 1000), _LSReplaySendDue, NULL);
+                return FALSE;
+            }
+            max_lag = MAX(max_lag, elapsed - due);
+        }
+
+        _LSReplaySend(call);
+        next_call++;
+        sent++;
+    }
+
+    /* everything is out; wait a while for the replies */
+    if (pending_replies == 0)
+    {
+        g_main_loop_quit(mainloop);
+    }
+    else
+    {
+        g_timeout_add_seconds(reply_timeout, _LSReplayQuit, NULL);
+    }
+
+    return FALSE;
+}
+
+static void
+_LSReplayPrint(double duration)
+{
+    GPtrArray *sorted = _LSMonitorMethodStatsSort(methods);
+
+    fprintf(stdout, "Sent %u calls in %.3f s, %u without a reply, most late %.3f ms\n",
+            next_call, duration, pending_replies, max_lag * 1000);
+    fprintf(stdout, "%10s %10s %10s %10s %10s %10s %10s  %s\n",
+            "Calls", "Replied", "Errors", "p50 ms", "p90 ms", "p99 ms", "max ms", "Method");
+
+    guint i;
+    for (i = 0; i < sorted->len; i++)
+    {
+        _LSReplayMethod *method = g_ptr_array_index(sorted, i);
+        _LSMonitorMethodStats *stats = &method->stats;
+
+        fprintf(stdout, "%10llu %10llu %10llu ", (unsigned long long)stats->calls,
+                (unsigned long long)stats->replies, (unsigned long long)method->errors);
+        _LSMonitorMethodStatsPrintLatencies(stats);
+        fprintf(stdout, "  %s\n", stats->name);
+    }
+
+    g_ptr_array_free(sorted, TRUE);
+}
+
+static void
+_HandleCommandline(int *argc, char ***argv)
+{
+    GError *gerror = NULL;
+    GOptionContext *opt_context = NULL;
+
+    static GOptionEntry opt_entries[] =
+    {
+        {"speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed, "Replay this many times faster than recorded", "N"},
+        {"fast", 'f', 0, G_OPTION_ARG_NONE, &fast, "Replay as fast as possible", NULL},
+        {"timeout", 'w', 0, G_OPTION_ARG_INT, &reply_timeout, "Wait this long for replies after the last call (default 10)", "seconds"},
+        {"method", 'M', 0, G_OPTION_ARG_STRING, &method_glob, "Only replay calls whose uri without the scheme matches a glob", "com.palm.foo/*"},
+        {"anonymous", 'a', 0, G_OPTION_ARG_NONE, &anonymous, "Don't register as the recorded senders", NULL},
+        { NULL }
+    };
+
+    opt_context = g_option_context_new("FILE - Luna Service traffic replay");
+    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
+    g_option_context_set_description(opt_context, ""
+"FILE is a capture written by \"ls-monitor --capture\", or JSONL with a call\n"
+"per line: {\"time\": 1.25, \"sender\": \"com.palm.foo\", \"uri\": \"palm://...\",\n"
+"\"payload\": {...}, \"appId\": \"...\", \"public\": false}");
+
+    if (!g_option_context_parse(opt_context, argc, argv, &gerror))
+    {
+        g_critical("Error processing commandline args: %s", gerror->message);
+        g_error_free(gerror);
+        exit(EXIT_FAILURE);
+    }
+
+    if (*argc != 2 || speed <= 0)
+    {
+        char *help = g_option_context_get_help(opt_context, TRUE, NULL);
+        fprintf(stderr, "%s", help);
+        g_free(help);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(opt_context);
+
+    if (method_glob)
+    {
+        method_pattern = g_pattern_spec_new(method_glob);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    int ret = EXIT_FAILURE;
+
+    _HandleCommandline(&argc, &argv);
+
+    mainloop = g_main_loop_new(NULL, FALSE);
+    calls = g_ptr_array_new_with_free_func(_LSReplayCallFree);
+    methods = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _LSReplayMethodFree);
+    handles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    bool loaded = _LSReplayIsCapture(argv[1]) ? _LSReplayLoadCapture(argv[1], &lserror)
+                                              : _LSReplayLoadJson(argv[1], &lserror);
+    if (!loaded)
+    {
+        LSErrorPrint(&lserror, stderr);
+        LSErrorFree(&lserror);
+        goto exit;
+    }
+
+    if (calls->len == 0)
+    {
+        g_critical("No calls to replay in %s", argv[1]);
+        goto exit;
+    }
+
+    g_ptr_array_sort(calls, _LSReplayCallCompare);
+
+    /* register everyone before starting the clock, so that registration
+     * doesn't hold up the calls */
+    double first_time = ((_LSReplayCall*)g_ptr_array_index(calls, 0))->time;
+    guint i;
+
+    for (i = 0; i < calls->len; i++)
+    {
+        _LSReplayCall *call = g_ptr_array_index(calls, i);
+
+        call->time -= first_time;
+        call->sh = _LSReplayGetHandle(call->sender, call->public_bus);
+        if (!call->sh)
+        {
+            goto exit;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (fast)
+    {
+        g_idle_add(_LSReplaySendDue, NULL);
+    }
+    else
+    {
+        g_timeout_add(0, _LSReplaySendDue, NULL);
+    }
+
+    g_main_loop_run(mainloop);
+
+    _LSReplayPrint(_LSReplayElapsed(&start));
+    ret = EXIT_SUCCESS;
+
+exit:
+    {
+        /* the anonymous fallback can be shared by several senders */
+        GHashTable *unregistered = g_hash_table_new(g_direct_hash, g_direct_equal);
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, handles);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            if (g_hash_table_lookup(unregistered, value)) continue;
+            g_hash_table_insert(unregistered, value, value);
+
+            if (!LSUnregister(value, &lserror))
+            {
+                LSErrorPrint(&lserror, stderr);
+                LSErrorFree(&lserror);
+            }
+        }
+        g_hash_table_destroy(unregistered);
+    }
+
+    g_hash_table_destroy(handles);
+    g_ptr_array_free(calls, TRUE);
+    g_hash_table_destroy(methods);
+    if (method_pattern) g_pattern_spec_free(method_pattern);
+    g_main_loop_unref(mainloop);
+
+    return ret;
+}
@@ -161,6 +161,20 @@ jvalue_ref apply_query(jvalue_ref obj, char * query)
   }
 }
 
+static void
+print_binary_payload(LSMessage *reply)
+{
+    size_t len = 0;
+    const unsigned char *payload = LSMessageGetPayloadBinary(reply, &len);
+    size_t i;
+
+    printf("<binary type %#x, %zu bytes>", LSMessageGetPayloadType(reply), len);
+    for (i = 0; i < len; i++) {
+        printf("%s%02x", (i % 16) ? " " : "\n", payload[i]);
+    }
+    printf("\n");
+}
+
 static bool
 serviceResponse(LSHandle *sh, LSMessage *reply, void *ctx)
 {
@@ -183,7 +197,9 @@ serviceResponse(LSHandle *sh, LSMessage *reply, void *ctx)
       printf("%2d: ", current_line_number++);
     }
 
-    if (query_list != NULL) {
+    bool binary = LSMessageGetPayloadType(reply) != LS_PAYLOAD_TYPE_JSON;
+
+    if (query_list != NULL && !binary) {
       // Use set of queries to transform original object into reduced form that
       // only contains queried selections -- then pass that through normal formatting.
       jvalue_ref original = jdom_parse(j_cstr_to_buffer(payload),
@@ -208,7 +224,10 @@ serviceResponse(LSHandle *sh, LSMessage *reply, void *ctx)
       }
     }
 
-    if (format_response) {
+    if (binary) {
+      // queries and formatting only make sense for JSON
+      print_binary_payload(reply);
+    } else if (format_response) {
       jvalue_ref object = jdom_parse(j_cstr_to_buffer(payload), DOMOPT_NOOPT,
                                      &schemaInfo);
       if (jis_null(object)) {